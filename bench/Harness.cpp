@@ -0,0 +1,217 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for Harness.hpp.  */
+
+#include "Harness.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#include <pthread.h>
+#include <time.h>
+
+/* ************************************************************************** */
+/* Counting allocations.  */
+
+namespace
+{
+
+/** Per-thread allocation counter.  */
+pthread_key_t counterKey;
+
+/**
+ * Set up the key once.
+ */
+void
+createKey ()
+{
+  pthread_key_create (&counterKey, &std::free);
+}
+
+/** For initialising the key.  */
+pthread_once_t keyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Get this thread's counter, creating it if necessary.
+ * @return The counter.
+ */
+unsigned long*
+getCounter ()
+{
+  pthread_once (&keyOnce, &createKey);
+  void* res = pthread_getspecific (counterKey);
+  if (!res)
+    {
+      /* Use malloc, since this is called from operator new.  */
+      res = std::calloc (1, sizeof (unsigned long));
+      pthread_setspecific (counterKey, res);
+    }
+
+  return static_cast<unsigned long*> (res);
+}
+
+} // anonymous namespace
+
+/* The replacements must not be inlined into their callers:  GCC would then
+   see the std::free of operator delete applied to the result of a (still
+   built-in) operator new, and warn about mismatched allocation functions.  */
+#ifdef __GNUC__
+# define NMCRPC_NOINLINE __attribute__ ((noinline))
+#else /* __GNUC__  */
+# define NMCRPC_NOINLINE
+#endif /* __GNUC__  */
+
+#ifdef CXX_11
+NMCRPC_NOINLINE void*
+operator new (std::size_t size)
+#else /* CXX_11  */
+NMCRPC_NOINLINE void*
+operator new (std::size_t size) throw (std::bad_alloc)
+#endif /* CXX_11  */
+{
+  ++*getCounter ();
+
+  void* res = std::malloc (size == 0 ? 1 : size);
+  if (!res)
+    throw std::bad_alloc ();
+
+  return res;
+}
+
+#ifdef CXX_11
+NMCRPC_NOINLINE void
+operator delete (void* p) noexcept
+#else /* CXX_11  */
+NMCRPC_NOINLINE void
+operator delete (void* p) throw ()
+#endif /* CXX_11  */
+{
+  std::free (p);
+}
+
+/* From C++14 on, deletion may go through the sized form instead.  */
+#if __cplusplus >= 201402L
+NMCRPC_NOINLINE void
+operator delete (void* p, std::size_t) noexcept
+{
+  std::free (p);
+}
+#endif /* C++14?  */
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* The benchmark.  */
+
+/**
+ * Construct it.
+ * @param n Name for the report.
+ * @param u Unit of the operations, like "calls" or "names".
+ */
+Benchmark::Benchmark (const std::string& n, const std::string& u)
+  : name(n), unit(u), samples(), operations(0), allocations(0),
+    startTime(0.0), startAllocations(0)
+{
+  // Nothing else to do.
+}
+
+/**
+ * Start a sample.
+ */
+void
+Benchmark::start ()
+{
+  startAllocations = getAllocations ();
+  startTime = now ();
+}
+
+/**
+ * Finish the current sample.
+ * @param ops Number of operations it covered.
+ */
+void
+Benchmark::stop (unsigned long ops)
+{
+  const double end = now ();
+  allocations += getAllocations () - startAllocations;
+  samples.push_back (end - startTime);
+  operations += ops;
+}
+
+/**
+ * Print throughput, latency percentiles of the samples and
+ * allocations per operation.
+ * @param out Write the report here.
+ */
+void
+Benchmark::report (std::ostream& out) const
+{
+  if (samples.empty ())
+    return;
+
+  std::vector<double> sorted(samples);
+  std::sort (sorted.begin (), sorted.end ());
+  double total = 0.0;
+  for (unsigned i = 0; i < sorted.size (); ++i)
+    total += sorted[i];
+
+  const unsigned n = sorted.size ();
+  const double p50 = sorted[n / 2];
+  const double p90 = sorted[(n * 9) / 10];
+  const double p99 = sorted[(n * 99) / 100];
+
+  char buf[256];
+  std::snprintf (buf, sizeof (buf),
+                 "%-14s %10.0f %5s/s   p50 %9.1f us   p90 %9.1f us"
+                 "   p99 %9.1f us   %8.1f allocs/%s",
+                 name.c_str (), operations / total, unit.c_str (),
+                 p50 * 1e6, p90 * 1e6, p99 * 1e6,
+                 static_cast<double> (allocations) / operations,
+                 unit.substr (0, unit.size () - 1).c_str ());
+  out << buf << std::endl;
+}
+
+/**
+ * Get the current time.
+ * @return Time in seconds from some fixed point.
+ */
+double
+Benchmark::now ()
+{
+  timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Get the number of allocations done so far on this thread.
+ * @return The allocation count.
+ */
+unsigned long
+Benchmark::getAllocations ()
+{
+  return *getCounter ();
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,122 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Timing and allocation counting for the benchmarks.  */
+
+#ifndef NMCRPC_BENCH_HARNESS_HPP
+#define NMCRPC_BENCH_HARNESS_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Measure one benchmark.  Each sample is taken between start() and
+ * stop(), and may cover several operations (like all names of a scan).
+ * Memory allocations are counted only for the thread that called
+ * start(), so that the mock server does not distort the numbers.
+ */
+class Benchmark
+{
+
+private:
+
+  /** Name for the report.  */
+  std::string name;
+
+  /** Unit counted by the operations.  */
+  std::string unit;
+
+  /** Duration of each sample in seconds.  */
+  std::vector<double> samples;
+
+  /** Total number of operations.  */
+  unsigned long operations;
+
+  /** Total number of allocations.  */
+  unsigned long allocations;
+
+  /** Start time of the current sample.  */
+  double startTime;
+
+  /** Allocation count at the start of the current sample.  */
+  unsigned long startAllocations;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Benchmark ();
+  Benchmark (const Benchmark&);
+  Benchmark& operator= (const Benchmark&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it.
+   * @param n Name for the report.
+   * @param u Unit of the operations, like "calls" or "names".
+   */
+  Benchmark (const std::string& n, const std::string& u);
+
+  // No copying.
+#ifdef CXX_11
+  Benchmark () = delete;
+  Benchmark (const Benchmark&) = delete;
+  Benchmark& operator= (const Benchmark&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Start a sample.
+   */
+  void start ();
+
+  /**
+   * Finish the current sample.
+   * @param ops Number of operations it covered.
+   */
+  void stop (unsigned long ops = 1);
+
+  /**
+   * Print throughput, latency percentiles of the samples and
+   * allocations per operation.
+   * @param out Write the report here.
+   */
+  void report (std::ostream& out) const;
+
+  /**
+   * Get the current time.
+   * @return Time in seconds from some fixed point.
+   */
+  static double now ();
+
+  /**
+   * Get the number of allocations done so far on this thread.
+   * @return The allocation count.
+   */
+  static unsigned long getAllocations ();
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,530 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for MockServer.hpp.  */
+
+#include "MockServer.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <utility>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace nmcrpc
+{
+
+/**
+ * Encode a JSON value without the trailing newline of encodeJson.
+ * @param val The value.
+ * @param out Append here.
+ */
+static void
+appendJson (const JsonRpc::JsonData& val, std::string& out)
+{
+  const std::string enc = JsonRpc::encodeJson (val);
+  out.append (enc, 0, enc.size () - 1);
+}
+
+/**
+ * Append an unsigned number.
+ * @param n The number.
+ * @param out Append here.
+ */
+static void
+appendNumber (unsigned n, std::string& out)
+{
+  char buf[16];
+  std::snprintf (buf, sizeof (buf), "%u", n);
+  out += buf;
+}
+
+/**
+ * Write all data to a socket.
+ * @param fd The socket.
+ * @param data The data.
+ * @return False if writing failed.
+ */
+static bool
+writeAll (int fd, const std::string& data)
+{
+  size_t done = 0;
+  while (done < data.size ())
+    {
+      const ssize_t n = send (fd, data.data () + done, data.size () - done,
+                              MSG_NOSIGNAL);
+      if (n <= 0)
+        return false;
+      done += n;
+    }
+
+  return true;
+}
+
+/**
+ * Construct it, not yet started.  By default, there's no latency,
+ * values of 100 bytes, 100k names in the chain and 1000 in the wallet.
+ */
+MockServer::MockServer ()
+  : listenFd(-1), port(0), socketPath(), acceptor(), connections(),
+    latency(0), payloadSize(100), chainSize(100000), walletSize(1000),
+    encodedValue()
+{
+  pthread_mutex_init (&mutex, nullptr);
+  pthread_cond_init (&closed, nullptr);
+}
+
+/**
+ * Destroy it, closing all connections.
+ */
+MockServer::~MockServer ()
+{
+  if (listenFd >= 0)
+    {
+      /* This makes the blocked accept() fail.  */
+      shutdown (listenFd, SHUT_RDWR);
+      pthread_join (acceptor, nullptr);
+      close (listenFd);
+    }
+  if (!socketPath.empty ())
+    unlink (socketPath.c_str ());
+
+  pthread_mutex_lock (&mutex);
+  for (std::set<int>::const_iterator i = connections.begin ();
+       i != connections.end (); ++i)
+    shutdown (*i, SHUT_RDWR);
+  while (!connections.empty ())
+    pthread_cond_wait (&closed, &mutex);
+  pthread_mutex_unlock (&mutex);
+
+  pthread_cond_destroy (&closed);
+  pthread_mutex_destroy (&mutex);
+}
+
+/**
+ * Encode the value of the names, so that all responses can use it.
+ */
+void
+MockServer::prepareValue ()
+{
+  std::string value = "{\"ip\":\"192.0.2.1\",\"pad\":\"";
+  const size_t rest = value.size () + 2;
+  if (payloadSize > rest)
+    value.append (payloadSize - rest, 'x');
+  value += "\"}";
+  encodedValue.clear ();
+  appendJson (JsonRpc::JsonData (value), encodedValue);
+}
+
+/**
+ * Bind the listening socket and start accepting connections.
+ * @param addr The address to bind to.
+ * @param len Size of the address.
+ * @throws std::runtime_error if that fails.
+ */
+void
+MockServer::listenOn (const void* addr, size_t len)
+{
+  const sockaddr* sa = static_cast<const sockaddr*> (addr);
+  listenFd = socket (sa->sa_family, SOCK_STREAM, 0);
+  if (listenFd < 0)
+    throw std::runtime_error ("Could not create mock server socket.");
+
+  if (bind (listenFd, sa, len) != 0 || listen (listenFd, 64) != 0
+      || pthread_create (&acceptor, nullptr, &acceptMain, this) != 0)
+    {
+      close (listenFd);
+      listenFd = -1;
+      throw std::runtime_error ("Could not start mock server.");
+    }
+}
+
+/**
+ * Start listening on some free port on the loopback interface.
+ * @throws std::runtime_error if that fails.
+ */
+void
+MockServer::start ()
+{
+  prepareValue ();
+
+  sockaddr_in addr;
+  std::fill_n (reinterpret_cast<char*> (&addr), sizeof (addr), 0);
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl (INADDR_LOOPBACK);
+  addr.sin_port = 0;
+  listenOn (&addr, sizeof (addr));
+
+  socklen_t len = sizeof (addr);
+  getsockname (listenFd, reinterpret_cast<sockaddr*> (&addr), &len);
+  port = ntohs (addr.sin_port);
+}
+
+/**
+ * Start listening on a Unix socket instead of TCP.
+ * @param path The socket's path.
+ * @throws std::runtime_error if that fails.
+ */
+void
+MockServer::startUnix (const std::string& path)
+{
+  prepareValue ();
+
+  sockaddr_un addr;
+  std::fill_n (reinterpret_cast<char*> (&addr), sizeof (addr), 0);
+  addr.sun_family = AF_UNIX;
+  if (path.size () >= sizeof (addr.sun_path))
+    throw std::runtime_error ("Mock server socket path is too long.");
+  std::copy (path.begin (), path.end (), addr.sun_path);
+
+  unlink (path.c_str ());
+  listenOn (&addr, sizeof (addr));
+  socketPath = path;
+}
+
+/**
+ * Main routine of the accepting thread.
+ * @param self The server as void pointer.
+ * @return Always NULL.
+ */
+void*
+MockServer::acceptMain (void* self)
+{
+  MockServer* srv = static_cast<MockServer*> (self);
+  while (true)
+    {
+      const int fd = accept (srv->listenFd, nullptr, nullptr);
+      if (fd < 0)
+        break;
+
+      pthread_mutex_lock (&srv->mutex);
+      srv->connections.insert (fd);
+      pthread_mutex_unlock (&srv->mutex);
+
+      pthread_t thread;
+      std::pair<MockServer*, int>* arg
+        = new std::pair<MockServer*, int> (srv, fd);
+      if (pthread_create (&thread, nullptr, &connectionMain, arg) != 0)
+        {
+          delete arg;
+          pthread_mutex_lock (&srv->mutex);
+          srv->connections.erase (fd);
+          pthread_mutex_unlock (&srv->mutex);
+          close (fd);
+          continue;
+        }
+      pthread_detach (thread);
+    }
+
+  return nullptr;
+}
+
+/**
+ * Main routine of a connection thread.
+ * @param arg Heap-allocated pair of server and socket.
+ * @return Always NULL.
+ */
+void*
+MockServer::connectionMain (void* arg)
+{
+  std::pair<MockServer*, int>* p
+    = static_cast<std::pair<MockServer*, int>*> (arg);
+  MockServer* srv = p->first;
+  const int fd = p->second;
+  delete p;
+
+  srv->serve (fd);
+
+  pthread_mutex_lock (&srv->mutex);
+  close (fd);
+  srv->connections.erase (fd);
+  pthread_cond_broadcast (&srv->closed);
+  pthread_mutex_unlock (&srv->mutex);
+
+  return nullptr;
+}
+
+/**
+ * Serve requests on a connection until it is closed.
+ * @param fd The client socket.
+ */
+void
+MockServer::serve (int fd)
+{
+  std::string buf;
+  char chunk[65536];
+  while (true)
+    {
+      /* Read the header and body of the next request.  */
+      size_t end;
+      while ((end = buf.find ("\r\n\r\n")) == std::string::npos)
+        {
+          const ssize_t n = recv (fd, chunk, sizeof (chunk), 0);
+          if (n <= 0)
+            return;
+          buf.append (chunk, n);
+        }
+
+      std::string header = buf.substr (0, end);
+      std::transform (header.begin (), header.end (), header.begin (),
+                      ::tolower);
+      const size_t lenPos = header.find ("content-length:");
+      if (lenPos == std::string::npos)
+        return;
+      const size_t length = std::strtoul (header.c_str () + lenPos + 15,
+                                          nullptr, 10);
+      const bool keepAlive
+        = (header.find ("connection: close") == std::string::npos);
+
+      while (buf.size () < end + 4 + length)
+        {
+          const ssize_t n = recv (fd, chunk, sizeof (chunk), 0);
+          if (n <= 0)
+            return;
+          buf.append (chunk, n);
+        }
+
+      const std::string body = buf.substr (end + 4, length);
+      buf.erase (0, end + 4 + length);
+
+      /* Handle it.  */
+      std::string resp;
+      bool ok = true;
+      try
+        {
+          const JsonRpc::JsonData req = JsonRpc::decodeJson (body);
+          if (req.isArray ())
+            {
+              resp += '[';
+              for (Json::ArrayIndex i = 0; i < req.size (); ++i)
+                {
+                  if (i > 0)
+                    resp += ',';
+                  handle (req[i], resp);
+                }
+              resp += ']';
+            }
+          else
+            ok = handle (req, resp);
+        }
+      catch (const JsonRpc::Exception&)
+        {
+          return;
+        }
+
+      if (latency > 0)
+        usleep (latency);
+
+      std::string out = (ok ? "HTTP/1.1 200 OK\r\n"
+                            : "HTTP/1.1 500 Internal Server Error\r\n");
+      out += "Content-Type: application/json\r\nContent-Length: ";
+      appendNumber (resp.size (), out);
+      out += "\r\n\r\n";
+      out += resp;
+
+      if (!writeAll (fd, out) || !keepAlive)
+        return;
+    }
+}
+
+/**
+ * Handle a single (non-batched) request.
+ * @param req The request.
+ * @param out Append the response object here.
+ * @return True iff the call succeeded.
+ */
+bool
+MockServer::handle (const JsonRpc::JsonData& req, std::string& out) const
+{
+  out += "{\"result\":";
+  const size_t resultStart = out.size ();
+  const int code = call (req["method"].asString (), req["params"], out);
+
+  if (code == 0)
+    out += ",\"error\":null";
+  else
+    {
+      out.resize (resultStart);
+      out += "null,\"error\":{\"code\":";
+      char buf[16];
+      std::snprintf (buf, sizeof (buf), "%d", code);
+      out += buf;
+      out += ",\"message\":\"mock error\"}";
+    }
+
+  out += ",\"id\":";
+  appendJson (req["id"], out);
+  out += '}';
+
+  return code == 0;
+}
+
+/**
+ * Compute the result of a call.
+ * @param method The method called.
+ * @param params The parameters.
+ * @param out Append the result here.
+ * @return Zero on success, the RPC error code otherwise.
+ */
+int
+MockServer::call (const std::string& method, const JsonRpc::JsonData& params,
+                  std::string& out) const
+{
+  if (method == "getblockcount")
+    {
+      out += "400000";
+      return 0;
+    }
+
+  if (method == "getbestblockhash")
+    {
+      out += '"';
+      out.append (64, '0');
+      out += '"';
+      return 0;
+    }
+
+  if (method == "name_show")
+    {
+      const std::string name = params[0u].asString ();
+      const unsigned i = lowerBound (name);
+      if (i >= chainSize || getName (i) != name)
+        return -4;
+
+      appendEntry (i, out);
+      return 0;
+    }
+
+  if (method == "name_scan")
+    {
+      const std::string start = params[0u].asString ();
+      const unsigned count = (params.size () > 1 ? params[1u].asUInt () : 500);
+      const unsigned first = lowerBound (start);
+      const unsigned last = std::min (chainSize, first + count);
+
+      out += '[';
+      for (unsigned i = first; i < last; ++i)
+        {
+          if (i > first)
+            out += ',';
+          appendEntry (i, out);
+        }
+      out += ']';
+      return 0;
+    }
+
+  if (method == "name_list")
+    {
+      out += '[';
+      for (unsigned i = 0; i < walletSize; ++i)
+        {
+          if (i > 0)
+            out += ',';
+          appendEntry (i, out);
+        }
+      out += ']';
+      return 0;
+    }
+
+  if (method == "validateaddress")
+    {
+      out += "{\"isvalid\":true,\"address\":";
+      appendJson (params[0u], out);
+      out += ",\"ismine\":true}";
+      return 0;
+    }
+
+  if (method == "gettransaction")
+    {
+      out += "{\"txid\":";
+      appendJson (params[0u], out);
+      out += ",\"confirmations\":12}";
+      return 0;
+    }
+
+  return -32601;
+}
+
+/**
+ * Append the JSON object for a name.
+ * @param i Index of the name.
+ * @param out Append here.
+ */
+void
+MockServer::appendEntry (unsigned i, std::string& out) const
+{
+  char txid[65];
+  std::snprintf (txid, sizeof (txid), "%064x", i);
+
+  out += "{\"name\":\"";
+  out += getName (i);
+  out += "\",\"value\":";
+  out += encodedValue;
+  out += ",\"txid\":\"";
+  out += txid;
+  out += "\",\"address\":\"Nbench";
+  appendNumber (i % 32, out);
+  out += "\",\"expires_in\":";
+  appendNumber (1000 + i % 30000, out);
+  out += '}';
+}
+
+/**
+ * Find the index of the first name not less than the given string.
+ * @param name The name to look for.
+ * @return The index, chainSize if all names are less.
+ */
+unsigned
+MockServer::lowerBound (const std::string& name) const
+{
+  unsigned lo = 0, hi = chainSize;
+  while (lo < hi)
+    {
+      const unsigned mid = lo + (hi - lo) / 2;
+      if (getName (mid) < name)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/**
+ * Get the name with the given index.
+ * @param i The index.
+ * @return The name.
+ */
+std::string
+MockServer::getName (unsigned i)
+{
+  char buf[32];
+  std::snprintf (buf, sizeof (buf), "d/bench%07u", i);
+  return buf;
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,245 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Mock namecoind for the benchmarks.  */
+
+#ifndef NMCRPC_BENCH_MOCKSERVER_HPP
+#define NMCRPC_BENCH_MOCKSERVER_HPP
+
+#include "JsonRpc.hpp"
+
+#include <set>
+#include <string>
+
+#include <pthread.h>
+
+namespace nmcrpc
+{
+
+/**
+ * Minimal JSON-RPC server over HTTP/1.1 with keep-alive, running on
+ * background threads in the benchmark process.  It serves a synthetic
+ * chain of names ("d/bench0000000" and onwards) for name_show and
+ * name_scan, a wallet of the first names for name_list (with ownership
+ * for validateaddress), and canned gettransaction and block count
+ * responses.  Batched requests are supported.  Responses are built as
+ * strings directly, so that the server is cheap compared to the client.
+ *
+ * The configuration must be set before start() is called.
+ */
+class MockServer
+{
+
+private:
+
+  /** Listening socket, -1 if not started.  */
+  int listenFd;
+
+  /** Port we listen on.  */
+  unsigned port;
+
+  /** Path of the Unix socket we listen on, empty for TCP.  */
+  std::string socketPath;
+
+  /** Thread accepting connections.  */
+  pthread_t acceptor;
+
+  /** Lock for the connection list.  */
+  pthread_mutex_t mutex;
+  /** Signalled when a connection is closed.  */
+  pthread_cond_t closed;
+  /** Sockets of open client connections.  */
+  std::set<int> connections;
+
+  /** Delay before each response in microseconds.  */
+  unsigned latency;
+  /** Size of each name's value in bytes.  */
+  unsigned payloadSize;
+  /** Number of names in the chain.  */
+  unsigned chainSize;
+  /** Number of names in the wallet.  */
+  unsigned walletSize;
+
+  /** The value of each name, already encoded as JSON string.  */
+  std::string encodedValue;
+
+  // Disable copying.
+#ifndef CXX_11
+  MockServer (const MockServer&);
+  MockServer& operator= (const MockServer&);
+#endif /* !CXX_11  */
+
+  /**
+   * Encode the value of the names, so that all responses can use it.
+   */
+  void prepareValue ();
+
+  /**
+   * Bind the listening socket and start accepting connections.
+   * @param addr The address to bind to.
+   * @param len Size of the address.
+   * @throws std::runtime_error if that fails.
+   */
+  void listenOn (const void* addr, size_t len);
+
+  /**
+   * Main routine of the accepting thread.
+   * @param self The server as void pointer.
+   * @return Always NULL.
+   */
+  static void* acceptMain (void* self);
+
+  /**
+   * Main routine of a connection thread.
+   * @param arg Heap-allocated pair of server and socket.
+   * @return Always NULL.
+   */
+  static void* connectionMain (void* arg);
+
+  /**
+   * Serve requests on a connection until it is closed.
+   * @param fd The client socket.
+   */
+  void serve (int fd);
+
+  /**
+   * Handle a single (non-batched) request.
+   * @param req The request.
+   * @param out Append the response object here.
+   * @return True iff the call succeeded.
+   */
+  bool handle (const JsonRpc::JsonData& req, std::string& out) const;
+
+  /**
+   * Compute the result of a call.
+   * @param method The method called.
+   * @param params The parameters.
+   * @param out Append the result here.
+   * @return Zero on success, the RPC error code otherwise.
+   */
+  int call (const std::string& method, const JsonRpc::JsonData& params,
+            std::string& out) const;
+
+  /**
+   * Append the JSON object for a name.
+   * @param i Index of the name.
+   * @param out Append here.
+   */
+  void appendEntry (unsigned i, std::string& out) const;
+
+  /**
+   * Find the index of the first name not less than the given string.
+   * @param name The name to look for.
+   * @return The index, chainSize if all names are less.
+   */
+  unsigned lowerBound (const std::string& name) const;
+
+public:
+
+  /**
+   * Construct it, not yet started.  By default, there's no latency,
+   * values of 100 bytes, 100k names in the chain and 1000 in the wallet.
+   */
+  MockServer ();
+
+  /**
+   * Destroy it, closing all connections.
+   */
+  ~MockServer ();
+
+  // No copying.
+#ifdef CXX_11
+  MockServer (const MockServer&) = delete;
+  MockServer& operator= (const MockServer&) = delete;
+#endif /* CXX_11?  */
+
+  inline void
+  setLatency (unsigned us)
+  {
+    latency = us;
+  }
+
+  inline void
+  setPayloadSize (unsigned bytes)
+  {
+    payloadSize = bytes;
+  }
+
+  inline void
+  setChainSize (unsigned n)
+  {
+    chainSize = n;
+  }
+
+  inline void
+  setWalletSize (unsigned n)
+  {
+    walletSize = n;
+  }
+
+  inline unsigned
+  getChainSize () const
+  {
+    return chainSize;
+  }
+
+  inline unsigned
+  getWalletSize () const
+  {
+    return walletSize;
+  }
+
+  /**
+   * Start listening on some free port on the loopback interface.
+   * @throws std::runtime_error if that fails.
+   */
+  void start ();
+
+  /**
+   * Start listening on a Unix socket instead of TCP.  An existing
+   * file at the path is replaced, and it is removed again when
+   * the server is destroyed.
+   * @param path The socket's path.
+   * @throws std::runtime_error if that fails.
+   */
+  void startUnix (const std::string& path);
+
+  /**
+   * Get the port we listen on.
+   * @return The port.
+   */
+  inline unsigned
+  getPort () const
+  {
+    return port;
+  }
+
+  /**
+   * Get the name with the given index.
+   * @param i The index.
+   * @return The name.
+   */
+  static std::string getName (unsigned i);
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,464 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Benchmarks of the RPC and name-scan hot paths against a mock daemon.  */
+
+#include "Harness.hpp"
+#include "MockServer.hpp"
+
+#include "IdnTool.hpp"
+#include "JsonRpc.hpp"
+#include "NameInterface.hpp"
+#include "NameTable.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+using namespace nmcrpc;
+
+/**
+ * Options of the benchmark run.
+ */
+struct Options
+{
+
+  /** Number of samples for the per-call benchmarks.  */
+  unsigned iterations;
+
+  /** Number of names in the synthetic chain.  */
+  unsigned chainSize;
+
+  /** Number of names in the wallet.  */
+  unsigned walletSize;
+
+  /** Size of the name values.  */
+  unsigned payloadSize;
+
+  /** Server latency in microseconds.  */
+  unsigned latency;
+
+  /** Whether to talk to the mock through a Unix socket.  */
+  bool unixSocket;
+
+  /** Benchmarks to run, all if empty.  */
+  std::set<std::string> selected;
+
+};
+
+/**
+ * Display the help message.
+ */
+static void
+displayHelp ()
+{
+  std::cerr << "Usage: nmbench [OPTIONS] [BENCHMARK...]"
+            << std::endl << std::endl;
+  std::cerr << "Options:" << std::endl;
+  std::cerr << "  --iterations=N: Samples per benchmark (default 1000)."
+            << std::endl;
+  std::cerr << "  --names=N: Names in the mock chain (default 500000)."
+            << std::endl;
+  std::cerr << "  --wallet=N: Names in the mock wallet (default 2000)."
+            << std::endl;
+  std::cerr << "  --payload=BYTES: Size of each value (default 100)."
+            << std::endl;
+  std::cerr << "  --latency=US: Mock server latency (default 0)."
+            << std::endl;
+  std::cerr << "  --unix=0|1: Connect through a Unix socket (default 0)."
+            << std::endl << std::endl;
+  std::cerr << "Benchmarks: rpc name_show batch confirmations encode decode"
+            << std::endl
+            << "            scan table mynames idn-decode idn-encode"
+            << std::endl;
+}
+
+/**
+ * Parse the command line.
+ * @param argc Number of arguments.
+ * @param argv The arguments.
+ * @param opts Store the options here.
+ * @return False if the help should be shown.
+ */
+static bool
+parseOptions (int argc, char** argv, Options& opts)
+{
+  opts.iterations = 1000;
+  opts.chainSize = 500000;
+  opts.walletSize = 2000;
+  opts.payloadSize = 100;
+  opts.latency = 0;
+  opts.unixSocket = false;
+
+  for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg.substr (0, 2) != "--")
+        {
+          opts.selected.insert (arg);
+          continue;
+        }
+
+      const size_t eq = arg.find ('=');
+      if (eq == std::string::npos)
+        return false;
+      const std::string key = arg.substr (2, eq - 2);
+      const unsigned val = std::atoi (arg.c_str () + eq + 1);
+
+      if (key == "iterations")
+        opts.iterations = (val > 0 ? val : 1);
+      else if (key == "names")
+        opts.chainSize = val;
+      else if (key == "wallet")
+        opts.walletSize = val;
+      else if (key == "payload")
+        opts.payloadSize = val;
+      else if (key == "latency")
+        opts.latency = val;
+      else if (key == "unix")
+        opts.unixSocket = (val != 0);
+      else
+        return false;
+    }
+
+  return true;
+}
+
+/**
+ * Check whether a benchmark should be run.
+ * @param opts The options.
+ * @param name The benchmark's name.
+ * @return True iff it is selected.
+ */
+static bool
+isSelected (const Options& opts, const std::string& name)
+{
+  return opts.selected.empty () || opts.selected.count (name) > 0;
+}
+
+/**
+ * Count the names passed to it by forAllNames or forMyNames.
+ */
+class NameCounter
+{
+
+private:
+
+  /** The count.  */
+  unsigned long& count;
+
+public:
+
+  explicit inline NameCounter (unsigned long& c)
+    : count(c)
+  {}
+
+  inline void
+  operator() (const NameInterface::ScanEntry&)
+  {
+    ++count;
+  }
+
+  inline void
+  operator() (const NameInterface::Name&)
+  {
+    ++count;
+  }
+
+};
+
+/**
+ * Benchmark single RPC round trips.
+ * @param rpc The RPC connection.
+ * @param opts The options.
+ * @param srv The mock server.
+ */
+static void
+benchRpc (JsonRpc& rpc, const Options& opts, const MockServer& srv)
+{
+  if (isSelected (opts, "rpc"))
+    {
+      Benchmark b("rpc", "calls");
+      const JsonRpc::JsonData params(Json::arrayValue);
+      for (unsigned i = 0; i < opts.iterations; ++i)
+        {
+          b.start ();
+          rpc.executeRpcArray ("getblockcount", params);
+          b.stop ();
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "name_show"))
+    {
+      Benchmark b("name_show", "calls");
+      for (unsigned i = 0; i < opts.iterations; ++i)
+        {
+          JsonRpc::JsonData params(Json::arrayValue);
+          params.append (MockServer::getName (i % srv.getChainSize ()));
+
+          b.start ();
+          rpc.executeRpcArray ("name_show", params);
+          b.stop ();
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "batch"))
+    {
+      Benchmark b("batch", "calls");
+      const unsigned perBatch = 100;
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          std::vector<JsonRpc::Call> calls;
+          for (unsigned j = 0; j < perBatch; ++j)
+            {
+              const unsigned ind = (i * perBatch + j) % srv.getChainSize ();
+              calls.push_back (JsonRpc::Call ("name_show")
+                                 .addParam (MockServer::getName (ind)));
+            }
+
+          b.start ();
+          rpc.executeRpcBatch (calls);
+          b.stop (perBatch);
+        }
+      b.report (std::cout);
+    }
+}
+
+/**
+ * Benchmark queries of the higher-level interface.
+ * @param nc The Namecoin interface.
+ * @param opts The options.
+ */
+static void
+benchInterface (NameInterface& nc, const Options& opts)
+{
+  if (isSelected (opts, "confirmations"))
+    {
+      Benchmark b("confirmations", "txs");
+      std::vector<std::string> txids;
+      for (unsigned i = 0; i < 100; ++i)
+        txids.push_back (std::string (63, '0')
+                         + static_cast<char> ('a' + i % 6));
+
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          b.start ();
+          nc.getNumberOfConfirmations (txids);
+          b.stop (txids.size ());
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "scan"))
+    {
+      Benchmark b("scan", "names");
+      for (unsigned i = 0; i < 3; ++i)
+        {
+          unsigned long count = 0;
+          b.start ();
+          nc.forAllNames (NameCounter (count));
+          b.stop (count);
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "table"))
+    {
+      Benchmark b("table", "names");
+      for (unsigned i = 0; i < 3; ++i)
+        {
+          NameTable table;
+          b.start ();
+          nc.collectNames (table);
+          table.sortByExpiration ();
+          table.filterNamespace ("d");
+          b.stop (table.size ());
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "mynames"))
+    {
+      Benchmark b("mynames", "names");
+      for (unsigned i = 0; i < 10; ++i)
+        {
+          unsigned long count = 0;
+          b.start ();
+          nc.forMyNames (NameCounter (count));
+          b.stop (count);
+        }
+      b.report (std::cout);
+    }
+}
+
+/**
+ * Benchmark JSON encoding and decoding of a name_scan page
+ * with 500 entries.
+ * @param rpc The RPC connection.
+ * @param opts The options.
+ */
+static void
+benchJson (JsonRpc& rpc, const Options& opts)
+{
+  const JsonRpc::JsonData page = rpc.executeRpc ("name_scan", "", 500);
+  const std::string encoded = JsonRpc::encodeJson (page);
+
+  if (isSelected (opts, "encode"))
+    {
+      Benchmark b("encode", "pages");
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          b.start ();
+          JsonRpc::encodeJson (page);
+          b.stop ();
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "decode"))
+    {
+      Benchmark b("decode", "pages");
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          b.start ();
+          JsonRpc::decodeJson (encoded);
+          b.stop ();
+        }
+      b.report (std::cout);
+    }
+}
+
+/**
+ * Benchmark IDN conversion of a list of names, most of them plain ASCII.
+ * @param opts The options.
+ */
+static void
+benchIdn (const Options& opts)
+{
+  std::vector<std::string> encoded, decoded;
+  for (unsigned i = 0; i < 1000; ++i)
+    if (i % 10 == 0)
+      {
+        encoded.push_back ("d/xn--mnchen-3ya");
+        decoded.push_back ("d/m\xc3\xbcnchen");
+      }
+    else
+      {
+        encoded.push_back (MockServer::getName (i));
+        decoded.push_back (MockServer::getName (i));
+      }
+
+  IdnTool idn(true);
+
+  if (isSelected (opts, "idn-decode"))
+    {
+      Benchmark b("idn-decode", "names");
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          std::vector<std::string> out;
+          b.start ();
+          idn.decodeAll (encoded, out);
+          b.stop (encoded.size ());
+        }
+      b.report (std::cout);
+    }
+
+  if (isSelected (opts, "idn-encode"))
+    {
+      Benchmark b("idn-encode", "names");
+      for (unsigned i = 0; i < opts.iterations / 10 + 1; ++i)
+        {
+          std::vector<std::string> out;
+          b.start ();
+          idn.encodeAll (decoded, out);
+          b.stop (decoded.size ());
+        }
+      b.report (std::cout);
+    }
+}
+
+/**
+ * Main routine with the usual interface.
+ */
+int
+main (int argc, char** argv)
+{
+  Options opts;
+  if (!parseOptions (argc, argv, opts))
+    {
+      displayHelp ();
+      return EXIT_FAILURE;
+    }
+
+  try
+    {
+      MockServer srv;
+      srv.setLatency (opts.latency);
+      srv.setPayloadSize (opts.payloadSize);
+      srv.setChainSize (opts.chainSize);
+      srv.setWalletSize (opts.walletSize);
+
+      std::ostringstream socketPath;
+      if (opts.unixSocket)
+        {
+          socketPath << "/tmp/nmbench-" << getpid () << ".sock";
+          srv.startUnix (socketPath.str ());
+          std::cout << "Mock server on " << socketPath.str ();
+        }
+      else
+        {
+          srv.start ();
+          std::cout << "Mock server on port " << srv.getPort ();
+        }
+      std::cout << " with " << opts.chainSize << " names, "
+                << opts.payloadSize << " byte values and "
+                << opts.latency << " us latency."
+                << std::endl << std::endl;
+
+      {
+        RpcSettings settings("127.0.0.1", srv.getPort (), "bench", "bench");
+        if (opts.unixSocket)
+          settings.setUnixSocket (socketPath.str ());
+        JsonRpc rpc(settings);
+        NameInterface nc(rpc);
+
+        benchRpc (rpc, opts, srv);
+        benchInterface (nc, opts);
+        benchJson (rpc, opts);
+      }
+
+      benchIdn (opts);
+    }
+  catch (const std::exception& exc)
+    {
+      std::cerr << "Error: " << exc.what () << std::endl;
+      return EXIT_FAILURE;
+    }
+
+  return EXIT_SUCCESS;
+}
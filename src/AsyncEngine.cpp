@@ -0,0 +1,278 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for AsyncEngine.hpp.  */
+
+#include "AsyncEngine.hpp"
+
+#include "Metrics.hpp"
+
+#include <cassert>
+
+#include <unistd.h>
+
+namespace nmcrpc
+{
+
+/**
+ * Construct it.
+ * @param settings Settings to use for limiting concurrency.
+ * @throws JsonRpc::Exception if initialising cURL fails.
+ */
+AsyncEngine::AsyncEngine (const RpcSettings& settings)
+  : multi(nullptr), active(), delayed(), mutex(true)
+{
+  multi = curl_multi_init ();
+  if (!multi)
+    throw JsonRpc::Exception ("Initialisation of cURL multi handle failed.");
+
+  const long maxConn = settings.getMaxParallelRequests ();
+  curl_multi_setopt (multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, maxConn);
+  curl_multi_setopt (multi, CURLMOPT_MAXCONNECTS, maxConn);
+}
+
+/**
+ * Destroy it, aborting all active transfers.
+ */
+AsyncEngine::~AsyncEngine ()
+{
+  for (transferMapT::iterator i = active.begin (); i != active.end (); ++i)
+    {
+      curl_multi_remove_handle (multi, i->first);
+      i->second->pool->release (i->second->conn);
+      delete i->second;
+    }
+  active.clear ();
+
+  for (std::vector<Transfer*>::iterator i = delayed.begin ();
+       i != delayed.end (); ++i)
+    {
+      (*i)->pool->release ((*i)->conn);
+      delete *i;
+    }
+  delayed.clear ();
+
+  curl_multi_cleanup (multi);
+}
+
+/**
+ * Start a new request.
+ * @param data The data to post.  It is swapped into the connection,
+ *             so that its content is undefined afterwards.
+ * @param call The call object this request belongs to.
+ * @param method The method called, for the log.
+ * @param id The JSON-RPC id used for the request.
+ * @param logging Whether the response should be logged.
+ * @param sink If not null, stream the response body to it.
+ * @param policy Deadline and retry policy for the request.
+ * @param pool Take the connection from this pool.
+ */
+void
+AsyncEngine::submit (std::string& data, JsonRpc::AsyncCall& call,
+                     const std::string& method, int id, bool logging,
+                     ResponseSink* sink, const RetryPolicy& policy,
+                     ConnectionPool& pool)
+{
+  HttpConnection* conn = pool.acquire ();
+  conn->getData ().swap (data);
+  conn->setSink (sink);
+  conn->prepare (policy.getRemaining ());
+
+  CURL* handle = conn->getHandle ();
+  if (curl_multi_add_handle (multi, handle) != CURLM_OK)
+    {
+      pool.release (conn);
+      throw JsonRpc::Exception ("Failed to start asynchronous request.");
+    }
+
+  active[handle] = new Transfer (pool, conn, call, method, id, logging,
+                                 policy);
+}
+
+/**
+ * Abort the request for the given call, if it is active.
+ * @param call The call whose request to abort.
+ * @return The pool the request's connection was taken from, or NULL
+ *         if there was no active request.
+ */
+ConnectionPool*
+AsyncEngine::cancel (const JsonRpc::AsyncCall& call)
+{
+  for (transferMapT::iterator i = active.begin (); i != active.end (); ++i)
+    if (i->second->call == &call)
+      {
+        ConnectionPool* res = i->second->pool;
+        curl_multi_remove_handle (multi, i->first);
+        res->release (i->second->conn);
+        delete i->second;
+        active.erase (i);
+        return res;
+      }
+
+  for (std::vector<Transfer*>::iterator i = delayed.begin ();
+       i != delayed.end (); ++i)
+    if ((*i)->call == &call)
+      {
+        ConnectionPool* res = (*i)->pool;
+        res->release ((*i)->conn);
+        delete *i;
+        delayed.erase (i);
+        return res;
+      }
+
+  return nullptr;
+}
+
+/**
+ * Restart delayed transfers whose retry is due.  Those that can not
+ * be restarted are finished with the failure of their last attempt.
+ * @param now The current time.
+ * @param done Append transfers finished this way here.
+ */
+void
+AsyncEngine::startDue (double now, std::vector<Transfer*>& done)
+{
+  std::vector<Transfer*> waiting;
+  for (std::vector<Transfer*>::iterator i = delayed.begin ();
+       i != delayed.end (); ++i)
+    {
+      Transfer* t = *i;
+      if (t->retryAt > now)
+        {
+          waiting.push_back (t);
+          continue;
+        }
+
+      t->conn->prepare (t->policy.getRemaining ());
+      CURL* handle = t->conn->getHandle ();
+      if (curl_multi_add_handle (multi, handle) != CURLM_OK)
+        {
+          finish (t, t->result, done);
+          continue;
+        }
+
+      active[handle] = t;
+    }
+
+  delayed.swap (waiting);
+}
+
+/**
+ * Finish a transfer, releasing its connection.
+ * @param t The transfer.
+ * @param res cURL's result code of its last attempt.
+ * @param done Append the transfer here.
+ */
+void
+AsyncEngine::finish (Transfer* t, CURLcode res, std::vector<Transfer*>& done)
+{
+  t->result = res;
+  t->conn->fillCallInfo (t->info);
+  if (res == CURLE_OK)
+    {
+      t->responseCode = t->conn->getResponseCode ();
+      t->conn->takeResponseBody (t->response);
+      t->pool->recordCall (t->conn->wasReused ());
+    }
+
+  t->pool->release (t->conn);
+  t->conn = nullptr;
+  done.push_back (t);
+}
+
+/**
+ * Get the time until the next delayed transfer is due.
+ * @param now The current time.
+ * @param max Return at most this.
+ * @return The time in milliseconds.
+ */
+int
+AsyncEngine::getNextDue (double now, int max) const
+{
+  int res = max;
+  for (std::vector<Transfer*>::const_iterator i = delayed.begin ();
+       i != delayed.end (); ++i)
+    {
+      const int ms = static_cast<int> (((*i)->retryAt - now) * 1000.0) + 1;
+      if (ms < res)
+        res = (ms < 0 ? 0 : ms);
+    }
+
+  return res;
+}
+
+/**
+ * Process network events, waiting at most the given time for
+ * activity.  Finished transfers are returned, and must be freed
+ * by the caller.
+ * @param timeoutMs Maximum time to wait in milliseconds.
+ * @param done Append finished transfers here.
+ */
+void
+AsyncEngine::process (int timeoutMs, std::vector<Transfer*>& done)
+{
+  startDue (Metrics::now (), done);
+
+  int running;
+  curl_multi_perform (multi, &running);
+  if (timeoutMs > 0 && (running > 0 || !delayed.empty ()))
+    {
+      const int wait = getNextDue (Metrics::now (), timeoutMs);
+
+      /* curl_multi_wait returns immediately if there are no transfers.  */
+      if (running > 0)
+        curl_multi_wait (multi, nullptr, 0, wait, nullptr);
+      else
+        usleep (wait * 1000);
+
+      startDue (Metrics::now (), done);
+      curl_multi_perform (multi, &running);
+    }
+
+  int left;
+  CURLMsg* msg;
+  while ((msg = curl_multi_info_read (multi, &left)))
+    {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      CURL* handle = msg->easy_handle;
+      const CURLcode res = msg->data.result;
+      curl_multi_remove_handle (multi, handle);
+
+      const transferMapT::iterator i = active.find (handle);
+      assert (i != active.end ());
+      Transfer* t = i->second;
+      active.erase (i);
+
+      if (t->policy.shouldRetry (t->conn->isTransientFailure (res)))
+        {
+          /* Keep the result, in case the retry can not be started.  */
+          t->result = res;
+          t->retryAt = Metrics::now () + t->policy.getDelay () / 1000.0;
+          delayed.push_back (t);
+          continue;
+        }
+
+      finish (t, res, done);
+    }
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,268 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the event loop used
+   by JsonRpc for asynchronous calls.  */
+
+#ifndef NMCRPC_ASYNCENGINE_HPP
+#define NMCRPC_ASYNCENGINE_HPP
+
+#include "ConnectionPool.hpp"
+#include "JsonRpc.hpp"
+#include "RetryPolicy.hpp"
+#include "RpcSettings.hpp"
+#include "Thread.hpp"
+
+#include <curl/curl.h>
+
+#include <map>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Drive multiple HTTP requests concurrently using cURL's multi interface.
+ * Connections are taken from a pool when a request is submitted and
+ * handed back to it when the request is finished.  The engine does
+ * not know about JSON, it only reports finished transfers back.
+ */
+class AsyncEngine
+{
+
+public:
+
+  /** Data about a single transfer in progress or finished.  */
+  class Transfer;
+
+private:
+
+  /** The multi handle.  */
+  CURLM* multi;
+
+  /** Type of map holding all active transfers.  */
+  typedef std::map<CURL*, Transfer*> transferMapT;
+
+  /** Currently active transfers by easy handle.  */
+  transferMapT active;
+
+  /** Failed transfers waiting to be retried.  */
+  std::vector<Transfer*> delayed;
+
+  /**
+   * Lock serialising access to the engine.  The engine itself does not
+   * lock it, this is done by JsonRpc's methods.  It is recursive, since
+   * completion hooks may start new calls while it is held.
+   */
+  Mutex mutex;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  AsyncEngine ();
+  AsyncEngine (const AsyncEngine&);
+  AsyncEngine& operator= (const AsyncEngine&);
+#endif /* !CXX_11  */
+
+  /**
+   * Restart delayed transfers whose retry is due.  Those that can not
+   * be restarted are finished with the failure of their last attempt.
+   * @param now The current time.
+   * @param done Append transfers finished this way here.
+   */
+  void startDue (double now, std::vector<Transfer*>& done);
+
+  /**
+   * Finish a transfer, releasing its connection.
+   * @param t The transfer.
+   * @param res cURL's result code of its last attempt.
+   * @param done Append the transfer here.
+   */
+  void finish (Transfer* t, CURLcode res, std::vector<Transfer*>& done);
+
+  /**
+   * Get the time until the next delayed transfer is due.
+   * @param now The current time.
+   * @param max Return at most this.
+   * @return The time in milliseconds.
+   */
+  int getNextDue (double now, int max) const;
+
+public:
+
+  /**
+   * Construct it.
+   * @param settings Settings to use for limiting concurrency.
+   * @throws JsonRpc::Exception if initialising cURL fails.
+   */
+  explicit AsyncEngine (const RpcSettings& settings);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  AsyncEngine () = delete;
+  AsyncEngine (const AsyncEngine&) = delete;
+  AsyncEngine& operator= (const AsyncEngine&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it, aborting all active transfers.
+   */
+  ~AsyncEngine ();
+
+  /**
+   * Start a new request.
+   * @param data The data to post.  It is swapped into the connection,
+   *             so that its content is undefined afterwards.
+   * @param call The call object this request belongs to.
+   * @param method The method called, for the log.
+   * @param id The JSON-RPC id used for the request.
+   * @param logging Whether the response should be logged.
+   * @param sink If not null, stream the response body to it.
+   * @param policy Deadline and retry policy for the request.
+   * @param pool Take the connection from this pool.
+   */
+  void submit (std::string& data, JsonRpc::AsyncCall& call,
+               const std::string& method, int id, bool logging,
+               ResponseSink* sink, const RetryPolicy& policy,
+               ConnectionPool& pool);
+
+  /**
+   * Abort the request for the given call, if it is active.
+   * @param call The call whose request to abort.
+   * @return The pool the request's connection was taken from, or NULL
+   *         if there was no active request.
+   */
+  ConnectionPool* cancel (const JsonRpc::AsyncCall& call);
+
+  /**
+   * Process network events, waiting at most the given time for
+   * activity.  Finished transfers are returned, and must be freed
+   * by the caller.
+   * @param timeoutMs Maximum time to wait in milliseconds.
+   * @param done Append finished transfers here.
+   */
+  void process (int timeoutMs, std::vector<Transfer*>& done);
+
+  /**
+   * Get the number of currently active transfers, including those
+   * waiting to be retried.
+   * @return The number of active transfers.
+   */
+  inline unsigned
+  getActive () const
+  {
+    return active.size () + delayed.size ();
+  }
+
+  /**
+   * Get the lock that must be held while using the engine.
+   * @return The engine's lock.
+   */
+  inline Mutex&
+  getMutex ()
+  {
+    return mutex;
+  }
+
+};
+
+/**
+ * A single transfer done by the engine.
+ */
+class AsyncEngine::Transfer
+{
+
+private:
+
+  friend class AsyncEngine;
+
+  /** The connection used.  */
+  HttpConnection* conn;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Transfer ();
+  Transfer (const Transfer&);
+  Transfer& operator= (const Transfer&);
+#endif /* !CXX_11  */
+
+public:
+
+  /** The pool the connection was taken from.  */
+  ConnectionPool* pool;
+
+  /** The call this transfer belongs to.  */
+  JsonRpc::AsyncCall* call;
+
+  /** The JSON-RPC id.  */
+  int id;
+
+  /** Whether to log the response.  */
+  bool logging;
+
+  /** cURL's result code.  */
+  CURLcode result;
+
+  /** HTTP response code.  */
+  unsigned responseCode;
+
+  /** The response body.  Empty if it was streamed to a sink.  */
+  std::string response;
+
+  /** Timings and sizes of the transfer, for the statistics and log.  */
+  JsonRpc::CallInfo info;
+
+  /** Deadline and retries of the request.  */
+  RetryPolicy policy;
+
+  /** When a delayed transfer should be retried.  */
+  double retryAt;
+
+  /**
+   * Construct it.
+   * @param pl The pool of the connection.
+   * @param c The connection to use.
+   * @param cl The call object.
+   * @param m The method called.
+   * @param i The JSON-RPC id.
+   * @param l Whether to log the response.
+   * @param p The retry policy.
+   */
+  inline Transfer (ConnectionPool& pl, HttpConnection* c,
+                   JsonRpc::AsyncCall& cl, const std::string& m, int i,
+                   bool l, const RetryPolicy& p)
+    : conn(c), pool(&pl), call(&cl), id(i), logging(l),
+      result(CURLE_OK), responseCode(0), response(), info(m, i),
+      policy(p), retryAt(0.0)
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Transfer () = delete;
+  Transfer (const Transfer&) = delete;
+  Transfer& operator= (const Transfer&) = delete;
+#endif /* CXX_11?  */
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
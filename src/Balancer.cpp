@@ -0,0 +1,388 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for Balancer.hpp.  */
+
+#include "Balancer.hpp"
+
+#include "JsonWriter.hpp"
+#include "Metrics.hpp"
+#include "RetryPolicy.hpp"
+
+#include <cassert>
+
+namespace nmcrpc
+{
+
+/** Weight of a new latency sample in the running average.  */
+const double Balancer::LATENCY_WEIGHT = 0.2;
+
+/** Latency assumed for nodes before the first call.  */
+const double Balancer::INITIAL_LATENCY = 0.01;
+
+/** Nodes with at most this factor above the best load are used in turn.  */
+const double Balancer::LOAD_SLACK = 1.25;
+
+/**
+ * State of a single node.
+ */
+class Balancer::Node
+{
+
+private:
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Node ();
+  Node (const Node&);
+  Node& operator= (const Node&);
+#endif /* !CXX_11  */
+
+public:
+
+  /** Connections to the node.  */
+  ConnectionPool pool;
+
+  /** Number of calls currently sent to it.  */
+  unsigned outstanding;
+
+  /** Running average of the call latency in seconds.  */
+  double latency;
+
+  /** Whether the node is considered working.  */
+  bool healthy;
+
+  /** When an unhealthy node should be probed again.  */
+  double retryAt;
+
+  /** Whether the height is known.  */
+  bool haveHeight;
+
+  /** The node's block height at the last check.  */
+  unsigned height;
+
+  /**
+   * Construct it.
+   * @param s The settings to use.
+   * @param e The node's endpoint.
+   */
+  inline Node (const RpcSettings& s, const RpcEndpoint& e)
+    : pool(s, e), outstanding(0), latency(INITIAL_LATENCY),
+      healthy(true), retryAt(0.0), haveHeight(false), height(0)
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Node () = delete;
+  Node (const Node&) = delete;
+  Node& operator= (const Node&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Query the node's block height.  This can be done without holding
+   * the balancer's lock, as it only uses the connection pool.
+   * @param settings The settings to use.
+   * @param h Set to the block height on success.
+   * @return True iff the query succeeded.
+   */
+  bool probe (const RpcSettings& settings, unsigned& h);
+
+};
+
+/**
+ * Query the node's block height.  This is done directly and without
+ * retries, as it is also the health check.
+ * @param settings The settings to use.
+ * @param h Set to the block height on success.
+ * @return True iff the query succeeded.
+ */
+bool
+Balancer::Node::probe (const RpcSettings& settings, unsigned& h)
+{
+  PooledConnection conn(pool);
+  std::string& query = conn->getData ();
+  query.clear ();
+  JsonWriter::writeRequest ("getblockcount",
+                            JsonRpc::JsonData (Json::arrayValue), 0, query);
+
+  RetryPolicy policy(settings, settings.getConnectTimeout (), false);
+  try
+    {
+      pool.recordCall (conn->perform (policy));
+      if (conn->getResponseCode () != 200)
+        return false;
+
+      const JsonRpc::JsonData response
+        = JsonRpc::decodeJson (conn->getResponseBody ());
+      const JsonRpc::JsonData& result = response["result"];
+      if (!result.isIntegral ())
+        return false;
+
+      h = result.asUInt ();
+      return true;
+    }
+  catch (const JsonRpc::Exception&)
+    {
+      return false;
+    }
+}
+
+/**
+ * Construct it for the endpoints in the settings.  With multiple nodes,
+ * this starts the thread checking them.
+ * @param s The settings to use.  Must outlive the balancer.
+ * @throws JsonRpc::Exception if the thread can not be started.
+ */
+Balancer::Balancer (const RpcSettings& s)
+  : settings(s), nodes(), rotation(0), mutex(), wakeUp(),
+    stopping(false), checking(false), checker()
+{
+  const std::vector<RpcEndpoint> endpoints = settings.getEndpoints ();
+  for (std::vector<RpcEndpoint>::const_iterator i = endpoints.begin ();
+       i != endpoints.end (); ++i)
+    nodes.push_back (new Node (settings, *i));
+
+  if (nodes.size () > 1)
+    {
+      if (pthread_create (&checker, nullptr, &checkerMain, this) != 0)
+        {
+          for (std::vector<Node*>::iterator i = nodes.begin ();
+               i != nodes.end (); ++i)
+            delete *i;
+          throw JsonRpc::Exception ("Could not start node checking thread.");
+        }
+      checking = true;
+    }
+}
+
+/**
+ * Destroy it, stopping the checking thread and closing all connections.
+ * If a probe is in progress, this waits for it to finish.
+ */
+Balancer::~Balancer ()
+{
+  if (checking)
+    {
+      {
+        Lock lock(mutex);
+        stopping = true;
+        wakeUp.signal ();
+      }
+      pthread_join (checker, nullptr);
+    }
+
+  for (std::vector<Node*>::iterator i = nodes.begin (); i != nodes.end (); ++i)
+    delete *i;
+}
+
+/**
+ * Main routine of the checking thread.
+ * @param self The balancer as void pointer.
+ * @return Always NULL.
+ */
+void*
+Balancer::checkerMain (void* self)
+{
+  reinterpret_cast<Balancer*> (self)->checkLoop ();
+  return nullptr;
+}
+
+/**
+ * Check the chain height of all nodes that are healthy or due to be
+ * probed again, repeatedly until stopped.  The probes are done without
+ * holding the lock, so that a node that does not answer does not block
+ * the choice of nodes for other calls.
+ */
+void
+Balancer::checkLoop ()
+{
+  Lock lock(mutex);
+  while (!stopping)
+    {
+      const double now = Metrics::now ();
+      for (std::vector<Node*>::iterator i = nodes.begin ();
+           i != nodes.end () && !stopping; ++i)
+        {
+          Node& n = **i;
+          if (!n.healthy && n.retryAt > now)
+            continue;
+
+          unsigned h;
+          bool ok;
+          {
+            Unlock unlock(lock);
+            ok = n.probe (settings, h);
+          }
+
+          if (ok)
+            {
+              n.healthy = true;
+              n.height = h;
+              n.haveHeight = true;
+            }
+          else
+            markFailed (n, Metrics::now ());
+        }
+
+      if (!stopping)
+        wakeUp.waitFor (lock, settings.getNodeCheckInterval ());
+    }
+}
+
+/**
+ * Mark a node as unhealthy until the next probe.
+ * @param n The node.
+ * @param now The current time.
+ */
+void
+Balancer::markFailed (Node& n, double now)
+{
+  n.healthy = false;
+  n.retryAt = now + settings.getNodeCheckInterval () / 1000.0;
+}
+
+/**
+ * Find the node for a pool.
+ * @param pool The pool.
+ * @return The node it belongs to.
+ */
+Balancer::Node&
+Balancer::getNode (const ConnectionPool& pool) const
+{
+  for (std::vector<Node*>::const_iterator i = nodes.begin ();
+       i != nodes.end (); ++i)
+    if (&(*i)->pool == &pool)
+      return **i;
+
+  assert (false);
+  return *nodes.front ();
+}
+
+/**
+ * Choose the node for a new call.  Balanced calls are only sent to
+ * healthy nodes that are at most the configured number of blocks behind
+ * the best one, so that they don't answer with stale data.  If there is
+ * no such node, the primary is used.
+ * @param balanced Whether the call may be sent to any node.
+ * @return The connection pool of the chosen node.
+ */
+ConnectionPool&
+Balancer::choose (bool balanced)
+{
+  Lock lock(mutex);
+  Node* res = nodes.front ();
+
+  if (balanced && nodes.size () > 1)
+    {
+      unsigned best = 0;
+      for (std::vector<Node*>::const_iterator i = nodes.begin ();
+           i != nodes.end (); ++i)
+        if ((*i)->healthy && (*i)->haveHeight && (*i)->height > best)
+          best = (*i)->height;
+
+      std::vector<double> load(nodes.size (), -1.0);
+      double minLoad = -1.0;
+      for (unsigned i = 0; i < nodes.size (); ++i)
+        {
+          const Node& n = *nodes[i];
+          if (!n.healthy
+              || (n.haveHeight && n.height + settings.getMaxHeightLag () < best))
+            continue;
+
+          load[i] = (n.outstanding + 1) * n.latency;
+          if (minLoad < 0.0 || load[i] < minLoad)
+            minLoad = load[i];
+        }
+
+      for (unsigned j = 0; minLoad >= 0.0 && j < nodes.size (); ++j)
+        {
+          const unsigned i = (rotation + j) % nodes.size ();
+          if (load[i] >= 0.0 && load[i] <= minLoad * LOAD_SLACK)
+            {
+              res = nodes[i];
+              rotation = i + 1;
+              break;
+            }
+        }
+    }
+
+  ++res->outstanding;
+  return res->pool;
+}
+
+/**
+ * Report that a call is finished.  Transport and protocol failures mark
+ * the node as unhealthy, while RPC errors are the daemon's regular answer.
+ * @param pool The pool returned for the call by choose().
+ * @param info The call's outcome and timings, or NULL if it was
+ *             aborted before it was sent.
+ */
+void
+Balancer::finished (ConnectionPool& pool, const JsonRpc::CallInfo* info)
+{
+  Lock lock(mutex);
+  Node& n = getNode (pool);
+  assert (n.outstanding > 0);
+  --n.outstanding;
+
+  if (!info)
+    return;
+
+  switch (info->outcome)
+    {
+    case JsonRpc::CallInfo::SUCCESS:
+    case JsonRpc::CallInfo::RPC_ERROR:
+      {
+        const double total = info->connectTime + info->waitTime
+                              + info->transferTime;
+        n.latency += LATENCY_WEIGHT * (total - n.latency);
+        break;
+      }
+
+    default:
+      if (nodes.size () > 1)
+        markFailed (n, Metrics::now ());
+      break;
+    }
+}
+
+/**
+ * Get the connection statistics summed over all nodes.
+ * @return The statistics.
+ */
+JsonRpc::ConnectionStats
+Balancer::getStats () const
+{
+  JsonRpc::ConnectionStats res;
+  for (std::vector<Node*>::const_iterator i = nodes.begin ();
+       i != nodes.end (); ++i)
+    {
+      const JsonRpc::ConnectionStats cur = (*i)->pool.getStats ();
+      res.calls += cur.calls;
+      res.reused += cur.reused;
+      res.opened += cur.opened;
+    }
+
+  return res;
+}
+
+} // namespace nmcrpc
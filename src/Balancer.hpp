@@ -0,0 +1,277 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the routing of calls
+   across multiple daemons.  */
+
+#ifndef NMCRPC_BALANCER_HPP
+#define NMCRPC_BALANCER_HPP
+
+#include "ConnectionPool.hpp"
+#include "JsonRpc.hpp"
+#include "RpcSettings.hpp"
+#include "Thread.hpp"
+
+#include <pthread.h>
+
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Choose the daemon each call is sent to.  Calls of balanced methods go
+ * to the healthy node that is up to date with the chain and has the
+ * lowest load, measured as outstanding calls weighted by its recent
+ * latency.  All other calls always go to the primary node.  Nodes are
+ * marked unhealthy when calls fail on the transport level.  The heights
+ * and health of all nodes are checked periodically on a background
+ * thread, so that slow or unreachable nodes never hold up the choice.
+ * With a single node, there is no thread and no overhead besides the lock.
+ */
+class Balancer
+{
+
+private:
+
+  /** State of a single node.  */
+  class Node;
+
+  /** Weight of a new latency sample in the running average.  */
+  static const double LATENCY_WEIGHT;
+
+  /** Latency assumed for nodes before the first call.  */
+  static const double INITIAL_LATENCY;
+
+  /**
+   * Nodes whose load is at most this factor above the best one are
+   * considered equal, and used in turn.
+   */
+  static const double LOAD_SLACK;
+
+  /** The settings in use.  */
+  const RpcSettings& settings;
+
+  /** All nodes, the primary first.  */
+  std::vector<Node*> nodes;
+
+  /** Where to start looking for the next balanced call, for rotation.  */
+  unsigned rotation;
+
+  /** Lock for the nodes' state.  */
+  mutable Mutex mutex;
+
+  /** Signalled to stop the checking thread.  */
+  Condition wakeUp;
+
+  /** Set when the checking thread should stop.  */
+  bool stopping;
+
+  /** Whether the checking thread is running.  */
+  bool checking;
+
+  /** Thread checking the nodes.  */
+  pthread_t checker;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Balancer ();
+  Balancer (const Balancer&);
+  Balancer& operator= (const Balancer&);
+#endif /* !CXX_11  */
+
+  /**
+   * Main routine of the checking thread.
+   * @param self The balancer as void pointer.
+   * @return Always NULL.
+   */
+  static void* checkerMain (void* self);
+
+  /**
+   * Check the chain height of all nodes that are healthy or due to be
+   * probed again, repeatedly until stopped.  The lock is only held
+   * between the probes, not while they are in progress.
+   */
+  void checkLoop ();
+
+  /**
+   * Mark a node as unhealthy until the next probe.
+   * @param n The node.
+   * @param now The current time.
+   */
+  void markFailed (Node& n, double now);
+
+  /**
+   * Find the node for a pool.
+   * @param pool The pool.
+   * @return The node it belongs to.
+   */
+  Node& getNode (const ConnectionPool& pool) const;
+
+public:
+
+  /**
+   * Construct it for the endpoints in the settings.  With multiple nodes,
+   * this starts the thread checking them.
+   * @param s The settings to use.  Must outlive the balancer.
+   * @throws JsonRpc::Exception if the thread can not be started.
+   */
+  explicit Balancer (const RpcSettings& s);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Balancer () = delete;
+  Balancer (const Balancer&) = delete;
+  Balancer& operator= (const Balancer&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it, stopping the checking thread and closing all connections.
+   * If a probe is in progress, this waits for it to finish.
+   */
+  ~Balancer ();
+
+  /**
+   * Choose the node for a new call.  It is counted as outstanding there
+   * until finished() is called for it.
+   * @param balanced Whether the call may be sent to any node.
+   * @return The connection pool of the chosen node.
+   */
+  ConnectionPool& choose (bool balanced);
+
+  /**
+   * Report that a call is finished.
+   * @param pool The pool returned for the call by choose().
+   * @param info The call's outcome and timings, or NULL if it was
+   *             aborted before it was sent.
+   */
+  void finished (ConnectionPool& pool, const JsonRpc::CallInfo* info);
+
+  /**
+   * Get the number of nodes a failed balanced call may be tried on.
+   * @return The number of nodes.
+   */
+  inline unsigned
+  getNodeCount () const
+  {
+    return nodes.size ();
+  }
+
+  /**
+   * Get the connection statistics summed over all nodes.
+   * @return The statistics.
+   */
+  JsonRpc::ConnectionStats getStats () const;
+
+};
+
+/**
+ * RAII helper that chooses a node for a call and takes a connection to
+ * it, handing both back when going out of scope.
+ */
+class RoutedConnection
+{
+
+private:
+
+  /** The balancer used.  */
+  Balancer& balancer;
+
+  /** The connection.  */
+  PooledConnection conn;
+
+  /** Whether the outcome was reported already.  */
+  bool reported;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  RoutedConnection ();
+  RoutedConnection (const RoutedConnection&);
+  RoutedConnection& operator= (const RoutedConnection&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Choose a node and take a connection to it.
+   * @param b The balancer to use.
+   * @param balanced Whether the call may be sent to any node.
+   */
+  inline RoutedConnection (Balancer& b, bool balanced)
+    : balancer(b), conn(b.choose (balanced)), reported(false)
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  RoutedConnection () = delete;
+  RoutedConnection (const RoutedConnection&) = delete;
+  RoutedConnection& operator= (const RoutedConnection&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Finish the call if that was not done yet.
+   */
+  inline ~RoutedConnection ()
+  {
+    if (!reported)
+      balancer.finished (conn.getPool (), nullptr);
+  }
+
+  /**
+   * Report the outcome of the call to the balancer.
+   * @param info The call's outcome and timings.
+   */
+  inline void
+  report (const JsonRpc::CallInfo& info)
+  {
+    if (!reported)
+      balancer.finished (conn.getPool (), &info);
+    reported = true;
+  }
+
+  /**
+   * Get the pool of the connection.
+   * @return The pool.
+   */
+  inline ConnectionPool&
+  getPool () const
+  {
+    return conn.getPool ();
+  }
+
+  inline HttpConnection&
+  operator* () const
+  {
+    return *conn;
+  }
+
+  inline HttpConnection*
+  operator-> () const
+  {
+    return &*conn;
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
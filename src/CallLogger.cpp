@@ -0,0 +1,203 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for CallLogger.hpp.  */
+
+#include "CallLogger.hpp"
+
+#include <cstdlib>
+#include <sstream>
+
+namespace nmcrpc
+{
+
+/** Environment variable name for controlling the call log file.  */
+const char* const CallLogger::FILE_VAR = "LIBNMCRPC_LOGFILE_RPCCALLS";
+
+const size_t CallLogger::MAX_PENDING = 16 << 20;
+
+CallLogger* CallLogger::instance = nullptr;
+
+/** Ensure the environment is checked only once.  */
+static pthread_once_t initOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Construct it, starting the writer thread.
+ * @param f The opened log file.
+ */
+CallLogger::CallLogger (FILE* f)
+  : file(f), mutex(), wake(), written(), pending(),
+    writing(false), stopping(false), thread()
+{
+  pthread_create (&thread, nullptr, &writerMain, this);
+}
+
+/**
+ * Create the instance if the environment variable is set.
+ */
+void
+CallLogger::init ()
+{
+  const char* name = std::getenv (FILE_VAR);
+  if (!name)
+    return;
+
+  FILE* f = std::fopen (name, "a");
+  if (!f)
+    return;
+
+  instance = new CallLogger (f);
+  std::atexit (&shutdown);
+}
+
+/**
+ * Stop the writer thread at process exit, after it wrote all records.
+ * The instance is not destroyed, since other threads may still be using
+ * it.  Their records are written directly from then on, and the file
+ * is closed by the process exit.
+ */
+void
+CallLogger::shutdown ()
+{
+  {
+    Lock lock(instance->mutex);
+    instance->stopping = true;
+    instance->wake.signal ();
+    instance->written.broadcast ();
+  }
+
+  pthread_join (instance->thread, nullptr);
+}
+
+/**
+ * Get the logger.
+ * @return The logger, or NULL if call logging is disabled.
+ */
+CallLogger*
+CallLogger::get ()
+{
+  pthread_once (&initOnce, &init);
+  return instance;
+}
+
+/**
+ * Main routine of the writer thread.
+ * @param self The logger as void pointer.
+ * @return Always NULL.
+ */
+void*
+CallLogger::writerMain (void* self)
+{
+  static_cast<CallLogger*> (self)->runWriter ();
+  return nullptr;
+}
+
+/**
+ * Write out records until stopped.  All records queued since the last
+ * round are taken at once, so that the lock is held only for a swap.
+ */
+void
+CallLogger::runWriter ()
+{
+  std::string batch;
+
+  Lock lock(mutex);
+  while (true)
+    {
+      while (pending.empty () && !stopping)
+        wake.wait (lock);
+      if (pending.empty ())
+        break;
+
+      batch.clear ();
+      batch.swap (pending);
+      writing = true;
+
+      /* Write without holding the lock, so that callers can go on
+         queueing records in the meantime.  */
+      {
+        Unlock unlock(lock);
+        std::fwrite (batch.data (), 1, batch.size (), file);
+        std::fflush (file);
+      }
+
+      writing = false;
+      written.broadcast ();
+    }
+}
+
+/**
+ * Queue text for the log.  If the buffer is full, wait until the writer
+ * has taken it.  After the writer is stopped, write the text directly.
+ * @param str The text to write.
+ */
+void
+CallLogger::write (const std::string& str)
+{
+  Lock lock(mutex);
+  while (!stopping && !pending.empty ()
+         && pending.size () + str.size () > MAX_PENDING)
+    written.wait (lock);
+
+  if (stopping)
+    {
+      std::fwrite (str.data (), 1, str.size (), file);
+      std::fflush (file);
+      return;
+    }
+
+  if (pending.empty ())
+    wake.signal ();
+  pending += str;
+}
+
+/**
+ * Queue a record about a finished call.
+ * @param method The method called.
+ * @param id The JSON-RPC id of the call (the first one for a batch).
+ * @param seconds Time taken by the call.
+ * @param sent Number of bytes sent.
+ * @param received Number of bytes received.
+ */
+void
+CallLogger::writeRecord (const std::string& method, int id, double seconds,
+                         size_t sent, size_t received)
+{
+  std::ostringstream out;
+  out << "  # id=" << id << " method=" << method
+      << " us=" << static_cast<unsigned long> (seconds * 1e6 + 0.5)
+      << " sent=" << sent << " received=" << received << std::endl
+      << std::endl;
+
+  write (out.str ());
+}
+
+/**
+ * Wait until all queued records have been written to the file.
+ */
+void
+CallLogger::flush ()
+{
+  Lock lock(mutex);
+  while (!pending.empty () || writing)
+    written.wait (lock);
+}
+
+} // namespace nmcrpc
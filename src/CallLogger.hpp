@@ -0,0 +1,167 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the writer of the
+   RPC call log.  */
+
+#ifndef NMCRPC_CALLLOGGER_HPP
+#define NMCRPC_CALLLOGGER_HPP
+
+#include "Thread.hpp"
+
+#include <pthread.h>
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Write the RPC call log.  The log file is given by an environment
+ * variable, which is read only once.  Records are appended to an in-memory
+ * buffer, which a background thread writes to the file.  This way, the
+ * threads doing calls don't wait for the disk, unless the writer falls
+ * so far behind that the buffer is full.  There is only a single
+ * logger for the whole process, shared by all JsonRpc instances.  It is
+ * never destroyed, so that it can still be used while the process exits;
+ * the writer thread is only stopped then, and later records are written
+ * to the file directly.
+ */
+class CallLogger
+{
+
+private:
+
+  /** Environment variable name for controlling the call log file.  */
+  static const char* const FILE_VAR;
+
+  /**
+   * Size of the buffer in bytes above which callers wait for the writer.
+   * A single record larger than this is still queued if the buffer is
+   * empty.
+   */
+  static const size_t MAX_PENDING;
+
+  /** The single instance, if logging is enabled.  */
+  static CallLogger* instance;
+
+  /** The log file.  */
+  FILE* file;
+
+  /** Lock for the buffer and state.  */
+  Mutex mutex;
+
+  /** Signalled when records are added or the logger is stopped.  */
+  Condition wake;
+
+  /** Signalled when the writer has written out a batch.  */
+  Condition written;
+
+  /** Records not yet handed to the writer.  */
+  std::string pending;
+
+  /** Whether the writer is busy writing a batch.  */
+  bool writing;
+
+  /** Set to stop the writer thread.  Records are written directly then.  */
+  bool stopping;
+
+  /** The writer thread.  */
+  pthread_t thread;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  CallLogger ();
+  CallLogger (const CallLogger&);
+  CallLogger& operator= (const CallLogger&);
+#endif /* !CXX_11  */
+
+  /**
+   * Construct it, starting the writer thread.
+   * @param f The opened log file.
+   */
+  explicit CallLogger (FILE* f);
+
+  /**
+   * Create the instance if the environment variable is set.
+   */
+  static void init ();
+
+  /**
+   * Stop the writer thread at process exit, after it wrote all records.
+   */
+  static void shutdown ();
+
+  /**
+   * Main routine of the writer thread.
+   * @param self The logger as void pointer.
+   * @return Always NULL.
+   */
+  static void* writerMain (void* self);
+
+  /**
+   * Write out records until stopped.
+   */
+  void runWriter ();
+
+public:
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  CallLogger () = delete;
+  CallLogger (const CallLogger&) = delete;
+  CallLogger& operator= (const CallLogger&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the logger.
+   * @return The logger, or NULL if call logging is disabled.
+   */
+  static CallLogger* get ();
+
+  /**
+   * Queue text for the log.
+   * @param str The text to write.
+   */
+  void write (const std::string& str);
+
+  /**
+   * Queue a record about a finished call.
+   * @param method The method called.
+   * @param id The JSON-RPC id of the call (the first one for a batch).
+   * @param seconds Time taken by the call.
+   * @param sent Number of bytes sent.
+   * @param received Number of bytes received.
+   */
+  void writeRecord (const std::string& method, int id, double seconds,
+                    size_t sent, size_t received);
+
+  /**
+   * Wait until all queued records have been written to the file.
+   */
+  void flush ();
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
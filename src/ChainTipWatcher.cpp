@@ -0,0 +1,253 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for ChainTipWatcher.hpp.  */
+
+#include "ChainTipWatcher.hpp"
+
+#include "Thread.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace nmcrpc
+{
+
+/**
+ * Construct it.  The tip is not yet queried.
+ * @param r The RPC connection to use.
+ */
+ChainTipWatcher::ChainTipWatcher (JsonRpc& r)
+  : rpc(r), height(0), hash(), haveTip(false), listeners(),
+    mutex(new Mutex (true)), wakeUp(new Condition ()), thread(),
+    running(false), stopping(false), notified(false), interval(0)
+{
+  // Nothing else to do.
+}
+
+/**
+ * Destroy it, stopping the background thread if it is running.
+ */
+ChainTipWatcher::~ChainTipWatcher ()
+{
+  stop ();
+  delete wakeUp;
+  delete mutex;
+}
+
+/**
+ * Register a listener.  It must stay alive until removed again
+ * or until the watcher is destroyed.
+ * @param l The listener to add.
+ */
+void
+ChainTipWatcher::addListener (Listener& l)
+{
+  Lock lock(*mutex);
+  listeners.push_back (&l);
+}
+
+/**
+ * Remove a listener again.  When this returns, the listener is
+ * guaranteed to not be called any more.
+ * @param l The listener to remove.
+ */
+void
+ChainTipWatcher::removeListener (Listener& l)
+{
+  Lock lock(*mutex);
+  listeners.erase (std::remove (listeners.begin (), listeners.end (), &l),
+                   listeners.end ());
+}
+
+/**
+ * Query the chain tip, and inform the listeners if it changed.  The first
+ * poll only records the tip, since there's nothing to compare to.
+ * @return True iff the tip changed.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+bool
+ChainTipWatcher::poll ()
+{
+  std::vector<JsonRpc::Call> calls;
+  calls.push_back (JsonRpc::Call ("getblockcount"));
+  calls.push_back (JsonRpc::Call ("getbestblockhash"));
+
+  const std::vector<JsonRpc::CallResult> res = rpc.executeRpcBatch (calls);
+  const unsigned newHeight = res[0].get ().asUInt ();
+  const std::string newHash = res[1].get ().asString ();
+
+  Lock lock(*mutex);
+  if (haveTip && newHeight == height && newHash == hash)
+    return false;
+
+  const bool first = !haveTip;
+  height = newHeight;
+  hash = newHash;
+  haveTip = true;
+
+  if (first)
+    return false;
+
+  /* Work on a copy, so that listeners can remove themselves.  */
+  const std::vector<Listener*> current = listeners;
+  for (unsigned i = 0; i < current.size (); ++i)
+    current[i]->tipChanged (newHeight, newHash);
+
+  return true;
+}
+
+/**
+ * Notify the watcher that a new block may have arrived.  If the background
+ * thread is running, it polls right away.  Otherwise, poll() is called
+ * directly.
+ * @throws JsonRpc::Exception in case of RPC errors in a direct poll.
+ */
+void
+ChainTipWatcher::notify ()
+{
+  {
+    Lock lock(*mutex);
+    if (running)
+      {
+        notified = true;
+        wakeUp->signal ();
+        return;
+      }
+  }
+
+  poll ();
+}
+
+/**
+ * Start polling on a background thread.  RPC errors there are ignored,
+ * polling simply continues with the next interval.
+ * @param ms Polling interval in milliseconds.
+ * @throws std::logic_error if the thread is already running.
+ * @throws std::runtime_error if the thread can not be started.
+ */
+void
+ChainTipWatcher::start (unsigned ms)
+{
+  Lock lock(*mutex);
+  if (running)
+    throw std::logic_error ("ChainTipWatcher is already running.");
+
+  interval = ms;
+  stopping = false;
+  notified = false;
+  if (pthread_create (&thread, nullptr, &threadMain, this) != 0)
+    throw std::runtime_error ("Could not start ChainTipWatcher thread.");
+  running = true;
+}
+
+/**
+ * Stop the background thread, if it is running.
+ */
+void
+ChainTipWatcher::stop ()
+{
+  {
+    Lock lock(*mutex);
+    if (!running)
+      return;
+
+    stopping = true;
+    wakeUp->signal ();
+  }
+
+  pthread_join (thread, nullptr);
+
+  Lock lock(*mutex);
+  running = false;
+}
+
+/**
+ * Check whether the background thread is running.
+ * @return True iff the background thread is running.
+ */
+bool
+ChainTipWatcher::isRunning () const
+{
+  Lock lock(*mutex);
+  return running;
+}
+
+/**
+ * Get the last known block height.
+ * @return The block height as of the last poll.
+ */
+unsigned
+ChainTipWatcher::getHeight () const
+{
+  Lock lock(*mutex);
+  return height;
+}
+
+/**
+ * Get the last known best block hash.
+ * @return The best block hash as of the last poll.
+ */
+std::string
+ChainTipWatcher::getBestHash () const
+{
+  Lock lock(*mutex);
+  return hash;
+}
+
+/**
+ * Main routine of the background thread.
+ * @param self The watcher as void pointer.
+ * @return Always NULL.
+ */
+void*
+ChainTipWatcher::threadMain (void* self)
+{
+  reinterpret_cast<ChainTipWatcher*> (self)->runLoop ();
+  return nullptr;
+}
+
+/**
+ * Poll repeatedly until stopped.
+ */
+void
+ChainTipWatcher::runLoop ()
+{
+  while (true)
+    {
+      try
+        {
+          poll ();
+        }
+      catch (const std::exception&)
+        {
+          /* Ignore the error and try again next time.  */
+        }
+
+      Lock lock(*mutex);
+      if (!stopping && !notified)
+        wakeUp->waitFor (lock, interval);
+      if (stopping)
+        break;
+      notified = false;
+    }
+}
+
+} // namespace nmcrpc
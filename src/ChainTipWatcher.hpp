@@ -0,0 +1,233 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_CHAINTIPWATCHER_HPP
+#define NMCRPC_CHAINTIPWATCHER_HPP
+
+#include "JsonRpc.hpp"
+
+#include <pthread.h>
+
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+class Condition;
+class Mutex;
+
+/* ************************************************************************** */
+/* Watch for new blocks.  */
+
+/**
+ * Keep track of the chain tip (block height and best block hash) and
+ * inform listeners when it changes.  The tip is checked either explicitly
+ * with poll(), or periodically on a background thread started with start().
+ * In addition, notify() can be hooked up to the daemon's -blocknotify
+ * mechanism (for instance through a pipe or signal handling in the
+ * application) to check immediately when a block arrives.
+ *
+ * Listeners are called on the thread doing the poll.  It is safe to
+ * add and remove listeners from other threads.
+ */
+class ChainTipWatcher
+{
+
+public:
+
+  class Listener;
+
+private:
+
+  /** The RPC connection to use.  */
+  JsonRpc& rpc;
+
+  /** Last known block height.  */
+  unsigned height;
+
+  /** Last known best block hash.  */
+  std::string hash;
+
+  /** Whether the tip has been queried at least once.  */
+  bool haveTip;
+
+  /** Registered listeners.  */
+  std::vector<Listener*> listeners;
+
+  /**
+   * Lock for the state.  It is held also while calling the listeners,
+   * so that they can't be removed while in use.  It is recursive, so that
+   * listeners may query the watcher.
+   */
+  Mutex* mutex;
+
+  /** Signalled to wake up the background thread.  */
+  Condition* wakeUp;
+
+  /** The background thread, if running.  */
+  pthread_t thread;
+
+  /** Whether the background thread is running.  */
+  bool running;
+
+  /** Set to stop the background thread.  */
+  bool stopping;
+
+  /** Set when notify() requested an immediate poll.  */
+  bool notified;
+
+  /** Polling interval of the background thread in milliseconds.  */
+  unsigned interval;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  ChainTipWatcher ();
+  ChainTipWatcher (const ChainTipWatcher&);
+  ChainTipWatcher& operator= (const ChainTipWatcher&);
+#endif /* !CXX_11  */
+
+  /**
+   * Main routine of the background thread.
+   * @param self The watcher as void pointer.
+   * @return Always NULL.
+   */
+  static void* threadMain (void* self);
+
+  /**
+   * Poll repeatedly until stopped.
+   */
+  void runLoop ();
+
+public:
+
+  /**
+   * Construct it.  The tip is not yet queried.
+   * @param r The RPC connection to use.
+   */
+  explicit ChainTipWatcher (JsonRpc& r);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  ChainTipWatcher () = delete;
+  ChainTipWatcher (const ChainTipWatcher&) = delete;
+  ChainTipWatcher& operator= (const ChainTipWatcher&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it, stopping the background thread if it is running.
+   */
+  ~ChainTipWatcher ();
+
+  /**
+   * Register a listener.  It must stay alive until removed again
+   * or until the watcher is destroyed.
+   * @param l The listener to add.
+   */
+  void addListener (Listener& l);
+
+  /**
+   * Remove a listener again.  When this returns, the listener is
+   * guaranteed to not be called any more.
+   * @param l The listener to remove.
+   */
+  void removeListener (Listener& l);
+
+  /**
+   * Query the chain tip, and inform the listeners if it changed.  The first
+   * poll only records the tip, since there's nothing to compare to.
+   * @return True iff the tip changed.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  bool poll ();
+
+  /**
+   * Notify the watcher that a new block may have arrived.  If the background
+   * thread is running, it polls right away.  Otherwise, poll() is called
+   * directly.
+   * @throws JsonRpc::Exception in case of RPC errors in a direct poll.
+   */
+  void notify ();
+
+  /**
+   * Start polling on a background thread.  RPC errors there are ignored,
+   * polling simply continues with the next interval.
+   * @param ms Polling interval in milliseconds.
+   * @throws std::logic_error if the thread is already running.
+   * @throws std::runtime_error if the thread can not be started.
+   */
+  void start (unsigned ms);
+
+  /**
+   * Stop the background thread, if it is running.
+   */
+  void stop ();
+
+  /**
+   * Check whether the background thread is running.
+   * @return True iff the background thread is running.
+   */
+  bool isRunning () const;
+
+  /**
+   * Get the last known block height.
+   * @return The block height as of the last poll.
+   */
+  unsigned getHeight () const;
+
+  /**
+   * Get the last known best block hash.
+   * @return The best block hash as of the last poll.
+   */
+  std::string getBestHash () const;
+
+};
+
+/**
+ * Interface for listeners to chain tip changes.
+ */
+class ChainTipWatcher::Listener
+{
+
+public:
+
+  inline Listener ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~Listener ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Called when the chain tip changed.  This includes re-organisations,
+   * where the height may stay the same or even decrease.
+   * @param height The new block height.
+   * @param hash The new best block hash.
+   */
+  virtual void tipChanged (unsigned height, const std::string& hash) = 0;
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -22,6 +22,10 @@
 
 #include "CoinInterface.hpp"
 
+#include "JsonTape.hpp"
+#include "Rpc.hpp"
+#include "SignatureVerifier.hpp"
+
 #include <ctime>
 #include <iomanip>
 #include <sstream>
@@ -46,8 +50,10 @@ CoinInterface::testConnection (std::string& msg)
 {
   try
     {
-      const JsonRpc::JsonData res = rpc.executeRpc ("getinfo");
-      int version = res["version"].asInt ();
+      JsonTape tape;
+      rpc.executeRpcTape ("getinfo", JsonRpc::JsonData (Json::arrayValue),
+                          tape);
+      int version = tape.getRoot ()["result"]["version"].asInt ();
 
       unsigned v3 = version % 100;
       version /= 100;
@@ -92,6 +98,20 @@ CoinInterface::queryAddress (const std::string& addr)
   return Address (rpc, addr);
 }
 
+/**
+ * Construct an address object from the result of a validateaddress call
+ * that has already been done.
+ * @param addr The address as string.
+ * @param info The result of validateaddress for it.
+ * @return The created address object.
+ */
+CoinInterface::Address
+CoinInterface::addressFromInfo (const std::string& addr,
+                                const JsonRpc::JsonData& info)
+{
+  return Address (rpc, addr, info);
+}
+
 /**
  * Create a new address (as per "getnewaddress") and return it.
  * @return Newly created address.
@@ -112,10 +132,48 @@ CoinInterface::createAddress ()
 unsigned
 CoinInterface::getNumberOfConfirmations (const std::string& txid)
 {
-  const JsonRpc::JsonData res = rpc.executeRpc ("gettransaction", txid);
-  assert (res.isObject ());
+  return rpc.call (Rpc::GetTransaction (txid)).getConfirmations ();
+}
+
+/**
+ * Query for the number of confirmations of multiple transactions at once,
+ * using a single batched request.
+ * @param txids The transaction ids to check for.
+ * @return Number of confirmations for each transaction, in the same order.
+ * @throws JsonRpc::RpcError if one of the txs is not found.
+ */
+std::vector<unsigned>
+CoinInterface::getNumberOfConfirmations (const std::vector<std::string>& txids)
+{
+  std::vector<JsonRpc::Call> calls;
+  for (unsigned i = 0; i < txids.size (); ++i)
+    calls.push_back (Rpc::GetTransaction (txids[i]));
 
-  return res["confirmations"].asInt ();
+  std::vector<unsigned> res;
+  if (calls.empty ())
+    return res;
+
+  const std::vector<JsonRpc::CallResult> results = rpc.executeRpcBatch (calls);
+  for (unsigned i = 0; i < results.size (); ++i)
+    res.push_back (Rpc::GetTransaction::decode (results[i].get ())
+                     .getConfirmations ());
+
+  return res;
+}
+
+/**
+ * Start a query for the number of confirmations asynchronously.  The
+ * result can be retrieved from the passed object once the call is done.
+ * @param txid The transaction id to check for.
+ * @param res The object receiving the result.
+ */
+void
+CoinInterface::getNumberOfConfirmationsAsync (const std::string& txid,
+                                              AsyncConfirmations& res)
+{
+  JsonRpc::JsonData params(Json::arrayValue);
+  params.append (txid);
+  rpc.executeRpcAsync ("gettransaction", params, res);
 }
 
 /**
@@ -129,6 +187,16 @@ CoinInterface::getBalance ()
   return Balance(res);
 }
 
+/**
+ * Get the current number of blocks in the chain.
+ * @return The block height of the chain tip.
+ */
+unsigned
+CoinInterface::getBlockCount ()
+{
+  return rpc.call (Rpc::GetBlockCount ());
+}
+
 /**
  * Check whether the wallet needs to be unlocked or not.  This routine is
  * used to decide whether we need to ask for a passphrase or not before
@@ -138,13 +206,134 @@ CoinInterface::getBalance ()
 bool
 CoinInterface::needWalletPassphrase ()
 {
-  const JsonRpc::JsonData res = rpc.executeRpc ("getinfo");
+  JsonTape tape;
+  rpc.executeRpcTape ("getinfo", JsonRpc::JsonData (Json::arrayValue), tape);
+  const JsonTape::Value until = tape.getRoot ()["result"]["unlocked_until"];
 
-  if (res["unlocked_until"].isNull ())
+  if (until.isNull ())
     return false;
 
-  const int until = res["unlocked_until"].asInt ();
-  return (until < std::time (nullptr) + UNLOCK_SECONDS);
+  return (until.asInt () < std::time (nullptr) + UNLOCK_SECONDS);
+}
+
+/**
+ * Check many message signatures at once.  This does not need to
+ * validate the addresses first, and either sends all verifymessage calls
+ * in batched requests or, if local is set, checks the signatures
+ * without involving the daemon at all.  Invalid addresses or malformed
+ * signatures simply fail to verify.
+ * @param msgs The signed messages to check.
+ * @param local Whether to check the signatures locally.
+ * @return For each message whether its signature is valid, in order.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+std::vector<bool>
+CoinInterface::verifySignatures (const std::vector<SignedMessage>& msgs,
+                                 bool local)
+{
+  std::vector<bool> res;
+  res.reserve (msgs.size ());
+
+  if (local)
+    {
+      const SignatureVerifier verifier(messageMagic, addressVersion);
+      for (unsigned i = 0; i < msgs.size (); ++i)
+        res.push_back (verifier.verify (msgs[i].getAddress (),
+                                        msgs[i].getMessage (),
+                                        msgs[i].getSignature ()));
+      return res;
+    }
+
+  if (msgs.empty ())
+    return res;
+
+  std::vector<JsonRpc::Call> calls;
+  calls.reserve (msgs.size ());
+  for (unsigned i = 0; i < msgs.size (); ++i)
+    calls.push_back (Rpc::VerifyMessage (msgs[i].getAddress (),
+                                         msgs[i].getSignature (),
+                                         msgs[i].getMessage ()));
+
+  const std::vector<JsonRpc::CallResult> results = rpc.executeRpcBatch (calls);
+  for (unsigned i = 0; i < results.size (); ++i)
+    {
+      /* Invalid addresses (-3) and malformed base64 (-5) just mean
+         that the signature is not valid.  */
+      if (results[i].isError ())
+        {
+          const int code = results[i].getErrorCode ();
+          if (code != -3 && code != -5)
+            results[i].get ();
+          res.push_back (false);
+          continue;
+        }
+
+      res.push_back (Rpc::VerifyMessage::decode (results[i].get ()));
+    }
+
+  return res;
+}
+
+/**
+ * Sign many messages with the same address, using batched requests.
+ * The wallet must already be unlocked.
+ * @param addr The address to sign with.
+ * @param msgs The messages to sign.
+ * @return The signatures, in the same order as the messages.
+ * @throws NoPrivateKey if the address is not owned.
+ * @throws std::runtime_error if the address is invalid or the wallet locked.
+ */
+std::vector<std::string>
+CoinInterface::signMessages (const Address& addr,
+                             const std::vector<std::string>& msgs)
+{
+  if (!addr.isValid ())
+    throw std::runtime_error ("Can't sign with invalid address.");
+
+  std::vector<std::string> res;
+  if (msgs.empty ())
+    return res;
+
+  std::vector<JsonRpc::Call> calls;
+  calls.reserve (msgs.size ());
+  for (unsigned i = 0; i < msgs.size (); ++i)
+    calls.push_back (Rpc::SignMessage (addr.getAddress (), msgs[i]));
+
+  const std::vector<JsonRpc::CallResult> results = rpc.executeRpcBatch (calls);
+  res.reserve (results.size ());
+  for (unsigned i = 0; i < results.size (); ++i)
+    try
+      {
+        res.push_back (Rpc::SignMessage::decode (results[i].get ()));
+      }
+    catch (const JsonRpc::RpcError& exc)
+      {
+        addr.throwSignError (exc);
+      }
+
+  return res;
+}
+
+/**
+ * Sign many messages with the same address, unlocking the wallet
+ * once for all of them if necessary and locking it again afterwards.
+ * @param addr The address to sign with.
+ * @param msgs The messages to sign.
+ * @param passphrase The wallet passphrase.
+ * @return The signatures, in the same order as the messages.
+ * @throws UnlockFailure if the passphrase is wrong.
+ * @throws NoPrivateKey if the address is not owned.
+ * @throws std::runtime_error if the address is invalid.
+ */
+std::vector<std::string>
+CoinInterface::signMessages (const Address& addr,
+                             const std::vector<std::string>& msgs,
+                             const std::string& passphrase)
+{
+  WalletUnlocker unlocker(*this);
+  unlocker.unlock (passphrase);
+
+  return signMessages (addr, msgs);
 }
 
 /* ************************************************************************** */
@@ -161,11 +350,34 @@ CoinInterface::needWalletPassphrase ()
 CoinInterface::Address::Address (JsonRpc& r, const std::string& a)
   : rpc(&r), addr(a)
 {
-  const JsonRpc::JsonData res = rpc->executeRpc ("validateaddress", addr);
-  valid = res["isvalid"].asBool ();
+  setInfo (rpc->executeRpc ("validateaddress", addr));
+}
+
+/**
+ * Construct the address from the already known result of
+ * validateaddress for it.
+ * @param r The namecoin interface to use.
+ * @param a The address as string.
+ * @param info Result of validateaddress.
+ */
+CoinInterface::Address::Address (JsonRpc& r, const std::string& a,
+                                 const JsonRpc::JsonData& info)
+  : rpc(&r), addr(a)
+{
+  setInfo (info);
+}
+
+/**
+ * Set the validity and ownership flags from the result of validateaddress.
+ * @param info Result of validateaddress.
+ */
+void
+CoinInterface::Address::setInfo (const JsonRpc::JsonData& info)
+{
+  valid = info["isvalid"].asBool ();
   mine = false;
   if (valid)
-    mine = res["ismine"].asBool ();
+    mine = info["ismine"].asBool ();
 }
 
 /**
@@ -184,8 +396,7 @@ CoinInterface::Address::verifySignature (const std::string& msg,
 
   try
     {
-      JsonRpc::JsonData res = rpc->executeRpc ("verifymessage", addr, sig, msg);
-      return (res.isBool () && res.asBool ());
+      return rpc->call (Rpc::VerifyMessage (addr, sig, msg));
     }
   catch (const JsonRpc::RpcError& exc)
     {
@@ -210,32 +421,61 @@ CoinInterface::Address::signMessage (const std::string& msg) const
   if (!valid)
     throw std::runtime_error ("Can't sign with invalid address.");
 
+  std::string res;
   try
     {
-      const JsonRpc::JsonData res = rpc->executeRpc ("signmessage", addr, msg);
-      return res.asString ();
+      res = rpc->call (Rpc::SignMessage (addr, msg));
     }
   catch (const JsonRpc::RpcError& exc)
     {
-      switch (exc.getErrorCode ())
-        {
-        case -13:
-          throw std::runtime_error ("Need to unlock the wallet first.");
-
-        case -3:
-          {
-            std::ostringstream msg;
-            msg << "You don't have the private key of " << addr << " in order"
-                << " to sign messages with that address.";
-            throw NoPrivateKey (msg.str ());
-          }
-
-        default:
-          throw exc;
-        }
+      throwSignError (exc);
+    }
+
+  return res;
+}
+
+/**
+ * Translate an error of signmessage into the proper exception.
+ * This always throws, the original error if it is not handled.
+ * @param exc The error returned.
+ * @throws NoPrivateKey if this address is not owned.
+ * @throws std::runtime_error if the wallet is locked.
+ */
+void
+CoinInterface::Address::throwSignError (const JsonRpc::RpcError& exc) const
+{
+  switch (exc.getErrorCode ())
+    {
+    case -13:
+      throw std::runtime_error ("Need to unlock the wallet first.");
+
+    case -3:
+      {
+        std::ostringstream msg;
+        msg << "You don't have the private key of " << addr << " in order"
+            << " to sign messages with that address.";
+        throw NoPrivateKey (msg.str ());
+      }
+
+    default:
+      throw exc;
     }
 }
 
+/* ************************************************************************** */
+/* Asynchronous confirmations query.  */
+
+/**
+ * Wait for the query to finish and return the number of confirmations.
+ * @return Number of confirmations the transaction has.
+ * @throws JsonRpc::RpcError if the tx is not found.
+ */
+unsigned
+CoinInterface::AsyncConfirmations::getConfirmations ()
+{
+  return Rpc::GetTransaction::decode (get ()).getConfirmations ();
+}
+
 /* ************************************************************************** */
 /* Balance object.  */
 
@@ -325,8 +565,13 @@ CoinInterface::WalletUnlocker::unlock (const std::string& passphrase)
 
       try
         {
-          rpc.disableLoggingOneShot ();
-          rpc.executeRpc ("walletpassphrase", passphrase, UNLOCK_SECONDS);
+          JsonRpc::JsonData params(Json::arrayValue);
+          params.append (passphrase);
+          params.append (UNLOCK_SECONDS);
+
+          const JsonRpc::CallOptions opts = JsonRpc::CallOptions ()
+                                              .setLogging (false);
+          rpc.executeRpcArray ("walletpassphrase", params, opts);
           unlocked = true;
         }
       catch (const JsonRpc::RpcError& exc)
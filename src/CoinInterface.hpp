@@ -28,6 +28,7 @@
 #include <stdint.h>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace nmcrpc
 {
@@ -40,6 +41,9 @@ namespace nmcrpc
  * connection.  This is the part that is independent of names, just balances
  * and addresses.  It can be used for Bitcoin or other coins as well as
  * Namecoin.
+ *
+ * Like JsonRpc, objects of this class can be shared between threads.
+ * The Address objects returned are not synchronised, though.
  */
 class CoinInterface
 {
@@ -52,7 +56,9 @@ public:
 
   /* Other child classes.  */
   class Address;
+  class AsyncConfirmations;
   class Balance;
+  class SignedMessage;
   class WalletUnlocker;
 
 protected:
@@ -60,6 +66,16 @@ protected:
   /** Underlying RPC connection.  */
   JsonRpc& rpc;
 
+  /**
+   * Construct an address object from the result of a validateaddress call
+   * that has already been done.
+   * @param addr The address as string.
+   * @param info The result of validateaddress for it.
+   * @return The created address object.
+   */
+  Address addressFromInfo (const std::string& addr,
+                           const JsonRpc::JsonData& info);
+
 private:
 
   /**
@@ -68,6 +84,12 @@ private:
    */
   static const unsigned UNLOCK_SECONDS;
 
+  /** The prefix hashed together with messages when signing them.  */
+  std::string messageMagic;
+
+  /** The version byte of the coin's pay-to-pubkey-hash addresses.  */
+  unsigned char addressVersion;
+
   // Disable copying and default constructor.
 #ifndef CXX_11
   CoinInterface ();
@@ -82,7 +104,7 @@ public:
    * @param r The RPC connection.
    */
   explicit inline CoinInterface (JsonRpc& r)
-    : rpc(r)
+    : rpc(r), messageMagic("Bitcoin Signed Message:\n"), addressVersion(52)
   {
     // Nothing more to be done.
   }
@@ -137,12 +159,37 @@ public:
    */
   unsigned getNumberOfConfirmations (const std::string& txid);
 
+  /**
+   * Query for the number of confirmations of multiple transactions at once,
+   * using a single batched request.
+   * @param txids The transaction ids to check for.
+   * @return Number of confirmations for each transaction, in the same order.
+   * @throws JsonRpc::RpcError if one of the txs is not found.
+   */
+  std::vector<unsigned>
+  getNumberOfConfirmations (const std::vector<std::string>& txids);
+
+  /**
+   * Start a query for the number of confirmations asynchronously.  The
+   * result can be retrieved from the passed object once the call is done.
+   * @param txid The transaction id to check for.
+   * @param res The object receiving the result.
+   */
+  void getNumberOfConfirmationsAsync (const std::string& txid,
+                                      AsyncConfirmations& res);
+
   /**
    * Get the current wallet balance.
    * @return Current wallet balance.
    */
   Balance getBalance ();
 
+  /**
+   * Get the current number of blocks in the chain.
+   * @return The block height of the chain tip.
+   */
+  unsigned getBlockCount ();
+
   /**
    * Check whether the wallet needs to be unlocked or not.  This routine is
    * used to decide whether we need to ask for a passphrase or not before
@@ -151,6 +198,74 @@ public:
    */
   bool needWalletPassphrase ();
 
+  /**
+   * Set the prefix that the coin hashes together with signed messages.
+   * This is only needed for local verification of signatures.  The
+   * default is the one of Bitcoin, which Namecoin uses as well.  It should
+   * be set before the interface is used by other threads.
+   * @param magic The prefix.
+   */
+  inline void
+  setMessageMagic (const std::string& magic)
+  {
+    messageMagic = magic;
+  }
+
+  /**
+   * Set the version byte of the coin's addresses.  This is only needed
+   * for local verification of signatures, which rejects addresses with
+   * another version.  The default is 52, the one of Namecoin's main
+   * network (the test network uses 111).  It should be set before the
+   * interface is used by other threads.
+   * @param v The version byte.
+   */
+  inline void
+  setAddressVersion (unsigned char v)
+  {
+    addressVersion = v;
+  }
+
+  /**
+   * Check many message signatures at once.  This does not need to
+   * validate the addresses first, and either sends all verifymessage calls
+   * in batched requests or, if local is set, checks the signatures
+   * without involving the daemon at all.  Invalid addresses or malformed
+   * signatures simply fail to verify.
+   * @param msgs The signed messages to check.
+   * @param local Whether to check the signatures locally.
+   * @return For each message whether its signature is valid, in order.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  std::vector<bool> verifySignatures (const std::vector<SignedMessage>& msgs,
+                                      bool local = false);
+
+  /**
+   * Sign many messages with the same address, using batched requests.
+   * The wallet must already be unlocked.
+   * @param addr The address to sign with.
+   * @param msgs The messages to sign.
+   * @return The signatures, in the same order as the messages.
+   * @throws NoPrivateKey if the address is not owned.
+   * @throws std::runtime_error if the address is invalid or the wallet locked.
+   */
+  std::vector<std::string> signMessages (const Address& addr,
+                                         const std::vector<std::string>& msgs);
+
+  /**
+   * Sign many messages with the same address, unlocking the wallet
+   * once for all of them if necessary and locking it again afterwards.
+   * @param addr The address to sign with.
+   * @param msgs The messages to sign.
+   * @param passphrase The wallet passphrase.
+   * @return The signatures, in the same order as the messages.
+   * @throws UnlockFailure if the passphrase is wrong.
+   * @throws NoPrivateKey if the address is not owned.
+   * @throws std::runtime_error if the address is invalid.
+   */
+  std::vector<std::string> signMessages (const Address& addr,
+                                         const std::vector<std::string>& msgs,
+                                         const std::string& passphrase);
+
 };
 
 /* ************************************************************************** */
@@ -187,6 +302,30 @@ private:
    */
   Address (JsonRpc& r, const std::string& a);
 
+  /**
+   * Construct the address from the already known result of
+   * validateaddress for it.
+   * @param r The namecoin interface to use.
+   * @param a The address as string.
+   * @param info Result of validateaddress.
+   */
+  Address (JsonRpc& r, const std::string& a, const JsonRpc::JsonData& info);
+
+  /**
+   * Set the validity and ownership flags from the result of validateaddress.
+   * @param info Result of validateaddress.
+   */
+  void setInfo (const JsonRpc::JsonData& info);
+
+  /**
+   * Translate an error of signmessage into the proper exception.
+   * This always throws, the original error if it is not handled.
+   * @param exc The error returned.
+   * @throws NoPrivateKey if this address is not owned.
+   * @throws std::runtime_error if the wallet is locked.
+   */
+  void throwSignError (const JsonRpc::RpcError& exc) const;
+
 public:
 
   /**
@@ -199,10 +338,12 @@ public:
     // Nothing more to do.
   }
 
-  // Copying is ok.
+  // Copying and moving is ok.
 #ifdef CXX_11
   Address (const Address&) = default;
+  Address (Address&&) = default;
   Address& operator= (const Address&) = default;
+  Address& operator= (Address&&) = default;
 #endif /* CXX_11?  */
 
   /**
@@ -256,6 +397,120 @@ public:
 
 };
 
+/* ************************************************************************** */
+/* Signed message.  */
+
+/**
+ * A message together with its signature and the address that should
+ * have signed it, for checking many signatures at once.
+ */
+class CoinInterface::SignedMessage
+{
+
+private:
+
+  /** The address that should have signed.  */
+  std::string address;
+
+  /** The message.  */
+  std::string message;
+
+  /** The base64-encoded signature.  */
+  std::string signature;
+
+  // Disable default constructor.
+#ifndef CXX_11
+  SignedMessage ();
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it.
+   * @param a The address that should have signed.
+   * @param m The message.
+   * @param s The signature.
+   */
+  inline SignedMessage (const std::string& a, const std::string& m,
+                        const std::string& s)
+    : address(a), message(m), signature(s)
+  {
+    // Nothing else to do.
+  }
+
+  // No default constructor, copying and moving is ok.
+#ifdef CXX_11
+  SignedMessage () = delete;
+  SignedMessage (const SignedMessage&) = default;
+  SignedMessage (SignedMessage&&) = default;
+  SignedMessage& operator= (const SignedMessage&) = default;
+  SignedMessage& operator= (SignedMessage&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getAddress () const
+  {
+    return address;
+  }
+
+  inline const std::string&
+  getMessage () const
+  {
+    return message;
+  }
+
+  inline const std::string&
+  getSignature () const
+  {
+    return signature;
+  }
+
+};
+
+/* ************************************************************************** */
+/* Asynchronous confirmations query.  */
+
+/**
+ * Receive the result of an asynchronous query for the number of
+ * confirmations of a transaction.
+ */
+class CoinInterface::AsyncConfirmations : public JsonRpc::AsyncCall
+{
+
+private:
+
+  // Disable copying.
+#ifndef CXX_11
+  AsyncConfirmations (const AsyncConfirmations&);
+  AsyncConfirmations& operator= (const AsyncConfirmations&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it, not yet associated to any query.
+   */
+  inline AsyncConfirmations ()
+    : JsonRpc::AsyncCall()
+  {
+    // Nothing else to do.
+  }
+
+  // No copying.
+#ifdef CXX_11
+  AsyncConfirmations (const AsyncConfirmations&) = delete;
+  AsyncConfirmations& operator= (const AsyncConfirmations&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Wait for the query to finish and return the number of confirmations.
+   * @return Number of confirmations the transaction has.
+   * @throws JsonRpc::RpcError if the tx is not found.
+   */
+  unsigned getConfirmations ();
+
+};
+
 /* ************************************************************************** */
 /* Balance object.  */
 
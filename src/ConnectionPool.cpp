@@ -0,0 +1,383 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for ConnectionPool.hpp.  */
+
+#include "ConnectionPool.hpp"
+
+#include <cassert>
+#include <sstream>
+
+#include <unistd.h>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* A single persistent HTTP connection.  */
+
+/**
+ * Construct the connection and set up the handle for the given settings.
+ * This does not yet connect, that happens on the first request.
+ * @param settings The connection settings to use.
+ * @param transport How to reach the daemon.
+ * @throws JsonRpc::Exception if cURL initialisation fails.
+ */
+HttpConnection::HttpConnection (const RpcSettings& settings,
+                                const Transport& transport)
+  : handle(nullptr), headers(nullptr), data(), response(), sink(nullptr)
+{
+  handle = curl_easy_init ();
+  if (!handle)
+    throw JsonRpc::Exception ("Initialisation of cURL failed.");
+
+  addHeader ("Content-Type", "application/json");
+  addHeader ("Accept", "application/json");
+
+  curl_easy_setopt (handle, CURLOPT_HTTPHEADER, headers);
+  curl_easy_setopt (handle, CURLOPT_POST, 1L);
+  curl_easy_setopt (handle, CURLOPT_USERAGENT, "libnmcrpc");
+
+  curl_easy_setopt (handle, CURLOPT_TCP_KEEPALIVE, 1L);
+  curl_easy_setopt (handle, CURLOPT_TCP_NODELAY,
+                    settings.getTcpNoDelay () ? 1L : 0L);
+
+  /* We may be used from threads, so don't let cURL use signals.  */
+  curl_easy_setopt (handle, CURLOPT_NOSIGNAL, 1L);
+
+  curl_easy_setopt (handle, CURLOPT_CONNECTTIMEOUT_MS,
+                    static_cast<long> (settings.getConnectTimeout ()));
+
+  curl_easy_setopt (handle, CURLOPT_WRITEFUNCTION, &writeHandler);
+  curl_easy_setopt (handle, CURLOPT_WRITEDATA, this);
+
+  /* The destructor is not run if we throw here.  */
+  try
+    {
+      transport.configure (handle);
+    }
+  catch (...)
+    {
+      curl_easy_cleanup (handle);
+      curl_slist_free_all (headers);
+      throw;
+    }
+}
+
+/**
+ * Destroy, which closes the connection.
+ */
+HttpConnection::~HttpConnection ()
+{
+  if (handle)
+    curl_easy_cleanup (handle);
+  if (headers)
+    curl_slist_free_all (headers);
+}
+
+size_t
+HttpConnection::writeHandler (char* buf, size_t size, size_t nmemb,
+                              void* userdata)
+{
+  HttpConnection& me = *reinterpret_cast<HttpConnection*> (userdata);
+  const size_t realSize = size * nmemb;
+
+  if (me.sink)
+    return (me.sink->consume (buf, realSize) ? realSize : 0);
+
+  me.response.append (buf, realSize);
+  return realSize;
+}
+
+/**
+ * Add an HTTP header to be posted.
+ * @param header The header's name.
+ * @param value The header's value.
+ */
+void
+HttpConnection::addHeader (const std::string& header, const std::string& value)
+{
+  std::ostringstream out;
+  out << header << ": " << value;
+  headers = curl_slist_append (headers, out.str ().c_str ());
+}
+
+/**
+ * Prepare the handle for a new request with the data set before.  This is
+ * done by perform(), but must be called explicitly before the handle
+ * is added to a multi handle for asynchronous processing.
+ * @param timeout Timeout for the transfer in milliseconds, zero for none.
+ */
+void
+HttpConnection::prepare (unsigned timeout)
+{
+  assert (handle);
+
+  response.clear ();
+  curl_easy_setopt (handle, CURLOPT_TIMEOUT_MS, static_cast<long> (timeout));
+  curl_easy_setopt (handle, CURLOPT_POSTFIELDS, data.c_str ());
+  curl_easy_setopt (handle, CURLOPT_POSTFIELDSIZE,
+                    static_cast<long> (data.size ()));
+}
+
+/**
+ * Perform the request with the data set before.  Transient failures
+ * are retried as long as the policy allows, waiting in between.  If the
+ * last try gets an HTTP error, it is not thrown but must be checked
+ * from the response code.
+ * @param policy The deadline and retry policy of the call.
+ * @return True iff an existing connection was reused for it.
+ * @throws JsonRpc::Exception in case of a cURL error.
+ */
+bool
+HttpConnection::perform (RetryPolicy& policy)
+{
+  while (true)
+    {
+      prepare (policy.getRemaining ());
+      const CURLcode res = curl_easy_perform (handle);
+
+      if (!policy.shouldRetry (isTransientFailure (res)))
+        {
+          checkResult (res);
+          return wasReused ();
+        }
+
+      usleep (policy.getDelay () * 1000);
+    }
+}
+
+/**
+ * Check whether the last transfer failed in a way that makes it safe
+ * and useful to just try again.
+ * @param res cURL's result code for the transfer.
+ * @return True iff the request can be retried.
+ */
+bool
+HttpConnection::isTransientFailure (CURLcode res) const
+{
+  if (sink && getReceivedBytes () > 0)
+    return false;
+
+  switch (res)
+    {
+    case CURLE_OK:
+      break;
+
+    case CURLE_COULDNT_RESOLVE_HOST:
+    case CURLE_COULDNT_CONNECT:
+    case CURLE_OPERATION_TIMEDOUT:
+    case CURLE_GOT_NOTHING:
+    case CURLE_SEND_ERROR:
+    case CURLE_RECV_ERROR:
+      return true;
+
+    default:
+      return false;
+    }
+
+  /* 500 is used by the daemon for RPC errors.  Gateway errors and 503
+     (the daemon's work queue is full) are worth another try.  */
+  switch (getResponseCode ())
+    {
+    case 502:
+    case 503:
+    case 504:
+      return true;
+
+    default:
+      return false;
+    }
+}
+
+/**
+ * Check the result code of a finished transfer and throw if it
+ * indicates an error.
+ * @param res cURL's result code.
+ * @throws JsonRpc::Exception in case of a cURL error.
+ */
+void
+HttpConnection::checkResult (CURLcode res)
+{
+  if (res != CURLE_OK)
+    {
+      std::ostringstream msg;
+      msg << "Error in cURL: " << curl_easy_strerror (res);
+      throw JsonRpc::Exception (msg.str ());
+    }
+}
+
+/**
+ * Check whether the last transfer reused an existing connection.
+ * @return True iff no new connection had to be opened.
+ */
+bool
+HttpConnection::wasReused () const
+{
+  assert (handle);
+
+  long connects;
+  curl_easy_getinfo (handle, CURLINFO_NUM_CONNECTS, &connects);
+
+  return (connects == 0);
+}
+
+/**
+ * Fill in the timings and sizes of the last transfer.  cURL reports all
+ * times from the start of the transfer, so they are turned into the
+ * durations of the phases here.
+ * @param info Set the timings and sizes here.
+ */
+void
+HttpConnection::fillCallInfo (JsonRpc::CallInfo& info) const
+{
+  assert (handle);
+
+  double connect, start, total;
+  curl_easy_getinfo (handle, CURLINFO_CONNECT_TIME, &connect);
+  curl_easy_getinfo (handle, CURLINFO_STARTTRANSFER_TIME, &start);
+  curl_easy_getinfo (handle, CURLINFO_TOTAL_TIME, &total);
+
+  /* The start time is zero if nothing was received.  */
+  if (start < connect)
+    start = total;
+
+  info.connectTime = connect;
+  info.waitTime = start - connect;
+  info.transferTime = total - start;
+  info.sent = data.size ();
+  info.received = getReceivedBytes ();
+}
+
+/**
+ * Get the size of the last response body, even if it was streamed.
+ * @return The number of bytes received.
+ */
+size_t
+HttpConnection::getReceivedBytes () const
+{
+  assert (handle);
+
+#if LIBCURL_VERSION_NUM >= 0x073700
+  curl_off_t res;
+  curl_easy_getinfo (handle, CURLINFO_SIZE_DOWNLOAD_T, &res);
+#else /* LIBCURL_VERSION_NUM?  */
+  double res;
+  curl_easy_getinfo (handle, CURLINFO_SIZE_DOWNLOAD, &res);
+#endif /* LIBCURL_VERSION_NUM?  */
+
+  return static_cast<size_t> (res);
+}
+
+/**
+ * Get the response HTTP code.
+ * @return The response HTTP code.
+ */
+unsigned
+HttpConnection::getResponseCode () const
+{
+  assert (handle);
+
+  long res;
+  curl_easy_getinfo (handle, CURLINFO_RESPONSE_CODE, &res);
+
+  return res;
+}
+
+/* ************************************************************************** */
+/* Pool of idle connections.  */
+
+/**
+ * Destroy, closing all idle connections.  The transport may only
+ * go away after them.
+ */
+ConnectionPool::~ConnectionPool ()
+{
+#ifdef CXX_11
+  for (auto conn : idle)
+    delete conn;
+#else /* CXX_11?  */
+  for (std::vector<HttpConnection*>::iterator i = idle.begin ();
+       i != idle.end (); ++i)
+    delete *i;
+#endif /* CXX_11?  */
+
+  delete transport;
+}
+
+/**
+ * Take a connection out of the pool, creating a new one if none is idle.
+ * It must be handed back with release() when done.
+ * @return The connection to use.
+ */
+HttpConnection*
+ConnectionPool::acquire ()
+{
+  {
+    Lock lock(mutex);
+    if (!idle.empty ())
+      {
+        HttpConnection* res = idle.back ();
+        idle.pop_back ();
+        return res;
+      }
+  }
+
+  return new HttpConnection (settings, *transport);
+}
+
+/**
+ * Hand a connection back to the pool after use.
+ * @param conn The connection to return.
+ */
+void
+ConnectionPool::release (HttpConnection* conn)
+{
+  assert (conn);
+  conn->setSink (nullptr);
+
+  {
+    Lock lock(mutex);
+    if (idle.size () < settings.getMaxIdleConnections ())
+      {
+        idle.push_back (conn);
+        return;
+      }
+  }
+
+  delete conn;
+}
+
+/**
+ * Record the outcome of a performed request in the statistics.
+ * @param reused Whether an existing connection was reused.
+ */
+void
+ConnectionPool::recordCall (bool reused)
+{
+  Lock lock(mutex);
+  ++stats.calls;
+  if (reused)
+    ++stats.reused;
+  else
+    ++stats.opened;
+}
+
+} // namespace nmcrpc
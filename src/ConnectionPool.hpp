@@ -0,0 +1,455 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the persistent cURL
+   connections used by JsonRpc.  */
+
+#ifndef NMCRPC_CONNECTIONPOOL_HPP
+#define NMCRPC_CONNECTIONPOOL_HPP
+
+#include "JsonRpc.hpp"
+#include "RetryPolicy.hpp"
+#include "RpcSettings.hpp"
+#include "Thread.hpp"
+#include "Transport.hpp"
+
+#include <curl/curl.h>
+
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* A single persistent HTTP connection.  */
+
+/**
+ * Receiver for the response body, which gets it in chunks as they
+ * come in from the network instead of buffered as a whole.
+ */
+class ResponseSink
+{
+
+public:
+
+  inline ResponseSink ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~ResponseSink ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Handle the next chunk of the body.
+   * @param data Start of the chunk.
+   * @param len Length of the chunk.
+   * @return False to abort the transfer.
+   */
+  virtual bool consume (const char* data, size_t len) = 0;
+
+};
+
+/**
+ * Long-lived cURL easy handle used to POST JSON-RPC requests to the
+ * daemon.  All options that do not change between requests (URL,
+ * headers, authentication, keep-alive) are set up once on construction
+ * so that each request only needs to pass the new body.  cURL keeps
+ * the underlying connection open between requests on the same handle.
+ */
+class HttpConnection
+{
+
+private:
+
+  /** The CURL handle.  */
+  CURL* handle;
+
+  /** List of headers to send.  */
+  struct curl_slist* headers;
+
+  /** Data to be posted.  */
+  std::string data;
+
+  /** Store response body here.  */
+  std::string response;
+
+  /** If set, the response body is passed here instead of stored.  */
+  ResponseSink* sink;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  HttpConnection ();
+  HttpConnection (const HttpConnection&);
+  HttpConnection& operator= (const HttpConnection&);
+#endif /* !CXX_11  */
+
+  /**
+   * Write function for cURL.
+   * @param buf Buffer containing data.
+   * @param size Buffer size in elements.
+   * @param nmemb Size of an element in bytes.
+   * @param userdata User data, which is a pointer to the object in this case.
+   * @return Number of processed bytes.
+   */
+  static size_t writeHandler (char* buf, size_t size, size_t nmemb,
+                              void* userdata);
+
+  /**
+   * Add an HTTP header to be posted.
+   * @param header The header's name.
+   * @param value The header's value.
+   */
+  void addHeader (const std::string& header, const std::string& value);
+
+public:
+
+  /**
+   * Construct the connection and set up the handle for the given settings.
+   * This does not yet connect, that happens on the first request.
+   * @param settings The connection settings to use.
+   * @param transport How to reach the daemon.
+   * @throws JsonRpc::Exception if cURL initialisation fails.
+   */
+  HttpConnection (const RpcSettings& settings, const Transport& transport);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  HttpConnection () = delete;
+  HttpConnection (const HttpConnection&) = delete;
+  HttpConnection& operator= (const HttpConnection&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy, which closes the connection.
+   */
+  ~HttpConnection ();
+
+  /**
+   * Set the data to post.
+   * @param d The data to be posted.
+   */
+  inline void
+  setData (const std::string& d)
+  {
+    data = d;
+  }
+
+  /**
+   * Access the data to be posted, so that it can be written in place.
+   * The buffer keeps its storage between requests.
+   * @return The buffer of data to post.
+   */
+  inline std::string&
+  getData ()
+  {
+    return data;
+  }
+
+  /**
+   * Set a sink to receive the response body of the following requests,
+   * instead of storing it.
+   * @param s The sink to use, or NULL to store the body again.
+   */
+  inline void
+  setSink (ResponseSink* s)
+  {
+    sink = s;
+  }
+
+  /**
+   * Prepare the handle for a new request with the data set before.  This is
+   * done by perform(), but must be called explicitly before the handle
+   * is added to a multi handle for asynchronous processing.
+   * @param timeout Timeout for the transfer in milliseconds, zero for none.
+   */
+  void prepare (unsigned timeout);
+
+  /**
+   * Perform the request with the data set before.  Transient failures
+   * are retried as long as the policy allows, waiting in between.  If the
+   * last try gets an HTTP error, it is not thrown but must be checked
+   * from the response code.
+   * @param policy The deadline and retry policy of the call.
+   * @return True iff an existing connection was reused for it.
+   * @throws JsonRpc::Exception in case of a cURL error.
+   */
+  bool perform (RetryPolicy& policy);
+
+  /**
+   * Check whether the last transfer failed in a way that makes it safe
+   * and useful to just try again.  This is the case if the daemon could
+   * not be reached or did not answer anything, or if it refused the
+   * call because it is overloaded.  If part of the response was passed
+   * to a sink already, it is never the case.
+   * @param res cURL's result code for the transfer.
+   * @return True iff the request can be retried.
+   */
+  bool isTransientFailure (CURLcode res) const;
+
+  /**
+   * Check the result code of a finished transfer and throw if it
+   * indicates an error.
+   * @param res cURL's result code.
+   * @throws JsonRpc::Exception in case of a cURL error.
+   */
+  static void checkResult (CURLcode res);
+
+  /**
+   * Check whether the last transfer reused an existing connection.
+   * @return True iff no new connection had to be opened.
+   */
+  bool wasReused () const;
+
+  /**
+   * Fill in the timings and sizes of the last transfer.
+   * @param info Set the timings and sizes here.
+   */
+  void fillCallInfo (JsonRpc::CallInfo& info) const;
+
+  /**
+   * Get the size of the last response body, even if it was streamed.
+   * @return The number of bytes received.
+   */
+  size_t getReceivedBytes () const;
+
+  /**
+   * Get the underlying cURL handle.
+   * @return The easy handle.
+   */
+  inline CURL*
+  getHandle () const
+  {
+    return handle;
+  }
+
+  /**
+   * Return the response body text after performing the request.
+   * @return The response body text.
+   */
+  inline const std::string&
+  getResponseBody () const
+  {
+    return response;
+  }
+
+  /**
+   * Move the response body to the given string, without copying it.
+   * @param out Receives the response body.
+   */
+  inline void
+  takeResponseBody (std::string& out)
+  {
+    out.clear ();
+    out.swap (response);
+  }
+
+  /**
+   * Get the response HTTP code.
+   * @return The response HTTP code.
+   */
+  unsigned getResponseCode () const;
+
+};
+
+/* ************************************************************************** */
+/* Pool of idle connections.  */
+
+/**
+ * Keep a number of idle HttpConnection objects around so that they can
+ * be reused for later calls instead of connecting anew each time.
+ */
+class ConnectionPool
+{
+
+private:
+
+  /** Settings used for newly created connections.  */
+  const RpcSettings& settings;
+
+  /** The daemon connected to.  */
+  const RpcEndpoint endpoint;
+
+  /** How new connections reach the daemon.  */
+  Transport* transport;
+
+  /** Currently idle connections.  */
+  std::vector<HttpConnection*> idle;
+
+  /** Statistics about connection use.  */
+  JsonRpc::ConnectionStats stats;
+
+  /** Lock for idle list and statistics, since calls may come from threads.  */
+  mutable Mutex mutex;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  ConnectionPool ();
+  ConnectionPool (const ConnectionPool&);
+  ConnectionPool& operator= (const ConnectionPool&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct an empty pool.
+   * @param s Settings for the connections.  Must outlive the pool.
+   * @param e The daemon to connect to.
+   */
+  inline ConnectionPool (const RpcSettings& s, const RpcEndpoint& e)
+    : settings(s), endpoint(e), transport(Transport::create (s, e)),
+      idle(), stats(), mutex()
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  ConnectionPool () = delete;
+  ConnectionPool (const ConnectionPool&) = delete;
+  ConnectionPool& operator= (const ConnectionPool&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy, closing all idle connections.
+   */
+  ~ConnectionPool ();
+
+  /**
+   * Take a connection out of the pool, creating a new one if none is idle.
+   * It must be handed back with release() when done.
+   * @return The connection to use.
+   */
+  HttpConnection* acquire ();
+
+  /**
+   * Hand a connection back to the pool after use.
+   * @param conn The connection to return.
+   */
+  void release (HttpConnection* conn);
+
+  /**
+   * Record the outcome of a performed request in the statistics.
+   * @param reused Whether an existing connection was reused.
+   */
+  void recordCall (bool reused);
+
+  /**
+   * Get a snapshot of the current statistics.
+   * @return The statistics.
+   */
+  inline JsonRpc::ConnectionStats
+  getStats () const
+  {
+    Lock lock(mutex);
+    return stats;
+  }
+
+  /**
+   * Get the daemon this pool connects to.
+   * @return The endpoint of the daemon.
+   */
+  inline const RpcEndpoint&
+  getEndpoint () const
+  {
+    return endpoint;
+  }
+
+};
+
+/**
+ * RAII helper to acquire a connection from a pool and release it again
+ * when going out of scope, also in case of exceptions.
+ */
+class PooledConnection
+{
+
+private:
+
+  /** The pool this belongs to.  */
+  ConnectionPool& pool;
+
+  /** The connection held.  */
+  HttpConnection* conn;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  PooledConnection ();
+  PooledConnection (const PooledConnection&);
+  PooledConnection& operator= (const PooledConnection&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Acquire a connection from the given pool.
+   * @param p The pool to use.
+   */
+  explicit inline PooledConnection (ConnectionPool& p)
+    : pool(p), conn(p.acquire ())
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  PooledConnection () = delete;
+  PooledConnection (const PooledConnection&) = delete;
+  PooledConnection& operator= (const PooledConnection&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Release the connection back to the pool.
+   */
+  inline ~PooledConnection ()
+  {
+    pool.release (conn);
+  }
+
+  /**
+   * Get the pool the connection belongs to.
+   * @return The pool.
+   */
+  inline ConnectionPool&
+  getPool () const
+  {
+    return pool;
+  }
+
+  inline HttpConnection&
+  operator* () const
+  {
+    return *conn;
+  }
+
+  inline HttpConnection*
+  operator-> () const
+  {
+    return conn;
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -22,11 +22,12 @@
 
 #include "IdnTool.hpp"
 
-#include "NameInterface.hpp"
-
 #include <idna.h>
 #include <stringprep.h>
 
+#include <pthread.h>
+#include <strings.h>
+
 #include <cassert>
 #include <clocale>
 #include <cstdlib>
@@ -37,27 +38,123 @@
 namespace nmcrpc
 {
 
+/** Ensure the locale is set up only once.  */
+static pthread_once_t localeOnce = PTHREAD_ONCE_INIT;
+
+/** The ACE prefix of encoded labels.  */
+static const char* const ACE_PREFIX = "xn--";
+
+/** Maximum length of a label allowed by ToASCII.  */
+static const size_t MAX_LABEL_LENGTH = 63;
+
 /**
  * Default constructor.  Allow to specify whether or not to handle
  * namespaces, default is true.
  * Also call setlocale() to properly set up the locale settings
- * from the environment.
+ * from the environment, the first time an IdnTool is created.
  * @param ns Handle namespaces for codings?
  */
 IdnTool::IdnTool (bool ns)
   : handleNS(ns)
+{
+  pthread_once (&localeOnce, &initLocale);
+}
+
+/**
+ * Set up the locale from the environment, done once per process.
+ */
+void
+IdnTool::initLocale ()
 {
   std::setlocale (LC_ALL, "");
 }
 
 /**
- * Decode IDN to native locale string.  This routine handles the full string
- * and does not split off a namespace prefix.
+ * Check whether decoding would leave a string unchanged, which is
+ * the case if it is ASCII and has no label with the ACE prefix.
+ * @param in The string to check.
+ * @param start Check it from this position on.
+ * @return True iff libidn can be skipped.
+ */
+bool
+IdnTool::isPlainForDecode (const std::string& in, size_t start)
+{
+  const size_t prefixLen = std::strlen (ACE_PREFIX);
+
+  bool labelStart = true;
+  for (size_t i = start; i < in.size (); ++i)
+    {
+      const unsigned char c = in[i];
+      if (c >= 0x80)
+        return false;
+
+      if (labelStart && in.size () - i >= prefixLen
+          && strncasecmp (in.c_str () + i, ACE_PREFIX, prefixLen) == 0)
+        return false;
+      labelStart = (c == '.');
+    }
+
+  return true;
+}
+
+/**
+ * Check whether encoding would leave a string unchanged, which is
+ * the case if it is ASCII and all labels have valid lengths.
+ * @param in The string to check.
+ * @param start Check it from this position on.
+ * @return True iff libidn can be skipped.
+ */
+bool
+IdnTool::isPlainForEncode (const std::string& in, size_t start)
+{
+  size_t labelLen = 0;
+  for (size_t i = start; i < in.size (); ++i)
+    {
+      const unsigned char c = in[i];
+      if (c >= 0x80)
+        return false;
+
+      if (c != '.')
+        {
+          ++labelLen;
+          continue;
+        }
+
+      if (labelLen == 0 || labelLen > MAX_LABEL_LENGTH)
+        return false;
+      labelLen = 0;
+    }
+
+  return labelLen > 0 && labelLen <= MAX_LABEL_LENGTH;
+}
+
+/**
+ * Find where the part to convert starts, after a namespace prefix
+ * if those are handled.
+ * @param in The full string.
+ * @return Position of the first character to convert.
+ */
+size_t
+IdnTool::getConvertStart (const std::string& in) const
+{
+  if (!handleNS)
+    return 0;
+
+  const std::string::size_type pos = in.find ('/');
+  if (pos == std::string::npos)
+    return 0;
+
+  return pos + 1;
+}
+
+/**
+ * Decode IDN to native locale string and append it to out.  This routine
+ * handles the full string and does not split off a namespace prefix.
  * @param in Input string, encoded as IDN.
- * @return Decoded output string.
+ * @param out Append the decoded string here.
  */
-std::string
-IdnTool::decodeFull (const std::string& in) const
+void
+IdnTool::decodeFull (const std::string& in, std::string& out)
 {
   char* buf = nullptr;
 
@@ -74,20 +171,18 @@ IdnTool::decodeFull (const std::string& in) const
     }
   assert (buf);
 
-  const std::string res(buf);
+  out.append (buf);
   std::free (buf);
-
-  return res;
 }
 
 /**
- * Encode a native string to IDN.  Handle the full string and do not split
- * off a namespace prefix.
+ * Encode a native string to IDN and append it to out.  Handle the full
+ * string and do not split off a namespace prefix.
  * @param in Input string in native locale encoding.
- * @return IDN encoded output string.
+ * @param out Append the encoded string here.
  */
-std::string
-IdnTool::encodeFull (const std::string& in) const
+void
+IdnTool::encodeFull (const std::string& in, std::string& out)
 {
   char* buf = nullptr;
 
@@ -104,58 +199,58 @@ IdnTool::encodeFull (const std::string& in) const
     }
   assert (buf);
 
-  const std::string res(buf);
+  out.append (buf);
   std::free (buf);
-
-  return res;
 }
 
 /**
- * Decode IDN string to local encoding.  According to handleNS setting,
- * possibly split off a namespace before coding.
+ * Decode IDN string to local encoding into the given string, reusing
+ * its buffer.  According to handleNS setting, possibly split off a
+ * namespace before coding.
  * @param in Input string in IDN encoding.
- * @return Decoded string in local encoding.
+ * @param out Set to the decoded string in local encoding.
+ *            It may be the same string as in.
  */
-std::string
-IdnTool::decode (const std::string& in) const
+void
+IdnTool::decode (const std::string& in, std::string& out) const
 {
-  if (!handleNS)
-    return decodeFull (in);
-
-  std::string ns, trimmed;
-  const bool hasNS = NameInterface::Name::split (in, ns, trimmed);
-  if (!hasNS)
-    return decodeFull (in);
-
-  trimmed = decodeFull (trimmed);
-  std::ostringstream buf;
-  buf << ns << '/' << trimmed;
+  const size_t start = getConvertStart (in);
+  if (isPlainForDecode (in, start))
+    {
+      out.assign (in);
+      return;
+    }
 
-  return buf.str ();
+  /* Take the part to convert first, since in and out may be the
+     same string.  */
+  const std::string rest = in.substr (start);
+  out.assign (in, 0, start);
+  decodeFull (rest, out);
 }
 
 /**
- * Encode string in local encoding to IDN.  According to handleNS setting,
- * possibly split off a namespace before coding.
+ * Encode string in local encoding to IDN into the given string, reusing
+ * its buffer.  According to handleNS setting, possibly split off a
+ * namespace before coding.
  * @param in Input string in local encoding.
- * @return IDN encoded string.
+ * @param out Set to the IDN encoded string.
+ *            It may be the same string as in.
  */
-std::string
-IdnTool::encode (const std::string& in) const
+void
+IdnTool::encode (const std::string& in, std::string& out) const
 {
-  if (!handleNS)
-    return encodeFull (in);
-
-  std::string ns, trimmed;
-  const bool hasNS = NameInterface::Name::split (in, ns, trimmed);
-  if (!hasNS)
-    return encodeFull (in);
-
-  trimmed = encodeFull (trimmed);
-  std::ostringstream buf;
-  buf << ns << '/' << trimmed;
+  const size_t start = getConvertStart (in);
+  if (isPlainForEncode (in, start))
+    {
+      out.assign (in);
+      return;
+    }
 
-  return buf.str ();
+  /* Take the part to convert first, since in and out may be the
+     same string.  */
+  const std::string rest = in.substr (start);
+  out.assign (in, 0, start);
+  encodeFull (rest, out);
 }
 
 } // namespace nmcrpc
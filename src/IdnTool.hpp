@@ -23,12 +23,15 @@
 
 #include <cstddef>
 #include <string>
+#include <vector>
 
 namespace nmcrpc
 {
 
 /**
- * Class with basic IDN encoding and decoding capabilities.
+ * Class with basic IDN encoding and decoding capabilities.  Labels that
+ * libidn would not change anyway (pure ASCII without an "xn--" prefix)
+ * are passed through without calling it, which is the case for most names.
  */
 class IdnTool
 {
@@ -39,20 +42,51 @@ private:
   bool handleNS;
 
   /**
-   * Decode IDN to native locale string.  This routine handles the full string
-   * and does not split off a namespace prefix.
+   * Set up the locale from the environment, done once per process.
+   */
+  static void initLocale ();
+
+  /**
+   * Check whether decoding would leave a string unchanged, which is
+   * the case if it is ASCII and has no label with the ACE prefix.
+   * @param in The string to check.
+   * @param start Check it from this position on.
+   * @return True iff libidn can be skipped.
+   */
+  static bool isPlainForDecode (const std::string& in, size_t start);
+
+  /**
+   * Check whether encoding would leave a string unchanged, which is
+   * the case if it is ASCII and all labels have valid lengths.
+   * @param in The string to check.
+   * @param start Check it from this position on.
+   * @return True iff libidn can be skipped.
+   */
+  static bool isPlainForEncode (const std::string& in, size_t start);
+
+  /**
+   * Find where the part to convert starts, after a namespace prefix
+   * if those are handled.
+   * @param in The full string.
+   * @return Position of the first character to convert.
+   */
+  size_t getConvertStart (const std::string& in) const;
+
+  /**
+   * Decode IDN to native locale string and append it to out.  This routine
+   * handles the full string and does not split off a namespace prefix.
    * @param in Input string, encoded as IDN.
-   * @return Decoded output string.
+   * @param out Append the decoded string here.
    */
-  std::string decodeFull (const std::string& in) const;
+  static void decodeFull (const std::string& in, std::string& out);
 
   /**
-   * Encode a native string to IDN.  Handle the full string and do not split
-   * off a namespace prefix.
+   * Encode a native string to IDN and append it to out.  Handle the full
+   * string and do not split off a namespace prefix.
    * @param in Input string in native locale encoding.
-   * @return IDN encoded output string.
+   * @param out Append the encoded string here.
    */
-  std::string encodeFull (const std::string& in) const;
+  static void encodeFull (const std::string& in, std::string& out);
 
 public:
 
@@ -88,7 +122,13 @@ public:
    * @param in Input string in IDN encoding.
    * @return Decoded string in local encoding.
    */
-  std::string decode (const std::string& in) const;
+  inline std::string
+  decode (const std::string& in) const
+  {
+    std::string res;
+    decode (in, res);
+    return res;
+  }
 
   /**
    * Encode string in local encoding to IDN.  According to handleNS setting,
@@ -96,10 +136,57 @@ public:
    * @param in Input string in local encoding.
    * @return IDN encoded string.
    */
-  std::string encode (const std::string& in) const;
+  inline std::string
+  encode (const std::string& in) const
+  {
+    std::string res;
+    encode (in, res);
+    return res;
+  }
+
+  /**
+   * Decode IDN string to local encoding into the given string, reusing
+   * its buffer.  According to handleNS setting, possibly split off a
+   * namespace before coding.
+   * @param in Input string in IDN encoding.
+   * @param out Set to the decoded string in local encoding.
+   *            It may be the same string as in.
+   */
+  void decode (const std::string& in, std::string& out) const;
+
+  /**
+   * Encode string in local encoding to IDN into the given string, reusing
+   * its buffer.  According to handleNS setting, possibly split off a
+   * namespace before coding.
+   * @param in Input string in local encoding.
+   * @param out Set to the IDN encoded string.
+   *            It may be the same string as in.
+   */
+  void encode (const std::string& in, std::string& out) const;
+
+  /**
+   * Decode a whole list of strings.  The output list is resized to match,
+   * and the buffers of strings already in it are reused.
+   * @param in Iterable list of strings in IDN encoding.
+   * @param out Set to the decoded strings, in the same order.
+   */
+  template<typename L>
+    void decodeAll (const L& in, std::vector<std::string>& out) const;
+
+  /**
+   * Encode a whole list of strings.  The output list is resized to match,
+   * and the buffers of strings already in it are reused.
+   * @param in Iterable list of strings in local encoding.
+   * @param out Set to the encoded strings, in the same order.
+   */
+  template<typename L>
+    void encodeAll (const L& in, std::vector<std::string>& out) const;
 
 };
 
+/* Include template implementations.  */
+#include "IdnTool.tpp"
+
 } // namespace nmcrpc
 
 #endif /* Header guard.  */
@@ -0,0 +1,53 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Template implementation for IdnTool.hpp.  */
+
+/**
+ * Decode a whole list of strings.  The output list is resized to match,
+ * and the buffers of strings already in it are reused.
+ * @param in Iterable list of strings in IDN encoding.
+ * @param out Set to the decoded strings, in the same order.
+ */
+template<typename L>
+  void
+  IdnTool::decodeAll (const L& in, std::vector<std::string>& out) const
+{
+  out.resize (in.size ());
+  std::vector<std::string>::iterator o = out.begin ();
+  for (typename L::const_iterator i = in.begin (); i != in.end (); ++i, ++o)
+    decode (*i, *o);
+}
+
+/**
+ * Encode a whole list of strings.  The output list is resized to match,
+ * and the buffers of strings already in it are reused.
+ * @param in Iterable list of strings in local encoding.
+ * @param out Set to the encoded strings, in the same order.
+ */
+template<typename L>
+  void
+  IdnTool::encodeAll (const L& in, std::vector<std::string>& out) const
+{
+  out.resize (in.size ());
+  std::vector<std::string>::iterator o = out.begin ();
+  for (typename L::const_iterator i = in.begin (); i != in.end (); ++i, ++o)
+    encode (*i, *o);
+}
@@ -22,259 +22,185 @@
 
 #include "JsonRpc.hpp"
 
-#include <json/reader.h>
-#include <json/writer.h>
+#include "AsyncEngine.hpp"
+#include "Balancer.hpp"
+#include "CallLogger.hpp"
+#include "ConnectionPool.hpp"
+#include "JsonTape.hpp"
+#include "JsonWriter.hpp"
+#include "Metrics.hpp"
+#include "ResponseSplitter.hpp"
+#include "RetryPolicy.hpp"
+#include "Thread.hpp"
 
-#include <curl/curl.h>
+#include <json/reader.h>
 
+#include <algorithm>
 #include <cassert>
-#include <clocale>
 #include <cstdlib>
-#include <fstream>
 #include <sstream>
 
+#include <pthread.h>
+
 namespace nmcrpc
 {
 
 /* ************************************************************************** */
-/* Internal cURL wrapper.  */
+/* Global state.  */
+
+/** Ensure cURL's global initialisation is done only once.  */
+static pthread_once_t curlInitOnce = PTHREAD_ONCE_INIT;
 
 /**
- * This class is a quick utility wrapper around cURL to perform the POST
- * HTTP requests we need.
+ * Perform cURL's global initialisation.  This is not thread-safe
+ * in cURL itself, so we do it explicitly and only once.
  */
-class CurlPost
+static void
+initCurl ()
 {
+  curl_global_init (CURL_GLOBAL_ALL);
+}
 
-private:
-
-  /** The CURL handle.  */
-  CURL* handle;
+/* ************************************************************************** */
+/* The JsonRpc class itself.  */
 
-  /** List of headers to send.  */
-  struct curl_slist* headers;
+/** Time to wait for network activity in each round of waiting loops.  */
+const int JsonRpc::ASYNC_WAIT_MS = 100;
 
-  /** Data to be posted.  */
-  std::string data;
-  
-  /** Store response body here.  */
-  std::string response;
+/**
+ * Construct for the given connection data.
+ * @param s Settings to use for the connection.  They are copied.
+ */
+JsonRpc::JsonRpc (const RpcSettings& s)
+  : settings(s), nodes(nullptr), async(nullptr), metrics(nullptr),
+    nextId(0), dontLogNextCall(false)
+{
+  pthread_once (&curlInitOnce, &initCurl);
 
-  // Disable copying.
-#ifndef CXX_11
-  CurlPost (const CurlPost& o);
-  CurlPost& operator= (const CurlPost& o);
-#endif /* !CXX_11  */
+  nodes = new Balancer (settings);
+  async = new AsyncEngine (settings);
+  metrics = new Metrics ();
+}
 
-  /**
-   * Write function for cURL.
-   * @param buf Buffer containing data.
-   * @param size Buffer size in elements.
-   * @param nmemb Size of an element in bytes.
-   * @param userdata User data, which is a pointer to the object in this case.
-   * @return Number of processed bytes.
-   */
-  static size_t writeHandler (char* buf, size_t size, size_t nmemb,
-                              void* userdata);
-
-public:
-
-  /**
-   * Construct it, which will not yet intialise the handle.
-   */
-  inline CurlPost ()
-    : handle(nullptr), headers(nullptr), data("")
-  {
-    // Nothing else to do.
-  }
-
-  // No copying.
-#ifdef CXX_11
-  CurlPost (const CurlPost& o) = delete;
-  CurlPost& operator= (const CurlPost& o) = delete;
-#endif /* CXX_11?  */
+/**
+ * Destroy, closing all open connections.
+ */
+JsonRpc::~JsonRpc ()
+{
+  delete async;
+  delete nodes;
+  delete metrics;
+}
 
-  /**
-   * Destory, which cleans up the cURL connection.
-   */
-  ~CurlPost ();
-
-  /**
-   * Initialise the cURL handle.
-   * @throws JsonRpc::Exception in case this fails.
-   */
-  void init ();
-
-  /**
-   * Add an HTTP header to be posted.
-   * @param header The header's name.
-   * @param value The header's value.
-   */
-  void addHeader (const std::string& header, const std::string& value);
-
-  /**
-   * Set the data to post.
-   * @param d The data to be posted.
-   */
-  inline void
-  setData (const std::string& d)
-  {
-    data = d;
-  }
-
-  /**
-   * Perform the request and return the response body text.
-   * @param host The host to connect to.
-   * @param port The port to connect to.
-   * @param user The username to use.
-   * @param password The password to use.
-   */
-  void perform (const std::string& host, unsigned port,
-                const std::string& user, const std::string& password);
-
-  /**
-   * Return the response body text after performing the request.
-   * @return The response body text.
-   */
-  const std::string& getResponseBody () const
-  {
-    return response;
-  }
-
-  /**
-   * Get the response HTTP code.
-   * @return The response HTTP code.
-   */
-  unsigned getResponseCode () const;
-
-};
-
-CurlPost::~CurlPost ()
-{
-  if (headers)
-    curl_slist_free_all (headers);
-  if (handle)
-    curl_easy_cleanup (handle);
-}
-
-size_t
-CurlPost::writeHandler (char* buf, size_t size, size_t nmemb,
-                        void* userdata)
-{
-  CurlPost& me = *reinterpret_cast<CurlPost*> (userdata);
-  const size_t realSize = size * nmemb;
-
-  me.response.append (buf, realSize);
-  return realSize;
+/**
+ * Get statistics about how often connections to the daemon were
+ * reused and how often new ones had to be opened.
+ * @return The connection statistics.
+ */
+JsonRpc::ConnectionStats
+JsonRpc::getConnectionStats () const
+{
+  return nodes->getStats ();
 }
 
-void
-CurlPost::init ()
+/**
+ * Get a snapshot of the per-method statistics.
+ * @return The statistics of all methods called so far.
+ */
+JsonRpc::MethodStatsMap
+JsonRpc::getMethodStats () const
 {
-  assert (!handle);
-  handle = curl_easy_init ();
-  if (!handle)
-    throw JsonRpc::Exception ("Initialisation of cURL failed.");
+  return metrics->getStats ();
 }
-  
+
+/**
+ * Reset all per-method statistics.
+ */
 void
-CurlPost::addHeader (const std::string& header, const std::string& value)
+JsonRpc::resetMethodStats ()
 {
-  assert (handle);
-
-  std::ostringstream out;
-  out << header << ": " << value;
-  headers = curl_slist_append (headers, out.str ().c_str ());
+  metrics->reset ();
 }
 
+/**
+ * Set an observer that is notified about each finished HTTP request.
+ * @param obs The observer to use, or NULL to remove it.
+ */
 void
-CurlPost::perform (const std::string& host, unsigned port,
-                   const std::string& user, const std::string& password)
+JsonRpc::setObserver (Observer* obs)
 {
-  assert (handle);
-
-  curl_easy_setopt (handle, CURLOPT_HTTPHEADER, headers);
-  curl_easy_setopt (handle, CURLOPT_POST, 1);
-  curl_easy_setopt (handle, CURLOPT_POSTFIELDS, data.c_str ());
-  curl_easy_setopt (handle, CURLOPT_USERAGENT, "libnmcrpc");
-  curl_easy_setopt (handle, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
-
-  std::ostringstream url;
-  url << "http://" << user << ":" << password << "@" << host << ":" << port;
-  curl_easy_setopt (handle, CURLOPT_URL, url.str ().c_str ());
-
-  curl_easy_setopt (handle, CURLOPT_WRITEFUNCTION, &writeHandler);
-  curl_easy_setopt (handle, CURLOPT_WRITEDATA, this);
-
-  const CURLcode res = curl_easy_perform (handle);
-  if (res != CURLE_OK)
-    {
-      std::ostringstream msg;
-      msg << "Error in cURL: " << curl_easy_strerror (res);
-      throw JsonRpc::Exception (msg.str ());
-    }
+  metrics->setObserver (obs);
 }
 
+/**
+ * Allocate a range of consecutive JSON-RPC ids.  This is atomic, so that
+ * multiple threads get distinct ids.
+ * @param n Number of ids to allocate.
+ * @return The first allocated id.
+ */
 unsigned
-CurlPost::getResponseCode () const
+JsonRpc::allocateIds (unsigned n)
 {
-  assert (handle);
-
-  long res;
-  curl_easy_getinfo (handle, CURLINFO_RESPONSE_CODE, &res);
-
-  return res;
+  return __sync_fetch_and_add (&nextId, n);
 }
 
-/* ************************************************************************** */
-/* The JsonRpc class itself.  */
-
-/** Environment variable name for controlling the call log file.  */
-const std::string JsonRpc::LOGFILE_VAR = "LIBNMCRPC_LOGFILE_RPCCALLS";
-
 /**
- * Perform a HTTP query with JSON data.  However, this routine does not
- * know/care about JSON, it just sends the raw string and returns the
- * response body as string or throws if an error or an unaccepted
- * HTTP response code is detected.
- * @param query Query string to send.
- * @param responseCode Set to the HTTP response code.
- * @return The response body.
- * @throws Exception if some error occurs.
+ * Decide whether the next call should be logged.  This consumes the
+ * one-shot flag set by disableLoggingOneShot.
+ * @param opts The options passed for the call.
+ * @return True iff the call should be logged.
  */
-std::string
-JsonRpc::queryHttp (const std::string& query, unsigned& responseCode)
+bool
+JsonRpc::shouldLog (const CallOptions& opts)
 {
-  CurlPost poster;
-  poster.init ();
-
-  poster.setData (query);
-  poster.addHeader ("Content-Type", "application/json");
-  poster.addHeader ("Accept", "application/json");
-
-  poster.perform (settings.getHost (), settings.getPort (),
-                  settings.getUsername (), settings.getPassword ());
-
-  responseCode = poster.getResponseCode ();
-  return poster.getResponseBody ();
+  const bool oneShot = __sync_bool_compare_and_swap (&dontLogNextCall,
+                                                     true, false);
+  return opts.isLogging () && !oneShot && CallLogger::get ();
 }
 
 /**
  * If logging of RPC calls is enabled (environment variable
- * LIBNMCRPC_LOGFILE_RPCCALLS), write the given string to the
+ * LIBNMCRPC_LOGFILE_RPCCALLS), queue the given string for the
  * log file.
  * @param str String to log.
  */
 void
 JsonRpc::logRpcCall (const std::string& str)
 {
-  const char* file = std::getenv (LOGFILE_VAR.c_str ());
-  if (!file)
-    return;
+  CallLogger* log = CallLogger::get ();
+  if (log)
+    log->write (str);
+}
+
+/**
+ * Log the response to a call together with a record about it.
+ * Call logging must be enabled.
+ * @param response The response body, or a placeholder if it was streamed.
+ * @param info Timings and sizes of the call.
+ */
+void
+JsonRpc::logResponse (const std::string& response, const CallInfo& info)
+{
+  CallLogger* log = CallLogger::get ();
+  assert (log);
 
-  std::ofstream out(file, std::ios::app);
-  out << str;
-  out.close ();
+  const double seconds = info.connectTime + info.waitTime
+                          + info.transferTime;
+
+  log->write ("  -> " + response + "\n");
+  log->writeRecord (info.method, info.id, seconds, info.sent, info.received);
+}
+
+/**
+ * Wait until all queued records of the call log have been written
+ * to the log file.  This does nothing if call logging is disabled.
+ */
+void
+JsonRpc::flushCallLog ()
+{
+  CallLogger* log = CallLogger::get ();
+  if (log)
+    log->flush ();
 }
 
 /**
@@ -286,8 +212,28 @@ JsonRpc::logRpcCall (const std::string& str)
 JsonRpc::JsonData
 JsonRpc::decodeJson (const std::string& str)
 {
-  std::istringstream in(str);
-  return readJson (in);
+  const char* begin = str.data ();
+  return decodeJson (begin, begin + str.size ());
+}
+
+/**
+ * Decode JSON from a character range, without copying it first.
+ * @param begin Start of the JSON text.
+ * @param end One past the end of the JSON text.
+ * @returns The parsed JSON data.
+ * @throws JsonParseError in case of parsing errors.
+ */
+JsonRpc::JsonData
+JsonRpc::decodeJson (const char* begin, const char* end)
+{
+  Json::Reader parser;
+  Json::Value root;
+
+  const bool success = parser.parse (begin, end, root, false);
+  if (!success)
+    throw JsonParseError ("Error decoding the JSON value.");
+
+  return root;
 }
 
 /**
@@ -310,29 +256,133 @@ JsonRpc::readJson (std::istream& in)
 }
 
 /**
- * Encode JSON to a string.
+ * Encode JSON to a string.  Like jsoncpp's FastWriter, a newline
+ * is added at the end.
  * @param data The JSON data.
  * @return The encoded JSON as string.
  */
 std::string
 JsonRpc::encodeJson (const JsonData& data)
 {
-  /* Work around a locale problem with outputting decimal numbers.
-     We always want '.' to be the decimal separator.
-     See http://sourceforge.net/p/jsoncpp/bugs/43/.  */
-#ifndef WIN32
-  const char* oldLocale = std::setlocale (LC_NUMERIC, nullptr);
-  std::setlocale (LC_NUMERIC, "C");
-#endif /* !WIN32  */
+  /* jsoncpp's writers format decimal numbers according to the global
+     locale (see http://sourceforge.net/p/jsoncpp/bugs/43/), and switching
+     it temporarily is not thread-safe.  Thus use our own encoder.  */
+  std::string res;
+  JsonWriter::write (data, res);
+  res += '\n';
+
+  return res;
+}
+
+/**
+ * Write the log line for a call that is about to be sent.
+ * @param method The method name called.
+ * @param params The parameters passed.
+ */
+void
+JsonRpc::logCall (const std::string& method, const JsonData& params)
+{
+  std::string msg = "namecoind " + method;
+  for (Json::Value::const_iterator i = params.begin ();
+       i != params.end (); ++i)
+    {
+      msg += ' ';
+      JsonWriter::write (*i, msg);
+    }
+  msg += '\n';
+  logRpcCall (msg);
+}
 
-  Json::FastWriter writer;
-  const std::string res = writer.write (data);
+/**
+ * Encode and log the request object for a call.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param logging Whether to log the call.
+ * @param id Set to the JSON-RPC id used.
+ * @param out Buffer that is set to the encoded request.
+ */
+void
+JsonRpc::prepareCall (const std::string& method, const JsonData& params,
+                      bool logging, int& id, std::string& out)
+{
+  id = allocateIds (1);
 
-#ifndef WIN32
-  std::setlocale (LC_NUMERIC, oldLocale);
-#endif /* !WIN32  */
+  out.clear ();
+  JsonWriter::writeRequest (method, params, id, out);
 
-  return res;
+  if (logging)
+    logCall (method, params);
+  else
+    logRpcCall ("<logging disabled for one RPC call>\n\n");
+}
+
+/**
+ * Send an encoded JSON-RPC request (single or batch) and parse the
+ * response onto a tape.  This checks the HTTP response code, but not yet
+ * the JSON-RPC id or error fields.
+ * @param conn The connection, with the encoded request set as its data.
+ * @param logging Whether to log the response.
+ * @param policy Deadline and retry policy for the request.
+ * @param info Fill in timings and sizes here.
+ * @param tape Parse the response onto this tape.
+ * @throws Exception in case of error.
+ */
+void
+JsonRpc::queryTape (RoutedConnection& conn, bool logging, RetryPolicy& policy,
+                    CallInfo& info, JsonTape& tape)
+{
+  const bool reused = conn->perform (policy);
+  conn.getPool ().recordCall (reused);
+
+  conn->fillCallInfo (info);
+  if (logging)
+    logResponse (conn->getResponseBody (), info);
+
+  const double start = Metrics::now ();
+  checkResponseCode (conn->getResponseCode ());
+
+  /* Move the body onto the tape instead of copying it.  */
+  std::string body;
+  conn->takeResponseBody (body);
+  tape.swapAndParse (body);
+  info.parseTime = Metrics::now () - start;
+}
+
+/**
+ * Decode a received response body after checking the HTTP response code.
+ * @param responseStr The response body.
+ * @param respCode The HTTP response code.
+ * @return The decoded response.
+ * @throws Exception in case of error.
+ */
+JsonRpc::JsonData
+JsonRpc::decodeResponse (const std::string& responseStr, unsigned respCode)
+{
+  checkResponseCode (respCode);
+  return decodeJson (responseStr);
+}
+
+/**
+ * Check the HTTP response code and throw if it is not accepted.
+ * @param respCode The HTTP response code.
+ * @throws HttpError if the code indicates an error.
+ */
+void
+JsonRpc::checkResponseCode (unsigned respCode)
+{
+  switch (respCode)
+    {
+    case 200:
+    case 404:
+    case 500:
+      break;
+
+    case 401:
+      throw HttpError ("Login credentials not accepted.", respCode);
+
+    default:
+      throw HttpError ("Invalid HTTP status code returned.", respCode);
+    }
 }
 
 /**
@@ -346,62 +396,720 @@ JsonRpc::encodeJson (const JsonData& data)
 JsonRpc::JsonData
 JsonRpc::executeRpcArray (const std::string& method, const JsonData& params)
 {
-  const bool logging = !dontLogNextCall;
-  dontLogNextCall = false;
+  return executeRpcArray (method, params, CallOptions ());
+}
 
-  JsonData query(Json::objectValue);
-  const int id = nextId++;
+/**
+ * Perform a JSON-RPC query with arbitrary parameter list and
+ * options for this call.  Only the result is converted to Json::Value,
+ * the envelope is checked on a tape.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param opts Options for this call.
+ * @return Result of the query.
+ * @throws Exception in case of error.
+ * @throws RpcError if the RPC call returns an error.
+ */
+JsonRpc::JsonData
+JsonRpc::executeRpcArray (const std::string& method, const JsonData& params,
+                          const CallOptions& opts)
+{
+  JsonTape tape;
+  executeRpcTape (method, params, tape, opts);
+  return tape.getRoot ()["result"].toJson ();
+}
 
-  query["id"] = id;
-  query["method"] = method;
-  query["params"] = params;
-  const std::string queryStr = encodeJson (query);
+/**
+ * Perform a JSON-RPC query and keep the response on a tape, without
+ * building a Json::Value for it.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param tape Set to the response.  Its id and error have been checked,
+ *             the result is the "result" member of the root.
+ * @throws Exception in case of error.
+ * @throws RpcError if the RPC call returns an error.
+ */
+void
+JsonRpc::executeRpcTape (const std::string& method, const JsonData& params,
+                         JsonTape& tape)
+{
+  executeRpcTape (method, params, tape, CallOptions ());
+}
 
-  if (logging)
+/**
+ * Perform a JSON-RPC query onto a tape with options for this call.
+ * If a balanced call fails on one node, it is tried again on the others
+ * (which are chosen by the balancer since the failed one is marked
+ * as unhealthy).
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param tape Set to the response.
+ * @param opts Options for this call.
+ * @throws Exception in case of error.
+ * @throws RpcError if the RPC call returns an error.
+ */
+void
+JsonRpc::executeRpcTape (const std::string& method, const JsonData& params,
+                         JsonTape& tape, const CallOptions& opts)
+{
+  const bool logging = shouldLog (opts);
+  const bool balanced = settings.isBalanced (method);
+  const bool retry = opts.isRetry () && settings.isIdempotent (method);
+  const unsigned tries = (balanced && retry ? nodes->getNodeCount () : 1);
+
+  RetryPolicy policy(settings, opts.getTimeout (), retry);
+  for (unsigned tried = 1; ; ++tried)
     {
-      std::ostringstream msg;
-      msg << "namecoind " << method;
-      for (Json::Value::const_iterator i = params.begin ();
-           i != params.end (); ++i)
-        msg << " " << encodeJson (*i);
-      msg << std::endl;
-      logRpcCall (msg.str ());
+      RoutedConnection conn(*nodes, balanced);
+      int id;
+      prepareCall (method, params, logging, id, conn->getData ());
+
+      CallInfo info(method, id);
+      try
+        {
+          queryTape (conn, logging, policy, info, tape);
+          const JsonTape::Value response = tape.getRoot ();
+          if (response["id"].asInt () != id)
+            throw Exception ("IDs don't match for JSON-RPC response.");
+
+          const JsonTape::Value error = response["error"];
+          if (!error.isNull ())
+            throw RpcError (error.toJson ());
+
+          conn.report (info);
+          metrics->record (info);
+          return;
+        }
+      catch (const Exception& exc)
+        {
+          info.setFailure (exc);
+          conn.report (info);
+          metrics->record (info);
+
+          if (tried >= tries || info.outcome == CallInfo::RPC_ERROR)
+            throw;
+        }
     }
-  else
-    logRpcCall ("<logging disabled for one RPC call>\n\n");
+}
+
+/**
+ * Perform multiple JSON-RPC calls in batched requests.  The calls are
+ * sent as JSON arrays of requests, each HTTP request containing up to
+ * the maximum batch size configured in the settings.  Responses are matched
+ * back to the calls by their id, and RPC errors are reported per call
+ * instead of aborting the whole batch.  If a request fails in transport
+ * or returns an invalid response, its calls and those of all following
+ * requests (which are not sent anymore) are marked as failed, while the
+ * results of the requests before are still returned.
+ * @param calls The calls to perform.
+ * @return The results, in the same order as the calls.
+ */
+std::vector<JsonRpc::CallResult>
+JsonRpc::executeRpcBatch (const std::vector<Call>& calls)
+{
+  return executeRpcBatch (calls, CallOptions ());
+}
 
-  unsigned respCode;
-  const std::string responseStr = queryHttp (queryStr, respCode);
+/**
+ * Perform multiple JSON-RPC calls in batched requests with options
+ * that apply to all of them.
+ * @see executeRpcBatch (const std::vector<Call>&)
+ * @param calls The calls to perform.
+ * @param opts Options for the calls.
+ * @return The results, in the same order as the calls.
+ */
+std::vector<JsonRpc::CallResult>
+JsonRpc::executeRpcBatch (const std::vector<Call>& calls,
+                          const CallOptions& opts)
+{
+  const bool logging = shouldLog (opts);
+  if (!logging)
+    logRpcCall ("<logging disabled for one RPC batch>\n\n");
 
-  if (logging)
+  std::vector<CallResult> results(calls.size ());
+
+  const size_t chunk = std::max (1u, settings.getMaxBatchSize ());
+  for (size_t start = 0; start < calls.size (); start += chunk)
     {
-      std::ostringstream msg;
-      msg << "  -> " << responseStr << std::endl;
-      logRpcCall (msg.str ());
+      const size_t end = std::min (calls.size (), start + chunk);
+
+      /* Ids of one chunk are consecutive, so that the position of a
+         response within the chunk is just its id minus the first one.  */
+      const unsigned firstId = allocateIds (end - start);
+
+      /* The batch is only balanced or retried if all its calls can be.  */
+      bool balanced = true;
+      bool retry = opts.isRetry ();
+      for (size_t i = start; i < end; ++i)
+        {
+          balanced = balanced && settings.isBalanced (calls[i].getMethod ());
+          retry = retry && settings.isIdempotent (calls[i].getMethod ());
+        }
+      RetryPolicy policy(settings, opts.getTimeout (), retry);
+
+      RoutedConnection conn(*nodes, balanced);
+      std::string& query = conn->getData ();
+      query = "[";
+      for (size_t i = start; i < end; ++i)
+        {
+          if (i > start)
+            query += ',';
+          JsonWriter::writeRequest (calls[i].getMethod (),
+                                    calls[i].getParams (),
+                                    static_cast<int> (firstId + (i - start)),
+                                    query);
+
+          if (logging)
+            logCall (calls[i].getMethod (), calls[i].getParams ());
+        }
+      query += ']';
+
+      CallInfo info("<batch>", static_cast<int> (firstId));
+      try
+        {
+          JsonTape tape;
+          queryTape (conn, logging, policy, info, tape);
+          const JsonTape::Value response = tape.getRoot ();
+
+          /* A daemon that does not understand the batch (or fails to parse
+             it) answers with a single error object instead.  */
+          if (response.isObject () && !response["error"].isNull ())
+            throw RpcError (response["error"].toJson ());
+          if (!response.isArray ())
+            throw Exception ("Invalid JSON-RPC batch response.");
+
+          std::vector<bool> seen(end - start, false);
+          const JsonTape::Value last = response.end ();
+          for (JsonTape::Value i = response.begin (); i != last;
+               i = i.getNext ())
+            {
+              const JsonTape::Value id = i["id"];
+              if (!id.isInt ())
+                throw Exception ("Invalid id in JSON-RPC batch response.");
+
+              const unsigned ind = id.asInt64 () - firstId;
+              if (ind >= seen.size () || seen[ind])
+                throw Exception ("IDs don't match for JSON-RPC batch"
+                                 " response.");
+              seen[ind] = true;
+
+              CallResult& res = results[start + ind];
+              res.result = i["result"].toJson ();
+              res.error = i["error"].toJson ();
+            }
+
+          if (std::find (seen.begin (), seen.end (), false) != seen.end ())
+            throw Exception ("Missing responses in JSON-RPC batch response.");
+        }
+      catch (const Exception& exc)
+        {
+          info.setFailure (exc);
+          conn.report (info);
+          metrics->record (info);
+
+          /* The earlier requests are done and their results must not be
+             lost, so mark this and all remaining calls as failed instead
+             of throwing.  The remaining calls are not sent anymore.  */
+          for (size_t i = start; i < calls.size (); ++i)
+            {
+              results[i] = CallResult ();
+              results[i].failed = true;
+              results[i].failure = exc.what ();
+            }
+          break;
+        }
+
+      conn.report (info);
+      metrics->record (info);
+      for (size_t i = start; i < end; ++i)
+        metrics->recordBatched (calls[i].getMethod (), results[i]);
     }
 
-  switch (respCode)
+  return results;
+}
+
+/**
+ * Perform a JSON-RPC query whose result is an array, and pass each element
+ * to the call-back as soon as it has been received.  The whole result is
+ * never kept in memory at once.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param cb The call-back for the elements.
+ * @return The number of elements received.
+ * @throws Exception in case of error.
+ * @throws RpcError if the RPC call returns an error.
+ */
+unsigned
+JsonRpc::executeRpcStreaming (const std::string& method,
+                              const JsonData& params, ElementCallback& cb)
+{
+  return executeRpcStreaming (method, params, cb, CallOptions ());
+}
+
+/**
+ * Perform a streaming JSON-RPC query with options for this call.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param cb The call-back for the elements.
+ * @param opts Options for this call.
+ * @return The number of elements received.
+ * @throws Exception in case of error.
+ * @throws RpcError if the RPC call returns an error.
+ */
+unsigned
+JsonRpc::executeRpcStreaming (const std::string& method,
+                              const JsonData& params, ElementCallback& cb,
+                              const CallOptions& opts)
+{
+  const bool logging = shouldLog (opts);
+
+  RoutedConnection conn(*nodes, settings.isBalanced (method));
+  int id;
+  prepareCall (method, params, logging, id, conn->getData ());
+
+  RetryPolicy policy(settings, opts.getTimeout (),
+                     opts.isRetry () && settings.isIdempotent (method));
+  CallInfo info(method, id);
+  try
     {
-    case 200:
-    case 404:
-    case 500:
+      ResponseSplitter splitter(cb);
+      conn->setSink (&splitter);
+      try
+        {
+          const bool reused = conn->perform (policy);
+          conn.getPool ().recordCall (reused);
+        }
+      catch (const Exception& exc)
+        {
+          /* If the call-back aborted the transfer, report its failure
+             instead of cURL's generic "write error".  */
+          splitter.checkFailure ();
+          throw;
+        }
+      conn->setSink (nullptr);
+
+      conn->fillCallInfo (info);
+      if (logging)
+        logResponse ("<streamed response>", info);
+
+      checkResponseCode (conn->getResponseCode ());
+      const unsigned res = splitter.finish (id);
+
+      conn.report (info);
+      metrics->record (info);
+      return res;
+    }
+  catch (const Exception& exc)
+    {
+      info.setFailure (exc);
+      conn.report (info);
+      metrics->record (info);
+      throw;
+    }
+}
+
+/**
+ * Start a streaming JSON-RPC call asynchronously.  The elements are passed
+ * to the call-back from within processAsync as they are received.
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param cb The call-back for the elements.
+ * @param call The call object that receives the result.
+ * @throws Exception if the request can not be started.
+ */
+void
+JsonRpc::executeRpcStreamingAsync (const std::string& method,
+                                   const JsonData& params, ElementCallback& cb,
+                                   AsyncCall& call)
+{
+  executeRpcStreamingAsync (method, params, cb, call, CallOptions ());
+}
+
+/**
+ * Start a streaming JSON-RPC call asynchronously with options for
+ * this call.
+ * @see executeRpcStreamingAsync (const std::string&, const JsonData&,
+ *                                ElementCallback&, AsyncCall&)
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param cb The call-back for the elements.
+ * @param call The call object that receives the result.
+ * @param opts Options for this call.
+ * @throws Exception if the request can not be started.
+ */
+void
+JsonRpc::executeRpcStreamingAsync (const std::string& method,
+                                   const JsonData& params, ElementCallback& cb,
+                                   AsyncCall& call, const CallOptions& opts)
+{
+  Lock lock(async->getMutex ());
+  if (call.pending)
+    throw std::logic_error ("AsyncCall is already pending.");
+
+  const bool logging = shouldLog (opts);
+
+  int id;
+  std::string queryStr;
+  prepareCall (method, params, logging, id, queryStr);
+
+  delete call.splitter;
+  call.splitter = new ResponseSplitter (cb);
+  const RetryPolicy policy(settings, opts.getTimeout (),
+                           opts.isRetry () && settings.isIdempotent (method));
+  ConnectionPool& pool = nodes->choose (settings.isBalanced (method));
+  try
+    {
+      async->submit (queryStr, call, method, id, logging, call.splitter,
+                     policy, pool);
+    }
+  catch (...)
+    {
+      nodes->finished (pool, nullptr);
+      delete call.splitter;
+      call.splitter = nullptr;
+      throw;
+    }
+
+  call.rpc = this;
+  call.pending = true;
+  call.done = false;
+  call.result = JsonData ();
+  call.failure = AsyncCall::NO_FAILURE;
+  call.error = JsonData ();
+}
+
+/**
+ * Start a JSON-RPC call asynchronously.  The request is sent and processed
+ * in the background while processAsync() or waitAsync() are called, or
+ * while some call object is waited for.  The call object must stay alive
+ * until the call is finished (or it is destroyed, which aborts it).
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param call The call object that receives the result.
+ * @throws Exception if the request can not be started.
+ */
+void
+JsonRpc::executeRpcAsync (const std::string& method, const JsonData& params,
+                          AsyncCall& call)
+{
+  executeRpcAsync (method, params, call, CallOptions ());
+}
+
+/**
+ * Start a JSON-RPC call asynchronously with options for this call.
+ * @see executeRpcAsync (const std::string&, const JsonData&, AsyncCall&)
+ * @param method The method name to call.
+ * @param params Parameter list as single Json::Value containing an array.
+ * @param call The call object that receives the result.
+ * @param opts Options for this call.
+ * @throws Exception if the request can not be started.
+ */
+void
+JsonRpc::executeRpcAsync (const std::string& method, const JsonData& params,
+                          AsyncCall& call, const CallOptions& opts)
+{
+  Lock lock(async->getMutex ());
+  if (call.pending)
+    throw std::logic_error ("AsyncCall is already pending.");
+
+  const bool logging = shouldLog (opts);
+
+  int id;
+  std::string queryStr;
+  prepareCall (method, params, logging, id, queryStr);
+
+  delete call.splitter;
+  call.splitter = nullptr;
+  const RetryPolicy policy(settings, opts.getTimeout (),
+                           opts.isRetry () && settings.isIdempotent (method));
+  ConnectionPool& pool = nodes->choose (settings.isBalanced (method));
+  try
+    {
+      async->submit (queryStr, call, method, id, logging, nullptr, policy,
+                     pool);
+    }
+  catch (...)
+    {
+      nodes->finished (pool, nullptr);
+      throw;
+    }
+
+  call.rpc = this;
+  call.pending = true;
+  call.done = false;
+  call.result = JsonData ();
+  call.failure = AsyncCall::NO_FAILURE;
+  call.error = JsonData ();
+}
+
+/**
+ * Process pending asynchronous calls.  This waits at most the given
+ * time for network activity and completes all calls that are finished
+ * by then, invoking their completion hooks.
+ * @param timeoutMs Maximum time to wait in milliseconds, zero to not wait.
+ * @return Number of calls still pending afterwards.
+ */
+unsigned
+JsonRpc::processAsync (int timeoutMs)
+{
+  Lock lock(async->getMutex ());
+
+  std::vector<AsyncEngine::Transfer*> finished;
+  async->process (timeoutMs, finished);
+
+  std::vector<AsyncCall*> calls;
+#ifdef CXX_11
+  for (auto t : finished)
+#else /* CXX_11?  */
+  for (std::vector<AsyncEngine::Transfer*>::iterator i = finished.begin ();
+       i != finished.end (); ++i)
+#endif /* CXX_11?  */
+    {
+#ifndef CXX_11
+      AsyncEngine::Transfer* t = *i;
+#endif /* !CXX_11  */
+      AsyncCall& call = *t->call;
+      call.pending = false;
+      call.done = true;
+
+      CallInfo& info = t->info;
+      if (t->logging && t->result == CURLE_OK)
+        logResponse (call.splitter ? "<streamed response>" : t->response,
+                     info);
+
+      try
+        {
+          if (call.splitter)
+            {
+              /* Report a failed call-back rather than the aborted
+                 transfer it caused.  */
+              call.splitter->checkFailure ();
+              HttpConnection::checkResult (t->result);
+              checkResponseCode (t->responseCode);
+
+              call.result = JsonData (call.splitter->finish (t->id));
+            }
+          else
+            {
+              HttpConnection::checkResult (t->result);
+
+              const double start = Metrics::now ();
+              const JsonData response = decodeResponse (t->response,
+                                                        t->responseCode);
+              info.parseTime = Metrics::now () - start;
+
+              if (response["id"].asInt () != t->id)
+                throw Exception ("IDs don't match for JSON-RPC response.");
+
+              const JsonData& error = response["error"];
+              if (!error.isNull ())
+                {
+                  call.failure = AsyncCall::FAILED_RPC;
+                  call.error = error;
+                  info.outcome = CallInfo::RPC_ERROR;
+                  info.errorCode = error["code"].asInt ();
+                }
+              else
+                call.result = response["result"];
+            }
+        }
+      catch (const RpcError& exc)
+        {
+          call.failure = AsyncCall::FAILED_RPC;
+          call.error = JsonData (Json::objectValue);
+          call.error["code"] = exc.getErrorCode ();
+          call.error["message"] = exc.getErrorMessage ();
+          info.setFailure (exc);
+        }
+      catch (const Exception& exc)
+        {
+          call.fail (exc);
+          info.setFailure (exc);
+        }
+      nodes->finished (*t->pool, &info);
+      metrics->record (info);
+
+      delete call.splitter;
+      call.splitter = nullptr;
+
+      delete t;
+      calls.push_back (&call);
+    }
+
+  /* Only run the hooks now, so that they see all results of this round
+     and may freely start new calls.  */
+#ifdef CXX_11
+  for (auto call : calls)
+#else /* CXX_11?  */
+  for (std::vector<AsyncCall*>::iterator i = calls.begin ();
+       i != calls.end (); ++i)
+#endif /* CXX_11?  */
+    {
+#ifndef CXX_11
+      AsyncCall* call = *i;
+#endif /* !CXX_11  */
+      call->completed ();
+    }
+
+  return async->getActive ();
+}
+
+/**
+ * Wait until all pending asynchronous calls are finished.  This includes
+ * calls started from completion hooks while waiting.
+ */
+void
+JsonRpc::waitAsync ()
+{
+  processUntil (nullptr);
+}
+
+/**
+ * Abort the request of an asynchronous call, if it is still pending.
+ * @param call The call to abort.
+ */
+void
+JsonRpc::cancelAsync (AsyncCall& call)
+{
+  Lock lock(async->getMutex ());
+  ConnectionPool* pool = async->cancel (call);
+  if (pool)
+    nodes->finished (*pool, nullptr);
+  call.pending = false;
+  delete call.splitter;
+  call.splitter = nullptr;
+}
+
+/**
+ * Process asynchronous calls until the given one is finished, or
+ * (if it is NULL) until no calls are pending any more.
+ * @param call The call to wait for or NULL.
+ */
+void
+JsonRpc::processUntil (const AsyncCall* call)
+{
+  /* The lock is released between the rounds, so that other threads
+     get a chance to start calls in the meantime.  */
+  while (true)
+    {
+      Lock lock(async->getMutex ());
+      if (call && call->done)
+        break;
+
+      const unsigned left = processAsync (ASYNC_WAIT_MS);
+      if (!call && left == 0)
+        break;
+    }
+}
+
+/* ************************************************************************** */
+/* Asynchronous calls.  */
+
+/**
+ * Destroy it.  If the call is still pending, it is aborted.
+ */
+JsonRpc::AsyncCall::~AsyncCall ()
+{
+  if (rpc)
+    rpc->cancelAsync (*this);
+}
+
+/**
+ * Mark the call as finished and store the given exception as
+ * its failure.  The completion hook is not yet called.
+ * @param exc The exception that occured.
+ */
+void
+JsonRpc::AsyncCall::fail (const Exception& exc)
+{
+  done = true;
+  errorMessage = exc.what ();
+
+  const HttpError* http = dynamic_cast<const HttpError*> (&exc);
+  if (http)
+    {
+      failure = FAILED_HTTP;
+      errorHttpCode = http->getResponseCode ();
+    }
+  else if (dynamic_cast<const JsonParseError*> (&exc))
+    failure = FAILED_PARSE;
+  else
+    failure = FAILED_GENERIC;
+}
+
+/**
+ * Called when the call is finished, either successful or not.  By
+ * default, nothing is done.  Exceptions must not be thrown from here.
+ */
+void
+JsonRpc::AsyncCall::completed ()
+{
+  // Nothing to do by default.
+}
+
+/**
+ * Wait for the call to finish.  Other pending calls on the same
+ * connection are processed in the meantime, too.
+ * @throws std::logic_error if the call was never started.
+ */
+void
+JsonRpc::AsyncCall::wait ()
+{
+  if (!rpc)
+    throw std::logic_error ("AsyncCall was never started.");
+
+  rpc->processUntil (this);
+}
+
+/**
+ * Wait for the call to finish and return the result.
+ * @return The result of the call.
+ * @throws Exception and subclasses if the call failed.
+ */
+const JsonRpc::JsonData&
+JsonRpc::AsyncCall::get ()
+{
+  wait ();
+
+  switch (failure)
+    {
+    case NO_FAILURE:
       break;
 
-    case 401:
-      throw HttpError ("Login credentials not accepted.", respCode);
+    case FAILED_PARSE:
+      throw JsonParseError (errorMessage);
+
+    case FAILED_HTTP:
+      throw HttpError (errorMessage, errorHttpCode);
 
+    case FAILED_RPC:
+      throw RpcError (error);
+
+    case FAILED_GENERIC:
     default:
-      throw HttpError ("Invalid HTTP status code returned.", respCode);
+      throw Exception (errorMessage);
     }
 
-  const JsonData response = decodeJson (responseStr);
-  if (response["id"].asInt () != id)
-    throw Exception ("IDs don't match for JSON-RPC response.");
+  return result;
+}
+
+/* ************************************************************************** */
+/* Batched calls.  */
 
-  const JsonData& result = response["result"];
-  const JsonData& error = response["error"];
-  if (!error.isNull ())
+/**
+ * Get the result, throwing the error if the call failed.
+ * @return The result value.
+ * @throws RpcError if the call returned an error.
+ * @throws Exception if the request containing the call failed.
+ */
+const JsonRpc::JsonData&
+JsonRpc::CallResult::get () const
+{
+  if (failed)
+    throw Exception (failure);
+  if (isError ())
     throw RpcError (error);
+
   return result;
 }
 
@@ -26,12 +26,26 @@
 #include <json/value.h>
 
 #include <iostream>
+#include <map>
 #include <stdexcept>
 #include <string>
+#include <vector>
+
+#ifdef CXX_11
+#include <utility>
+#endif /* CXX_11  */
 
 namespace nmcrpc
 {
 
+class AsyncEngine;
+class Balancer;
+class JsonTape;
+class Metrics;
+class ResponseSplitter;
+class RetryPolicy;
+class RoutedConnection;
+
 /* ************************************************************************** */
 /* The JsonRpc class itself.  */
 
@@ -39,6 +53,15 @@ namespace nmcrpc
  * JSON-RPC handling class.  It does the HTTP connection to the given server
  * as well as the JSON parsing/encoding, but doesn't care about the
  * Namecoin behind.
+ *
+ * A single JsonRpc object may be shared between threads:  All call methods
+ * can be used concurrently, each call then uses its own connection from the
+ * internal pool.  If the settings list replicas besides the primary daemon,
+ * calls of read-only methods are spread across all of them.  The
+ * asynchronous event loop is serialised internally, so it is best to
+ * drive it (processAsync, waitAsync) from one thread.
+ * The exception is disableLoggingOneShot, which can not know what the
+ * "next" call is if there are multiple threads.  Use CallOptions instead.
  */
 class JsonRpc
 {
@@ -51,17 +74,44 @@ public:
   class HttpError;
   class RpcError;
 
+  /* Other child classes.  */
+  class AsyncCall;
+  class Call;
+  class CallInfo;
+  class CallOptions;
+  class CallResult;
+  class ConnectionStats;
+  class ElementCallback;
+  class Histogram;
+  class MethodStats;
+  class Observer;
+
+  /** Type of the per-method statistics, keyed by method name.  */
+  typedef std::map<std::string, MethodStats> MethodStatsMap;
+
   /** Type of JSON data returned.  */
   typedef Json::Value JsonData;
 
 private:
 
-  /** Environment variable name for controlling the call log file.  */
-  static const std::string LOGFILE_VAR;
+  /** Time to wait for network activity in each round of waiting loops.  */
+  static const int ASYNC_WAIT_MS;
 
   /** Connection settings.  */
   RpcSettings settings;
 
+  /**
+   * The daemons calls are sent to, each with persistent connections
+   * that are reused between calls.
+   */
+  Balancer* nodes;
+
+  /** Event loop for asynchronous calls.  */
+  AsyncEngine* async;
+
+  /** Per-method statistics and the observer.  */
+  Metrics* metrics;
+
   /** The next ID to use for JSON-RPC queries.  */
   unsigned nextId;
 
@@ -71,6 +121,22 @@ private:
    */
   bool dontLogNextCall;
 
+  /**
+   * Allocate a range of consecutive JSON-RPC ids.  This is atomic, so that
+   * multiple threads get distinct ids.
+   * @param n Number of ids to allocate.
+   * @return The first allocated id.
+   */
+  unsigned allocateIds (unsigned n);
+
+  /**
+   * Decide whether the next call should be logged.  This consumes the
+   * one-shot flag set by disableLoggingOneShot.
+   * @param opts The options passed for the call.
+   * @return True iff the call should be logged.
+   */
+  bool shouldLog (const CallOptions& opts);
+
   // Disable copying.
 #ifndef CXX_11
   JsonRpc ();
@@ -78,25 +144,110 @@ private:
   JsonRpc& operator= (const JsonRpc&);
 #endif /* !CXX_11  */
 
-  /**
-   * Perform a HTTP query with JSON data.  However, this routine does not
-   * know/care about JSON, it just sends the raw string and returns the
-   * response body as string or throws if an error or an unaccepted
-   * HTTP response code is detected.
-   * @param query Query string to send.
-   * @param responseCode Set to the HTTP response code.
-   * @return The response body.
-   * @throws Exception if some error occurs.
-   */
-  std::string queryHttp (const std::string& query, unsigned& responseCode);
-
   /**
    * If logging of RPC calls is enabled (environment variable
-   * LIBNMCRPC_LOGFILE_RPCCALLS), write the given string to the
+   * LIBNMCRPC_LOGFILE_RPCCALLS), queue the given string for the
    * log file.
    * @param str String to log.
    */
-  void logRpcCall (const std::string& str);
+  static void logRpcCall (const std::string& str);
+
+  /**
+   * Log the response to a call together with a record about it.
+   * Call logging must be enabled.
+   * @param response The response body, or a placeholder if it was streamed.
+   * @param info Timings and sizes of the call.
+   */
+  static void logResponse (const std::string& response, const CallInfo& info);
+
+  /**
+   * Write the log line for a call that is about to be sent.
+   * @param method The method name called.
+   * @param params The parameters passed.
+   */
+  void logCall (const std::string& method, const JsonData& params);
+
+  /**
+   * Send an encoded JSON-RPC request (single or batch) and parse the
+   * response onto a tape.  This checks the HTTP response code, but not yet
+   * the JSON-RPC id or error fields.
+   * @param conn The connection, with the encoded request set as its data.
+   * @param logging Whether to log the response.
+   * @param policy Deadline and retry policy for the request.
+   * @param info Fill in timings and sizes here.
+   * @param tape Parse the response onto this tape.
+   * @throws Exception in case of error.
+   */
+  void queryTape (RoutedConnection& conn, bool logging, RetryPolicy& policy,
+                  CallInfo& info, JsonTape& tape);
+
+  /**
+   * Decode a received response body after checking the HTTP response code.
+   * @param responseStr The response body.
+   * @param respCode The HTTP response code.
+   * @return The decoded response.
+   * @throws Exception in case of error.
+   */
+  static JsonData decodeResponse (const std::string& responseStr,
+                                  unsigned respCode);
+
+  /**
+   * Check the HTTP response code and throw if it is not accepted.
+   * @param respCode The HTTP response code.
+   * @throws HttpError if the code indicates an error.
+   */
+  static void checkResponseCode (unsigned respCode);
+
+  /**
+   * Encode and log the request object for a call.
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param logging Whether to log the call.
+   * @param id Set to the JSON-RPC id used.
+   * @param out Buffer that is set to the encoded request.
+   */
+  void prepareCall (const std::string& method, const JsonData& params,
+                    bool logging, int& id, std::string& out);
+
+  /**
+   * Abort the request of an asynchronous call, if it is still pending.
+   * @param call The call to abort.
+   */
+  void cancelAsync (AsyncCall& call);
+
+  /**
+   * Process asynchronous calls until the given one is finished, or
+   * (if it is NULL) until no calls are pending any more.
+   * @param call The call to wait for or NULL.
+   */
+  void processUntil (const AsyncCall* call);
+
+#ifdef CXX_11
+
+  /**
+   * End the recursion of appendParams.
+   */
+  static inline void
+  appendParams (JsonData&)
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Append parameters to an array, moving them in where possible.
+   * @param params The parameter array.
+   * @param first The next parameter.
+   * @param rest The remaining parameters.
+   */
+  template<typename T, typename... Args>
+    static inline void
+    appendParams (JsonData& params, T&& first, Args&&... rest)
+  {
+    params.append (JsonData (std::forward<T> (first)));
+    appendParams (params, std::forward<Args> (rest)...);
+  }
+
+#endif /* CXX_11  */
 
 public:
 
@@ -104,11 +255,7 @@ public:
    * Construct for the given connection data.
    * @param s Settings to use for the connection.  They are copied.
    */
-  explicit inline JsonRpc (const RpcSettings& s)
-    : settings(s), nextId(0), dontLogNextCall(false)
-  {
-    // Nothing more to be done.
-  }
+  explicit JsonRpc (const RpcSettings& s);
 
   // We want no default constructor or copying.
 #ifdef CXX_11
@@ -117,6 +264,40 @@ public:
   JsonRpc& operator= (const JsonRpc&) = delete;
 #endif /* CXX_11?  */
 
+  /**
+   * Destroy, closing all open connections.
+   */
+  ~JsonRpc ();
+
+  /**
+   * Get statistics about how often connections to the daemon were
+   * reused and how often new ones had to be opened.
+   * @return The connection statistics.
+   */
+  ConnectionStats getConnectionStats () const;
+
+  /**
+   * Get a snapshot of the per-method statistics.  Calls that were part
+   * of a batch are counted for their method, but the timing and size of
+   * the whole batch request is recorded for the method "<batch>".
+   * @return The statistics of all methods called so far.
+   */
+  MethodStatsMap getMethodStats () const;
+
+  /**
+   * Reset all per-method statistics.
+   */
+  void resetMethodStats ();
+
+  /**
+   * Set an observer that is notified about each finished HTTP request.
+   * It is called on the thread that finished the request (for asynchronous
+   * calls, the one in processAsync), and must not throw.
+   * @param obs The observer to use, or NULL to remove it.  It must stay
+   *            alive as long as it is set.
+   */
+  void setObserver (Observer* obs);
+
   /**
    * Decode JSON from a string.
    * @param str JSON string.
@@ -125,6 +306,15 @@ public:
    */
   static JsonData decodeJson (const std::string& str);
 
+  /**
+   * Decode JSON from a character range, without copying it first.
+   * @param begin Start of the JSON text.
+   * @param end One past the end of the JSON text.
+   * @returns The parsed JSON data.
+   * @throws JsonParseError in case of parsing errors.
+   */
+  static JsonData decodeJson (const char* begin, const char* end);
+
   /**
    * Decose JSON from an input stream.
    * @param in Input stream.
@@ -134,15 +324,34 @@ public:
   static JsonData readJson (std::istream& in);
 
   /**
-   * Encode JSON to a string.
+   * Encode JSON to a string.  Like jsoncpp's FastWriter, a newline
+   * is added at the end.  This does not depend on the locale.
    * @param data The JSON data.
    * @return The encoded JSON as string.
    */
   static std::string encodeJson (const JsonData& data);
 
+  /**
+   * Wait until all queued records of the call log have been written
+   * to the log file.  This does nothing if call logging is disabled.
+   */
+  static void flushCallLog ();
+
+  /**
+   * Get the settings used by this connection.
+   * @return The settings.
+   */
+  inline const RpcSettings&
+  getSettings () const
+  {
+    return settings;
+  }
+
   /**
    * Disable logging for the next call.  This can be used to prevent passwords
    * from being logged.
+   * @deprecated This is not safe when the object is shared between threads,
+   * use CallOptions::setLogging instead.
    */
   inline void
   disableLoggingOneShot ()
@@ -160,6 +369,47 @@ public:
    */
   JsonData executeRpcArray (const std::string& method, const JsonData& params);
 
+  /**
+   * Perform a JSON-RPC query with arbitrary parameter list and
+   * options for this call.
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param opts Options for this call.
+   * @return Result of the query.
+   * @throws Exception in case of error.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  JsonData executeRpcArray (const std::string& method, const JsonData& params,
+                            const CallOptions& opts);
+
+  /**
+   * Perform a JSON-RPC query and keep the response on a tape, without
+   * building a Json::Value for it.  This is meant for use within the
+   * library (JsonTape is not part of the installed headers), where only
+   * a few fields of the result are read.
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param tape Set to the response.  Its id and error have been checked,
+   *             the result is the "result" member of the root.
+   * @throws Exception in case of error.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  void executeRpcTape (const std::string& method, const JsonData& params,
+                       JsonTape& tape);
+
+  /**
+   * Perform a JSON-RPC query onto a tape with options for this call.
+   * @see executeRpcTape (const std::string&, const JsonData&, JsonTape&)
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param tape Set to the response.
+   * @param opts Options for this call.
+   * @throws Exception in case of error.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  void executeRpcTape (const std::string& method, const JsonData& params,
+                       JsonTape& tape, const CallOptions& opts);
+
   /**
    * Perform a JSON-RPC query with arbitrary parameter list.
    * @param method The method name to call.
@@ -171,32 +421,199 @@ public:
   template<typename L>
     JsonData executeRpcList (const std::string& method, const L& params);
 
-  /* Utility methods to call RPC methods with small number of parameters.  */
+  /**
+   * Perform a typed call, as described in Rpc.hpp, and decode its result.
+   * @param c The call to perform.
+   * @return The decoded result.
+   * @throws Exception in case of error or if the result is malformed.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  template<typename M>
+    typename M::Result call (const M& c);
+
+  /**
+   * Perform a typed call with options for this call.
+   * @see call (const M&)
+   * @param c The call to perform.
+   * @param opts Options for this call.
+   * @return The decoded result.
+   * @throws Exception in case of error or if the result is malformed.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  template<typename M>
+    typename M::Result call (const M& c, const CallOptions& opts);
+
+  /**
+   * Perform multiple JSON-RPC calls in batched requests.  The calls are
+   * sent as JSON arrays of requests, each HTTP request containing up to
+   * the maximum batch size configured in the settings.  Responses are matched
+   * back to the calls by their id, and RPC errors are reported per call
+   * instead of aborting the whole batch.  If a request fails in transport
+   * or returns an invalid response, its calls and those of all following
+   * requests (which are not sent anymore) are marked as failed, while the
+   * results of the requests before are still returned.
+   * @param calls The calls to perform.
+   * @return The results, in the same order as the calls.
+   */
+  std::vector<CallResult> executeRpcBatch (const std::vector<Call>& calls);
+
+  /**
+   * Perform multiple JSON-RPC calls in batched requests with options
+   * that apply to all of them.
+   * @see executeRpcBatch (const std::vector<Call>&)
+   * @param calls The calls to perform.
+   * @param opts Options for the calls.
+   * @return The results, in the same order as the calls.
+   */
+  std::vector<CallResult> executeRpcBatch (const std::vector<Call>& calls,
+                                           const CallOptions& opts);
+
+  /**
+   * Start a JSON-RPC call asynchronously.  The request is sent and processed
+   * in the background while processAsync() or waitAsync() are called, or
+   * while some call object is waited for.  The call object must stay alive
+   * until the call is finished (or it is destroyed, which aborts it).
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param call The call object that receives the result.
+   * @throws Exception if the request can not be started.
+   */
+  void executeRpcAsync (const std::string& method, const JsonData& params,
+                        AsyncCall& call);
+
+  /**
+   * Start a JSON-RPC call asynchronously with options for this call.
+   * @see executeRpcAsync (const std::string&, const JsonData&, AsyncCall&)
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param call The call object that receives the result.
+   * @param opts Options for this call.
+   * @throws Exception if the request can not be started.
+   */
+  void executeRpcAsync (const std::string& method, const JsonData& params,
+                        AsyncCall& call, const CallOptions& opts);
+
+  /**
+   * Process pending asynchronous calls.  This waits at most the given
+   * time for network activity and completes all calls that are finished
+   * by then, invoking their completion hooks.
+   * @param timeoutMs Maximum time to wait in milliseconds, zero to not wait.
+   * @return Number of calls still pending afterwards.
+   */
+  unsigned processAsync (int timeoutMs);
+
+  /**
+   * Wait until all pending asynchronous calls are finished.  This includes
+   * calls started from completion hooks while waiting.
+   */
+  void waitAsync ();
+
+  /**
+   * Perform a JSON-RPC query whose result is an array, and pass each element
+   * to the call-back as soon as it has been received.  The whole result is
+   * never kept in memory at once.  This is meant for calls like name_scan
+   * with large results.
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param cb The call-back for the elements.
+   * @return The number of elements received.
+   * @throws Exception in case of error, also if the call-back throws or
+   *                   the result is no array.  In the last case, the
+   *                   call-back may have been called already.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  unsigned executeRpcStreaming (const std::string& method,
+                                const JsonData& params, ElementCallback& cb);
+
+  /**
+   * Perform a streaming JSON-RPC query with options for this call.
+   * @see executeRpcStreaming (const std::string&, const JsonData&,
+   *                           ElementCallback&)
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param cb The call-back for the elements.
+   * @param opts Options for this call.
+   * @return The number of elements received.
+   * @throws Exception in case of error.
+   * @throws RpcError if the RPC call returns an error.
+   */
+  unsigned executeRpcStreaming (const std::string& method,
+                                const JsonData& params, ElementCallback& cb,
+                                const CallOptions& opts);
+
+  /**
+   * Start a streaming JSON-RPC call asynchronously.  The elements are passed
+   * to the call-back from within processAsync as they are received.
+   * The result of the call object is the number of elements.
+   * @see executeRpcStreaming
+   * @see executeRpcAsync
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param cb The call-back for the elements.  Must stay alive as long as
+   *           the call is pending.
+   * @param call The call object that receives the result.
+   * @throws Exception if the request can not be started.
+   */
+  void executeRpcStreamingAsync (const std::string& method,
+                                 const JsonData& params, ElementCallback& cb,
+                                 AsyncCall& call);
+
+  /**
+   * Start a streaming JSON-RPC call asynchronously with options for
+   * this call.
+   * @see executeRpcStreamingAsync (const std::string&, const JsonData&,
+   *                                ElementCallback&, AsyncCall&)
+   * @param method The method name to call.
+   * @param params Parameter list as single Json::Value containing an array.
+   * @param cb The call-back for the elements.  Must stay alive as long as
+   *           the call is pending.
+   * @param call The call object that receives the result.
+   * @param opts Options for this call.
+   * @throws Exception if the request can not be started.
+   */
+  void executeRpcStreamingAsync (const std::string& method,
+                                 const JsonData& params, ElementCallback& cb,
+                                 AsyncCall& call, const CallOptions& opts);
+
+  /* Utility methods to call RPC methods with small number of parameters.
+     The parameter array is built in place, without a temporary list.  */
 
   inline JsonData
   executeRpc (const std::string& method)
   {
-    std::vector<JsonData> params;
-    return executeRpcList (method, params);
+    return executeRpcArray (method, JsonData (Json::arrayValue));
+  }
+
+#ifdef CXX_11
+
+  template<typename... Args>
+    inline JsonData
+    executeRpc (const std::string& method, Args&&... args)
+  {
+    JsonData params(Json::arrayValue);
+    appendParams (params, std::forward<Args> (args)...);
+    return executeRpcArray (method, params);
   }
 
+#else /* CXX_11  */
+
   template<typename T>
     inline JsonData
     executeRpc (const std::string& method, const T& p1)
   {
-    std::vector<JsonData> params;
-    params.push_back (JsonData(p1));
-    return executeRpcList (method, params);
+    JsonData params(Json::arrayValue);
+    params.append (JsonData(p1));
+    return executeRpcArray (method, params);
   }
 
   template<typename S, typename T>
     inline JsonData
     executeRpc (const std::string& method, const S& p1, const T& p2)
   {
-    std::vector<JsonData> params;
-    params.push_back (JsonData(p1));
-    params.push_back (JsonData(p2));
-    return executeRpcList (method, params);
+    JsonData params(Json::arrayValue);
+    params.append (JsonData(p1));
+    params.append (JsonData(p2));
+    return executeRpcArray (method, params);
   }
 
   template<typename R, typename S, typename T>
@@ -204,15 +621,854 @@ public:
     executeRpc (const std::string& method,
                 const R& p1, const S& p2, const T& p3)
   {
-    std::vector<JsonData> params;
-    params.push_back (JsonData(p1));
-    params.push_back (JsonData(p2));
-    params.push_back (JsonData(p3));
-    return executeRpcList (method, params);
+    JsonData params(Json::arrayValue);
+    params.append (JsonData(p1));
+    params.append (JsonData(p2));
+    params.append (JsonData(p3));
+    return executeRpcArray (method, params);
+  }
+
+#endif /* CXX_11?  */
+
+};
+
+/* ************************************************************************** */
+/* Streaming of results.  */
+
+/**
+ * Call-back interface for streamed calls.  It gets the elements
+ * of the result array one by one.
+ */
+class JsonRpc::ElementCallback
+{
+
+public:
+
+  inline ElementCallback ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~ElementCallback ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Handle an element of the result.
+   * @param element The element.
+   */
+  virtual void operator() (const JsonData& element) = 0;
+
+};
+
+/* ************************************************************************** */
+/* Per-call options.  */
+
+/**
+ * Options that can be set for individual calls.  The setters return
+ * a reference to the object, so that they can be chained on a temporary.
+ */
+class JsonRpc::CallOptions
+{
+
+private:
+
+  /** Whether the call should be logged.  */
+  bool logging;
+
+  /** Deadline for the call in milliseconds, zero for the default.  */
+  unsigned timeout;
+
+  /** Whether the call may be retried if its method is idempotent.  */
+  bool retry;
+
+public:
+
+  /**
+   * Construct with default options.
+   */
+  inline CallOptions ()
+    : logging(true), timeout(0), retry(true)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying is ok.
+#ifdef CXX_11
+  CallOptions (const CallOptions&) = default;
+  CallOptions& operator= (const CallOptions&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Enable or disable logging of the call.  Disabling it can be used
+   * to prevent passwords from being logged.
+   * @param l Whether to log the call.
+   * @return Reference to "this".
+   */
+  inline CallOptions&
+  setLogging (bool l)
+  {
+    logging = l;
+    return *this;
+  }
+
+  inline bool
+  isLogging () const
+  {
+    return logging;
+  }
+
+  /**
+   * Set the deadline for the call, including all retries.
+   * @param ms The deadline in milliseconds, zero to use the default
+   *           from the settings.
+   * @return Reference to "this".
+   */
+  inline CallOptions&
+  setTimeout (unsigned ms)
+  {
+    timeout = ms;
+    return *this;
+  }
+
+  inline unsigned
+  getTimeout () const
+  {
+    return timeout;
+  }
+
+  /**
+   * Allow or forbid retrying the call.  Even if allowed, only calls of
+   * methods that are idempotent according to the settings are retried.
+   * @param r Whether the call may be retried.
+   * @return Reference to "this".
+   */
+  inline CallOptions&
+  setRetry (bool r)
+  {
+    retry = r;
+    return *this;
+  }
+
+  inline bool
+  isRetry () const
+  {
+    return retry;
   }
 
 };
 
+/* ************************************************************************** */
+/* Batched calls.  */
+
+/**
+ * A single call to be executed as part of a batch.
+ */
+class JsonRpc::Call
+{
+
+private:
+
+  /** The method to call.  */
+  std::string method;
+
+  /** The parameters as JSON array.  */
+  JsonData params;
+
+  // Disable default constructor.
+#ifndef CXX_11
+  Call ();
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct a call without parameters.  They can be added later
+   * with addParam().
+   * @param m The method to call.
+   */
+  explicit inline Call (const std::string& m)
+    : method(m), params(Json::arrayValue)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Construct a call with the given parameter list.
+   * @param m The method to call.
+   * @param p Parameter list as single Json::Value containing an array.
+   */
+  inline Call (const std::string& m, const JsonData& p)
+    : method(m), params(p)
+  {
+    // Nothing else to do.
+  }
+
+  // No default constructor, copying and moving is ok.
+#ifdef CXX_11
+  Call () = delete;
+  Call (const Call&) = default;
+  Call (Call&&) = default;
+  Call& operator= (const Call&) = default;
+  Call& operator= (Call&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Append a parameter.
+   * @param p The parameter's value.
+   * @return Reference to "this" to allow chaining.
+   */
+  template<typename T>
+    inline Call&
+    addParam (const T& p)
+  {
+    params.append (JsonData(p));
+    return *this;
+  }
+
+  inline const std::string&
+  getMethod () const
+  {
+    return method;
+  }
+
+  inline const JsonData&
+  getParams () const
+  {
+    return params;
+  }
+
+};
+
+/**
+ * Result of a call executed as part of a batch.  It holds either the
+ * result value or the error returned for this call.  If the request
+ * containing the call failed as a whole, the call is marked as failed
+ * instead; it may or may not have been executed by the daemon.
+ */
+class JsonRpc::CallResult
+{
+
+private:
+
+  friend class JsonRpc;
+
+  /** The result, if successful.  */
+  JsonData result;
+
+  /** The error object, if the call failed.  */
+  JsonData error;
+
+  /** Whether the request containing the call failed.  */
+  bool failed;
+
+  /** Error message of the failed request.  */
+  std::string failure;
+
+public:
+
+  /**
+   * Construct it as null result.
+   */
+  inline CallResult ()
+    : result(), error(), failed(false), failure()
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  CallResult (const CallResult&) = default;
+  CallResult (CallResult&&) = default;
+  CallResult& operator= (const CallResult&) = default;
+  CallResult& operator= (CallResult&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Check whether the call returned an error.
+   * @return True iff the call failed.
+   */
+  inline bool
+  isError () const
+  {
+    return !error.isNull ();
+  }
+
+  /**
+   * Check whether the request containing the call failed in transport
+   * or with an invalid response, so that it has no result or error.
+   * @return True iff the request failed.
+   */
+  inline bool
+  isFailed () const
+  {
+    return failed;
+  }
+
+  /**
+   * Get the error message of the failed request.
+   * @return The error message, empty if the request did not fail.
+   */
+  inline const std::string&
+  getFailure () const
+  {
+    return failure;
+  }
+
+  /**
+   * Get the error code, if the call failed.
+   * @return The RPC error code.
+   * @throws std::logic_error if the call did not fail.
+   */
+  inline int
+  getErrorCode () const
+  {
+    if (!isError ())
+      throw std::logic_error ("Call did not return an error.");
+    return error["code"].asInt ();
+  }
+
+  /**
+   * Get the result, throwing the error if the call failed.
+   * @return The result value.
+   * @throws RpcError if the call returned an error.
+   * @throws Exception if the request containing the call failed.
+   */
+  const JsonData& get () const;
+
+};
+
+/* ************************************************************************** */
+/* Asynchronous calls.  */
+
+/**
+ * Receive the result of a call started with JsonRpc::executeRpcAsync.  This
+ * can be used like a future:  isDone() checks whether the result is there,
+ * and get() waits for it and returns it (or throws the error).  Subclasses
+ * can override completed() to get notified as soon as the result is in,
+ * which can for instance be used to start follow-up calls.
+ */
+class JsonRpc::AsyncCall
+{
+
+private:
+
+  friend class JsonRpc;
+
+  /** Possible kinds of failure of the call.  */
+  enum Failure
+  {
+    /** No failure (yet).  */
+    NO_FAILURE,
+    /** Some generic error, like a cURL failure.  */
+    FAILED_GENERIC,
+    /** JSON parsing error.  */
+    FAILED_PARSE,
+    /** HTTP error.  */
+    FAILED_HTTP,
+    /** The RPC call returned an error.  */
+    FAILED_RPC
+  };
+
+  /** The RPC connection the call is performed on, if started.  */
+  JsonRpc* rpc;
+
+  /** For streamed calls, the splitter receiving the response.  */
+  ResponseSplitter* splitter;
+
+  /** Whether the call is currently in progress.  */
+  bool pending;
+
+  /** Whether the call is finished.  */
+  bool done;
+
+  /** The result, if successful.  */
+  JsonData result;
+
+  /** Kind of failure, if any.  */
+  Failure failure;
+
+  /** Error message for generic/parse/HTTP failures.  */
+  std::string errorMessage;
+
+  /** HTTP response code for HTTP failures.  */
+  unsigned errorHttpCode;
+
+  /** The RPC error object for RPC failures.  */
+  JsonData error;
+
+  // Disable copying.
+#ifndef CXX_11
+  AsyncCall (const AsyncCall&);
+  AsyncCall& operator= (const AsyncCall&);
+#endif /* !CXX_11  */
+
+  /**
+   * Mark the call as finished and store the given exception as
+   * its failure.  The completion hook is not yet called.
+   * @param exc The exception that occured.
+   */
+  void fail (const Exception& exc);
+
+protected:
+
+  /**
+   * Called when the call is finished, either successful or not.  By
+   * default, nothing is done.  Exceptions must not be thrown from here.
+   */
+  virtual void completed ();
+
+public:
+
+  /**
+   * Construct it, not yet associated to any call.
+   */
+  inline AsyncCall ()
+    : rpc(nullptr), splitter(nullptr), pending(false), done(false), result(),
+      failure(NO_FAILURE), errorMessage(), errorHttpCode(0), error()
+  {
+    // Nothing else to do.
+  }
+
+  // No copying.
+#ifdef CXX_11
+  AsyncCall (const AsyncCall&) = delete;
+  AsyncCall& operator= (const AsyncCall&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it.  If the call is still pending, it is aborted.
+   */
+  virtual ~AsyncCall ();
+
+  /**
+   * Check whether the call is finished.
+   * @return True iff the result (or error) is available.
+   */
+  inline bool
+  isDone () const
+  {
+    return done;
+  }
+
+  /**
+   * Check whether the call succeeded.
+   * @return True iff the call is finished and returned without errors.
+   */
+  inline bool
+  isSuccess () const
+  {
+    return done && failure == NO_FAILURE;
+  }
+
+  /**
+   * Check whether the call is finished and failed with an RPC error.
+   * @return True iff the call returned an RPC error.
+   */
+  inline bool
+  isRpcError () const
+  {
+    return done && failure == FAILED_RPC;
+  }
+
+  /**
+   * Wait for the call to finish.  Other pending calls on the same
+   * connection are processed in the meantime, too.
+   * @throws std::logic_error if the call was never started.
+   */
+  void wait ();
+
+  /**
+   * Wait for the call to finish and return the result.
+   * @return The result of the call.
+   * @throws Exception and subclasses if the call failed.
+   */
+  const JsonData& get ();
+
+};
+
+/* ************************************************************************** */
+/* Connection statistics.  */
+
+/**
+ * Counters about the use of persistent connections.  Each HTTP request
+ * either reuses a kept-alive connection or has to open a new one.
+ */
+class JsonRpc::ConnectionStats
+{
+
+private:
+
+  friend class Balancer;
+  friend class ConnectionPool;
+
+  /** Number of HTTP requests performed.  */
+  unsigned long calls;
+  /** Number of requests that reused an existing connection.  */
+  unsigned long reused;
+  /** Number of requests that needed a new connection.  */
+  unsigned long opened;
+
+public:
+
+  /**
+   * Construct with all counters zero.
+   */
+  inline ConnectionStats ()
+    : calls(0), reused(0), opened(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying is ok.
+#ifdef CXX_11
+  ConnectionStats (const ConnectionStats&) = default;
+  ConnectionStats& operator= (const ConnectionStats&) = default;
+#endif /* CXX_11?  */
+
+  inline unsigned long
+  getCalls () const
+  {
+    return calls;
+  }
+
+  inline unsigned long
+  getReused () const
+  {
+    return reused;
+  }
+
+  inline unsigned long
+  getOpened () const
+  {
+    return opened;
+  }
+
+};
+
+/**
+ * Histogram of durations, with a bucket for each power of two
+ * microseconds.  Bucket i counts durations below 2^i microseconds (and
+ * at least 2^(i-1)), the last bucket all longer ones.
+ */
+class JsonRpc::Histogram
+{
+
+public:
+
+  /** Number of buckets.  */
+  static const unsigned NUM_BUCKETS = 28;
+
+private:
+
+  friend class Metrics;
+
+  /** Counts in the buckets.  */
+  unsigned long buckets[NUM_BUCKETS];
+
+  /** Number of samples.  */
+  unsigned long count;
+
+  /** Sum of all samples in seconds.  */
+  double sum;
+
+  /**
+   * Add a sample.
+   * @param seconds The duration in seconds.
+   */
+  void add (double seconds);
+
+public:
+
+  /**
+   * Construct it empty.
+   */
+  Histogram ();
+
+  // Copying is ok.
+#ifdef CXX_11
+  Histogram (const Histogram&) = default;
+  Histogram& operator= (const Histogram&) = default;
+#endif /* CXX_11?  */
+
+  inline unsigned long
+  getCount () const
+  {
+    return count;
+  }
+
+  /**
+   * Get the sum of all samples.
+   * @return The total duration in seconds.
+   */
+  inline double
+  getSum () const
+  {
+    return sum;
+  }
+
+  /**
+   * Get the count of a bucket.
+   * @param i The bucket's index.
+   * @return The number of samples in it.
+   */
+  inline unsigned long
+  getBucket (unsigned i) const
+  {
+    return buckets[i];
+  }
+
+  /**
+   * Get the upper limit of a bucket.
+   * @param i The bucket's index, not the last one.
+   * @return The limit in seconds.
+   */
+  static double getBucketLimit (unsigned i);
+
+  /**
+   * Estimate a quantile as the upper limit of the bucket it falls in.
+   * @param q The quantile, between zero and one.
+   * @return The estimate in seconds, zero if there are no samples.
+   */
+  double getQuantile (double q) const;
+
+};
+
+/**
+ * Statistics about the calls of one method.
+ */
+class JsonRpc::MethodStats
+{
+
+private:
+
+  friend class Metrics;
+
+  /** Number of calls finished.  */
+  unsigned long calls;
+
+  /** Number of calls that failed for any reason.  */
+  unsigned long failures;
+
+  /** Failed calls by RPC error code.  */
+  std::map<int, unsigned long> rpcErrors;
+
+  /** Failed calls by HTTP response code.  */
+  std::map<unsigned, unsigned long> httpErrors;
+
+  /** Total bytes of the requests.  */
+  unsigned long bytesSent;
+
+  /** Total bytes of the responses.  */
+  unsigned long bytesReceived;
+
+  /** Time to set up the connection (zero if it was reused).  */
+  Histogram connectTime;
+
+  /** Time from sending the request to the first byte of the response.  */
+  Histogram waitTime;
+
+  /** Time to receive the response.  */
+  Histogram transferTime;
+
+  /** Time to parse the response.  */
+  Histogram parseTime;
+
+public:
+
+  /**
+   * Construct with all counters zero.
+   */
+  inline MethodStats ()
+    : calls(0), failures(0), rpcErrors(), httpErrors(),
+      bytesSent(0), bytesReceived(0),
+      connectTime(), waitTime(), transferTime(), parseTime()
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  MethodStats (const MethodStats&) = default;
+  MethodStats (MethodStats&&) = default;
+  MethodStats& operator= (const MethodStats&) = default;
+  MethodStats& operator= (MethodStats&&) = default;
+#endif /* CXX_11?  */
+
+  inline unsigned long
+  getCalls () const
+  {
+    return calls;
+  }
+
+  inline unsigned long
+  getFailures () const
+  {
+    return failures;
+  }
+
+  inline const std::map<int, unsigned long>&
+  getRpcErrors () const
+  {
+    return rpcErrors;
+  }
+
+  inline const std::map<unsigned, unsigned long>&
+  getHttpErrors () const
+  {
+    return httpErrors;
+  }
+
+  inline unsigned long
+  getBytesSent () const
+  {
+    return bytesSent;
+  }
+
+  inline unsigned long
+  getBytesReceived () const
+  {
+    return bytesReceived;
+  }
+
+  inline const Histogram&
+  getConnectTime () const
+  {
+    return connectTime;
+  }
+
+  inline const Histogram&
+  getWaitTime () const
+  {
+    return waitTime;
+  }
+
+  inline const Histogram&
+  getTransferTime () const
+  {
+    return transferTime;
+  }
+
+  inline const Histogram&
+  getParseTime () const
+  {
+    return parseTime;
+  }
+
+};
+
+/**
+ * Information about a single finished HTTP request, as passed
+ * to the observer.
+ */
+class JsonRpc::CallInfo
+{
+
+public:
+
+  /** Possible outcomes of a call.  */
+  enum Outcome
+  {
+    /** The call succeeded.  */
+    SUCCESS,
+    /** The daemon returned an RPC error.  */
+    RPC_ERROR,
+    /** The HTTP response code indicated an error.  */
+    HTTP_ERROR,
+    /** Any other error (network, parsing, mismatched id).  */
+    OTHER_ERROR
+  };
+
+  /** The method called, or "<batch>" for a batch.  */
+  std::string method;
+
+  /** The JSON-RPC id (the first one for a batch).  */
+  int id;
+
+  /** The outcome.  */
+  Outcome outcome;
+
+  /** The RPC error code or HTTP response code for errors.  */
+  int errorCode;
+
+  /** Time to set up the connection in seconds.  */
+  double connectTime;
+
+  /** Time until the first byte of the response in seconds.  */
+  double waitTime;
+
+  /** Time to receive the response in seconds.  */
+  double transferTime;
+
+  /**
+   * Time to parse the response in seconds.  For streamed calls, parsing
+   * is interleaved with the transfer and included in its time.
+   */
+  double parseTime;
+
+  /** Bytes sent.  */
+  size_t sent;
+
+  /** Bytes received.  */
+  size_t received;
+
+  /**
+   * Construct it for a call, with everything else zero.
+   * @param m The method called.
+   * @param i The JSON-RPC id.
+   */
+  inline CallInfo (const std::string& m, int i)
+    : method(m), id(i), outcome(SUCCESS), errorCode(0),
+      connectTime(0.0), waitTime(0.0), transferTime(0.0), parseTime(0.0),
+      sent(0), received(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  CallInfo (const CallInfo&) = default;
+  CallInfo (CallInfo&&) = default;
+  CallInfo& operator= (const CallInfo&) = default;
+  CallInfo& operator= (CallInfo&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Set the outcome from an exception thrown by the call.
+   * @param exc The exception.
+   */
+  void setFailure (const Exception& exc);
+
+};
+
+/**
+ * Interface for observers of finished calls, for instance to export
+ * them to a metrics system.
+ */
+class JsonRpc::Observer
+{
+
+public:
+
+  inline Observer ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~Observer ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Called when an HTTP request is finished.
+   * @param info Information about it.
+   */
+  virtual void callFinished (const CallInfo& info) = 0;
+
+};
+
 /* ************************************************************************** */
 /* Exception classes.  */
 
@@ -46,3 +46,32 @@ template<typename L>
 
   return executeRpcArray (method, arr);
 }
+
+/**
+ * Perform a typed call, as described in Rpc.hpp, and decode its result.
+ * @param c The call to perform.
+ * @return The decoded result.
+ * @throws Exception in case of error or if the result is malformed.
+ * @throws RpcError if the RPC call returns an error.
+ */
+template<typename M>
+  typename M::Result
+  JsonRpc::call (const M& c)
+{
+  return M::decode (executeRpcArray (c.getMethod (), c.getParams ()));
+}
+
+/**
+ * Perform a typed call with options for this call.
+ * @param c The call to perform.
+ * @param opts Options for this call.
+ * @return The decoded result.
+ * @throws Exception in case of error or if the result is malformed.
+ * @throws RpcError if the RPC call returns an error.
+ */
+template<typename M>
+  typename M::Result
+  JsonRpc::call (const M& c, const CallOptions& opts)
+{
+  return M::decode (executeRpcArray (c.getMethod (), c.getParams (), opts));
+}
@@ -0,0 +1,783 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for JsonTape.hpp.  */
+
+#include "JsonTape.hpp"
+
+#include <cerrno>
+#include <climits>
+#include <cstdlib>
+#include <cstring>
+#include <locale>
+#include <sstream>
+
+namespace nmcrpc
+{
+
+const unsigned JsonTape::MAX_DEPTH = 1000;
+
+/**
+ * Throw the error for malformed JSON text.
+ * @throws JsonRpc::JsonParseError always.
+ */
+static void
+fail ()
+{
+  throw JsonRpc::JsonParseError ("Error decoding the JSON value.");
+}
+
+/**
+ * Check whether a character is a hex digit.
+ * @param c The character.
+ * @return True iff it is a hex digit.
+ */
+static bool
+isHexDigit (char c)
+{
+  return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f')
+          || (c >= 'A' && c <= 'F');
+}
+
+/**
+ * Read four hex digits, which have been checked already.
+ * @param str The text.
+ * @param pos Position of the first digit.
+ * @return The number.
+ */
+static unsigned
+readHex (const std::string& str, size_t pos)
+{
+  unsigned res = 0;
+  for (size_t i = pos; i < pos + 4; ++i)
+    {
+      const char c = str[i];
+      res <<= 4;
+      if (c >= '0' && c <= '9')
+        res += c - '0';
+      else if (c >= 'a' && c <= 'f')
+        res += c - 'a' + 10;
+      else
+        res += c - 'A' + 10;
+    }
+
+  return res;
+}
+
+/**
+ * Append a code point in UTF-8.
+ * @param cp The code point.
+ * @param out Append to this string.
+ */
+static void
+appendUtf8 (unsigned cp, std::string& out)
+{
+  if (cp < 0x80)
+    out += static_cast<char> (cp);
+  else if (cp < 0x800)
+    {
+      out += static_cast<char> (0xC0 | (cp >> 6));
+      out += static_cast<char> (0x80 | (cp & 0x3F));
+    }
+  else if (cp < 0x10000)
+    {
+      out += static_cast<char> (0xE0 | (cp >> 12));
+      out += static_cast<char> (0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char> (0x80 | (cp & 0x3F));
+    }
+  else
+    {
+      out += static_cast<char> (0xF0 | (cp >> 18));
+      out += static_cast<char> (0x80 | ((cp >> 12) & 0x3F));
+      out += static_cast<char> (0x80 | ((cp >> 6) & 0x3F));
+      out += static_cast<char> (0x80 | (cp & 0x3F));
+    }
+}
+
+/**
+ * Skip decimal digits.
+ * @param str The text.
+ * @param pos The position, advanced past the digits.
+ * @return True iff there was at least one digit.
+ */
+static bool
+skipDigits (const std::string& str, size_t& pos)
+{
+  const size_t start = pos;
+  while (pos < str.size () && str[pos] >= '0' && str[pos] <= '9')
+    ++pos;
+
+  return pos > start;
+}
+
+/**
+ * Read a floating-point number.  This does not depend on the
+ * global locale.
+ * @param str The text.
+ * @param begin Start of the number.
+ * @param end End of the number.
+ * @return The number.
+ * @throws JsonRpc::JsonParseError if it can not be read.
+ */
+static double
+readReal (const std::string& str, size_t begin, size_t end)
+{
+  std::istringstream in(str.substr (begin, end - begin));
+  in.imbue (std::locale::classic ());
+
+  double res;
+  in >> res;
+  if (!in)
+    fail ();
+
+  return res;
+}
+
+/**
+ * Parse a text given as character range, replacing what the tape
+ * held before.
+ * @param begin Start of the JSON text.
+ * @param end One past the end of the JSON text.
+ * @throws JsonRpc::JsonParseError in case of parsing errors.
+ */
+void
+JsonTape::parse (const char* begin, const char* end)
+{
+  text.assign (begin, end);
+  parseText ();
+}
+
+/**
+ * Parse a text, taking over its buffer instead of copying it.  The
+ * string is left with the tape's previous buffer.
+ * @param str The JSON text, swapped with the tape's buffer.
+ * @throws JsonRpc::JsonParseError in case of parsing errors.
+ */
+void
+JsonTape::swapAndParse (std::string& str)
+{
+  text.swap (str);
+  parseText ();
+}
+
+/**
+ * Parse the text held by the tape, replacing the tokens.
+ * @throws JsonRpc::JsonParseError in case of parsing errors.
+ */
+void
+JsonTape::parseText ()
+{
+  tokens.clear ();
+
+  size_t pos = 0;
+  skipSpace (pos);
+  parseValue (pos, 0);
+  skipSpace (pos);
+
+  if (pos != text.size ())
+    fail ();
+}
+
+/**
+ * Parse a value starting at the given position and append its tokens.
+ * @param pos The position, advanced past the value.
+ * @param depth Nesting depth of the value.
+ * @throws JsonRpc::JsonParseError if the text is malformed.
+ */
+void
+JsonTape::parseValue (size_t& pos, unsigned depth)
+{
+  if (pos >= text.size () || depth > MAX_DEPTH)
+    fail ();
+
+  switch (text[pos])
+    {
+    case '"':
+      parseString (pos);
+      return;
+
+    case 't':
+      parseLiteral (pos, "true", BOOLEAN);
+      return;
+
+    case 'f':
+      parseLiteral (pos, "false", BOOLEAN);
+      return;
+
+    case 'n':
+      parseLiteral (pos, "null", NULL_VALUE);
+      return;
+
+    case '[':
+    case '{':
+      break;
+
+    default:
+      parseNumber (pos);
+      return;
+    }
+
+  /* The token is referred to by index, since adding the children
+     may reallocate the vector.  */
+  const bool obj = (text[pos] == '{');
+  const char close = (obj ? '}' : ']');
+  const size_t ind = addToken (obj ? OBJECT : ARRAY, pos);
+
+  ++pos;
+  skipSpace (pos);
+  if (pos < text.size () && text[pos] == close)
+    ++pos;
+  else
+    while (true)
+      {
+        if (obj)
+          {
+            if (pos >= text.size () || text[pos] != '"')
+              fail ();
+            parseString (pos);
+
+            skipSpace (pos);
+            if (pos >= text.size () || text[pos] != ':')
+              fail ();
+            ++pos;
+            skipSpace (pos);
+          }
+
+        parseValue (pos, depth + 1);
+        ++tokens[ind].size;
+
+        skipSpace (pos);
+        if (pos >= text.size ())
+          fail ();
+        const char c = text[pos++];
+        if (c == close)
+          break;
+        if (c != ',')
+          fail ();
+        skipSpace (pos);
+      }
+
+  tokens[ind].end = pos;
+  tokens[ind].next = tokens.size ();
+}
+
+/**
+ * Parse a string starting at its opening quote and append its token.
+ * @param pos The position, advanced past the closing quote.
+ * @throws JsonRpc::JsonParseError if the string is malformed.
+ */
+void
+JsonTape::parseString (size_t& pos)
+{
+  ++pos;
+  const size_t ind = addToken (STRING, pos);
+
+  while (true)
+    {
+      if (pos >= text.size ())
+        fail ();
+
+      const char c = text[pos];
+      if (c == '"')
+        break;
+      ++pos;
+      if (c != '\\')
+        continue;
+
+      /* Escapes are only checked here, and decoded when the
+         string is read.  */
+      tokens[ind].escaped = true;
+      if (pos >= text.size ())
+        fail ();
+      switch (text[pos])
+        {
+        case '"':
+        case '\\':
+        case '/':
+        case 'b':
+        case 'f':
+        case 'n':
+        case 'r':
+        case 't':
+          ++pos;
+          break;
+
+        case 'u':
+          if (pos + 4 >= text.size ())
+            fail ();
+          for (size_t i = pos + 1; i <= pos + 4; ++i)
+            if (!isHexDigit (text[i]))
+              fail ();
+          pos += 5;
+          break;
+
+        default:
+          fail ();
+        }
+    }
+
+  tokens[ind].end = pos;
+  ++pos;
+}
+
+/**
+ * Parse a number and append its token.
+ * @param pos The position, advanced past the number.
+ * @throws JsonRpc::JsonParseError if the number is malformed.
+ */
+void
+JsonTape::parseNumber (size_t& pos)
+{
+  const size_t ind = addToken (NUMBER, pos);
+
+  if (text[pos] == '-')
+    ++pos;
+  if (!skipDigits (text, pos))
+    fail ();
+
+  if (pos < text.size () && text[pos] == '.')
+    {
+      ++pos;
+      if (!skipDigits (text, pos))
+        fail ();
+    }
+
+  if (pos < text.size () && (text[pos] == 'e' || text[pos] == 'E'))
+    {
+      ++pos;
+      if (pos < text.size () && (text[pos] == '+' || text[pos] == '-'))
+        ++pos;
+      if (!skipDigits (text, pos))
+        fail ();
+    }
+
+  tokens[ind].end = pos;
+}
+
+/**
+ * Parse a literal (true, false or null) and append its token.
+ * @param pos The position, advanced past the literal.
+ * @param lit The literal expected.
+ * @param type The type of the token.
+ * @throws JsonRpc::JsonParseError if the literal doesn't match.
+ */
+void
+JsonTape::parseLiteral (size_t& pos, const char* lit, Type type)
+{
+  const size_t len = std::strlen (lit);
+  if (text.compare (pos, len, lit) != 0)
+    fail ();
+
+  const size_t ind = addToken (type, pos);
+  pos += len;
+  tokens[ind].end = pos;
+}
+
+/**
+ * Skip white space.
+ * @param pos The position, advanced past the white space.
+ */
+void
+JsonTape::skipSpace (size_t& pos) const
+{
+  while (pos < text.size ())
+    switch (text[pos])
+      {
+      case ' ':
+      case '\t':
+      case '\n':
+      case '\r':
+        ++pos;
+        break;
+
+      default:
+        return;
+      }
+}
+
+/**
+ * Append a new token for the given type and start.
+ * @param type Type of the token.
+ * @param begin Start of its text.
+ * @return Index of the token.
+ */
+size_t
+JsonTape::addToken (Type type, size_t begin)
+{
+  Token tok;
+  tok.type = type;
+  tok.escaped = false;
+  tok.begin = begin;
+  tok.end = begin;
+  tok.next = tokens.size () + 1;
+  tok.size = 0;
+
+  tokens.push_back (tok);
+  return tokens.size () - 1;
+}
+
+/**
+ * Decode the string of a token, resolving all escapes.
+ * @param ind Index of the token.
+ * @param out Set to the decoded string.
+ * @throws JsonRpc::JsonParseError if an escape is invalid.
+ */
+void
+JsonTape::decodeString (size_t ind, std::string& out) const
+{
+  const Token& tok = tokens[ind];
+  if (!tok.escaped)
+    {
+      out.assign (text, tok.begin, tok.end - tok.begin);
+      return;
+    }
+
+  out.clear ();
+  out.reserve (tok.end - tok.begin);
+  for (size_t pos = tok.begin; pos < tok.end; ++pos)
+    {
+      if (text[pos] != '\\')
+        {
+          out += text[pos];
+          continue;
+        }
+
+      ++pos;
+      switch (text[pos])
+        {
+        case 'b':
+          out += '\b';
+          break;
+        case 'f':
+          out += '\f';
+          break;
+        case 'n':
+          out += '\n';
+          break;
+        case 'r':
+          out += '\r';
+          break;
+        case 't':
+          out += '\t';
+          break;
+
+        case 'u':
+          {
+            unsigned cp = readHex (text, pos + 1);
+            pos += 4;
+
+            /* A high surrogate must be followed by the low one.  */
+            if (cp >= 0xD800 && cp < 0xDC00)
+              {
+                if (pos + 6 >= tok.end || text[pos + 1] != '\\'
+                    || text[pos + 2] != 'u')
+                  fail ();
+
+                const unsigned low = readHex (text, pos + 3);
+                if (low < 0xDC00 || low >= 0xE000)
+                  fail ();
+
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                pos += 6;
+              }
+
+            appendUtf8 (cp, out);
+            break;
+          }
+
+        default:
+          out += text[pos];
+          break;
+        }
+    }
+}
+
+/**
+ * Convert a token (and its children) to Json::Value.  Numbers get the
+ * same types as jsoncpp's reader gives them.
+ * @param ind Index of the token.
+ * @return The value.
+ * @throws JsonRpc::JsonParseError if a string or number is invalid.
+ */
+JsonRpc::JsonData
+JsonTape::convert (size_t ind) const
+{
+  const Token& tok = tokens[ind];
+  switch (tok.type)
+    {
+    case NULL_VALUE:
+      return JsonRpc::JsonData ();
+
+    case BOOLEAN:
+      return JsonRpc::JsonData (text[tok.begin] == 't');
+
+    case STRING:
+      {
+        std::string str;
+        decodeString (ind, str);
+        return JsonRpc::JsonData (str);
+      }
+
+    case NUMBER:
+      {
+        if (!Value (*this, ind).isInt ())
+          return JsonRpc::JsonData (readReal (text, tok.begin, tok.end));
+
+        const char* str = text.c_str () + tok.begin;
+        errno = 0;
+        if (*str == '-')
+          {
+            const Json::LargestInt val = std::strtoll (str, nullptr, 10);
+            if (errno == 0)
+              return JsonRpc::JsonData (val);
+          }
+        else
+          {
+            const Json::LargestUInt val = std::strtoull (str, nullptr, 10);
+            /* Like jsoncpp, non-negative numbers that fit into int
+               are signed, larger ones unsigned.  */
+            const Json::LargestUInt maxInt = INT_MAX;
+            if (errno == 0 && val <= maxInt)
+              return JsonRpc::JsonData (static_cast<Json::LargestInt> (val));
+            if (errno == 0)
+              return JsonRpc::JsonData (val);
+          }
+
+        return JsonRpc::JsonData (readReal (text, tok.begin, tok.end));
+      }
+
+    case ARRAY:
+      {
+        JsonRpc::JsonData res(Json::arrayValue);
+        for (size_t i = ind + 1; i < tok.next; i = tokens[i].next)
+          res.append (convert (i));
+        return res;
+      }
+
+    case OBJECT:
+      {
+        JsonRpc::JsonData res(Json::objectValue);
+        std::string key;
+        for (size_t i = ind + 1; i < tok.next; i = tokens[i + 1].next)
+          {
+            decodeString (i, key);
+            res[key] = convert (i + 1);
+          }
+        return res;
+      }
+    }
+
+  /* Not reached.  */
+  return JsonRpc::JsonData ();
+}
+
+/* ************************************************************************** */
+/* JsonTape::Value.  */
+
+/**
+ * Check whether this is a number without fraction or exponent.
+ * @return True iff this is an integer.
+ */
+bool
+JsonTape::Value::isInt () const
+{
+  if (getType () != NUMBER)
+    return false;
+
+  const Token& tok = getToken ();
+  for (size_t i = tok.begin; i < tok.end; ++i)
+    switch (tape->text[i])
+      {
+      case '.':
+      case 'e':
+      case 'E':
+        return false;
+
+      default:
+        break;
+      }
+
+  return true;
+}
+
+/**
+ * Look up a member of an object.  If the key appears more than once,
+ * the last one counts as with jsoncpp.
+ * @param key The member's key.
+ * @return The member, or a null value if it is missing or this
+ *         is no object.
+ */
+JsonTape::Value
+JsonTape::Value::operator[] (const char* key) const
+{
+  if (!isObject ())
+    return Value ();
+
+  const size_t len = std::strlen (key);
+  const std::string& text = tape->text;
+  std::string decoded;
+
+  Value res;
+  for (size_t i = ind + 1; i < getToken ().next; i = tape->tokens[i + 1].next)
+    {
+      const Token& k = tape->tokens[i];
+      if (k.escaped)
+        {
+          tape->decodeString (i, decoded);
+          if (decoded == key)
+            res = Value (*tape, i + 1);
+        }
+      else if (k.end - k.begin == len
+               && text.compare (k.begin, len, key) == 0)
+        res = Value (*tape, i + 1);
+    }
+
+  return res;
+}
+
+/**
+ * Parse the number as integer.
+ * @param what Name of the target type for the error message.
+ * @return The value.
+ * @throws JsonRpc::Exception if this is no integer.
+ */
+Json::LargestInt
+JsonTape::Value::getInteger (const char* what) const
+{
+  switch (getType ())
+    {
+    case NULL_VALUE:
+      return 0;
+
+    case BOOLEAN:
+      return (tape->text[getToken ().begin] == 't' ? 1 : 0);
+
+    case NUMBER:
+      {
+        const Token& tok = getToken ();
+        if (!isInt ())
+          return static_cast<Json::LargestInt> (readReal (tape->text,
+                                                          tok.begin,
+                                                          tok.end));
+
+        errno = 0;
+        const Json::LargestInt res
+          = std::strtoll (tape->text.c_str () + tok.begin, nullptr, 10);
+        if (errno != 0)
+          throw JsonRpc::Exception ("JSON integer out of range.");
+        return res;
+      }
+
+    default:
+      break;
+    }
+
+  throw JsonRpc::Exception (std::string ("JSON value is not convertible to ")
+                            + what + ".");
+}
+
+/**
+ * Get the value as string.  Null values are returned as empty string,
+ * other non-strings as their JSON text.
+ * @return The string.
+ * @throws JsonRpc::Exception if this is an array or object.
+ */
+std::string
+JsonTape::Value::asString () const
+{
+  std::string res;
+  switch (getType ())
+    {
+    case NULL_VALUE:
+      break;
+
+    case STRING:
+      tape->decodeString (ind, res);
+      break;
+
+    case BOOLEAN:
+    case NUMBER:
+      res.assign (tape->text, getToken ().begin,
+                  getToken ().end - getToken ().begin);
+      break;
+
+    default:
+      throw JsonRpc::Exception ("JSON value is not convertible to string.");
+    }
+
+  return res;
+}
+
+/**
+ * Get the value as integer.  Null is returned as zero.
+ * @return The integer.
+ * @throws JsonRpc::Exception if the value is no integer or
+ *                            out of range.
+ */
+int
+JsonTape::Value::asInt () const
+{
+  const Json::LargestInt res = getInteger ("int");
+  if (res < INT_MIN || res > INT_MAX)
+    throw JsonRpc::Exception ("JSON integer out of range.");
+
+  return static_cast<int> (res);
+}
+
+/**
+ * Get the value as 64-bit integer.  Null is returned as zero.
+ * @return The integer.
+ * @throws JsonRpc::Exception if the value is no integer.
+ */
+Json::Int64
+JsonTape::Value::asInt64 () const
+{
+  return getInteger ("int64");
+}
+
+/**
+ * Get the value as boolean.  Null is false.
+ * @return The boolean.
+ * @throws JsonRpc::Exception if the value is no boolean or null.
+ */
+bool
+JsonTape::Value::asBool () const
+{
+  if (getType () == NUMBER && !isInt ())
+    return readReal (tape->text, getToken ().begin, getToken ().end) != 0.0;
+
+  return getInteger ("bool") != 0;
+}
+
+/**
+ * Convert the value to Json::Value.
+ * @return The converted value.
+ * @throws JsonRpc::JsonParseError if a number can not be read.
+ */
+JsonRpc::JsonData
+JsonTape::Value::toJson () const
+{
+  if (!tape)
+    return JsonRpc::JsonData ();
+
+  return tape->convert (ind);
+}
+
+} // namespace nmcrpc
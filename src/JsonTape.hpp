@@ -0,0 +1,486 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the read-only JSON
+   representation used for responses on the hot paths.  */
+
+#ifndef NMCRPC_JSONTAPE_HPP
+#define NMCRPC_JSONTAPE_HPP
+
+#include "JsonRpc.hpp"
+
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Parsed JSON text as a flat "tape" of tokens.  Parsing does not build
+ * a tree of allocated nodes like Json::Value, but only records the type
+ * and position of each value in a single vector, while strings are kept
+ * as ranges of the (owned) text and unescaped only when they are read.
+ * The text is either copied or, with swapAndParse, taken over without
+ * a copy.  Reusing a tape for the next text keeps the capacity of both
+ * buffers, so that parsing a page of results does not allocate at all
+ * once the tape has grown large enough, and all of it is dropped at once.
+ *
+ * Values are accessed through light-weight Value handles, which stay valid
+ * until the tape is parsed again or destroyed.  Their interface mimics
+ * the part of Json::Value that is used to read out responses, and toJson
+ * converts a sub-tree for code that needs an actual Json::Value.
+ */
+class JsonTape
+{
+
+public:
+
+  class Callback;
+  class Value;
+
+  /** Types of values.  */
+  enum Type
+  {
+    NULL_VALUE,
+    BOOLEAN,
+    NUMBER,
+    STRING,
+    ARRAY,
+    OBJECT
+  };
+
+private:
+
+  /** Maximum nesting depth accepted, as with jsoncpp's default.  */
+  static const unsigned MAX_DEPTH;
+
+  /**
+   * A single value on the tape.  Arrays and objects are followed directly
+   * by their children, object members as key string and value.
+   */
+  struct Token
+  {
+
+    /** Type of the value.  */
+    Type type;
+
+    /** Whether a string contains escape sequences.  */
+    bool escaped;
+
+    /** Start of the value's text (without quotes for strings).  */
+    size_t begin;
+
+    /** End of the value's text (without quotes for strings).  */
+    size_t end;
+
+    /** Index of the token after this value and all its children.  */
+    size_t next;
+
+    /** Number of elements or members of arrays and objects.  */
+    size_t size;
+
+  };
+
+  /** The text parsed.  */
+  std::string text;
+
+  /** The tokens of the text.  */
+  std::vector<Token> tokens;
+
+  // Disable copying.
+#ifndef CXX_11
+  JsonTape (const JsonTape&);
+  JsonTape& operator= (const JsonTape&);
+#endif /* !CXX_11  */
+
+  /**
+   * Parse the text held by the tape, replacing the tokens.
+   * @throws JsonRpc::JsonParseError in case of parsing errors.
+   */
+  void parseText ();
+
+  /**
+   * Parse a value starting at the given position and append its tokens.
+   * @param pos The position, advanced past the value.
+   * @param depth Nesting depth of the value.
+   * @throws JsonRpc::JsonParseError if the text is malformed.
+   */
+  void parseValue (size_t& pos, unsigned depth);
+
+  /**
+   * Parse a string starting at its opening quote and append its token.
+   * @param pos The position, advanced past the closing quote.
+   * @throws JsonRpc::JsonParseError if the string is malformed.
+   */
+  void parseString (size_t& pos);
+
+  /**
+   * Parse a number and append its token.
+   * @param pos The position, advanced past the number.
+   * @throws JsonRpc::JsonParseError if the number is malformed.
+   */
+  void parseNumber (size_t& pos);
+
+  /**
+   * Parse a literal (true, false or null) and append its token.
+   * @param pos The position, advanced past the literal.
+   * @param lit The literal expected.
+   * @param type The type of the token.
+   * @throws JsonRpc::JsonParseError if the literal doesn't match.
+   */
+  void parseLiteral (size_t& pos, const char* lit, Type type);
+
+  /**
+   * Skip white space.
+   * @param pos The position, advanced past the white space.
+   */
+  void skipSpace (size_t& pos) const;
+
+  /**
+   * Append a new token for the given type and start.
+   * @param type Type of the token.
+   * @param begin Start of its text.
+   * @return Index of the token.
+   */
+  size_t addToken (Type type, size_t begin);
+
+  /**
+   * Decode the string of a token, resolving all escapes.
+   * @param ind Index of the token.
+   * @param out Set to the decoded string.
+   * @throws JsonRpc::JsonParseError if an escape is invalid.
+   */
+  void decodeString (size_t ind, std::string& out) const;
+
+  /**
+   * Convert a token (and its children) to Json::Value.
+   * @param ind Index of the token.
+   * @return The value.
+   * @throws JsonRpc::JsonParseError if a string or number is invalid.
+   */
+  JsonRpc::JsonData convert (size_t ind) const;
+
+  friend class Value;
+
+public:
+
+  /**
+   * Construct an empty tape.
+   */
+  inline JsonTape ()
+    : text(), tokens()
+  {
+    // Nothing else to do.
+  }
+
+  // No copying.
+#ifdef CXX_11
+  JsonTape (const JsonTape&) = delete;
+  JsonTape& operator= (const JsonTape&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Parse a text, replacing what the tape held before.
+   * @param str The JSON text.
+   * @throws JsonRpc::JsonParseError in case of parsing errors.
+   */
+  inline void
+  parse (const std::string& str)
+  {
+    parse (str.data (), str.data () + str.size ());
+  }
+
+  /**
+   * Parse a text given as character range, replacing what the tape
+   * held before.
+   * @param begin Start of the JSON text.
+   * @param end One past the end of the JSON text.
+   * @throws JsonRpc::JsonParseError in case of parsing errors.
+   */
+  void parse (const char* begin, const char* end);
+
+  /**
+   * Parse a text, taking over its buffer instead of copying it.  The
+   * string is left with the tape's previous buffer, so that its capacity
+   * can be reused by the caller.  Its content is unspecified.
+   * @param str The JSON text, swapped with the tape's buffer.
+   * @throws JsonRpc::JsonParseError in case of parsing errors.
+   */
+  void swapAndParse (std::string& str);
+
+  /**
+   * Get the root value of the parsed text.
+   * @return The root value.
+   */
+  Value getRoot () const;
+
+};
+
+/**
+ * Handle for a value on a tape.  A default-constructed handle (or the
+ * result of looking up a missing member) is a null value, just like
+ * Json::Value returns for them.
+ */
+class JsonTape::Value
+{
+
+private:
+
+  /** The tape, or NULL for missing values.  */
+  const JsonTape* tape;
+
+  /** Index of the token.  */
+  size_t ind;
+
+  /**
+   * Get the token.  Must only be called if tape is set.
+   * @return The token of this value.
+   */
+  inline const Token&
+  getToken () const
+  {
+    return tape->tokens[ind];
+  }
+
+  /**
+   * Parse the number as integer.
+   * @param what Name of the target type for the error message.
+   * @return The value.
+   * @throws JsonRpc::Exception if this is no integer.
+   */
+  Json::LargestInt getInteger (const char* what) const;
+
+public:
+
+  /**
+   * Construct a null value.
+   */
+  inline Value ()
+    : tape(nullptr), ind(0)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Construct a handle for a token on the tape.
+   * @param t The tape.
+   * @param i Index of the token.
+   */
+  inline Value (const JsonTape& t, size_t i)
+    : tape(&t), ind(i)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  Value (const Value&) = default;
+  Value (Value&&) = default;
+  Value& operator= (const Value&) = default;
+  Value& operator= (Value&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the type.
+   * @return The type of the value.
+   */
+  inline Type
+  getType () const
+  {
+    return (tape ? getToken ().type : NULL_VALUE);
+  }
+
+  inline bool
+  isNull () const
+  {
+    return getType () == NULL_VALUE;
+  }
+
+  inline bool
+  isString () const
+  {
+    return getType () == STRING;
+  }
+
+  inline bool
+  isArray () const
+  {
+    return getType () == ARRAY;
+  }
+
+  inline bool
+  isObject () const
+  {
+    return getType () == OBJECT;
+  }
+
+  /**
+   * Check whether this is a number without fraction or exponent.
+   * @return True iff this is an integer.
+   */
+  bool isInt () const;
+
+  /**
+   * Get the number of elements or members.
+   * @return The size of arrays and objects, zero otherwise.
+   */
+  inline size_t
+  size () const
+  {
+    return (isArray () || isObject () ? getToken ().size : 0);
+  }
+
+  /**
+   * Look up a member of an object.
+   * @param key The member's key.
+   * @return The member, or a null value if it is missing or this
+   *         is no object.
+   */
+  Value operator[] (const char* key) const;
+
+  /**
+   * Get the first element of an array.  Together with end and getNext,
+   * this iterates over the elements.
+   * @return The first element, or end() if there is none.
+   */
+  inline Value
+  begin () const
+  {
+    return (isArray () ? Value (*tape, ind + 1) : end ());
+  }
+
+  /**
+   * Get the position after the last element of an array.
+   * @return A handle to compare the elements against.
+   */
+  inline Value
+  end () const
+  {
+    return (isArray () ? Value (*tape, getToken ().next) : Value ());
+  }
+
+  /**
+   * Get the next element of the array this one is in.  Must only be
+   * called if this is not its end.
+   * @return The next element.
+   */
+  inline Value
+  getNext () const
+  {
+    return Value (*tape, getToken ().next);
+  }
+
+  /**
+   * Compare two handles.  They are equal if they refer to the same
+   * position on the same tape.
+   * @param other The other handle.
+   * @return True iff both are the same.
+   */
+  inline bool
+  operator== (const Value& other) const
+  {
+    return tape == other.tape && ind == other.ind;
+  }
+
+  inline bool
+  operator!= (const Value& other) const
+  {
+    return !(*this == other);
+  }
+
+  /**
+   * Get the value as string.  Null values are returned as empty string,
+   * other non-strings as their JSON text.
+   * @return The string.
+   * @throws JsonRpc::Exception if this is an array or object.
+   */
+  std::string asString () const;
+
+  /**
+   * Get the value as integer.  Null is returned as zero.
+   * @return The integer.
+   * @throws JsonRpc::Exception if the value is no integer or
+   *                            out of range.
+   */
+  int asInt () const;
+
+  /**
+   * Get the value as 64-bit integer.  Null is returned as zero.
+   * @return The integer.
+   * @throws JsonRpc::Exception if the value is no integer.
+   */
+  Json::Int64 asInt64 () const;
+
+  /**
+   * Get the value as boolean.  Null is false.
+   * @return The boolean.
+   * @throws JsonRpc::Exception if the value is no boolean or null.
+   */
+  bool asBool () const;
+
+  /**
+   * Convert the value to Json::Value.
+   * @return The converted value.
+   * @throws JsonRpc::JsonParseError if a number can not be read.
+   */
+  JsonRpc::JsonData toJson () const;
+
+};
+
+/**
+ * Interface for call-backs of streamed elements that can handle them as
+ * values on a tape.  An ElementCallback that also implements this is
+ * passed the elements through this interface instead, so that they are
+ * never converted to Json::Value.
+ */
+class JsonTape::Callback
+{
+
+public:
+
+  inline Callback ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~Callback ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Handle an element of the result.
+   * @param element The element.
+   */
+  virtual void element (const Value& element) = 0;
+
+};
+
+/* ************************************************************************** */
+
+inline JsonTape::Value
+JsonTape::getRoot () const
+{
+  return Value (*this, 0);
+}
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
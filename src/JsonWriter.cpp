@@ -0,0 +1,268 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for JsonWriter.hpp.  */
+
+#include "JsonWriter.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+namespace nmcrpc
+{
+
+/**
+ * Append an integer in decimal.  This does not depend on the locale.
+ * @param val The number to encode.
+ * @param neg Whether to write a minus sign before it.
+ * @param out Append to this buffer.
+ */
+static void
+writeDigits (Json::LargestUInt val, bool neg, std::string& out)
+{
+  char buf[24];
+  char* pos = buf + sizeof (buf);
+  do
+    {
+      *--pos = '0' + static_cast<char> (val % 10);
+      val /= 10;
+    }
+  while (val > 0);
+
+  if (neg)
+    *--pos = '-';
+
+  out.append (pos, buf + sizeof (buf));
+}
+
+/**
+ * Append the encoding of a JSON value.
+ * @param val The value to encode.
+ * @param out Append to this buffer.
+ */
+void
+JsonWriter::write (const JsonRpc::JsonData& val, std::string& out)
+{
+  switch (val.type ())
+    {
+    case Json::nullValue:
+      out += "null";
+      break;
+
+    case Json::booleanValue:
+      out += (val.asBool () ? "true" : "false");
+      break;
+
+    case Json::intValue:
+      {
+        const Json::LargestInt num = val.asLargestInt ();
+        /* Negate as unsigned, so that the smallest value works, too.  */
+        if (num < 0)
+          writeDigits (-static_cast<Json::LargestUInt> (num), true, out);
+        else
+          writeDigits (num, false, out);
+        break;
+      }
+
+    case Json::uintValue:
+      writeDigits (val.asLargestUInt (), false, out);
+      break;
+
+    case Json::realValue:
+      writeReal (val.asDouble (), out);
+      break;
+
+    case Json::stringValue:
+      writeString (val.asString (), out);
+      break;
+
+    case Json::arrayValue:
+      out += '[';
+      for (Json::ArrayIndex i = 0; i < val.size (); ++i)
+        {
+          if (i > 0)
+            out += ',';
+          write (val[i], out);
+        }
+      out += ']';
+      break;
+
+    case Json::objectValue:
+      out += '{';
+      for (Json::Value::const_iterator i = val.begin (); i != val.end (); ++i)
+        {
+          if (i != val.begin ())
+            out += ',';
+          writeString (i.name (), out);
+          out += ':';
+          write (*i, out);
+        }
+      out += '}';
+      break;
+    }
+}
+
+/**
+ * Append a string literal with all necessary escapes.  Non-ASCII
+ * characters are copied as they are, since the text is UTF-8 already.
+ * @param str The string to encode.
+ * @param out Append to this buffer.
+ */
+void
+JsonWriter::writeString (const std::string& str, std::string& out)
+{
+  static const char hex[] = "0123456789abcdef";
+
+  out.reserve (out.size () + str.size () + 2);
+  out += '"';
+  for (std::string::const_iterator i = str.begin (); i != str.end (); ++i)
+    {
+      const unsigned char c = *i;
+      switch (c)
+        {
+        case '"':
+          out += "\\\"";
+          break;
+        case '\\':
+          out += "\\\\";
+          break;
+        case '\b':
+          out += "\\b";
+          break;
+        case '\f':
+          out += "\\f";
+          break;
+        case '\n':
+          out += "\\n";
+          break;
+        case '\r':
+          out += "\\r";
+          break;
+        case '\t':
+          out += "\\t";
+          break;
+
+        default:
+          if (c < 0x20)
+            {
+              out += "\\u00";
+              out += hex[c >> 4];
+              out += hex[c & 0xF];
+            }
+          else
+            out += static_cast<char> (c);
+          break;
+        }
+    }
+  out += '"';
+}
+
+/**
+ * Append a floating-point number.  It is written with the shortest
+ * precision that reads back to the same value, always with '.' as
+ * decimal separator.  Like jsoncpp, NaN is written as null and
+ * infinities as numbers too large to be represented.
+ * @param val The number to encode.
+ * @param out Append to this buffer.
+ */
+void
+JsonWriter::writeReal (double val, std::string& out)
+{
+  if (val != val)
+    {
+      out += "null";
+      return;
+    }
+  if (val > 0.0 && val * 0.5 == val)
+    {
+      out += "1e+9999";
+      return;
+    }
+  if (val < 0.0 && val * 0.5 == val)
+    {
+      out += "-1e+9999";
+      return;
+    }
+
+  /* printf and strtod both use the decimal separator of the current locale,
+     so the round-trip check works in any locale.  Afterwards, replace the
+     separator (which may be more than one byte) by '.'.  That is the only
+     part of %g's output which is not a digit, sign or exponent marker.  */
+  char buf[64];
+  for (int prec = 15; prec <= 17; ++prec)
+    {
+      std::snprintf (buf, sizeof (buf), "%.*g", prec, val);
+      if (std::strtod (buf, nullptr) == val)
+        break;
+    }
+
+  bool isInteger = true;
+  bool inSeparator = false;
+  for (const char* p = buf; *p; ++p)
+    switch (*p)
+      {
+      case '0': case '1': case '2': case '3': case '4':
+      case '5': case '6': case '7': case '8': case '9':
+      case '+': case '-':
+        out += *p;
+        inSeparator = false;
+        break;
+
+      case 'e': case 'E':
+        out += 'e';
+        isInteger = false;
+        inSeparator = false;
+        break;
+
+      default:
+        if (!inSeparator)
+          out += '.';
+        isInteger = false;
+        inSeparator = true;
+        break;
+      }
+
+  /* Keep it recognisable as real number when read back.  */
+  if (isInteger)
+    out += ".0";
+}
+
+/**
+ * Append a single JSON-RPC request object.
+ * @param method The method to call.
+ * @param params The parameters as JSON array.
+ * @param id The id of the request.
+ * @param out Append to this buffer.
+ */
+void
+JsonWriter::writeRequest (const std::string& method,
+                          const JsonRpc::JsonData& params, int id,
+                          std::string& out)
+{
+  out += "{\"id\":";
+  writeDigits (id < 0 ? -static_cast<Json::LargestInt> (id) : id, id < 0, out);
+  out += ",\"method\":";
+  writeString (method, out);
+  out += ",\"params\":";
+  write (params, out);
+  out += '}';
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,100 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the JSON encoder used
+   for requests and by JsonRpc::encodeJson.  */
+
+#ifndef NMCRPC_JSONWRITER_HPP
+#define NMCRPC_JSONWRITER_HPP
+
+#include "JsonRpc.hpp"
+
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Encode JSON values into a string buffer.  In contrast to jsoncpp's
+ * writers, this appends to a buffer owned by the caller (so that it can
+ * be reused between calls) and formats numbers without depending on the
+ * global locale.  It is also used to write the request envelope directly,
+ * without building a Json::Value for it first.
+ */
+class JsonWriter
+{
+
+private:
+
+  // This class only has static methods.
+#ifndef CXX_11
+  JsonWriter ();
+  JsonWriter (const JsonWriter&);
+  JsonWriter& operator= (const JsonWriter&);
+#endif /* !CXX_11  */
+
+public:
+
+  // No instances.
+#ifdef CXX_11
+  JsonWriter () = delete;
+  JsonWriter (const JsonWriter&) = delete;
+  JsonWriter& operator= (const JsonWriter&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Append the encoding of a JSON value.
+   * @param val The value to encode.
+   * @param out Append to this buffer.
+   */
+  static void write (const JsonRpc::JsonData& val, std::string& out);
+
+  /**
+   * Append a string literal with all necessary escapes.
+   * @param str The string to encode.
+   * @param out Append to this buffer.
+   */
+  static void writeString (const std::string& str, std::string& out);
+
+  /**
+   * Append a floating-point number.  It is written with the shortest
+   * precision that reads back to the same value, always with '.' as
+   * decimal separator.
+   * @param val The number to encode.
+   * @param out Append to this buffer.
+   */
+  static void writeReal (double val, std::string& out);
+
+  /**
+   * Append a single JSON-RPC request object.
+   * @param method The method to call.
+   * @param params The parameters as JSON array.
+   * @param id The id of the request.
+   * @param out Append to this buffer.
+   */
+  static void writeRequest (const std::string& method,
+                            const JsonRpc::JsonData& params, int id,
+                            std::string& out);
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,268 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for Metrics.hpp.  */
+
+#include "Metrics.hpp"
+
+#include <sys/time.h>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* Histogram.  */
+
+/**
+ * Construct it empty.
+ */
+JsonRpc::Histogram::Histogram ()
+  : count(0), sum(0.0)
+{
+  for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+    buckets[i] = 0;
+}
+
+/**
+ * Add a sample.
+ * @param seconds The duration in seconds.
+ */
+void
+JsonRpc::Histogram::add (double seconds)
+{
+  if (seconds < 0.0)
+    seconds = 0.0;
+
+  ++count;
+  sum += seconds;
+
+  double limit = 1e-6;
+  unsigned i = 0;
+  while (i + 1 < NUM_BUCKETS && seconds >= limit)
+    {
+      ++i;
+      limit *= 2.0;
+    }
+
+  ++buckets[i];
+}
+
+/**
+ * Get the upper limit of a bucket.
+ * @param i The bucket's index, not the last one.
+ * @return The limit in seconds.
+ */
+double
+JsonRpc::Histogram::getBucketLimit (unsigned i)
+{
+  return static_cast<double> (1UL << i) * 1e-6;
+}
+
+/**
+ * Estimate a quantile as the upper limit of the bucket it falls in.
+ * Samples in the last bucket are estimated by its lower limit.
+ * @param q The quantile, between zero and one.
+ * @return The estimate in seconds, zero if there are no samples.
+ */
+double
+JsonRpc::Histogram::getQuantile (double q) const
+{
+  if (count == 0)
+    return 0.0;
+
+  const double target = q * count;
+  unsigned long seen = 0;
+  for (unsigned i = 0; i + 1 < NUM_BUCKETS; ++i)
+    {
+      seen += buckets[i];
+      if (seen >= target)
+        return getBucketLimit (i);
+    }
+
+  return getBucketLimit (NUM_BUCKETS - 2);
+}
+
+/* ************************************************************************** */
+/* CallInfo.  */
+
+/**
+ * Set the outcome from an exception thrown by the call.
+ * @param exc The exception.
+ */
+void
+JsonRpc::CallInfo::setFailure (const Exception& exc)
+{
+  const RpcError* rpc = dynamic_cast<const RpcError*> (&exc);
+  const HttpError* http = dynamic_cast<const HttpError*> (&exc);
+
+  if (rpc)
+    {
+      outcome = RPC_ERROR;
+      errorCode = rpc->getErrorCode ();
+    }
+  else if (http)
+    {
+      outcome = HTTP_ERROR;
+      errorCode = http->getResponseCode ();
+    }
+  else
+    {
+      outcome = OTHER_ERROR;
+      errorCode = 0;
+    }
+}
+
+/* ************************************************************************** */
+/* Metrics.  */
+
+/**
+ * Construct it without any calls and observer.
+ */
+Metrics::Metrics ()
+  : mutex(), stats(), observer(nullptr)
+{
+  // Nothing else to do.
+}
+
+/**
+ * Get the current time for measuring durations.
+ * @return The current time in seconds.
+ */
+double
+Metrics::now ()
+{
+  struct timeval tv;
+  gettimeofday (&tv, nullptr);
+
+  return tv.tv_sec + tv.tv_usec * 1e-6;
+}
+
+/**
+ * Count a finished call for a method, without timings.  The lock
+ * must be held.
+ * @param s The method's statistics.
+ * @param info The call's outcome.
+ */
+void
+Metrics::count (JsonRpc::MethodStats& s, const JsonRpc::CallInfo& info)
+{
+  ++s.calls;
+  switch (info.outcome)
+    {
+    case JsonRpc::CallInfo::SUCCESS:
+      return;
+
+    case JsonRpc::CallInfo::RPC_ERROR:
+      ++s.rpcErrors[info.errorCode];
+      break;
+
+    case JsonRpc::CallInfo::HTTP_ERROR:
+      ++s.httpErrors[info.errorCode];
+      break;
+
+    case JsonRpc::CallInfo::OTHER_ERROR:
+    default:
+      break;
+    }
+
+  ++s.failures;
+}
+
+/**
+ * Record a finished HTTP request and notify the observer.
+ * @param info Information about the request.
+ */
+void
+Metrics::record (const JsonRpc::CallInfo& info)
+{
+  JsonRpc::Observer* obs;
+  {
+    Lock lock(mutex);
+
+    JsonRpc::MethodStats& s = stats[info.method];
+    count (s, info);
+    s.bytesSent += info.sent;
+    s.bytesReceived += info.received;
+    s.connectTime.add (info.connectTime);
+    s.waitTime.add (info.waitTime);
+    s.transferTime.add (info.transferTime);
+    s.parseTime.add (info.parseTime);
+
+    obs = observer;
+  }
+
+  if (obs)
+    obs->callFinished (info);
+}
+
+/**
+ * Record the outcome of a call that was part of a batch.  Only the
+ * counters are updated, the timings are recorded for the batch.
+ * @param method The method called.
+ * @param res The call's result.
+ */
+void
+Metrics::recordBatched (const std::string& method,
+                        const JsonRpc::CallResult& res)
+{
+  JsonRpc::CallInfo info(method, 0);
+  if (res.isError ())
+    {
+      info.outcome = JsonRpc::CallInfo::RPC_ERROR;
+      info.errorCode = res.getErrorCode ();
+    }
+
+  Lock lock(mutex);
+  count (stats[method], info);
+}
+
+/**
+ * Get a snapshot of the statistics.
+ * @return All statistics collected so far.
+ */
+JsonRpc::MethodStatsMap
+Metrics::getStats () const
+{
+  Lock lock(mutex);
+  return stats;
+}
+
+/**
+ * Reset all statistics.
+ */
+void
+Metrics::reset ()
+{
+  Lock lock(mutex);
+  stats.clear ();
+}
+
+/**
+ * Set the observer.
+ * @param obs The new observer or NULL.
+ */
+void
+Metrics::setObserver (JsonRpc::Observer* obs)
+{
+  Lock lock(mutex);
+  observer = obs;
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,122 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the collector of
+   per-method call statistics.  */
+
+#ifndef NMCRPC_METRICS_HPP
+#define NMCRPC_METRICS_HPP
+
+#include "JsonRpc.hpp"
+#include "Thread.hpp"
+
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Collect the per-method statistics of a JsonRpc instance and pass
+ * finished calls on to the observer.  It is thread-safe.
+ */
+class Metrics
+{
+
+private:
+
+  /** Lock for the statistics and observer.  */
+  mutable Mutex mutex;
+
+  /** The statistics.  */
+  JsonRpc::MethodStatsMap stats;
+
+  /** The observer, if any.  */
+  JsonRpc::Observer* observer;
+
+  // Disable copying.
+#ifndef CXX_11
+  Metrics (const Metrics&);
+  Metrics& operator= (const Metrics&);
+#endif /* !CXX_11  */
+
+  /**
+   * Count a finished call for a method, without timings.  The lock
+   * must be held.
+   * @param s The method's statistics.
+   * @param info The call's outcome.
+   */
+  static void count (JsonRpc::MethodStats& s, const JsonRpc::CallInfo& info);
+
+public:
+
+  /**
+   * Construct it without any calls and observer.
+   */
+  Metrics ();
+
+  // No copying.
+#ifdef CXX_11
+  Metrics (const Metrics&) = delete;
+  Metrics& operator= (const Metrics&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the current time for measuring durations.
+   * @return The current time in seconds.
+   */
+  static double now ();
+
+  /**
+   * Record a finished HTTP request and notify the observer.
+   * @param info Information about the request.
+   */
+  void record (const JsonRpc::CallInfo& info);
+
+  /**
+   * Record the outcome of a call that was part of a batch.  Only the
+   * counters are updated, the timings are recorded for the batch.
+   * @param method The method called.
+   * @param res The call's result.
+   */
+  void recordBatched (const std::string& method,
+                      const JsonRpc::CallResult& res);
+
+  /**
+   * Get a snapshot of the statistics.
+   * @return All statistics collected so far.
+   */
+  JsonRpc::MethodStatsMap getStats () const;
+
+  /**
+   * Reset all statistics.
+   */
+  void reset ();
+
+  /**
+   * Set the observer.
+   * @param obs The new observer or NULL.
+   */
+  void setObserver (JsonRpc::Observer* obs);
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
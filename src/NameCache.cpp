@@ -0,0 +1,290 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for NameCache.hpp.  */
+
+#include "NameCache.hpp"
+
+#include "Thread.hpp"
+
+#include <sstream>
+
+namespace nmcrpc
+{
+
+/**
+ * Construct it.  By default, neither the time nor the height are checked,
+ * so that entries are only dropped when evicted, clear() is called or
+ * setBlockHeight notices a new block.
+ * @param n The name interface to use for lookups.
+ * @param size Maximum number of names to hold.
+ */
+NameCache::NameCache (NameInterface& n, unsigned size)
+  : nc(n), maxSize(size < 1 ? 1 : size), ttl(0), heightInterval(0),
+    negativeCaching(true), entries(), index(),
+    height(0), haveHeight(false), heightChecked(0), generation(0),
+    stats(new Stats ()), mutex(new Mutex ())
+{
+  // Nothing else to do.
+}
+
+/**
+ * Destroy it.
+ */
+NameCache::~NameCache ()
+{
+  delete mutex;
+  delete stats;
+}
+
+/**
+ * Look up a name, either from the cache or with NameInterface::queryName.
+ * @param name The name to look up.
+ * @return The name object.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+NameInterface::Name
+NameCache::queryName (const std::string& name)
+{
+  checkHeight ();
+
+  unsigned long gen;
+  {
+    Lock lock(*mutex);
+
+    const entryMapT::iterator i = index.find (name);
+    if (i != index.end ())
+      {
+        const entryListT::iterator e = i->second;
+        if (ttl == 0 || std::time (nullptr) - e->stored < ttl)
+          {
+            entries.splice (entries.begin (), entries, e);
+            ++stats->hits;
+            if (!e->name.exists ())
+              ++stats->negativeHits;
+            return e->name;
+          }
+
+        entries.erase (e);
+        index.erase (i);
+      }
+
+    ++stats->misses;
+    gen = generation;
+  }
+
+  /* Do the actual query without holding the lock.  */
+  const NameInterface::Name res = nc.queryName (name);
+  if (!res.exists () && !negativeCaching)
+    return res;
+
+  Lock lock(*mutex);
+  if (gen != generation)
+    return res;
+
+  const entryMapT::iterator i = index.find (name);
+  if (i != index.end ())
+    {
+      entries.erase (i->second);
+      index.erase (i);
+    }
+
+  entries.push_front (Entry (res, std::time (nullptr)));
+  index[name] = entries.begin ();
+
+  while (entries.size () > maxSize)
+    {
+      index.erase (entries.back ().name.getName ());
+      entries.pop_back ();
+      ++stats->evictions;
+    }
+
+  return res;
+}
+
+/**
+ * Look up a name by namespace and name.
+ * @see queryName (const std::string&)
+ * @param ns The namespace.
+ * @param name The (namespace-less) name.
+ * @return The name object.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+NameInterface::Name
+NameCache::queryName (const std::string& ns, const std::string& name)
+{
+  std::ostringstream full;
+  full << ns << "/" << name;
+
+  return queryName (full.str ());
+}
+
+/**
+ * Drop a single name from the cache, if it is there.  This can be used
+ * after updating the name.
+ * @param name The name to drop.
+ */
+void
+NameCache::invalidate (const std::string& name)
+{
+  Lock lock(*mutex);
+
+  const entryMapT::iterator i = index.find (name);
+  if (i != index.end ())
+    {
+      entries.erase (i->second);
+      index.erase (i);
+    }
+}
+
+/**
+ * Drop all names from the cache.
+ */
+void
+NameCache::clear ()
+{
+  Lock lock(*mutex);
+  clearLocked ();
+}
+
+/**
+ * Remove all entries.  The lock must be held.
+ */
+void
+NameCache::clearLocked ()
+{
+  entries.clear ();
+  index.clear ();
+  ++generation;
+}
+
+/**
+ * Tell the cache about the current block height.  If it changed, all
+ * entries are dropped.
+ * @param h The current block height.
+ */
+void
+NameCache::setBlockHeight (unsigned h)
+{
+  Lock lock(*mutex);
+
+  if (!haveHeight)
+    {
+      height = h;
+      haveHeight = true;
+    }
+  else if (h != height)
+    newTipLocked (h);
+}
+
+/**
+ * Drop all entries when notified of a new chain tip by a ChainTipWatcher.
+ * Unlike setBlockHeight, this also clears the cache if only the best block
+ * changed but not the height.
+ * @param h The new block height.
+ * @param hash The new best block hash.
+ */
+void
+NameCache::tipChanged (unsigned h, const std::string&)
+{
+  Lock lock(*mutex);
+  newTipLocked (h);
+}
+
+/**
+ * Record a new chain tip, clearing the cache.  The lock must be held.
+ * @param h The new block height.
+ */
+void
+NameCache::newTipLocked (unsigned h)
+{
+  clearLocked ();
+  ++stats->blockClears;
+
+  height = h;
+  haveHeight = true;
+}
+
+/**
+ * Query the block height if it is time for it, and clear the cache
+ * if it changed.
+ */
+void
+NameCache::checkHeight ()
+{
+  if (heightInterval == 0)
+    return;
+
+  {
+    Lock lock(*mutex);
+
+    const std::time_t now = std::time (nullptr);
+    if (haveHeight && now - heightChecked < heightInterval)
+      return;
+
+    /* Set the time already now, so that other threads don't
+       query the height as well in the meantime.  */
+    heightChecked = now;
+  }
+
+  setBlockHeight (nc.getBlockCount ());
+}
+
+/**
+ * Get the number of names currently held.
+ * @return The number of cached names.
+ */
+unsigned
+NameCache::getSize () const
+{
+  Lock lock(*mutex);
+  return entries.size ();
+}
+
+/**
+ * Get a snapshot of the lookup statistics.
+ * @return The statistics.
+ */
+NameCache::Stats
+NameCache::getStats () const
+{
+  Lock lock(*mutex);
+  return *stats;
+}
+
+/**
+ * Set the maximum number of names held.  Excess names are evicted.
+ * @param s The new maximum size.
+ */
+void
+NameCache::setMaxSize (unsigned s)
+{
+  Lock lock(*mutex);
+
+  maxSize = (s < 1 ? 1 : s);
+  while (entries.size () > maxSize)
+    {
+      index.erase (entries.back ().name.getName ());
+      entries.pop_back ();
+      ++stats->evictions;
+    }
+}
+
+} // namespace nmcrpc
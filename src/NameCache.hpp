@@ -0,0 +1,364 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_NAMECACHE_HPP
+#define NMCRPC_NAMECACHE_HPP
+
+#include "ChainTipWatcher.hpp"
+#include "NameInterface.hpp"
+
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+
+namespace nmcrpc
+{
+
+class Mutex;
+
+/* ************************************************************************** */
+/* Cache for name lookups.  */
+
+/**
+ * Cache the results of NameInterface::queryName.  Names can only change
+ * when a new block arrives, so entries are dropped when the block height
+ * changes.  The height can either be polled by the cache itself in a
+ * configurable interval, or be passed in from the outside with
+ * setBlockHeight.  The cache can also be registered as listener with
+ * a ChainTipWatcher.  In addition, entries can expire after a fixed time.
+ * The cache holds a bounded number of names and evicts the least recently
+ * used ones.  Non-existing names are cached, too, unless disabled.
+ *
+ * The cache can be shared between threads.
+ */
+class NameCache : public ChainTipWatcher::Listener
+{
+
+public:
+
+  class Stats;
+
+private:
+
+  /** A single cache entry.  */
+  class Entry;
+
+  /** Type of the entry list, ordered from most to least recently used.  */
+  typedef std::list<Entry> entryListT;
+  /** Type of the index into the entry list.  */
+  typedef std::map<std::string, entryListT::iterator> entryMapT;
+
+  /** The name interface to use for lookups.  */
+  NameInterface& nc;
+
+  /** Maximum number of names held.  */
+  unsigned maxSize;
+
+  /** Time in seconds after which entries expire, zero to disable.  */
+  unsigned ttl;
+
+  /**
+   * Interval in seconds between checks of the block height,
+   * zero to not check automatically.
+   */
+  unsigned heightInterval;
+
+  /** Whether non-existing names are cached.  */
+  bool negativeCaching;
+
+  /** The entries.  */
+  entryListT entries;
+
+  /** Index into the entries by name.  */
+  entryMapT index;
+
+  /** Last known block height.  */
+  unsigned height;
+
+  /** Whether the height is known.  */
+  bool haveHeight;
+
+  /** Time of the last automatic height check.  */
+  std::time_t heightChecked;
+
+  /**
+   * Counter of cache clears.  Lookups started before a clear
+   * must not store their (possibly outdated) results.
+   */
+  unsigned long generation;
+
+  /** Lookup statistics.  */
+  Stats* stats;
+
+  /** Lock for all of the state.  */
+  Mutex* mutex;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  NameCache ();
+  NameCache (const NameCache&);
+  NameCache& operator= (const NameCache&);
+#endif /* !CXX_11  */
+
+  /**
+   * Query the block height if it is time for it, and clear the cache
+   * if it changed.
+   */
+  void checkHeight ();
+
+  /**
+   * Remove all entries.  The lock must be held.
+   */
+  void clearLocked ();
+
+  /**
+   * Record a new chain tip, clearing the cache.  The lock must be held.
+   * @param h The new block height.
+   */
+  void newTipLocked (unsigned h);
+
+public:
+
+  /**
+   * Construct it.  By default, neither the time nor the height are checked,
+   * so that entries are only dropped when evicted, clear() is called or
+   * setBlockHeight notices a new block.
+   * @param n The name interface to use for lookups.
+   * @param size Maximum number of names to hold.
+   */
+  explicit NameCache (NameInterface& n, unsigned size = 1000);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  NameCache () = delete;
+  NameCache (const NameCache&) = delete;
+  NameCache& operator= (const NameCache&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it.
+   */
+  ~NameCache ();
+
+  /**
+   * Look up a name, either from the cache or with NameInterface::queryName.
+   * @param name The name to look up.
+   * @return The name object.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  NameInterface::Name queryName (const std::string& name);
+
+  /**
+   * Look up a name by namespace and name.
+   * @see queryName (const std::string&)
+   * @param ns The namespace.
+   * @param name The (namespace-less) name.
+   * @return The name object.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  NameInterface::Name queryName (const std::string& ns,
+                                 const std::string& name);
+
+  /**
+   * Drop a single name from the cache, if it is there.  This can be used
+   * after updating the name.
+   * @param name The name to drop.
+   */
+  void invalidate (const std::string& name);
+
+  /**
+   * Drop all names from the cache.
+   */
+  void clear ();
+
+  /**
+   * Tell the cache about the current block height.  If it changed, all
+   * entries are dropped.
+   * @param h The current block height.
+   */
+  void setBlockHeight (unsigned h);
+
+  /**
+   * Drop all entries when notified of a new chain tip by a ChainTipWatcher.
+   * Unlike setBlockHeight, this also clears the cache if only the best block
+   * changed but not the height.
+   * @param h The new block height.
+   * @param hash The new best block hash.
+   */
+  void tipChanged (unsigned h, const std::string& hash);
+
+  /**
+   * Get the number of names currently held.
+   * @return The number of cached names.
+   */
+  unsigned getSize () const;
+
+  /**
+   * Get a snapshot of the lookup statistics.
+   * @return The statistics.
+   */
+  Stats getStats () const;
+
+  /* Accessor methods.  These should be used before the cache is shared
+     between threads.  */
+
+  inline unsigned
+  getMaxSize () const
+  {
+    return maxSize;
+  }
+  void setMaxSize (unsigned s);
+
+  inline unsigned
+  getTtl () const
+  {
+    return ttl;
+  }
+  inline void
+  setTtl (unsigned t)
+  {
+    ttl = t;
+  }
+
+  inline unsigned
+  getHeightCheckInterval () const
+  {
+    return heightInterval;
+  }
+  inline void
+  setHeightCheckInterval (unsigned i)
+  {
+    heightInterval = i;
+  }
+
+  inline bool
+  getNegativeCaching () const
+  {
+    return negativeCaching;
+  }
+  inline void
+  setNegativeCaching (bool n)
+  {
+    negativeCaching = n;
+  }
+
+};
+
+/**
+ * A single entry of the cache.
+ */
+class NameCache::Entry
+{
+
+public:
+
+  /** The cached name.  */
+  NameInterface::Name name;
+
+  /** Time when the entry was stored.  */
+  std::time_t stored;
+
+  /**
+   * Construct it.
+   * @param n The name to hold.
+   * @param t The current time.
+   */
+  inline Entry (const NameInterface::Name& n, std::time_t t)
+    : name(n), stored(t)
+  {
+    // Nothing else to do.
+  }
+
+};
+
+/**
+ * Counters about cache lookups.
+ */
+class NameCache::Stats
+{
+
+private:
+
+  friend class NameCache;
+
+  /** Number of lookups answered from the cache.  */
+  unsigned long hits;
+  /** Number of those hits that were for non-existing names.  */
+  unsigned long negativeHits;
+  /** Number of lookups that had to query the daemon.  */
+  unsigned long misses;
+  /** Number of entries evicted because the cache was full.  */
+  unsigned long evictions;
+  /** Number of times the cache was cleared due to a new block.  */
+  unsigned long blockClears;
+
+public:
+
+  /**
+   * Construct with all counters zero.
+   */
+  inline Stats ()
+    : hits(0), negativeHits(0), misses(0), evictions(0), blockClears(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying is ok.
+#ifdef CXX_11
+  Stats (const Stats&) = default;
+  Stats& operator= (const Stats&) = default;
+#endif /* CXX_11?  */
+
+  inline unsigned long
+  getHits () const
+  {
+    return hits;
+  }
+
+  inline unsigned long
+  getNegativeHits () const
+  {
+    return negativeHits;
+  }
+
+  inline unsigned long
+  getMisses () const
+  {
+    return misses;
+  }
+
+  inline unsigned long
+  getEvictions () const
+  {
+    return evictions;
+  }
+
+  inline unsigned long
+  getBlockClears () const
+  {
+    return blockClears;
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -22,7 +22,13 @@
 
 #include "NameInterface.hpp"
 
+#include "JsonTape.hpp"
+#include "NameScanner.hpp"
+#include "NameTable.hpp"
+
+#include <map>
 #include <sstream>
+#include <stdexcept>
 
 namespace nmcrpc
 {
@@ -30,6 +36,9 @@ namespace nmcrpc
 /* ************************************************************************** */
 /* High-level interface to Namecoin.  */
 
+/** Number of blocks after which a name expires since its last update.  */
+const unsigned NameInterface::EXPIRATION_DEPTH = 36000;
+
 /**
  * Query for a name by string.  If the name is registered, this immediately
  * queries for the name's associated data.  If the name does not yet exist,
@@ -41,7 +50,7 @@ namespace nmcrpc
 NameInterface::Name
 NameInterface::queryName (const std::string& name)
 {
-  return Name (name, *this, rpc);
+  return Name (name, *this, lazyNames);
 }
 
 /**
@@ -59,37 +68,382 @@ NameInterface::queryName (const std::string& ns, const std::string& name)
   return queryName (full.str ());
 }
 
+/**
+ * Start a query for a name asynchronously.  This performs the same
+ * RPC calls as queryName, but they are processed in the background
+ * and the result is made available in the passed object.
+ * @param name The name to check.
+ * @param res The object receiving the result.
+ * @throws JsonRpc::Exception if starting the query fails.
+ */
+void
+NameInterface::queryNameAsync (const std::string& name, AsyncName& res)
+{
+  res.nc = this;
+  res.name = name;
+  res.done = false;
+  res.haveResult = false;
+  res.submitError.clear ();
+
+  JsonRpc::JsonData params(Json::arrayValue);
+  params.append (name);
+  rpc.executeRpcAsync ("name_show", params, res.show);
+}
+
+/**
+ * Check whether a name_list entry has all the data we need to build
+ * the Name object from it (as opposed to calling name_show).
+ * @param entry The name_list entry.
+ * @return True iff the entry can be used directly.
+ */
+static bool
+isCompleteListEntry (const JsonRpc::JsonData& entry)
+{
+  return entry.isObject ()
+          && entry["name"].isString () && entry["value"].isString ()
+          && entry["address"].isString () && entry.isMember ("expires_in");
+}
+
+/**
+ * Query the data of all user-owned names in the wallet, for queryMyNames.
+ * Entries sent away are skipped, name_show is only done (batched) for
+ * entries that lack some of the data, and ownership is checked once per
+ * distinct address, also in a single batch.
+ * @param entries Set to the name_list or name_show data of the names.
+ * @param addrs Set to the address of each name.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+void
+NameInterface::queryMyEntries (std::vector<JsonRpc::JsonData>& entries,
+                               std::vector<Address>& addrs)
+{
+  const JsonRpc::JsonData list = rpc.executeRpc ("name_list");
+  if (!list.isArray ())
+    throw JsonRpc::Exception ("name_list returned no array.");
+
+  /* Collect the data of all names not sent away, and find those
+     that need name_show.  */
+  entries.clear ();
+  std::vector<JsonRpc::Call> shows;
+  std::vector<unsigned> showIndices;
+  for (Json::ArrayIndex i = 0; i < list.size (); ++i)
+    {
+      const JsonRpc::JsonData& entry = list[i];
+      if (entry["transferred"].isConvertibleTo (Json::booleanValue)
+          && entry["transferred"].asBool ())
+        continue;
+
+      entries.push_back (entry);
+      if (!isCompleteListEntry (entry))
+        {
+          const std::string name = entry["name"].asString ();
+          shows.push_back (JsonRpc::Call ("name_show").addParam (name));
+          showIndices.push_back (entries.size () - 1);
+        }
+    }
+
+  if (!shows.empty ())
+    {
+      const std::vector<JsonRpc::CallResult> res = rpc.executeRpcBatch (shows);
+      for (unsigned i = 0; i < res.size (); ++i)
+        {
+          JsonRpc::JsonData& entry = entries[showIndices[i]];
+          if (res[i].isError () && res[i].getErrorCode () == -4)
+            entry = JsonRpc::JsonData ();
+          else
+            entry = res[i].get ();
+        }
+    }
+
+  /* Look up each distinct address once.  */
+  std::map<std::string, JsonRpc::JsonData> infos;
+  std::vector<JsonRpc::Call> checks;
+  std::vector<std::string> checkAddrs;
+  for (unsigned i = 0; i < entries.size (); ++i)
+    {
+      if (entries[i].isNull ())
+        continue;
+
+      const std::string addr = entries[i]["address"].asString ();
+      if (infos.insert (std::make_pair (addr, JsonRpc::JsonData ())).second)
+        {
+          checks.push_back (JsonRpc::Call ("validateaddress").addParam (addr));
+          checkAddrs.push_back (addr);
+        }
+    }
+
+  if (!checks.empty ())
+    {
+      const std::vector<JsonRpc::CallResult> res
+        = rpc.executeRpcBatch (checks);
+      for (unsigned i = 0; i < res.size (); ++i)
+        infos[checkAddrs[i]] = res[i].get ();
+    }
+
+  /* Keep only the owned names, moving them to the front.  */
+  unsigned kept = 0;
+  addrs.clear ();
+  for (unsigned i = 0; i < entries.size (); ++i)
+    {
+      if (entries[i].isNull ())
+        continue;
+
+      const std::string addr = entries[i]["address"].asString ();
+      const Address a = addressFromInfo (addr, infos[addr]);
+      if (!a.isMine ())
+        continue;
+
+      if (kept != i)
+        entries[kept].swap (entries[i]);
+      ++kept;
+      addrs.push_back (a);
+    }
+  entries.resize (kept);
+}
+
+/**
+ * Query for all user-owned names in the wallet (according to name_list but
+ * filtering out names that have been sent away).  The Name objects are
+ * built from the name_list data directly, name_show is only done (batched)
+ * for entries that lack some of the data.  Ownership is checked once per
+ * distinct address, also in a single batch.
+ * @return The user's names.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+std::vector<NameInterface::Name>
+NameInterface::queryMyNames ()
+{
+  std::vector<JsonRpc::JsonData> entries;
+  std::vector<Address> addrs;
+  queryMyEntries (entries, addrs);
+
+  std::vector<Name> names;
+  names.reserve (entries.size ());
+  for (unsigned i = 0; i < entries.size (); ++i)
+    names.push_back (Name (entries[i]["name"].asString (), entries[i],
+                           addrs[i], keepFullData));
+
+  return names;
+}
+
+/**
+ * Query for all user-owned names in the wallet like queryMyNames,
+ * but add them to a table instead of building Name objects.  They are
+ * all marked as owned.
+ * @param table Add the names to this table.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+void
+NameInterface::queryMyNames (NameTable& table)
+{
+  std::vector<JsonRpc::JsonData> entries;
+  std::vector<Address> addrs;
+  queryMyEntries (entries, addrs);
+
+  for (unsigned i = 0; i < entries.size (); ++i)
+    {
+      const JsonRpc::JsonData& entry = entries[i];
+      table.add (entry["name"].asString (), entry["value"].asString (),
+                 addrs[i].getAddress (), entry["expires_in"].asInt (),
+                 entry["height"].asUInt (), true);
+    }
+}
+
+/**
+ * Run a scan over all names, feeding them to the call-back.
+ * @param cb The call-back to use.
+ * @param opts Options for the scan.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if a call-back failed on a worker thread.
+ */
+void
+NameInterface::scanNames (ScanCallback& cb, const ScanOptions& opts)
+{
+  NameScanner scanner(rpc, cb, opts);
+  scanner.run ();
+}
+
+/**
+ * Call-back for collectNames, which adds the entries to a table.
+ */
+class TableFiller
+{
+
+private:
+
+  /** The table to fill.  */
+  NameTable& table;
+
+public:
+
+  explicit inline TableFiller (NameTable& t)
+    : table(t)
+  {
+    // Nothing else to do.
+  }
+
+  inline void
+  operator() (const NameInterface::ScanEntry& entry)
+  {
+    table.add (entry);
+  }
+
+};
+
+/**
+ * Add all names in the index (according to name_scan) to a table.
+ * This uses the default ScanOptions.
+ * @param table Add the names to this table.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+void
+NameInterface::collectNames (NameTable& table)
+{
+  collectNames (table, ScanOptions ());
+}
+
+/**
+ * Add the names in the range given by the options to a table.
+ * Worker threads in the options are ignored, since the table is
+ * filled in order.
+ * @param table Add the names to this table.
+ * @param opts Options for the scan.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if the filter is invalid.
+ */
+void
+NameInterface::collectNames (NameTable& table, const ScanOptions& opts)
+{
+  ScanOptions inOrder(opts);
+  inOrder.setWorkers (0);
+
+  forAllNames (TableFiller (table), inOrder);
+}
+
 /* ************************************************************************** */
 /* Name object.  */
 
+/**
+ * Read the fields of name_show data kept in Name, given either as
+ * Json::Value or on a tape.
+ * @param d The name_show result.
+ * @param value Set to the value.
+ * @param expiresIn Set to the blocks until expiration.
+ * @param expired Set to whether the name is expired.
+ */
+template<typename T>
+  static void
+  readFields (const T& d, std::string& value, int& expiresIn, bool& expired)
+{
+  value = d["value"].asString ();
+  expiresIn = d["expires_in"].asInt ();
+  expired = (d["expired"].isInt () && (d["expired"].asInt () != 0));
+}
+
 /**
  * Construct the name.  This is meant to be used only
  * from inside NameInterface.  Outside users should use
  * NameInterface::queryName or other methods to obtain
  * name objects.
  * @param n The name's string.
- * @param nc NameInterface object.
- * @param rpc The RPC object to use for finding info about the name.
+ * @param nc NameInterface object, used for finding info about the name.
+ * @param lazy Whether to look up the data only when it is accessed.
  */
 NameInterface::Name::Name (const std::string& n, NameInterface& nc,
-                           JsonRpc& rpc)
-  : initialised(true), name(n)
+                           bool lazy)
+  : initialised(true), name(n), source(&nc), needShow(true),
+    needAddress(true), ex(false), expiresIn(0), expired(false),
+    haveData(false)
+{
+  if (lazy)
+    return;
+
+  fetchShow ();
+  if (ex)
+    fetchAddress ();
+}
+
+/**
+ * Do the name_show call and fill in the fields from it.  If the name
+ * does not exist, there is no address to look up either.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+void
+NameInterface::Name::fetchShow () const
 {
   try
     {
-      data = rpc.executeRpc ("name_show", n);
+      JsonRpc::JsonData params(Json::arrayValue);
+      params.append (name);
+
+      /* Only a few fields are needed unless the full data is kept,
+         so read them directly from the response.  */
+      JsonTape tape;
+      source->rpc.executeRpcTape ("name_show", params, tape);
+      const JsonTape::Value res = tape.getRoot ()["result"];
+
       ex = true;
-      addr = nc.queryAddress (data["address"].asString ());
+      addrString = res["address"].asString ();
+      readFields (res, value, expiresIn, expired);
+
+      haveData = source->keepFullData;
+      if (haveData)
+        data = res.toJson ();
     }
   catch (const JsonRpc::RpcError& exc)
     {
-      if (exc.getErrorCode () == -4)
-        {
-          ex = false;
-          return;
-        }
-      throw exc;
+      if (exc.getErrorCode () != -4)
+        throw exc;
+
+      ex = false;
+      needAddress = false;
     }
+
+  needShow = false;
+}
+
+/**
+ * Look up the address holding the name.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+void
+NameInterface::Name::fetchAddress () const
+{
+  addr = source->queryAddress (addrString);
+  addrString.clear ();
+  needAddress = false;
+}
+
+/**
+ * Construct the name from already queried data.
+ * @param n The name's string.
+ * @param d The name_show result, or null if the name doesn't exist.
+ * @param a The address holding the name.
+ * @param keep Whether to keep the full data.
+ */
+NameInterface::Name::Name (const std::string& n, const JsonRpc::JsonData& d,
+                           const Address& a, bool keep)
+  : initialised(true), name(n), source(nullptr), needShow(false),
+    needAddress(false), ex(!d.isNull ()), addr(a), expiresIn(0),
+    expired(false), haveData(false)
+{
+  if (ex)
+    fillFrom (d, keep);
+}
+
+/**
+ * Extract the fields from the name_show data.
+ * @param d The name_show result.
+ * @param keep Whether to keep the full data.
+ */
+void
+NameInterface::Name::fillFrom (const JsonRpc::JsonData& d, bool keep)
+{
+  readFields (d, value, expiresIn, expired);
+
+  haveData = keep;
+  if (keep)
+    data = d;
 }
 
 /**
@@ -99,6 +453,7 @@ NameInterface::Name::Name (const std::string& n, NameInterface& nc,
 void
 NameInterface::Name::ensureExists () const
 {
+  ensureShown ();
   if (!ex)
     throw NameNotFound (name);
 }
@@ -124,4 +479,125 @@ NameInterface::Name::split (const std::string& name,
   return true;
 }
 
+/* ************************************************************************** */
+/* Asynchronous name query.  */
+
+/**
+ * Notify the parent of the finished call.
+ */
+void
+NameInterface::AsyncName::Stage::completed ()
+{
+  parent.stageCompleted (*this);
+}
+
+/**
+ * Construct it, not yet associated to any query.
+ */
+NameInterface::AsyncName::AsyncName ()
+  : nc(nullptr), name(), show(*this), addr(*this),
+    done(false), haveResult(false), result(), submitError()
+{
+  // Nothing else to do.
+}
+
+/**
+ * Handle a finished stage, starting the next one if necessary.
+ * @param stage The stage that is finished.
+ */
+void
+NameInterface::AsyncName::stageCompleted (const Stage& stage)
+{
+  assert (nc && !done);
+
+  if (&stage == &addr)
+    {
+      done = true;
+      if (addr.isSuccess ())
+        {
+          const JsonRpc::JsonData& data = show.get ();
+          const Address a = nc->addressFromInfo (data["address"].asString (),
+                                                 addr.get ());
+          result = Name (name, data, a, nc->keepFullData);
+          haveResult = true;
+        }
+      return;
+    }
+
+  assert (&stage == &show);
+  if (show.isSuccess ())
+    {
+      JsonRpc::JsonData params(Json::arrayValue);
+      params.append (show.get ()["address"]);
+      try
+        {
+          nc->rpc.executeRpcAsync ("validateaddress", params, addr);
+        }
+      catch (const JsonRpc::Exception& exc)
+        {
+          submitError = exc.what ();
+          done = true;
+        }
+      return;
+    }
+
+  done = true;
+  try
+    {
+      show.get ();
+    }
+  catch (const JsonRpc::RpcError& exc)
+    {
+      if (exc.getErrorCode () == -4)
+        {
+          result = Name (name, JsonRpc::JsonData (), Address (), false);
+          haveResult = true;
+        }
+    }
+  catch (const JsonRpc::Exception&)
+    {
+      // The error will be thrown again from get().
+    }
+}
+
+/**
+ * Wait for the query to finish.
+ * @throws std::logic_error if the query was never started.
+ */
+void
+NameInterface::AsyncName::wait ()
+{
+  if (!nc)
+    throw std::logic_error ("AsyncName was never started.");
+
+  /* The second stage is started (if necessary) on completion of the
+     first one, before show.wait() returns.  */
+  show.wait ();
+  if (!done)
+    addr.wait ();
+  assert (done);
+}
+
+/**
+ * Wait for the query to finish and return the result.
+ * @return The name object, as queryName would have returned it.
+ * @throws JsonRpc::Exception and subclasses if the query failed.
+ */
+const NameInterface::Name&
+NameInterface::AsyncName::get ()
+{
+  wait ();
+  if (haveResult)
+    return result;
+
+  if (!submitError.empty ())
+    throw JsonRpc::Exception (submitError);
+
+  /* One of those throws the error.  */
+  show.get ();
+  addr.get ();
+
+  throw std::logic_error ("AsyncName failed without error.");
+}
+
 } // namespace nmcrpc
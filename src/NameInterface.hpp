@@ -27,16 +27,20 @@
 #include <cassert>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace nmcrpc
 {
 
+class NameTable;
+
 /* ************************************************************************** */
 /* High-level interface to Namecoin.  */
 
 /**
  * Extend the generic coin interface with high-level access to name
- * functionality.
+ * functionality.  It can be shared between threads, but the Name
+ * objects returned should each be used by only one.
  */
 class NameInterface : public CoinInterface
 {
@@ -47,10 +51,47 @@ public:
   class NameNotFound;
 
   /* Other child classes.  */
+  class AsyncName;
   class Name;
+  class ScanEntry;
+  class ScanOptions;
 
 private:
 
+  friend class NameScanner;
+
+  /** Whether Name objects should keep the full name_show data.  */
+  bool keepFullData;
+
+  /** Whether queryName returns lazily looked-up names.  */
+  bool lazyNames;
+
+  /** Interface for call-backs of name scans.  */
+  class ScanCallback;
+
+  /** Wrap an arbitrary call-back as ScanCallback.  */
+  template<typename T>
+    class ScanCallbackWrapper;
+
+  /**
+   * Run a scan over the names in the range given by the options,
+   * feeding them to the call-back.
+   * @param cb The call-back to use.
+   * @param opts Options for the scan.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if a call-back failed on a worker thread.
+   */
+  void scanNames (ScanCallback& cb, const ScanOptions& opts);
+
+  /**
+   * Query the data of all user-owned names in the wallet, for queryMyNames.
+   * @param entries Set to the name_list or name_show data of the names.
+   * @param addrs Set to the address of each name.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  void queryMyEntries (std::vector<JsonRpc::JsonData>& entries,
+                       std::vector<Address>& addrs);
+
   // Disable copying and default constructor.
 #ifndef CXX_11
   NameInterface ();
@@ -60,12 +101,15 @@ private:
 
 public:
 
+  /** Number of blocks after which a name expires since its last update.  */
+  static const unsigned EXPIRATION_DEPTH;
+
   /**
    * Construct it with the given RPC connection.
    * @param r The RPC connection.
    */
   explicit inline NameInterface (JsonRpc& r)
-    : CoinInterface(r)
+    : CoinInterface(r), keepFullData(false), lazyNames(false)
   {
     // Nothing more to be done.
   }
@@ -77,6 +121,56 @@ public:
   NameInterface& operator= (const NameInterface&) = delete;
 #endif /* CXX_11?  */
 
+  /**
+   * Set whether Name objects returned should keep the full JSON data
+   * of the name, so that Name::getFullData can be used.  By default
+   * only the fields needed by the other accessors are extracted.
+   * This should be set before the interface is used by other threads.
+   * @param keep Whether to keep the full data.
+   */
+  inline void
+  setKeepFullData (bool keep)
+  {
+    keepFullData = keep;
+  }
+
+  /**
+   * Get whether Name objects keep their full JSON data.
+   * @return True iff the full data is kept.
+   */
+  inline bool
+  getKeepFullData () const
+  {
+    return keepFullData;
+  }
+
+  /**
+   * Set whether queryName should return names that are looked up lazily.
+   * Such names only call name_show when their existence, value or other
+   * data is first asked for, and look up their address (which takes
+   * another RPC call to find out whether it is owned) only when
+   * Name::getAddress is used.  The results are kept in the Name object.
+   * Lazy names must not outlive the interface, and the lookups
+   * happen in the thread using the Name.
+   * This should be set before the interface is used by other threads.
+   * @param lazy Whether to return lazy names.
+   */
+  inline void
+  setLazyNames (bool lazy)
+  {
+    lazyNames = lazy;
+  }
+
+  /**
+   * Get whether queryName returns lazily looked-up names.
+   * @return True iff names are looked up lazily.
+   */
+  inline bool
+  getLazyNames () const
+  {
+    return lazyNames;
+  }
+
   /**
    * Query for a name by string.  If the name is registered, this immediately
    * queries for the name's associated data.  If the name does not yet exist,
@@ -96,10 +190,41 @@ public:
    */
   Name queryName (const std::string& ns, const std::string& name);
 
+  /**
+   * Start a query for a name asynchronously.  This performs the same
+   * RPC calls as queryName, but they are processed in the background
+   * and the result is made available in the passed object.
+   * @param name The name to check.
+   * @param res The object receiving the result.
+   * @throws JsonRpc::Exception if starting the query fails.
+   */
+  void queryNameAsync (const std::string& name, AsyncName& res);
+
+  /**
+   * Query for all user-owned names in the wallet (according to name_list but
+   * filtering out names that have been sent away).  The Name objects are
+   * built from the name_list data directly, name_show is only done (batched)
+   * for entries that lack some of the data.  Ownership is checked once per
+   * distinct address, also in a single batch.
+   * @return The user's names.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  std::vector<Name> queryMyNames ();
+
+  /**
+   * Query for all user-owned names in the wallet like queryMyNames,
+   * but add them to a table instead of building Name objects.  They are
+   * all marked as owned.
+   * @param table Add the names to this table.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  void queryMyNames (NameTable& table);
+
   /**
    * Query for all user-owned names in the wallet (according to name_list but
    * filtering out names that have been sent away) and execute some call-back
    * on them.
+   * @see queryMyNames
    * @param cb Call-back routine.
    */
   template<typename T>
@@ -107,19 +232,463 @@ public:
 
   /**
    * Query for all names in the index (according to name_scan) and execute
-   * some call-back on them.
+   * some call-back on them.  The call-back gets a ScanEntry for each name.
+   * This uses the default ScanOptions.
    * @param cb Call-back routine.
    */
   template<typename T>
     void forAllNames (T cb);
 
+  /**
+   * Query for names in the index (according to name_scan) and execute
+   * some call-back on them.  The call-back gets a ScanEntry for each name.
+   * The next pages are already fetched while the call-back processes the
+   * current one.  If worker threads are requested in the options, the
+   * call-back is run on them and must be safe to call concurrently.
+   * If the options restrict the range of names, only those are scanned.
+   * @param cb Call-back routine.
+   * @param opts Options for the scan.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if a call-back failed on a worker thread
+   *                            or the filter is invalid.
+   */
+  template<typename T>
+    void forAllNames (T cb, const ScanOptions& opts);
+
+  /**
+   * Add all names in the index (according to name_scan) to a table.
+   * This uses the default ScanOptions.
+   * @param table Add the names to this table.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  void collectNames (NameTable& table);
+
+  /**
+   * Add the names in the range given by the options to a table.
+   * Worker threads in the options are ignored, since the table is
+   * filled in order.
+   * @param table Add the names to this table.
+   * @param opts Options for the scan.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if the filter is invalid.
+   */
+  void collectNames (NameTable& table, const ScanOptions& opts);
+
+  /**
+   * Query for all names starting with a prefix and execute some call-back
+   * on them.  Scanning starts at the prefix and stops as soon as a
+   * name not matching it is found.
+   * @see forAllNames (T, const ScanOptions&)
+   * @param prefix The prefix, e.g. "d/" for a namespace.
+   * @param cb Call-back routine.
+   */
+  template<typename T>
+    void forNames (const std::string& prefix, T cb);
+
+};
+
+/* ************************************************************************** */
+/* Options and call-backs for name scans.  */
+
+/**
+ * Options for scanning through all names with forAllNames.
+ */
+class NameInterface::ScanOptions
+{
+
+private:
+
+  /** Number of names requested per name_scan call.  */
+  unsigned pageSize;
+
+  /** Number of pages fetched in advance.  */
+  unsigned prefetch;
+
+  /** Number of worker threads for the call-backs, zero to not use any.  */
+  unsigned workers;
+
+  /** Name to start the scan at.  */
+  std::string start;
+
+  /** Stop at the first name not less than this, if not empty.  */
+  std::string end;
+
+  /** Stop at the first name not starting with this.  */
+  std::string prefix;
+
+  /** Only pass names matching this extended regex on, if not empty.  */
+  std::string filter;
+
+  /** Stop after this many names were passed on, zero for no limit.  */
+  unsigned maxCount;
+
+  /** Options for each name_scan call.  */
+  JsonRpc::CallOptions callOptions;
+
+public:
+
+  /**
+   * Construct with default options:  Pages of 500 names, two pages
+   * prefetched, call-backs run on the scanning thread and all
+   * names scanned.
+   */
+  inline ScanOptions ()
+    : pageSize(500), prefetch(2), workers(0),
+      start(), end(), prefix(), filter(), maxCount(0), callOptions()
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  ScanOptions (const ScanOptions&) = default;
+  ScanOptions (ScanOptions&&) = default;
+  ScanOptions& operator= (const ScanOptions&) = default;
+  ScanOptions& operator= (ScanOptions&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Set the number of names requested per page.  Values below two are
+   * raised to two, since each page after the first repeats the last name
+   * from before.
+   * @param s The page size.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setPageSize (unsigned s)
+  {
+    pageSize = (s < 2 ? 2 : s);
+    return *this;
+  }
+
+  inline unsigned
+  getPageSize () const
+  {
+    return pageSize;
+  }
+
+  /**
+   * Set the number of pages to fetch in advance.  At least one is
+   * always used.
+   * @param p The prefetch depth.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setPrefetch (unsigned p)
+  {
+    prefetch = (p < 1 ? 1 : p);
+    return *this;
+  }
+
+  inline unsigned
+  getPrefetch () const
+  {
+    return prefetch;
+  }
+
+  /**
+   * Set the number of worker threads to run the call-backs on.
+   * @param w Number of worker threads, zero to use the scanning thread.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setWorkers (unsigned w)
+  {
+    workers = w;
+    return *this;
+  }
+
+  inline unsigned
+  getWorkers () const
+  {
+    return workers;
+  }
+
+  /**
+   * Set the name at which to start scanning.
+   * @param s The first name to consider.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setStart (const std::string& s)
+  {
+    start = s;
+    return *this;
+  }
+
+  inline const std::string&
+  getStart () const
+  {
+    return start;
+  }
+
+  /**
+   * Set the end of the range.  The scan stops at the first name
+   * that does not sort before it.
+   * @param e The end bound (exclusive), empty for none.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setEnd (const std::string& e)
+  {
+    end = e;
+    return *this;
+  }
+
+  inline const std::string&
+  getEnd () const
+  {
+    return end;
+  }
+
+  /**
+   * Restrict the scan to names with the given prefix.  The scan starts
+   * at the prefix if no later start is set, regardless of the order
+   * in which both are set.
+   * @param p The prefix.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setPrefix (const std::string& p)
+  {
+    prefix = p;
+    return *this;
+  }
+
+  inline const std::string&
+  getPrefix () const
+  {
+    return prefix;
+  }
+
+  /**
+   * Restrict the scan to a namespace, as returned by Name::split.
+   * @param ns The namespace, like "d".
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setNamespace (const std::string& ns)
+  {
+    return setPrefix (ns + "/");
+  }
+
+  /**
+   * Only pass names matching a POSIX extended regular expression to
+   * the call-back.  The scan itself still goes through the whole range.
+   * @param f The regular expression, empty for none.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setFilter (const std::string& f)
+  {
+    filter = f;
+    return *this;
+  }
+
+  inline const std::string&
+  getFilter () const
+  {
+    return filter;
+  }
+
+  /**
+   * Stop the scan after the given number of names.
+   * @param n Maximum number of names, zero for no limit.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setMaxCount (unsigned n)
+  {
+    maxCount = n;
+    return *this;
+  }
+
+  inline unsigned
+  getMaxCount () const
+  {
+    return maxCount;
+  }
+
+  /**
+   * Set the options used for each name_scan call, for instance to give
+   * the pages a shorter deadline or to disable retries.
+   * @param o The call options.
+   * @return Reference to "this".
+   */
+  inline ScanOptions&
+  setCallOptions (const JsonRpc::CallOptions& o)
+  {
+    callOptions = o;
+    return *this;
+  }
+
+  inline const JsonRpc::CallOptions&
+  getCallOptions () const
+  {
+    return callOptions;
+  }
+
+  /**
+   * Check whether a name is past the end of the range.  Since names are
+   * scanned in order, no later name can be in the range either.
+   * @param name The name.
+   * @return True iff the name is past the range.
+   */
+  inline bool
+  isPastEnd (const std::string& name) const
+  {
+    if (!end.empty () && name >= end)
+      return true;
+    return name.compare (0, prefix.size (), prefix) != 0;
+  }
+
+};
+
+/**
+ * A name found by a scan, with the data returned by name_scan.
+ */
+class NameInterface::ScanEntry
+{
+
+private:
+
+  friend class NameScanner;
+
+  /** The name.  */
+  std::string name;
+
+  /** The name's value.  */
+  std::string value;
+
+  /** The address holding the name.  */
+  std::string address;
+
+  /** Blocks until the name expires.  */
+  int expiresIn;
+
+  /** Block height of the name's last update, zero if unknown.  */
+  unsigned height;
+
+public:
+
+  /**
+   * Construct an empty entry.
+   */
+  inline ScanEntry ()
+    : name(), value(), address(), expiresIn(0), height(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  ScanEntry (const ScanEntry&) = default;
+  ScanEntry (ScanEntry&&) = default;
+  ScanEntry& operator= (const ScanEntry&) = default;
+  ScanEntry& operator= (ScanEntry&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getName () const
+  {
+    return name;
+  }
+
+  inline const std::string&
+  getStringValue () const
+  {
+    return value;
+  }
+
+  /**
+   * Get the name's value as JSON object.
+   * @return This name's value as JSON object.
+   * @throws JsonRpc::JsonParseError if JSON parsing fails.
+   */
+  inline JsonRpc::JsonData
+  getJsonValue () const
+  {
+    return JsonRpc::decodeJson (value);
+  }
+
+  /**
+   * Get the address holding the name.  This is just the string, use
+   * CoinInterface::queryAddress to find out more about it.
+   * @return The address as string.
+   */
+  inline const std::string&
+  getAddress () const
+  {
+    return address;
+  }
+
+  /**
+   * Return number of blocks until the name expires.
+   * @return The number of blocks until the name expires.  Might be negative.
+   */
+  inline int
+  getExpireCounter () const
+  {
+    return expiresIn;
+  }
+
+  /**
+   * Return whether the name is expired.
+   * @return True iff the name is expired.
+   */
+  inline bool
+  isExpired () const
+  {
+    return expiresIn <= 0;
+  }
+
+  /**
+   * Get the block height at which the name was last updated.
+   * @return The height of the last update, zero if the daemon
+   *         doesn't report it.
+   */
+  inline unsigned
+  getUpdateHeight () const
+  {
+    return height;
+  }
+
+};
+
+/**
+ * Interface for call-backs of name scans.  This allows the actual scanning
+ * to be done in non-template code.
+ */
+class NameInterface::ScanCallback
+{
+
+public:
+
+  inline ScanCallback ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~ScanCallback ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Handle a name.
+   * @param entry The name found.
+   */
+  virtual void operator() (const ScanEntry& entry) = 0;
+
 };
 
 /* ************************************************************************** */
 /* Name object.  */
 
 /**
- * Encapsulate a Namecoin name.
+ * Encapsulate a Namecoin name.  Names returned by a NameInterface with
+ * lazy names enabled do their RPC calls in the accessors, which may then
+ * also throw JsonRpc::Exception.
  */
 class NameInterface::Name
 {
@@ -127,6 +696,7 @@ class NameInterface::Name
 private:
 
   friend class NameInterface;
+  friend class AsyncName;
 
   /**
    * Whether or not this is a default-constructed object.  Those can't be
@@ -137,14 +707,75 @@ private:
   /** The name's string.  */
   std::string name;
 
+  /** The interface used to look up the data not yet there.  */
+  NameInterface* source;
+
+  /* The fields below are filled in when the name is looked up, which
+     lazy names only do when they are first accessed.  Hence they are
+     mutable.  */
+
+  /** Whether name_show has yet to be done.  */
+  mutable bool needShow;
+
+  /** Whether the address has yet to be looked up.  */
+  mutable bool needAddress;
+
   /** Whether or not the name is already registered.  */
-  bool ex;
+  mutable bool ex;
+
+  /** The address string returned by name_show, until it is looked up.  */
+  mutable std::string addrString;
 
   /** The address holding the name.  */
-  Address addr;
+  mutable Address addr;
+
+  /** The name's value.  */
+  mutable std::string value;
+
+  /** Number of blocks until the name expires.  */
+  mutable int expiresIn;
+
+  /** Whether the name is expired.  */
+  mutable bool expired;
 
-  /** The name's JSON data, which name_show returns.  */
-  JsonRpc::JsonData data;
+  /** Whether the full JSON data is kept.  */
+  mutable bool haveData;
+
+  /**
+   * The name's JSON data, which name_show returns.  It is only kept
+   * if requested, since most users need just the fields above.
+   */
+  mutable JsonRpc::JsonData data;
+
+  /**
+   * Extract the fields from the name_show data.
+   * @param d The name_show result.
+   * @param keep Whether to keep the full data.
+   */
+  void fillFrom (const JsonRpc::JsonData& d, bool keep);
+
+  /**
+   * Do the name_show call and fill in the fields from it.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  void fetchShow () const;
+
+  /**
+   * Look up the address holding the name.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  void fetchAddress () const;
+
+  /**
+   * Ensure that name_show has been done.
+   * @throws JsonRpc::Exception if that fails.
+   */
+  inline void
+  ensureShown () const
+  {
+    if (needShow)
+      fetchShow ();
+  }
 
   /**
    * Construct the name.  This is meant to be used only
@@ -152,10 +783,20 @@ private:
    * NameInterface::queryName or other methods to obtain
    * name objects.
    * @param n The name's string.
-   * @param nc NameInterface object.
-   * @param rpc The RPC object to use for finding info about the name.
+   * @param nc NameInterface object, used for finding info about the name.
+   * @param lazy Whether to look up the data only when it is accessed.
+   */
+  Name (const std::string& n, NameInterface& nc, bool lazy);
+
+  /**
+   * Construct the name from already queried data.
+   * @param n The name's string.
+   * @param d The name_show result, or null if the name doesn't exist.
+   * @param a The address holding the name.
+   * @param keep Whether to keep the full data.
    */
-  Name (const std::string& n, NameInterface& nc, JsonRpc& rpc);
+  Name (const std::string& n, const JsonRpc::JsonData& d, const Address& a,
+        bool keep);
 
   /**
    * Ensure that this object is initialised and not default-constructed.
@@ -182,15 +823,19 @@ public:
    * can't be used for anything until they have been assigned to.
    */
   inline Name ()
-    : initialised(false)
+    : initialised(false), source(nullptr), needShow(false),
+      needAddress(false), ex(false), expiresIn(0), expired(false),
+      haveData(false)
   {
     // Nothing more to do.
   }
 
-  // Copying is ok.
+  // Copying and moving is ok.
 #ifdef CXX_11
   Name (const Name&) = default;
+  Name (Name&&) = default;
   Name& operator= (const Name&) = default;
+  Name& operator= (Name&&) = default;
 #endif /* CXX_11?  */
 
   /**
@@ -213,6 +858,8 @@ public:
   getAddress () const
   {
     ensureExists ();
+    if (needAddress)
+      fetchAddress ();
     return addr;
   }
 
@@ -224,18 +871,25 @@ public:
   exists () const
   {
     ensureInitialised ();
+    ensureShown ();
     return ex;
   }
 
   /**
-   * Get the name's full JSON info as per name_show.
+   * Get the name's full JSON info as per name_show.  This is only
+   * available if NameInterface::setKeepFullData was enabled when the
+   * name was queried.
    * @return This name's full JSON info.
    * @throws NameNotFound if the name doesn't yet exist.
+   * @throws std::logic_error if the full data was not kept.
    */
   inline const JsonRpc::JsonData&
   getFullData () const
   {
     ensureExists ();
+    if (!haveData)
+      throw std::logic_error ("Full name data was not kept, see"
+                              " NameInterface::setKeepFullData.");
     return data;
   }
 
@@ -244,11 +898,11 @@ public:
    * @return This name's value as string.
    * @throws NameNotFound if the name doesn't yet exist.
    */
-  inline const std::string
+  inline const std::string&
   getStringValue () const
   {
     ensureExists ();
-    return data["value"].asString ();
+    return value;
   }
 
   /**
@@ -272,7 +926,7 @@ public:
   isExpired () const
   {
     ensureExists ();
-    return (data["expired"].isInt () && (data["expired"].asInt () != 0));
+    return expired;
   }
 
   /**
@@ -284,7 +938,7 @@ public:
   getExpireCounter () const
   {
     ensureExists ();
-    return data["expires_in"].asInt ();
+    return expiresIn;
   }
 
   /**
@@ -299,6 +953,143 @@ public:
 
 };
 
+/* ************************************************************************** */
+/* Asynchronous name query.  */
+
+/**
+ * Receive the result of NameInterface::queryNameAsync.  The query consists
+ * of two RPC calls (name_show and then validateaddress for the name's
+ * address), the second of which is started automatically as soon as
+ * the first one is finished.
+ */
+class NameInterface::AsyncName
+{
+
+private:
+
+  /**
+   * One of the RPC calls done for the query.  It notifies the
+   * AsyncName object when it is finished.
+   */
+  class Stage : public JsonRpc::AsyncCall
+  {
+
+  private:
+
+    /** The query this belongs to.  */
+    AsyncName& parent;
+
+    // Disable copying and default constructor.
+#ifndef CXX_11
+    Stage ();
+    Stage (const Stage&);
+    Stage& operator= (const Stage&);
+#endif /* !CXX_11  */
+
+  protected:
+
+    /**
+     * Notify the parent of the finished call.
+     */
+    void completed ();
+
+  public:
+
+    /**
+     * Construct it for the given parent.
+     * @param p The query this belongs to.
+     */
+    explicit inline Stage (AsyncName& p)
+      : JsonRpc::AsyncCall(), parent(p)
+    {
+      // Nothing else to do.
+    }
+
+    // No copying or default constructor.
+#ifdef CXX_11
+    Stage () = delete;
+    Stage (const Stage&) = delete;
+    Stage& operator= (const Stage&) = delete;
+#endif /* CXX_11?  */
+
+  };
+
+  friend class NameInterface;
+  friend class Stage;
+
+  /** The interface used for the query, if it was started.  */
+  NameInterface* nc;
+
+  /** The name queried for.  */
+  std::string name;
+
+  /** The name_show call.  */
+  Stage show;
+  /** The validateaddress call.  */
+  Stage addr;
+
+  /** Whether the query is finished.  */
+  bool done;
+
+  /** Whether the query succeeded and result is set.  */
+  bool haveResult;
+
+  /** The resulting name object.  */
+  Name result;
+
+  /** Error message if starting the second stage failed.  */
+  std::string submitError;
+
+  // Disable copying.
+#ifndef CXX_11
+  AsyncName (const AsyncName&);
+  AsyncName& operator= (const AsyncName&);
+#endif /* !CXX_11  */
+
+  /**
+   * Handle a finished stage, starting the next one if necessary.
+   * @param stage The stage that is finished.
+   */
+  void stageCompleted (const Stage& stage);
+
+public:
+
+  /**
+   * Construct it, not yet associated to any query.
+   */
+  AsyncName ();
+
+  // No copying.
+#ifdef CXX_11
+  AsyncName (const AsyncName&) = delete;
+  AsyncName& operator= (const AsyncName&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Check whether the query is finished.
+   * @return True iff the result (or error) is available.
+   */
+  inline bool
+  isDone () const
+  {
+    return done;
+  }
+
+  /**
+   * Wait for the query to finish.
+   * @throws std::logic_error if the query was never started.
+   */
+  void wait ();
+
+  /**
+   * Wait for the query to finish and return the result.
+   * @return The name object, as queryName would have returned it.
+   * @throws JsonRpc::Exception and subclasses if the query failed.
+   */
+  const Name& get ();
+
+};
+
 /* ************************************************************************** */
 /* Exception classes.  */
 
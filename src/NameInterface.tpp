@@ -33,75 +33,96 @@ template<typename T>
   void
   NameInterface::forMyNames (T cb)
 {
-  const JsonRpc::JsonData res = rpc.executeRpc ("name_list");
-  assert (res.isArray ());
+  const std::vector<Name> names = queryMyNames ();
 #ifdef CXX_11
-  for (const JsonRpc::JsonData& val : res)
+  for (const Name& nm : names)
 #else /* CXX_11?  */
-  for (JsonRpc::JsonData::const_iterator i = res.begin (); i != res.end (); ++i)
+  for (std::vector<Name>::const_iterator i = names.begin ();
+       i != names.end (); ++i)
 #endif /* CXX_11?  */
     {
 #ifndef CXX_11
-      const JsonRpc::JsonData& val = *i;
+      const Name& nm = *i;
 #endif /* !CXX_11?  */
-      NameInterface::Name nm = queryName (val["name"].asString ());
-      if (nm.getAddress ().isMine ())
-        cb (nm);
+      cb (nm);
     }
 }
 
 /**
- * Query for all names in the index (according to name_scan) and execute
- * some call-back on them.
- * @param cb Call-back routine.
+ * Wrap an arbitrary call-back as ScanCallback.
  */
 template<typename T>
-  void
-  NameInterface::forAllNames (T cb)
+  class NameInterface::ScanCallbackWrapper : public NameInterface::ScanCallback
 {
-  static const unsigned CNT = 5000;
 
-  std::string last;
-  bool haveLast = false;
-  while (true)
-    {
-      JsonRpc::JsonData res;
-      Json::ArrayIndex firstInd;
-      if (haveLast)
-        {
-          res = rpc.executeRpc ("name_scan", last, CNT);
-          assert (res.isArray () && res.size () > 0);
-          assert (res[0].isObject ());
-          assert (res[0]["name"].asString () == last);
+private:
 
-          /* FIXME: There are some unicode names in the blockchain, for which
-             the above assertion fails if they are hit as last names in a scan.
-             As a work-around, choosing CNT large enough helps for now, but
-             of course this is only a very crude fix!  */
+  /** The wrapped call-back.  */
+  T& cb;
 
-          firstInd = 1;
-        }
-      else
-        {
-          res = rpc.executeRpc ("name_scan");
-          assert (res.isArray ());
-          firstInd = 0;
-        }
+public:
 
-      assert (res.size () >= firstInd);
-      if (firstInd == res.size ())
-        break;
+  /**
+   * Construct it.
+   * @param c The call-back to wrap.
+   */
+  explicit inline ScanCallbackWrapper (T& c)
+    : cb(c)
+  {
+    // Nothing else to do.
+  }
 
-      for (Json::ArrayIndex i = firstInd; i < res.size (); ++i)
-        {
-          assert (res[i].isObject ());
-          const std::string name = res[i]["name"].asString ();
+  inline void
+  operator() (const ScanEntry& entry)
+  {
+    cb (entry);
+  }
 
-          /* FIXME: Update call-back interface.  */
-          cb (name);
-        }
+};
 
-      last = res[res.size () - 1]["name"].asString ();
-      haveLast = true;
-    }
+/**
+ * Query for all names in the index (according to name_scan) and execute
+ * some call-back on them.  The call-back gets a ScanEntry for each name.
+ * This uses the default ScanOptions.
+ * @param cb Call-back routine.
+ */
+template<typename T>
+  void
+  NameInterface::forAllNames (T cb)
+{
+  forAllNames (cb, ScanOptions ());
+}
+
+/**
+ * Query for names in the index (according to name_scan) and execute
+ * some call-back on them.  The call-back gets a ScanEntry for each name.
+ * The next pages are already fetched while the call-back processes the
+ * current one.  If worker threads are requested in the options, the
+ * call-back is run on them and must be safe to call concurrently.
+ * If the options restrict the range of names, only those are scanned.
+ * @param cb Call-back routine.
+ * @param opts Options for the scan.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if a call-back failed on a worker thread
+ *                            or the filter is invalid.
+ */
+template<typename T>
+  void
+  NameInterface::forAllNames (T cb, const ScanOptions& opts)
+{
+  ScanCallbackWrapper<T> wrapper(cb);
+  scanNames (wrapper, opts);
+}
+
+/**
+ * Query for all names starting with a prefix and execute some call-back
+ * on them.
+ * @param prefix The prefix, e.g. "d/" for a namespace.
+ * @param cb Call-back routine.
+ */
+template<typename T>
+  void
+  NameInterface::forNames (const std::string& prefix, T cb)
+{
+  forAllNames (cb, ScanOptions ().setPrefix (prefix));
 }
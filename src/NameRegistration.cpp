@@ -20,9 +20,10 @@
 
 #include "NameRegistration.hpp"
 
-#include <cassert>
+#include "Rpc.hpp"
+
+#include <algorithm>
 #include <cstdlib>
-#include <memory>
 #include <sstream>
 
 namespace nmcrpc
@@ -41,7 +42,7 @@ const std::string NameRegistration::FIRSTUPDATEDELAY_VAR
  * @param n The high-level Namecoin interface.
  */
 NameRegistration::NameRegistration (JsonRpc& r, NameInterface& n)
-  : rpc(r), nc(n), firstupdateDelay(12), state(NOT_STARTED)
+  : rpc(&r), nc(&n), firstupdateDelay(12), state(NOT_STARTED)
 {
   const char* delay = std::getenv (FIRSTUPDATEDELAY_VAR.c_str ());
   if (delay)
@@ -67,10 +68,9 @@ NameRegistration::registerName (const NameInterface::Name& nm)
     throw NameAlreadyReserved (nm.getName ());
 
   name = nm.getName ();
-  const JsonRpc::JsonData res = rpc.executeRpc ("name_new", name);
-  assert (res.isArray () && res.size () == 2);
-  rand = res[1].asString ();
-  tx = res[0].asString ();
+  const Rpc::NameNewResult res = rpc->call (Rpc::NameNew (name));
+  rand = res.getRand ();
+  tx = res.getTx ();
 
   /* Set default value, can be changed now.  */
   value = "";
@@ -105,7 +105,7 @@ NameRegistration::canActivate () const
   if (state != REGISTERED)
     return false;
 
-  return (nc.getNumberOfConfirmations (tx) >= firstupdateDelay);
+  return (nc->getNumberOfConfirmations (tx) >= firstupdateDelay);
 }
 
 /**
@@ -120,15 +120,21 @@ NameRegistration::activate ()
   if (!canActivate ())
     throw std::runtime_error ("Can't yet activate, please wait longer.");
 
-  JsonRpc::JsonData args(Json::arrayValue);
-  args.append (name);
-  args.append (rand);
-  args.append (tx);
-  args.append (value);
-  const JsonRpc::JsonData res = rpc.executeRpcArray ("name_firstupdate", args);
+  doActivate ();
+}
 
-  assert (res.isString ());
-  txActivation = res.asString ();
+/**
+ * Issue the firstupdate transaction, without checking the number
+ * of confirmations first.
+ * @throws std::runtime_error if this is not in REGISTERED state.
+ */
+void
+NameRegistration::doActivate ()
+{
+  if (state != REGISTERED)
+    throw std::runtime_error ("Can activate() only in REGISTERED state.");
+
+  txActivation = rpc->call (Rpc::NameFirstUpdate (name, rand, tx, value));
   state = ACTIVATED;
 }
 
@@ -143,7 +149,7 @@ NameRegistration::isFinished () const
   if (state != ACTIVATED)
     return false;
 
-  return (nc.getNumberOfConfirmations (txActivation) > 0);
+  return (nc->getNumberOfConfirmations (txActivation) > 0);
 }
 
 /**
@@ -228,32 +234,37 @@ operator>> (std::istream& in, NameRegistration& obj)
 /* Manage multiple name registration processes.  */
 
 /**
- * Destroy it safely.
+ * Clear all elements.
  */
-RegistrationManager::~RegistrationManager ()
+void
+RegistrationManager::clear ()
 {
-  clear ();
+  names.clear ();
+  updatedTip.clear ();
+  cleanedTip.clear ();
 }
 
 /**
- * Clear all elements, freeing the memory properly.
+ * Get the current chain tip.
+ * @return The best block hash.
  */
-void
-RegistrationManager::clear ()
+std::string
+RegistrationManager::getTip ()
 {
-#ifdef CXX_11
-  for (auto ptr : names)
-    delete ptr;
-#else /* CXX_11  */
-  for (nameListT::iterator i = names.begin (); i != names.end (); ++i)
-    delete *i;
-#endif /* CXX_11  */
-  names.clear ();
+  if (watcher)
+    {
+      const std::string res = watcher->getBestHash ();
+      if (!res.empty ())
+        return res;
+    }
+
+  return rpc.call (Rpc::GetBestBlockHash ());
 }
 
 /**
  * Start registration for a new name.  The process object is returned so that
- * the value can be set as desired.
+ * the value can be set as desired.  The reference is only valid until
+ * the list of names is changed otherwise.
  * @param nm The name to register.
  * @return The NameRegistration object created and inserted.
  * @throws NameAlreadyReserved if the name already exists.
@@ -261,60 +272,259 @@ RegistrationManager::clear ()
 NameRegistration&
 RegistrationManager::registerName (const NameInterface::Name& nm)
 {
-#ifdef CXX_11
-  std::unique_ptr<NameRegistration> ptr;
-#else /* CXX_11  */
-  std::auto_ptr<NameRegistration> ptr;
-#endif /* CXX_11  */
+  NameRegistration reg(rpc, nc);
+  reg.registerName (nm);
+
+  names.push_back (reg);
+  updatedTip.clear ();
+
+  return names.back ();
+}
+
+/**
+ * Start registration of many names with the same value.  The names are
+ * processed in batches bounded by the maximum batch size of the RPC
+ * settings:  The availability of a batch is checked with name_show calls,
+ * and its name_new transactions are then sent together.  The wallet must
+ * already be unlocked.  Names that are taken or fail are reported to the
+ * call-back and skipped, the others are added to the list.  Each batch
+ * is added before the next one is sent, and a batch that can not be sent
+ * fails only its own names.
+ * @param nms The names to register.
+ * @param value The value to set for all of them.
+ * @param progress Report each name here, may be NULL.
+ * @return The number of registrations started.
+ */
+unsigned
+RegistrationManager::registerNames (const std::vector<std::string>& nms,
+                                    const std::string& value,
+                                    Progress* progress)
+{
+  /* The names are processed one batch at a time, so that the rand values
+     of all broadcast transactions are recorded (and can be saved by the
+     call-back) before the next batch may fail.  */
+  const size_t chunk = std::max (1u, rpc.getSettings ().getMaxBatchSize ());
+  unsigned res = 0;
+  for (size_t start = 0; start < nms.size (); start += chunk)
+    {
+      const size_t end = std::min (nms.size (), start + chunk);
+
+      std::vector<JsonRpc::Call> shows;
+      shows.reserve (end - start);
+      for (size_t i = start; i < end; ++i)
+        shows.push_back (Rpc::NameShow (nms[i]));
+      const std::vector<JsonRpc::CallResult> existing
+        = rpc.executeRpcBatch (shows);
+
+      std::vector<std::string> available;
+      std::vector<JsonRpc::Call> news;
+      for (size_t i = 0; i < existing.size (); ++i)
+        try
+          {
+            const bool unknown = (existing[i].isError ()
+                                  && existing[i].getErrorCode () == -4);
+            if (!unknown
+                && !Rpc::NameShow::decode (existing[i].get ()).isExpired ())
+              throw NameRegistration::NameAlreadyReserved (nms[start + i]);
+
+            available.push_back (nms[start + i]);
+            news.push_back (Rpc::NameNew (nms[start + i]));
+          }
+        catch (const std::runtime_error& exc)
+          {
+            if (progress)
+              progress->failed (nms[start + i], exc.what ());
+          }
 
-  ptr.reset (new NameRegistration (rpc, nc));
-  ptr->registerName (nm);
+      if (news.empty ())
+        continue;
+      const std::vector<JsonRpc::CallResult> results
+        = rpc.executeRpcBatch (news);
 
-  names.push_back (ptr.release ());
-  return *names.back ();
+      for (size_t i = 0; i < results.size (); ++i)
+        try
+          {
+            const Rpc::NameNewResult tx
+              = Rpc::NameNew::decode (results[i].get ());
+
+            NameRegistration reg(rpc, nc);
+            reg.name = available[i];
+            reg.value = value;
+            reg.rand = tx.getRand ();
+            reg.tx = tx.getTx ();
+            reg.state = NameRegistration::REGISTERED;
+            names.push_back (reg);
+            ++res;
+
+            if (progress)
+              progress->registered (names.back ());
+          }
+        catch (const JsonRpc::Exception& exc)
+          {
+            if (progress)
+              progress->failed (available[i], exc.what ());
+          }
+
+      updatedTip.clear ();
+      if (progress)
+        progress->batchDone (*this);
+    }
+
+  return res;
 }
 
 /**
- * Try to update all processes, which activates names where it is possible.
+ * Start registration of many names, unlocking the wallet once for
+ * all of them if necessary and locking it again afterwards.
+ * @param nms The names to register.
+ * @param value The value to set for all of them.
+ * @param passphrase The wallet passphrase.
+ * @param progress Report each name here, may be NULL.
+ * @return The number of registrations started.
+ * @throws UnlockFailure if the passphrase is wrong.
+ * @throws JsonRpc::Exception in case of transport errors.
+ */
+unsigned
+RegistrationManager::registerNames (const std::vector<std::string>& nms,
+                                    const std::string& value,
+                                    const std::string& passphrase,
+                                    Progress* progress)
+{
+  CoinInterface::WalletUnlocker unlocker(nc);
+  unlocker.unlock (passphrase);
+
+  return registerNames (nms, value, progress);
+}
+
+/**
+ * Try to update all processes, reporting each name activated or failed
+ * to the call-back instead of throwing.  Failed names stay registered,
+ * and are tried again on the next call even if the tip is the same.
+ * The name_firstupdate calls are sent one batch at a time, and each
+ * batch is recorded before the next one is sent.
+ * @param progress The call-back to use.  If NULL, errors are thrown
+ *                 after all other names have been processed.
+ * @throws JsonRpc::Exception if activating a name failed without call-back.
  */
 void
-RegistrationManager::update ()
+RegistrationManager::update (Progress* progress)
 {
-#ifdef CXX_11
-  for (auto& nm : *this)
-#else /* CXX_11  */
-  for (iterator i = begin (); i != end (); ++i)
-#endif /* CXX_11  */
+  const std::string tip = getTip ();
+  if (tip == updatedTip)
+    return;
+
+  std::vector<std::string> txids;
+  std::vector<unsigned> indices;
+  for (unsigned i = 0; i < names.size (); ++i)
+    if (names[i].getState () == NameRegistration::REGISTERED)
+      {
+        txids.push_back (names[i].tx);
+        indices.push_back (i);
+      }
+
+  const std::vector<unsigned> confs = nc.getNumberOfConfirmations (txids);
+
+  std::vector<unsigned> ready;
+  for (unsigned i = 0; i < confs.size (); ++i)
+    if (confs[i] >= names[indices[i]].firstupdateDelay)
+      ready.push_back (indices[i]);
+
+  /* Like in registerNames, each batch is recorded before the next one
+     is sent.  A batch that fails as a whole only fails its own names.  */
+  const size_t chunk = std::max (1u, rpc.getSettings ().getMaxBatchSize ());
+  bool haveError = false;
+  JsonRpc::CallResult firstError;
+  for (size_t start = 0; start < ready.size (); start += chunk)
     {
-#ifndef CXX_11
-      NameRegistration& nm = *i;
-#endif /* !CXX_11  */
-      if (nm.canActivate ())
-        nm.activate ();
+      const size_t end = std::min (ready.size (), start + chunk);
+
+      std::vector<JsonRpc::Call> calls;
+      calls.reserve (end - start);
+      for (size_t i = start; i < end; ++i)
+        {
+          const NameRegistration& nm = names[ready[i]];
+          calls.push_back (Rpc::NameFirstUpdate (nm.name, nm.rand,
+                                                 nm.tx, nm.value));
+        }
+      const std::vector<JsonRpc::CallResult> results
+        = rpc.executeRpcBatch (calls);
+
+      for (size_t i = 0; i < results.size (); ++i)
+        {
+          NameRegistration& nm = names[ready[start + i]];
+          try
+            {
+              nm.txActivation
+                = Rpc::NameFirstUpdate::decode (results[i].get ());
+              nm.state = NameRegistration::ACTIVATED;
+              cleanedTip.clear ();
+
+              if (progress)
+                progress->activated (nm);
+            }
+          catch (const JsonRpc::Exception& exc)
+            {
+              if (progress)
+                progress->failed (nm.name, exc.what ());
+              if (!haveError)
+                {
+                  haveError = true;
+                  firstError = results[i];
+                }
+            }
+        }
+
+      if (progress)
+        progress->batchDone (*this);
     }
+
+  /* Without a call-back, throw the first error again now that the
+     other names are done.  The tip is kept unset in both cases,
+     so that the failed names are retried.  */
+  if (haveError)
+    {
+      if (!progress)
+        Rpc::NameFirstUpdate::decode (firstError.get ());
+      return;
+    }
+
+  updatedTip = tip;
 }
 
 /**
- * Purge finished names from the list.
+ * Purge finished names from the list.  This does nothing if the chain tip
+ * has not changed since the last call.
  * @return Number of elements purged.
  */
 unsigned
 RegistrationManager::cleanUp ()
 {
-  unsigned res = 0;
+  const std::string tip = getTip ();
+  if (tip == cleanedTip)
+    return 0;
+
+  std::vector<std::string> txids;
+  for (unsigned i = 0; i < names.size (); ++i)
+    if (names[i].getState () == NameRegistration::ACTIVATED)
+      txids.push_back (names[i].txActivation);
 
-  nameListT::iterator i = names.begin ();
-  while (i != names.end ())
+  const std::vector<unsigned> confs = nc.getNumberOfConfirmations (txids);
+
+  nameListT kept;
+  unsigned next = 0;
+  for (unsigned i = 0; i < names.size (); ++i)
     {
-      if ((*i)->isFinished ())
-        {
-          i = names.erase (i);
-          ++res;
-        }
-      else
-        ++i;
+      if (names[i].getState () == NameRegistration::ACTIVATED
+          && confs[next++] > 0)
+        continue;
+
+      kept.push_back (names[i]);
     }
 
+  const unsigned res = names.size () - kept.size ();
+  names.swap (kept);
+  cleanedTip = tip;
+
   return res;
 }
 
@@ -376,7 +586,7 @@ operator>> (std::istream& in, RegistrationManager& obj)
 
   obj.clear ();
 #ifdef CXX_11
-  for (const JsonRpc::JsonData el : elements)
+  for (const JsonRpc::JsonData& el : elements)
 #else /* CXX_11  */
   for (JsonRpc::JsonData::const_iterator i = elements.begin ();
        i != elements.end (); ++i)
@@ -387,20 +597,60 @@ operator>> (std::istream& in, RegistrationManager& obj)
 #endif /* !CXX_11  */
 
       std::istringstream val(el.asString ());
-#ifdef CXX_11
-      std::unique_ptr<NameRegistration> ptr;
-#else /* CXX_11  */
-      std::auto_ptr<NameRegistration> ptr;
-#endif /* CXX_11  */
-
-      ptr.reset (new NameRegistration (obj.rpc, obj.nc));
-      val >> *ptr;
-      obj.names.push_back (ptr.release ());
+      NameRegistration reg(obj.rpc, obj.nc);
+      val >> reg;
+      obj.names.push_back (reg);
     }
 
   return in;
 }
 
+/* ************************************************************************** */
+/* Progress call-back.  */
+
+/**
+ * Called when the name_new transaction for a name has been sent.
+ * @param reg The registration process.
+ */
+void
+RegistrationManager::Progress::registered (const NameRegistration&)
+{
+  // Nothing to do by default.
+}
+
+/**
+ * Called when the name_firstupdate transaction has been sent.
+ * @param reg The registration process.
+ */
+void
+RegistrationManager::Progress::activated (const NameRegistration&)
+{
+  // Nothing to do by default.
+}
+
+/**
+ * Called when a step failed for a name.
+ * @param name The name.
+ * @param error Description of the error.
+ */
+void
+RegistrationManager::Progress::failed (const std::string&,
+                                       const std::string&)
+{
+  // Nothing to do by default.
+}
+
+/**
+ * Called after each batch of transactions has been sent and its names
+ * have been reported and recorded in the manager.
+ * @param mgr The manager doing the operation.
+ */
+void
+RegistrationManager::Progress::batchDone (const RegistrationManager&)
+{
+  // Nothing to do by default.
+}
+
 /* ************************************************************************** */
 /* Name updater.  */
 
@@ -414,9 +664,9 @@ operator>> (std::istream& in, RegistrationManager& obj)
  */
 NameUpdate::NameUpdate (JsonRpc& r, NameInterface& n,
                         const NameInterface::Name& nm)
-  : rpc(r), nc(n), name(nm)
+  : rpc(r), nc(n), name(nm.getName ()), value(nm.getStringValue ())
 {
-  value = name.getStringValue ();
+  // Nothing more to do.
 }
 
 /**
@@ -432,18 +682,14 @@ NameUpdate::internalExecute (const NameInterface::Address* addr)
 {
   try
     {
-      JsonRpc::JsonData args(Json::arrayValue);
-      args.append (name.getName ());
-      args.append (value);
       if (addr)
         {
           if (!addr->isValid ())
             throw std::runtime_error ("Target address is invalid.");
-          args.append (addr->getAddress ());
+          return rpc.call (Rpc::NameUpdate (name, value, addr->getAddress ()));
         }
-      const JsonRpc::JsonData res = rpc.executeRpcArray ("name_update", args);
 
-      return res.asString ();
+      return rpc.call (Rpc::NameUpdate (name, value));
     }
   catch (const JsonRpc::RpcError& exc)
     {
@@ -456,7 +702,7 @@ NameUpdate::internalExecute (const NameInterface::Address* addr)
           {
             std::ostringstream msg;
             msg << "You don't have the private key for the name "
-                << name.getName () << " and can't update this name.";
+                << name << " and can't update this name.";
             throw NameInterface::NoPrivateKey (msg.str ());
           }
 
@@ -466,4 +712,145 @@ NameUpdate::internalExecute (const NameInterface::Address* addr)
     }
 }
 
+/* ************************************************************************** */
+/* Bulk name updates.  */
+
+/**
+ * Update all the given names.  The wallet must already be unlocked.
+ * If a batch can not be sent, its items fail with Result::FAILED
+ * and the other batches are still done.
+ * @param items The names to update.
+ * @return The result for each item, in the same order.
+ */
+std::vector<BulkNameUpdate::Result>
+BulkNameUpdate::execute (const std::vector<Item>& items)
+{
+  std::vector<Result> res;
+  res.reserve (items.size ());
+
+  /* Each batch of items is handled on its own, so that a batch that fails
+     in transport only fails its own items.  */
+  const size_t chunk = std::max (1u, rpc.getSettings ().getMaxBatchSize ());
+  for (size_t start = 0; start < items.size (); start += chunk)
+    {
+      const size_t end = std::min (items.size (), start + chunk);
+
+      /* Query the current values only for items that keep them.  */
+      std::vector<JsonRpc::Call> shows;
+      for (size_t i = start; i < end; ++i)
+        if (!items[i].hasValue)
+          shows.push_back (Rpc::NameShow (items[i].name));
+
+      std::vector<JsonRpc::CallResult> existing;
+      if (!shows.empty ())
+        existing = rpc.executeRpcBatch (shows);
+
+      std::vector<unsigned> indices;
+      std::vector<JsonRpc::Call> updates;
+      unsigned nextShow = 0;
+      for (size_t i = start; i < end; ++i)
+        {
+          const Item& it = items[i];
+          std::string value = it.value;
+
+          if (!it.hasValue)
+            try
+              {
+                value = Rpc::NameShow::decode (existing[nextShow++].get ())
+                          .getValue ();
+              }
+            catch (const JsonRpc::RpcError& exc)
+              {
+                if (exc.getErrorCode () == -4)
+                  res.push_back (Result (it.name, Result::NOT_FOUND,
+                                         "Name not found: " + it.name));
+                else
+                  res.push_back (Result (it.name, Result::FAILED,
+                                         exc.getErrorMessage ()));
+                continue;
+              }
+            catch (const JsonRpc::Exception& exc)
+              {
+                res.push_back (Result (it.name, Result::FAILED,
+                                       exc.what ()));
+                continue;
+              }
+
+          indices.push_back (res.size ());
+          res.push_back (Result (it.name, Result::FAILED, ""));
+          if (it.address.empty ())
+            updates.push_back (Rpc::NameUpdate (it.name, value));
+          else
+            updates.push_back (Rpc::NameUpdate (it.name, value,
+                                                it.address));
+        }
+
+      std::vector<JsonRpc::CallResult> results;
+      if (!updates.empty ())
+        results = rpc.executeRpcBatch (updates);
+
+      for (size_t i = 0; i < results.size (); ++i)
+        {
+          Result& cur = res[indices[i]];
+          try
+            {
+              cur = Result (cur.name,
+                            Rpc::NameUpdate::decode (results[i].get ()));
+            }
+          catch (const JsonRpc::RpcError& exc)
+            {
+              /* These are the same errors NameUpdate turns into
+                 exceptions.  */
+              switch (exc.getErrorCode ())
+                {
+                case -13:
+                  cur.status = Result::WALLET_LOCKED;
+                  cur.error = "Need to unlock the wallet first.";
+                  break;
+
+                case -1:
+                  cur.status = Result::NO_PRIVATE_KEY;
+                  cur.error = "You don't have the private key for the name "
+                              + cur.name + " and can't update this name.";
+                  break;
+
+                case -5:
+                  cur.status = Result::INVALID_ADDRESS;
+                  cur.error = "Target address is invalid.";
+                  break;
+
+                default:
+                  cur.error = exc.getErrorMessage ();
+                  break;
+                }
+            }
+          catch (const JsonRpc::Exception& exc)
+            {
+              cur.error = exc.what ();
+            }
+        }
+    }
+
+  return res;
+}
+
+/**
+ * Update all the given names, unlocking the wallet once for the whole
+ * run if necessary and locking it again afterwards.
+ * @param items The names to update.
+ * @param passphrase The wallet passphrase.
+ * @return The result for each item, in the same order.
+ * @throws UnlockFailure if the passphrase is wrong.
+ * @throws JsonRpc::Exception in case of transport errors.
+ */
+std::vector<BulkNameUpdate::Result>
+BulkNameUpdate::execute (const std::vector<Item>& items,
+                         const std::string& passphrase)
+{
+  CoinInterface::WalletUnlocker unlocker(nc);
+  unlocker.unlock (passphrase);
+
+  return execute (items);
+}
+
 } // namespace nmcrpc
@@ -21,13 +21,14 @@
 #ifndef NMCRPC_NAMEREGISTRATION_HPP
 #define NMCRPC_NAMEREGISTRATION_HPP
 
+#include "ChainTipWatcher.hpp"
 #include "JsonRpc.hpp"
 #include "NameInterface.hpp"
 
 #include <iostream>
-#include <list>
 #include <stdexcept>
 #include <string>
+#include <vector>
 
 namespace nmcrpc
 {
@@ -70,13 +71,19 @@ public:
 
 private:
 
+  friend class RegistrationJournal;
+  friend class RegistrationManager;
+
   /** Name of the envvar to configure firstupdateDelay.  */
   static const std::string FIRSTUPDATEDELAY_VAR;
 
-  /** Underlying RPC connection.  */
-  JsonRpc& rpc;
+  /**
+   * Underlying RPC connection.  This and nc are pointers rather than
+   * references so that objects can be assigned and kept in a vector.
+   */
+  JsonRpc* rpc;
   /** High-level Namecoin interface.  */
-  NameInterface& nc;
+  NameInterface* nc;
 
   /**
    * Number of confirmations we want on the name_new transaction before
@@ -106,6 +113,13 @@ private:
   NameRegistration ();
 #endif /* !CXX_11  */
 
+  /**
+   * Issue the firstupdate transaction, without checking the number
+   * of confirmations first.
+   * @throws std::runtime_error if this is not in REGISTERED state.
+   */
+  void doActivate ();
+
 public:
 
   /**
@@ -115,11 +129,13 @@ public:
    */
   explicit NameRegistration (JsonRpc& r, NameInterface& n);
 
-  // No default constructor, copying is ok.
+  // No default constructor, copying and moving is ok.
 #ifdef CXX_11
   NameRegistration () = delete;
   NameRegistration (const NameRegistration&) = default;
+  NameRegistration (NameRegistration&&) = default;
   NameRegistration& operator= (const NameRegistration&) = default;
+  NameRegistration& operator= (NameRegistration&&) = default;
 #endif /* CXX_11?  */
 
   /**
@@ -230,24 +246,51 @@ public:
 /**
  * Handle multiple name registration processes.  This is basically an array
  * of NameRegistration objects that allows to save/restore and update
- * all of them at once.
+ * all of them at once.  It is not synchronised, so each manager (as well
+ * as a NameRegistration or NameUpdate) should be used from a single thread.
+ *
+ * The confirmations of all pending transactions are checked with a single
+ * batched request.  Since they can only change with a new block, update()
+ * and cleanUp() do nothing if the chain tip is the same as on their last
+ * run.  The tip is taken from a ChainTipWatcher if one is set, and queried
+ * with getbestblockhash otherwise.  All names that became eligible are
+ * activated together with batched name_firstupdate calls, and registerNames
+ * starts many registrations the same way.
+ *
+ * The state can be saved with the stream operators, which always write
+ * out all names.  A RegistrationJournal records only the changes instead.
  */
 class RegistrationManager
 {
 
+public:
+
+  /** Call-back for progress of bulk operations.  */
+  class Progress;
+
 private:
 
+  friend class RegistrationJournal;
+
   /** The RPC connection to use.  */
   JsonRpc& rpc;
   /** The high-level Namecoin interface.  */
   NameInterface& nc;
 
   /** Type used internally to keep the list of names.  */
-  typedef std::list<NameRegistration*> nameListT;
+  typedef std::vector<NameRegistration> nameListT;
 
   /** Store the name registration processes.  */
   nameListT names;
 
+  /** Watcher to get the chain tip from, if any.  */
+  const ChainTipWatcher* watcher;
+
+  /** Chain tip at the last run of update(), empty to force it.  */
+  std::string updatedTip;
+  /** Chain tip at the last run of cleanUp(), empty to force it.  */
+  std::string cleanedTip;
+
   // Disable copying and default constructor.
 #ifndef CXX_11
   RegistrationManager ();
@@ -256,14 +299,20 @@ private:
 #endif /* !CXX_11  */
 
   /**
-   * Clear all elements, freeing the memory properly.
+   * Clear all elements.
    */
   void clear ();
 
+  /**
+   * Get the current chain tip.
+   * @return The best block hash.
+   */
+  std::string getTip ();
+
   /**
    * Template to use for const and non-const iterators.  They are based on
-   * the underlying iterators of the names list, but they dereference also
-   * the pointer already.
+   * the underlying iterators of the names list, but don't expose
+   * the list type itself.
    */
   template<typename Base, typename Val>
     class Iterator
@@ -330,14 +379,13 @@ private:
     }
 
     /**
-     * Dereference the iterator, which returns the NameRegistration as
-     * reference and not pointer.
+     * Dereference the iterator.
      * @return The currently pointed to NameRegistration object.
      */
     inline Val&
     operator* () const
     {
-      return **iter;
+      return *iter;
     }
 
   };
@@ -355,7 +403,7 @@ public:
    * @param n The high-level interface.
    */
   inline RegistrationManager (JsonRpc& r, NameInterface& n)
-    : rpc(r), nc(n), names()
+    : rpc(r), nc(n), names(), watcher(nullptr), updatedTip(), cleanedTip()
   {
     // Nothing more to do.
   }
@@ -368,26 +416,86 @@ public:
 #endif /* CXX_11?  */
 
   /**
-   * Destroy it safely.
+   * Set a watcher to take the chain tip from, instead of querying it
+   * on each update.  It must be polled regularly by the caller.
+   * @param w The watcher to use, or NULL to query the tip directly.
    */
-  ~RegistrationManager ();
+  inline void
+  setWatcher (const ChainTipWatcher* w)
+  {
+    watcher = w;
+  }
 
   /**
    * Start registration for a new name.  The process object is returned so that
-   * the value can be set as desired.
+   * the value can be set as desired.  The reference is only valid until
+   * the list of names is changed otherwise.
    * @param nm The name to register.
    * @return The NameRegistration object created and inserted.
    * @throws NameAlreadyReserved if the name already exists.
    */
   NameRegistration& registerName (const NameInterface::Name& nm);
 
+  /**
+   * Start registration of many names with the same value.  The names are
+   * processed in batches bounded by the maximum batch size of the RPC
+   * settings:  The availability of a batch is checked with name_show calls,
+   * and its name_new transactions are then sent together.  The wallet must
+   * already be unlocked.  Names that are taken or fail are reported to the
+   * call-back and skipped, the others are added to the list.  Each batch
+   * is added before the next one is sent, and a batch that can not be sent
+   * fails only its own names.
+   * @param nms The names to register.
+   * @param value The value to set for all of them.
+   * @param progress Report each name here, may be NULL.
+   * @return The number of registrations started.
+   */
+  unsigned registerNames (const std::vector<std::string>& nms,
+                          const std::string& value, Progress* progress);
+
+  /**
+   * Start registration of many names, unlocking the wallet once for
+   * all of them if necessary and locking it again afterwards.
+   * @see registerNames (const std::vector<std::string>&,
+   *                     const std::string&, Progress*)
+   * @param nms The names to register.
+   * @param value The value to set for all of them.
+   * @param passphrase The wallet passphrase.
+   * @param progress Report each name here, may be NULL.
+   * @return The number of registrations started.
+   * @throws UnlockFailure if the passphrase is wrong.
+   * @throws JsonRpc::Exception in case of transport errors.
+   */
+  unsigned registerNames (const std::vector<std::string>& nms,
+                          const std::string& value,
+                          const std::string& passphrase, Progress* progress);
+
   /**
    * Try to update all processes, which activates names where it is possible.
+   * This does nothing if the chain tip has not changed since the last call.
+   * @throws JsonRpc::Exception if activating one of the names failed.
+   */
+  inline void
+  update ()
+  {
+    update (nullptr);
+  }
+
+  /**
+   * Try to update all processes, reporting each name activated or failed
+   * to the call-back instead of throwing.  Failed names stay registered,
+   * and are tried again on the next call even if the tip is the same.
+   * The name_firstupdate calls are sent one batch at a time, and each
+   * batch is recorded before the next one is sent.
+   * @param progress The call-back to use.  If NULL, errors are thrown
+   *                 after all other names have been processed.
+   * @throws JsonRpc::Exception if activating a name failed without call-back.
    */
-  void update ();
+  void update (Progress* progress);
 
   /**
-   * Purge finished names from the list.
+   * Purge finished names from the list.  This does nothing if the chain tip
+   * has not changed since the last call.
    * @return Number of elements purged.
    */
   unsigned cleanUp ();
@@ -439,6 +547,55 @@ public:
 
 };
 
+/**
+ * Call-back interface for the bulk operations of RegistrationManager, which
+ * is notified about each name.  The default implementations do nothing.
+ */
+class RegistrationManager::Progress
+{
+
+public:
+
+  inline Progress ()
+  {
+    // Nothing to do.
+  }
+
+  virtual inline ~Progress ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Called when the name_new transaction for a name has been sent.
+   * @param reg The registration process.
+   */
+  virtual void registered (const NameRegistration& reg);
+
+  /**
+   * Called when the name_firstupdate transaction has been sent.
+   * @param reg The registration process.
+   */
+  virtual void activated (const NameRegistration& reg);
+
+  /**
+   * Called when a step failed for a name.
+   * @param name The name.
+   * @param error Description of the error.
+   */
+  virtual void failed (const std::string& name, const std::string& error);
+
+  /**
+   * Called after each batch of transactions has been sent and its names
+   * have been reported and recorded in the manager, before the next
+   * batch is sent.  This can be used to save the state, so that no
+   * transactions are forgotten if a later batch is interrupted.
+   * @param mgr The manager doing the operation.
+   */
+  virtual void batchDone (const RegistrationManager& mgr);
+
+};
+
 /* ************************************************************************** */
 /* Name updater.  */
 
@@ -458,7 +615,7 @@ private:
   NameInterface& nc;
 
   /** The name that is being updated.  */
-  NameInterface::Name name;
+  std::string name;
   
   /** The value to set.  */
   std::string value;
@@ -539,6 +696,293 @@ public:
 
 };
 
+/* ************************************************************************** */
+/* Update many names at once.  */
+
+/**
+ * Update many names in one run, for instance to renew them before they
+ * expire.  In contrast to using NameUpdate for each name, the current
+ * values are only queried for items that don't specify a new one, both
+ * these queries and the name_update calls themselves are sent in batches
+ * (bounded by the maximum batch size of the RPC settings), and the wallet
+ * is unlocked only once.  Errors are reported per item, so that a name
+ * (or a batch of names) that can't be updated does not stop the others.
+ */
+class BulkNameUpdate
+{
+
+public:
+
+  class Item;
+  class Result;
+
+private:
+
+  /** JSON RPC connection used.  */
+  JsonRpc& rpc;
+  /** Namecoin high-level interface.  */
+  NameInterface& nc;
+
+  // Disable default constructor and copying.
+#ifndef CXX_11
+  BulkNameUpdate ();
+  BulkNameUpdate (const BulkNameUpdate&);
+  BulkNameUpdate& operator= (const BulkNameUpdate&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it.
+   * @param r The RPC connection to use.
+   * @param n The high-level interface to use.
+   */
+  inline BulkNameUpdate (JsonRpc& r, NameInterface& n)
+    : rpc(r), nc(n)
+  {
+    // Nothing else to do.
+  }
+
+  /* No copying or default constructor.  */
+#ifdef CXX_11
+  BulkNameUpdate () = delete;
+  BulkNameUpdate (const BulkNameUpdate&) = delete;
+  BulkNameUpdate& operator= (const BulkNameUpdate&) = delete;
+#endif /* CXX_11  */
+
+  /**
+   * Update all the given names.  The wallet must already be unlocked.
+   * If a batch can not be sent, its items fail with Result::FAILED
+   * and the other batches are still done.
+   * @param items The names to update.
+   * @return The result for each item, in the same order.
+   */
+  std::vector<Result> execute (const std::vector<Item>& items);
+
+  /**
+   * Update all the given names, unlocking the wallet once for the whole
+   * run if necessary and locking it again afterwards.
+   * @param items The names to update.
+   * @param passphrase The wallet passphrase.
+   * @return The result for each item, in the same order.
+   * @throws UnlockFailure if the passphrase is wrong.
+   * @throws JsonRpc::Exception in case of transport errors.
+   */
+  std::vector<Result> execute (const std::vector<Item>& items,
+                               const std::string& passphrase);
+
+};
+
+/**
+ * A name to update with BulkNameUpdate, together with its new value
+ * and target address (if these should be set).
+ */
+class BulkNameUpdate::Item
+{
+
+private:
+
+  friend class BulkNameUpdate;
+
+  /** The name to update.  */
+  std::string name;
+
+  /** Whether a new value is set.  */
+  bool hasValue;
+  /** The new value, if set.  */
+  std::string value;
+
+  /** Address to send the name to, empty for a new wallet address.  */
+  std::string address;
+
+public:
+
+  /**
+   * Construct it to keep the current value.
+   * @param nm The name to update.
+   */
+  explicit inline Item (const std::string& nm)
+    : name(nm), hasValue(false), value(), address()
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Construct it with a new value.
+   * @param nm The name to update.
+   * @param val The value to set.
+   */
+  inline Item (const std::string& nm, const std::string& val)
+    : name(nm), hasValue(true), value(val), address()
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  Item (const Item&) = default;
+  Item (Item&&) = default;
+  Item& operator= (const Item&) = default;
+  Item& operator= (Item&&) = default;
+#endif /* CXX_11  */
+
+  /**
+   * Send the name to the given address instead of a new one
+   * from the wallet.
+   * @param addr The target address.
+   */
+  inline void
+  setAddress (const std::string& addr)
+  {
+    address = addr;
+  }
+
+  /**
+   * Get the name.
+   * @return The name to update.
+   */
+  inline const std::string&
+  getName () const
+  {
+    return name;
+  }
+
+};
+
+/**
+ * Outcome of updating one name with BulkNameUpdate.
+ */
+class BulkNameUpdate::Result
+{
+
+public:
+
+  /** Possible outcomes.  */
+  enum Status
+  {
+    /** The update transaction was sent.  */
+    UPDATED,
+
+    /** The name does not exist (and no value was given).  */
+    NOT_FOUND,
+
+    /** The name is not owned by the wallet.  */
+    NO_PRIVATE_KEY,
+
+    /** The wallet is locked.  */
+    WALLET_LOCKED,
+
+    /** The target address is invalid.  */
+    INVALID_ADDRESS,
+
+    /** Some other RPC error.  */
+    FAILED
+  };
+
+private:
+
+  friend class BulkNameUpdate;
+
+  /** The name.  */
+  std::string name;
+
+  /** The outcome.  */
+  Status status;
+
+  /** Txid of the update, if successful.  */
+  std::string txid;
+  /** Description of the error, if any.  */
+  std::string error;
+
+  /**
+   * Construct it for a successful update.
+   * @param nm The name.
+   * @param tx The txid.
+   */
+  inline Result (const std::string& nm, const std::string& tx)
+    : name(nm), status(UPDATED), txid(tx), error()
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Construct it for a failed update.
+   * @param nm The name.
+   * @param s The kind of failure.
+   * @param err Description of the error.
+   */
+  inline Result (const std::string& nm, Status s, const std::string& err)
+    : name(nm), status(s), txid(), error(err)
+  {
+    // Nothing else to do.
+  }
+
+public:
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  Result (const Result&) = default;
+  Result (Result&&) = default;
+  Result& operator= (const Result&) = default;
+  Result& operator= (Result&&) = default;
+#endif /* CXX_11  */
+
+  /**
+   * Get the name.
+   * @return The name this is for.
+   */
+  inline const std::string&
+  getName () const
+  {
+    return name;
+  }
+
+  /**
+   * Get the outcome.
+   * @return The status.
+   */
+  inline Status
+  getStatus () const
+  {
+    return status;
+  }
+
+  /**
+   * Check whether the update succeeded.
+   * @return True iff the transaction was sent.
+   */
+  inline bool
+  isSuccess () const
+  {
+    return status == UPDATED;
+  }
+
+  /**
+   * Get the txid of the update.
+   * @return The txid.
+   * @throws std::logic_error if the update failed.
+   */
+  inline const std::string&
+  getTxid () const
+  {
+    if (!isSuccess ())
+      throw std::logic_error ("Name update failed, no txid.");
+
+    return txid;
+  }
+
+  /**
+   * Get the error message.
+   * @return Description of the error, empty if successful.
+   */
+  inline const std::string&
+  getError () const
+  {
+    return error;
+  }
+
+};
+
 /* ************************************************************************** */
 /* Exception classes.  */
 
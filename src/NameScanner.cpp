@@ -0,0 +1,440 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for NameScanner.hpp.  */
+
+#include "NameScanner.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <stdexcept>
+
+namespace nmcrpc
+{
+
+const unsigned NameScanner::POLL_INTERVAL = 64;
+const int NameScanner::POLL_MS = 10;
+
+/**
+ * Construct it.
+ * @param r The RPC connection to use.
+ * @param c The call-back to run on all names.
+ * @param o The options for the scan.
+ * @throws std::runtime_error if the filter is invalid.
+ */
+NameScanner::NameScanner (JsonRpc& r, NameInterface::ScanCallback& c,
+                          const NameInterface::ScanOptions& o)
+  : rpc(r), cb(c), opts(o), request(), incoming(opts), requested(false),
+    last(), haveLast(false), finished(false), filter(), haveFilter(false),
+    passed(0), ready(), mutex(), workAvailable(), spaceAvailable(), work(),
+    closing(false), failed(false), failure(), threads()
+{
+  if (!opts.getFilter ().empty ())
+    {
+      if (regcomp (&filter, opts.getFilter ().c_str (),
+                   REG_EXTENDED | REG_NOSUB) != 0)
+        throw std::runtime_error ("Invalid name filter: "
+                                  + opts.getFilter ());
+      haveFilter = true;
+    }
+}
+
+/**
+ * Destroy it, stopping the workers if they are still running.
+ */
+NameScanner::~NameScanner ()
+{
+  stopWorkers ();
+  if (haveFilter)
+    regfree (&filter);
+}
+
+/**
+ * Request the next page if there's room for it and none is in flight.
+ * @throws JsonRpc::Exception if starting the request fails.
+ */
+void
+NameScanner::requestNext ()
+{
+  if (finished || requested || ready.size () >= opts.getPrefetch ())
+    return;
+
+  /* The first page starts at the prefix unless a later start is set.  */
+  JsonRpc::JsonData params(Json::arrayValue);
+  if (haveLast)
+    params.append (last);
+  else
+    params.append (std::max (opts.getStart (), opts.getPrefix ()));
+  params.append (opts.getPageSize ());
+
+  incoming.names.clear ();
+  incoming.pastEnd = false;
+  rpc.executeRpcStreamingAsync ("name_scan", params, incoming, request,
+                                opts.getCallOptions ());
+  requested = true;
+}
+
+/**
+ * Check if the request has finished and take care of its result, as well
+ * as of requesting the next page.
+ * @throws JsonRpc::Exception if the request failed.
+ */
+void
+NameScanner::pump ()
+{
+  if (requested && request.isDone ())
+    {
+      requested = false;
+      request.get ();
+      addPage (incoming.names, incoming.pastEnd);
+    }
+
+  requestNext ();
+}
+
+/**
+ * Take the data of an entry, either as Json::Value or on a tape.
+ * @param el The entry.
+ * @throws JsonRpc::Exception if the entry is invalid.
+ */
+template<typename T>
+  void
+  NameScanner::PageCollector::add (const T& el)
+{
+  if (!el.isObject ())
+    throw JsonRpc::Exception ("name_scan returned an invalid entry.");
+
+  if (pastEnd)
+    return;
+
+  const std::string name = el["name"].asString ();
+  if (opts.isPastEnd (name))
+    {
+      pastEnd = true;
+      return;
+    }
+
+  names.push_back (NameInterface::ScanEntry ());
+  NameInterface::ScanEntry& entry = names.back ();
+  entry.name = name;
+  entry.value = el["value"].asString ();
+  entry.address = el["address"].asString ();
+  entry.expiresIn = el["expires_in"].asInt ();
+  entry.height = el["height"].asInt ();
+}
+
+/**
+ * Take the data of an entry.
+ * @param el The entry.
+ * @throws JsonRpc::Exception if the entry is invalid.
+ */
+void
+NameScanner::PageCollector::operator() (const JsonRpc::JsonData& el)
+{
+  add (el);
+}
+
+/**
+ * Take the data of an entry on a tape, which is how the pages
+ * of name_scan are parsed.
+ * @param el The entry.
+ * @throws JsonRpc::Exception if the entry is invalid.
+ */
+void
+NameScanner::PageCollector::element (const JsonTape::Value& el)
+{
+  add (el);
+}
+
+/**
+ * Take the names of a received page, skipping those already seen
+ * and those not matching the filter.
+ * @param names The names returned by name_scan.  They are consumed.
+ * @param pastEnd Whether the page went past the end of the range.
+ * @throws JsonRpc::Exception if no progress is made.
+ */
+void
+NameScanner::addPage (pageT& names, bool pastEnd)
+{
+  /* A page starts with the last name of the page before.  But some unicode
+     names in the blockchain come back differently from how the daemon
+     compares them, so that the first entry need not be exactly the last
+     name.  Thus skip everything that does not sort after it, which also
+     works if more than one entry is repeated.  */
+
+  const unsigned limit = opts.getMaxCount ();
+
+  bool progress = false;
+  pageT page;
+  page.reserve (names.size ());
+  for (pageT::iterator i = names.begin (); i != names.end (); ++i)
+    {
+      if (haveLast && i->name <= last)
+        continue;
+
+      progress = true;
+      last = i->name;
+      haveLast = true;
+
+      if (haveFilter
+          && regexec (&filter, i->name.c_str (), 0, nullptr, 0) != 0)
+        continue;
+
+      page.push_back (NameInterface::ScanEntry ());
+      NameInterface::ScanEntry& entry = page.back ();
+      entry.name.swap (i->name);
+      entry.value.swap (i->value);
+      entry.address.swap (i->address);
+      entry.expiresIn = i->expiresIn;
+      entry.height = i->height;
+
+      ++passed;
+      if (limit > 0 && passed >= limit)
+        {
+          finished = true;
+          break;
+        }
+    }
+
+  if (pastEnd)
+    finished = true;
+  else if (!progress)
+    {
+      if (names.size () >= opts.getPageSize ())
+        throw JsonRpc::Exception ("name_scan made no progress.");
+
+      finished = true;
+    }
+
+  if (page.empty ())
+    return;
+
+  ready.push_back (pageT ());
+  ready.back ().swap (page);
+}
+
+/**
+ * Get the next page, waiting for it if necessary.
+ * @param page Set to the page's names.
+ * @return False if there are no more pages.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+bool
+NameScanner::nextPage (pageT& page)
+{
+  pump ();
+  while (ready.empty ())
+    {
+      if (!requested)
+        return false;
+
+      request.wait ();
+      pump ();
+    }
+
+  page.swap (ready.front ());
+  ready.pop_front ();
+  requestNext ();
+
+  return true;
+}
+
+/**
+ * Run the scan.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if a call-back failed on a worker thread.
+ */
+void
+NameScanner::run ()
+{
+  if (opts.getWorkers () == 0)
+    runInline ();
+  else
+    runWorkers ();
+}
+
+/**
+ * Run the call-backs on the scanning thread.
+ */
+void
+NameScanner::runInline ()
+{
+  pageT page;
+  while (nextPage (page))
+    for (unsigned i = 0; i < page.size (); ++i)
+      {
+        cb (page[i]);
+
+        /* Keep the prefetch going while we work through the page.  */
+        if ((i + 1) % POLL_INTERVAL == 0)
+          {
+            rpc.processAsync (0);
+            pump ();
+          }
+      }
+}
+
+/**
+ * Run the call-backs on worker threads.
+ */
+void
+NameScanner::runWorkers ()
+{
+  assert (threads.empty ());
+  for (unsigned i = 0; i < opts.getWorkers (); ++i)
+    {
+      pthread_t thread;
+      if (pthread_create (&thread, nullptr, &workerMain, this) != 0)
+        {
+          stopWorkers ();
+          throw std::runtime_error ("Could not start worker thread.");
+        }
+      threads.push_back (thread);
+    }
+
+  pageT page;
+  while (nextPage (page))
+    {
+      while (true)
+        {
+          {
+            Lock lock(mutex);
+            if (failed)
+              break;
+
+            if (work.size () < opts.getPrefetch ())
+              {
+                work.push_back (pageT ());
+                work.back ().swap (page);
+                workAvailable.signal ();
+                break;
+              }
+
+            /* Without a request in flight, there's nothing to do for us
+               except waiting on the workers.  */
+            if (!requested)
+              {
+                spaceAvailable.wait (lock);
+                continue;
+              }
+          }
+
+          rpc.processAsync (POLL_MS);
+          pump ();
+        }
+
+      Lock lock(mutex);
+      if (failed)
+        break;
+    }
+
+  stopWorkers ();
+  if (failed)
+    throw std::runtime_error ("Name scan call-back failed: " + failure);
+}
+
+/**
+ * Stop and join all worker threads.
+ */
+void
+NameScanner::stopWorkers ()
+{
+  {
+    Lock lock(mutex);
+    closing = true;
+    workAvailable.broadcast ();
+  }
+
+  for (unsigned i = 0; i < threads.size (); ++i)
+    pthread_join (threads[i], nullptr);
+  threads.clear ();
+}
+
+/**
+ * Main routine of the worker threads.
+ * @param self The scanner as void pointer.
+ * @return Always NULL.
+ */
+void*
+NameScanner::workerMain (void* self)
+{
+  reinterpret_cast<NameScanner*> (self)->processWork ();
+  return nullptr;
+}
+
+/**
+ * Process work from the queue until the scan is closed.
+ */
+void
+NameScanner::processWork ()
+{
+  while (true)
+    {
+      pageT page;
+      {
+        Lock lock(mutex);
+        while (work.empty () && !closing && !failed)
+          workAvailable.wait (lock);
+        if (work.empty () || failed)
+          return;
+
+        page.swap (work.front ());
+        work.pop_front ();
+        spaceAvailable.signal ();
+      }
+
+      try
+        {
+          for (unsigned i = 0; i < page.size (); ++i)
+            cb (page[i]);
+        }
+      catch (const std::exception& exc)
+        {
+          setFailed (exc.what ());
+          return;
+        }
+      catch (...)
+        {
+          /* Nothing may escape the thread's start routine.  */
+          setFailed ("unknown exception");
+          return;
+        }
+    }
+}
+
+/**
+ * Record the failure of a call-back on a worker and wake up everyone
+ * waiting, so that the scan stops.  Only the first failure is kept.
+ * @param msg The error message.
+ */
+void
+NameScanner::setFailed (const std::string& msg)
+{
+  Lock lock(mutex);
+  if (!failed)
+    {
+      failed = true;
+      failure = msg;
+    }
+  workAvailable.broadcast ();
+  spaceAvailable.signal ();
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,288 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It implements the pipelined name scan
+   behind NameInterface::forAllNames and forNames.  */
+
+#ifndef NMCRPC_NAMESCANNER_HPP
+#define NMCRPC_NAMESCANNER_HPP
+
+#include "JsonRpc.hpp"
+#include "JsonTape.hpp"
+#include "NameInterface.hpp"
+#include "Thread.hpp"
+
+#include <pthread.h>
+#include <regex.h>
+
+#include <deque>
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Scan through all names with name_scan.  Only one request can be in
+ * flight at a time, since each page starts at the last name of the one
+ * before.  But the next page is requested as soon as the current one
+ * arrives, and up to the configured number of pages are buffered while
+ * the call-back is busy.  The call-back is either run on the scanning
+ * thread, or on a pool of worker threads fed through a bounded queue.
+ * If the options restrict the range, the first page is requested at its
+ * start and no more pages are requested once a name past it is seen.
+ */
+class NameScanner
+{
+
+private:
+
+  /** Type of a page of names.  */
+  typedef std::vector<NameInterface::ScanEntry> pageT;
+
+  /**
+   * Collect the entries of the streamed name_scan result, so that the
+   * JSON data is never kept.  Entries past the end of the range are
+   * not kept, either.
+   */
+  class PageCollector : public JsonRpc::ElementCallback,
+                        public JsonTape::Callback
+  {
+
+  private:
+
+    /** The options with the range.  */
+    const NameInterface::ScanOptions& opts;
+
+    /**
+     * Take the data of an entry, either as Json::Value or on a tape.
+     * @param el The entry.
+     * @throws JsonRpc::Exception if the entry is invalid.
+     */
+    template<typename T>
+      void add (const T& el);
+
+  public:
+
+    /** The entries received.  */
+    pageT names;
+
+    /** Set when an entry past the range was seen.  */
+    bool pastEnd;
+
+    explicit inline PageCollector (const NameInterface::ScanOptions& o)
+      : opts(o), names(), pastEnd(false)
+    {
+      // Nothing else to do.
+    }
+
+    /**
+     * Take the data of an entry.
+     * @param el The entry.
+     * @throws JsonRpc::Exception if the entry is invalid.
+     */
+    void operator() (const JsonRpc::JsonData& el);
+
+    /**
+     * Take the data of an entry on a tape, which is how the pages
+     * of name_scan are parsed.
+     * @param el The entry.
+     * @throws JsonRpc::Exception if the entry is invalid.
+     */
+    void element (const JsonTape::Value& el);
+
+  };
+
+  /** Check for network activity after this many names in inline mode.  */
+  static const unsigned POLL_INTERVAL;
+
+  /** Wait this many milliseconds for the network while the queue is full.  */
+  static const int POLL_MS;
+
+  /** The RPC connection to use.  */
+  JsonRpc& rpc;
+
+  /** The call-back to run.  */
+  NameInterface::ScanCallback& cb;
+
+  /** The options for the scan.  */
+  const NameInterface::ScanOptions opts;
+
+  /** The request for the next page.  */
+  JsonRpc::AsyncCall request;
+
+  /** Receives the names of the page requested.  */
+  PageCollector incoming;
+
+  /** Whether the request is in flight.  */
+  bool requested;
+
+  /** The last name seen so far, to resume the scan from.  */
+  std::string last;
+
+  /** Whether we have already seen a name.  */
+  bool haveLast;
+
+  /** Set when the last page has been received.  */
+  bool finished;
+
+  /** The compiled filter, if the options have one.  */
+  regex_t filter;
+
+  /** Whether the filter is used.  */
+  bool haveFilter;
+
+  /** Number of names passed on so far, for the limit.  */
+  unsigned passed;
+
+  /** Pages received but not yet handed out.  */
+  std::deque<pageT> ready;
+
+  /** Lock for the worker queue and state.  */
+  Mutex mutex;
+
+  /** Signalled when work is added to the queue or the scan ends.  */
+  Condition workAvailable;
+
+  /** Signalled when a worker takes work from the queue or fails.  */
+  Condition spaceAvailable;
+
+  /** Pages waiting for a worker.  */
+  std::deque<pageT> work;
+
+  /** Set when no more work will be added.  */
+  bool closing;
+
+  /** Set when a call-back failed on a worker.  */
+  bool failed;
+
+  /** Message of the first failure on a worker.  */
+  std::string failure;
+
+  /** The worker threads.  */
+  std::vector<pthread_t> threads;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  NameScanner ();
+  NameScanner (const NameScanner&);
+  NameScanner& operator= (const NameScanner&);
+#endif /* !CXX_11  */
+
+  /**
+   * Request the next page if there's room for it and none is in flight.
+   * @throws JsonRpc::Exception if starting the request fails.
+   */
+  void requestNext ();
+
+  /**
+   * Check if the request has finished and take care of its result, as well
+   * as of requesting the next page.
+   * @throws JsonRpc::Exception if the request failed.
+   */
+  void pump ();
+
+  /**
+   * Take the names of a received page, skipping those already seen
+   * and those not matching the filter.
+   * @param names The names returned by name_scan.  They are consumed.
+   * @param pastEnd Whether the page went past the end of the range.
+   * @throws JsonRpc::Exception if no progress is made.
+   */
+  void addPage (pageT& names, bool pastEnd);
+
+  /**
+   * Get the next page, waiting for it if necessary.
+   * @param page Set to the page's names.
+   * @return False if there are no more pages.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  bool nextPage (pageT& page);
+
+  /**
+   * Run the call-backs on the scanning thread.
+   */
+  void runInline ();
+
+  /**
+   * Run the call-backs on worker threads.
+   */
+  void runWorkers ();
+
+  /**
+   * Stop and join all worker threads.
+   */
+  void stopWorkers ();
+
+  /**
+   * Main routine of the worker threads.
+   * @param self The scanner as void pointer.
+   * @return Always NULL.
+   */
+  static void* workerMain (void* self);
+
+  /**
+   * Process work from the queue until the scan is closed.
+   */
+  void processWork ();
+
+  /**
+   * Record the failure of a call-back on a worker and wake up everyone
+   * waiting, so that the scan stops.  Only the first failure is kept.
+   * @param msg The error message.
+   */
+  void setFailed (const std::string& msg);
+
+public:
+
+  /**
+   * Construct it.
+   * @param r The RPC connection to use.
+   * @param c The call-back to run on all names.
+   * @param o The options for the scan.
+   * @throws std::runtime_error if the filter is invalid.
+   */
+  NameScanner (JsonRpc& r, NameInterface::ScanCallback& c,
+               const NameInterface::ScanOptions& o);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  NameScanner () = delete;
+  NameScanner (const NameScanner&) = delete;
+  NameScanner& operator= (const NameScanner&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Destroy it, stopping the workers if they are still running.
+   */
+  ~NameScanner ();
+
+  /**
+   * Run the scan.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if a call-back failed on a worker thread.
+   */
+  void run ();
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
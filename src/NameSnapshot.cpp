@@ -0,0 +1,623 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for NameSnapshot.hpp.  */
+
+#include "NameSnapshot.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* File layout.  */
+
+/*
+ * The file holds the header, then the records sorted by name, and then
+ * the strings they reference.  All numbers are stored in native byte
+ * order, which is checked through the byte order marker.
+ */
+
+/**
+ * Header at the start of the file.
+ */
+class NameSnapshot::FileHeader
+{
+
+public:
+
+  /** Magic bytes identifying the file.  */
+  static const char MAGIC[8];
+
+  /** Current format version.  */
+  static const uint32_t VERSION;
+
+  /** Marker to detect files written with another byte order.  */
+  static const uint32_t ORDER_MARKER;
+
+  char magic[8];
+  uint32_t version;
+  uint32_t byteOrder;
+  uint32_t count;
+  uint32_t height;
+  uint64_t stringsSize;
+
+};
+
+const char NameSnapshot::FileHeader::MAGIC[8]
+  = {'N', 'M', 'C', 'S', 'N', 'A', 'P', '\0'};
+const uint32_t NameSnapshot::FileHeader::VERSION = 1;
+const uint32_t NameSnapshot::FileHeader::ORDER_MARKER = 0x01020304;
+
+/**
+ * Fixed-size record of an entry in the file.  Offsets are relative
+ * to the start of the string data.
+ */
+class NameSnapshot::Record
+{
+
+public:
+
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t valueOffset;
+  uint32_t valueLength;
+  uint32_t addressOffset;
+  uint32_t addressLength;
+  int32_t expiresIn;
+  uint32_t height;
+
+};
+
+/* ************************************************************************** */
+/* The snapshot view.  */
+
+/** Names requested per name_scan call when creating a snapshot.  */
+const unsigned NameSnapshot::SCAN_PAGE = 1000;
+
+/**
+ * Open the snapshot in the given file.
+ * @param file The file name.
+ * @throws std::runtime_error if the file can not be read or is invalid.
+ */
+NameSnapshot::NameSnapshot (const std::string& file)
+  : mapped(nullptr), mappedSize(0), records(nullptr), strings(nullptr),
+    count(0), height(0)
+{
+  const int fd = open (file.c_str (), O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error ("Could not open name snapshot " + file + ".");
+
+  struct stat st;
+  if (fstat (fd, &st) != 0
+      || static_cast<size_t> (st.st_size) < sizeof (FileHeader))
+    {
+      close (fd);
+      throw std::runtime_error ("Invalid name snapshot " + file + ".");
+    }
+
+  mappedSize = st.st_size;
+  mapped = mmap (nullptr, mappedSize, PROT_READ, MAP_SHARED, fd, 0);
+  close (fd);
+  if (mapped == MAP_FAILED)
+    {
+      mapped = nullptr;
+      throw std::runtime_error ("Could not map name snapshot " + file + ".");
+    }
+
+  const FileHeader& hdr = *static_cast<const FileHeader*> (mapped);
+  const uint64_t expected = sizeof (FileHeader)
+                            + static_cast<uint64_t> (hdr.count)
+                              * sizeof (Record)
+                            + hdr.stringsSize;
+  if (std::memcmp (hdr.magic, FileHeader::MAGIC, sizeof (hdr.magic)) != 0
+      || hdr.version != FileHeader::VERSION
+      || hdr.byteOrder != FileHeader::ORDER_MARKER
+      || expected != mappedSize)
+    {
+      munmap (mapped, mappedSize);
+      throw std::runtime_error ("Invalid name snapshot " + file + ".");
+    }
+
+  const char* base = static_cast<const char*> (mapped);
+  records = reinterpret_cast<const Record*> (base + sizeof (FileHeader));
+  strings = base + sizeof (FileHeader) + hdr.count * sizeof (Record);
+  count = hdr.count;
+  height = hdr.height;
+
+  if (!checkRecords (hdr.stringsSize))
+    {
+      munmap (mapped, mappedSize);
+      mapped = nullptr;
+      throw std::runtime_error ("Invalid name snapshot " + file + ".");
+    }
+
+  /* We go through the names in order for scans.  */
+  madvise (mapped, mappedSize, MADV_SEQUENTIAL);
+}
+
+/**
+ * Close the snapshot.
+ */
+NameSnapshot::~NameSnapshot ()
+{
+  if (mapped)
+    munmap (mapped, mappedSize);
+}
+
+/**
+ * Check that all records reference only the string data and are
+ * sorted by name, so that a corrupt file is never read out of bounds.
+ * @param stringsSize Size of the string data.
+ * @return True iff all records are valid.
+ */
+bool
+NameSnapshot::checkRecords (uint64_t stringsSize) const
+{
+  for (unsigned i = 0; i < count; ++i)
+    {
+      const Record& rec = records[i];
+      if (static_cast<uint64_t> (rec.nameOffset) + rec.nameLength
+            > stringsSize
+          || static_cast<uint64_t> (rec.valueOffset) + rec.valueLength
+              > stringsSize
+          || static_cast<uint64_t> (rec.addressOffset) + rec.addressLength
+              > stringsSize)
+        return false;
+
+      /* Lookups are a binary search, so the names must be in order.  */
+      if (i > 0)
+        {
+          const Record& prev = records[i - 1];
+          const size_t len = std::min (rec.nameLength, prev.nameLength);
+          const int cmp = std::memcmp (strings + prev.nameOffset,
+                                       strings + rec.nameOffset, len);
+          if (cmp > 0 || (cmp == 0 && prev.nameLength >= rec.nameLength))
+            return false;
+        }
+    }
+
+  return true;
+}
+
+/**
+ * Get the name of an entry without copying it.
+ * @param i The entry's index.
+ * @param len Set to the length of the name.
+ * @return Pointer to the name's characters.
+ */
+const char*
+NameSnapshot::getNameData (unsigned i, size_t& len) const
+{
+  assert (i < count);
+  len = records[i].nameLength;
+  return strings + records[i].nameOffset;
+}
+
+/**
+ * Find the first entry whose name is not less than the given key.
+ * @param key The key to look for.
+ * @return The entry's index, or size() if there is none.
+ */
+unsigned
+NameSnapshot::lowerBound (const std::string& key) const
+{
+  unsigned lo = 0;
+  unsigned hi = count;
+  while (lo < hi)
+    {
+      const unsigned mid = lo + (hi - lo) / 2;
+
+      size_t len;
+      const char* name = getNameData (mid, len);
+      const int cmp = key.compare (0, key.size (), name, len);
+
+      if (cmp > 0)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+
+  return lo;
+}
+
+/**
+ * Check whether the name of an entry starts with a prefix.
+ * @param i The entry's index.
+ * @param prefix The prefix.
+ * @return True iff the name starts with the prefix.
+ */
+bool
+NameSnapshot::hasPrefix (unsigned i, const std::string& prefix) const
+{
+  size_t len;
+  const char* name = getNameData (i, len);
+
+  return len >= prefix.size ()
+          && std::memcmp (name, prefix.data (), prefix.size ()) == 0;
+}
+
+/**
+ * Look up a name.
+ * @param name The name to look for.
+ * @param res Set to the entry if it is found.
+ * @return True iff the name is in the snapshot.
+ */
+bool
+NameSnapshot::lookup (const std::string& name, Entry& res) const
+{
+  const unsigned i = lowerBound (name);
+  if (i == count)
+    return false;
+
+  size_t len;
+  const char* found = getNameData (i, len);
+  if (name.compare (0, name.size (), found, len) != 0)
+    return false;
+
+  res = getEntry (i);
+  return true;
+}
+
+/**
+ * Get an entry by its index in the sorted order.
+ * @param i The index.
+ * @return The entry.
+ */
+NameSnapshot::Entry
+NameSnapshot::getEntry (unsigned i) const
+{
+  assert (i < count);
+  const Record& rec = records[i];
+
+  Entry res;
+  res.name.assign (strings + rec.nameOffset, rec.nameLength);
+  res.value.assign (strings + rec.valueOffset, rec.valueLength);
+  res.address.assign (strings + rec.addressOffset, rec.addressLength);
+  res.expiresIn = rec.expiresIn;
+  res.height = rec.height;
+
+  return res;
+}
+
+/**
+ * Read all entries into memory.
+ * @param entries Add the entries here.
+ */
+void
+NameSnapshot::readAll (entryMapT& entries) const
+{
+  /* The entries are sorted, so each goes to the end of the map.  */
+  for (unsigned i = 0; i < count; ++i)
+    {
+      const Entry e = getEntry (i);
+      entries.insert (entries.end (), std::make_pair (e.name, e));
+    }
+}
+
+/* ************************************************************************** */
+/* Creating and refreshing snapshots.  */
+
+/**
+ * Call-back adding scanned names to the entries.  The scan returns them
+ * in order, so each goes to the end of the map.
+ */
+class NameSnapshot::ScanCollector
+{
+
+private:
+
+  /** The entries to add to.  */
+  entryMapT* entries;
+
+  /** The current block height.  */
+  unsigned cur;
+
+public:
+
+  /**
+   * Construct it.
+   * @param e The entries to add to.
+   * @param h The current block height.
+   */
+  inline ScanCollector (entryMapT& e, unsigned h)
+    : entries(&e), cur(h)
+  {
+    // Nothing else to do.
+  }
+
+  inline void
+  operator() (const NameInterface::ScanEntry& data)
+  {
+    entries->insert (entries->end (),
+                     std::make_pair (data.getName (), fromScan (data, cur)));
+  }
+
+};
+
+/**
+ * Call-back adding the names of a name_filter result to the entries,
+ * replacing those already there.
+ */
+class NameSnapshot::FilterCollector : public JsonRpc::ElementCallback
+{
+
+private:
+
+  /** The entries to add to.  */
+  entryMapT& entries;
+
+  /** The current block height.  */
+  unsigned cur;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  FilterCollector ();
+  FilterCollector (const FilterCollector&);
+  FilterCollector& operator= (const FilterCollector&);
+#endif /* !CXX_11  */
+
+public:
+
+  /** Number of names received.  */
+  unsigned received;
+
+  /**
+   * Construct it.
+   * @param e The entries to add to.
+   * @param h The current block height.
+   */
+  inline FilterCollector (entryMapT& e, unsigned h)
+    : entries(e), cur(h), received(0)
+  {
+    // Nothing else to do.
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  FilterCollector () = delete;
+  FilterCollector (const FilterCollector&) = delete;
+  FilterCollector& operator= (const FilterCollector&) = delete;
+#endif /* CXX_11?  */
+
+  inline void
+  operator() (const JsonRpc::JsonData& el)
+  {
+    const Entry e = fromJson (el, cur);
+    entries[e.name] = e;
+    ++received;
+  }
+
+};
+
+/**
+ * Estimate the height of a name's last update from its expiration
+ * counter, for daemons that don't report it.
+ * @param expiresIn The name's expiration counter.
+ * @param cur The current block height.
+ * @return The height of the last update.
+ */
+unsigned
+NameSnapshot::guessHeight (int expiresIn, unsigned cur)
+{
+  const int h = static_cast<int> (cur) + expiresIn
+                - static_cast<int> (NameInterface::EXPIRATION_DEPTH);
+  return (h > 0 ? h : 0);
+}
+
+/**
+ * Turn a name_filter result into an entry.  Older daemons don't report
+ * the height of the last update, in which case it is derived from the
+ * expiration counter.
+ * @param data The JSON entry.
+ * @param cur The current block height.
+ * @return The entry.
+ * @throws JsonRpc::Exception if the data is invalid.
+ */
+NameSnapshot::Entry
+NameSnapshot::fromJson (const JsonRpc::JsonData& data, unsigned cur)
+{
+  if (!data.isObject () || !data["name"].isString ())
+    throw JsonRpc::Exception ("Invalid name entry returned.");
+
+  Entry res;
+  res.name = data["name"].asString ();
+  res.value = data["value"].asString ();
+  res.address = data["address"].asString ();
+  res.expiresIn = data["expires_in"].asInt ();
+
+  if (data["height"].isIntegral ())
+    res.height = data["height"].asUInt ();
+  else
+    res.height = guessHeight (res.expiresIn, cur);
+
+  return res;
+}
+
+/**
+ * Turn a scanned name into an entry.  If the daemon doesn't report the
+ * height of the last update, it is derived from the expiration counter.
+ * @param data The scanned name.
+ * @param cur The current block height.
+ * @return The entry.
+ */
+NameSnapshot::Entry
+NameSnapshot::fromScan (const NameInterface::ScanEntry& data, unsigned cur)
+{
+  Entry res;
+  res.name = data.getName ();
+  res.value = data.getStringValue ();
+  res.address = data.getAddress ();
+  res.expiresIn = data.getExpireCounter ();
+
+  res.height = data.getUpdateHeight ();
+  if (res.height == 0)
+    res.height = guessHeight (res.expiresIn, cur);
+
+  return res;
+}
+
+/**
+ * Write a snapshot file.  It is first written to a temporary file,
+ * which is then renamed to the final name.
+ * @param file The file name.
+ * @param h The block height of the snapshot.
+ * @param entries The entries.
+ * @throws std::runtime_error if writing fails.
+ */
+void
+NameSnapshot::write (const std::string& file, unsigned h,
+                     const entryMapT& entries)
+{
+  std::vector<Record> recs;
+  recs.reserve (entries.size ());
+  std::string data;
+
+  for (entryMapT::const_iterator i = entries.begin ();
+       i != entries.end (); ++i)
+    {
+      const Entry& e = i->second;
+      Record rec;
+
+      rec.nameOffset = data.size ();
+      rec.nameLength = e.name.size ();
+      data += e.name;
+      rec.valueOffset = data.size ();
+      rec.valueLength = e.value.size ();
+      data += e.value;
+      rec.addressOffset = data.size ();
+      rec.addressLength = e.address.size ();
+      data += e.address;
+
+      rec.expiresIn = e.expiresIn;
+      rec.height = e.height;
+      recs.push_back (rec);
+    }
+
+  FileHeader hdr;
+  std::memset (&hdr, 0, sizeof (hdr));
+  std::memcpy (hdr.magic, FileHeader::MAGIC, sizeof (hdr.magic));
+  hdr.version = FileHeader::VERSION;
+  hdr.byteOrder = FileHeader::ORDER_MARKER;
+  hdr.count = recs.size ();
+  hdr.height = h;
+  hdr.stringsSize = data.size ();
+
+  const std::string tmp = file + ".tmp";
+  std::FILE* out = std::fopen (tmp.c_str (), "wb");
+  if (!out)
+    throw std::runtime_error ("Could not write name snapshot " + tmp + ".");
+
+  bool ok = (std::fwrite (&hdr, sizeof (hdr), 1, out) == 1);
+  if (ok && !recs.empty ())
+    ok = (std::fwrite (&recs[0], sizeof (Record), recs.size (), out)
+          == recs.size ());
+  if (ok && !data.empty ())
+    ok = (std::fwrite (data.data (), 1, data.size (), out) == data.size ());
+  ok = (std::fclose (out) == 0) && ok;
+
+  if (!ok || std::rename (tmp.c_str (), file.c_str ()) != 0)
+    {
+      std::remove (tmp.c_str ());
+      throw std::runtime_error ("Could not write name snapshot " + file + ".");
+    }
+}
+
+/**
+ * Create a snapshot of all names with name_scan.  The height is taken
+ * before scanning, so that names updated during the scan are included
+ * again by the next refresh.
+ * @param rpc The RPC connection to use.
+ * @param file The file to write.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if writing the file fails.
+ */
+void
+NameSnapshot::create (JsonRpc& rpc, const std::string& file)
+{
+  const unsigned cur = rpc.executeRpc ("getblockcount").asUInt ();
+
+  entryMapT entries;
+  NameInterface nc(rpc);
+  nc.forAllNames (ScanCollector (entries, cur),
+                  NameInterface::ScanOptions ().setPageSize (SCAN_PAGE));
+
+  write (file, cur, entries);
+}
+
+/**
+ * Bring a snapshot up to the current block height.
+ * @param rpc The RPC connection to use.
+ * @param file The snapshot file, which is replaced.
+ * @return The number of names that were added or updated.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ * @throws std::runtime_error if reading or writing the file fails.
+ */
+unsigned
+NameSnapshot::refresh (JsonRpc& rpc, const std::string& file)
+{
+  entryMapT entries;
+  unsigned old;
+  {
+    const NameSnapshot snap(file);
+    old = snap.getHeight ();
+    snap.readAll (entries);
+  }
+
+  const unsigned cur = rpc.executeRpc ("getblockcount").asUInt ();
+  if (cur <= old)
+    return 0;
+
+  /* Counters of unchanged names just run down.  */
+  const int delta = cur - old;
+  for (entryMapT::iterator i = entries.begin (); i != entries.end (); ++i)
+    i->second.expiresIn -= delta;
+
+  /* name_filter with a maximum age returns all names updated in the
+     last blocks.  Passing the difference includes the snapshot's block
+     itself again, which does no harm.  */
+  JsonRpc::JsonData params(Json::arrayValue);
+  params.append ("");
+  params.append (delta);
+  params.append (0);
+  params.append (0);
+
+  FilterCollector changed(entries, cur);
+  rpc.executeRpcStreaming ("name_filter", params, changed);
+
+  write (file, cur, entries);
+  return changed.received;
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,386 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_NAMESNAPSHOT_HPP
+#define NMCRPC_NAMESNAPSHOT_HPP
+
+#include "JsonRpc.hpp"
+#include "NameInterface.hpp"
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+#include <stdint.h>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* Local snapshot of all names.  */
+
+/**
+ * Read-only view of all names as of some block height, stored in a local
+ * file.  This is meant for bulk jobs that would otherwise have to query
+ * each name from the daemon.  The file is mapped into memory and holds
+ * the entries sorted by name, so that lookups are a binary search and
+ * ranges of names (like a namespace) can be iterated in order.
+ *
+ * Snapshots are written by create() and brought up to date by refresh(),
+ * which only queries the names changed since the snapshot's height.  Both
+ * replace the file atomically, so views opened before keep seeing the
+ * old data until they are opened again.  A view can be shared between
+ * threads.
+ */
+class NameSnapshot
+{
+
+public:
+
+  class Entry;
+
+private:
+
+  /** Header at the start of the file.  */
+  class FileHeader;
+  /** Fixed-size record of an entry in the file.  */
+  class Record;
+
+  /** Type of the entries while building a snapshot.  */
+  typedef std::map<std::string, Entry> entryMapT;
+
+  /** Call-back adding scanned names to the entries.  */
+  class ScanCollector;
+  /** Call-back adding the names of a name_filter result to the entries.  */
+  class FilterCollector;
+
+  /** Names requested per name_scan call when creating a snapshot.  */
+  static const unsigned SCAN_PAGE;
+
+  /** The mapped file.  */
+  void* mapped;
+  /** Size of the mapped file.  */
+  size_t mappedSize;
+
+  /** The records, sorted by name.  */
+  const Record* records;
+  /** The string data referenced by the records.  */
+  const char* strings;
+  /** Number of entries.  */
+  unsigned count;
+
+  /** Block height of the snapshot.  */
+  unsigned height;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  NameSnapshot ();
+  NameSnapshot (const NameSnapshot&);
+  NameSnapshot& operator= (const NameSnapshot&);
+#endif /* !CXX_11  */
+
+  /**
+   * Get the name of an entry without copying it.
+   * @param i The entry's index.
+   * @param len Set to the length of the name.
+   * @return Pointer to the name's characters.
+   */
+  const char* getNameData (unsigned i, size_t& len) const;
+
+  /**
+   * Check that all records reference only the string data and are
+   * sorted by name, so that a corrupt file is never read out of bounds.
+   * @param stringsSize Size of the string data.
+   * @return True iff all records are valid.
+   */
+  bool checkRecords (uint64_t stringsSize) const;
+
+  /**
+   * Read all entries into memory.
+   * @param entries Add the entries here.
+   */
+  void readAll (entryMapT& entries) const;
+
+  /**
+   * Estimate the height of a name's last update from its expiration
+   * counter, for daemons that don't report it.
+   * @param expiresIn The name's expiration counter.
+   * @param cur The current block height.
+   * @return The height of the last update.
+   */
+  static unsigned guessHeight (int expiresIn, unsigned cur);
+
+  /**
+   * Turn a name_filter result into an entry.
+   * @param data The JSON entry.
+   * @param cur The current block height.
+   * @return The entry.
+   * @throws JsonRpc::Exception if the data is invalid.
+   */
+  static Entry fromJson (const JsonRpc::JsonData& data, unsigned cur);
+
+  /**
+   * Turn a scanned name into an entry.
+   * @param data The scanned name.
+   * @param cur The current block height.
+   * @return The entry.
+   */
+  static Entry fromScan (const NameInterface::ScanEntry& data, unsigned cur);
+
+  /**
+   * Write a snapshot file.  It is first written to a temporary file,
+   * which is then renamed to the final name.
+   * @param file The file name.
+   * @param h The block height of the snapshot.
+   * @param entries The entries.
+   * @throws std::runtime_error if writing fails.
+   */
+  static void write (const std::string& file, unsigned h,
+                     const entryMapT& entries);
+
+public:
+
+  /**
+   * Open the snapshot in the given file.
+   * @param file The file name.
+   * @throws std::runtime_error if the file can not be read or is invalid.
+   */
+  explicit NameSnapshot (const std::string& file);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  NameSnapshot () = delete;
+  NameSnapshot (const NameSnapshot&) = delete;
+  NameSnapshot& operator= (const NameSnapshot&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Close the snapshot.
+   */
+  ~NameSnapshot ();
+
+  /**
+   * Create a snapshot of all names with name_scan.
+   * @param rpc The RPC connection to use.
+   * @param file The file to write.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if writing the file fails.
+   */
+  static void create (JsonRpc& rpc, const std::string& file);
+
+  /**
+   * Bring a snapshot up to the current block height.  Only the names
+   * updated since the snapshot's height are queried (with name_filter),
+   * all others just get their expiration counters adjusted.
+   * @param rpc The RPC connection to use.
+   * @param file The snapshot file, which is replaced.
+   * @return The number of names that were added or updated.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   * @throws std::runtime_error if reading or writing the file fails.
+   */
+  static unsigned refresh (JsonRpc& rpc, const std::string& file);
+
+  /**
+   * Get the block height the snapshot reflects.
+   * @return The block height.
+   */
+  inline unsigned
+  getHeight () const
+  {
+    return height;
+  }
+
+  /**
+   * Get the number of names in the snapshot.
+   * @return The number of names.
+   */
+  inline unsigned
+  size () const
+  {
+    return count;
+  }
+
+  /**
+   * Look up a name.
+   * @param name The name to look for.
+   * @param res Set to the entry if it is found.
+   * @return True iff the name is in the snapshot.
+   */
+  bool lookup (const std::string& name, Entry& res) const;
+
+  /**
+   * Find the first entry whose name is not less than the given key.
+   * @param key The key to look for.
+   * @return The entry's index, or size() if there is none.
+   */
+  unsigned lowerBound (const std::string& key) const;
+
+  /**
+   * Get an entry by its index in the sorted order.
+   * @param i The index.
+   * @return The entry.
+   */
+  Entry getEntry (unsigned i) const;
+
+  /**
+   * Check whether the name of an entry starts with a prefix.
+   * @param i The entry's index.
+   * @param prefix The prefix.
+   * @return True iff the name starts with the prefix.
+   */
+  bool hasPrefix (unsigned i, const std::string& prefix) const;
+
+  /**
+   * Execute a call-back on all entries whose name starts with the
+   * given prefix, in sorted order.
+   * @param prefix The prefix.
+   * @param cb Call-back routine, called with the Entry.
+   */
+  template<typename T>
+    void forPrefix (const std::string& prefix, T cb) const;
+
+  /**
+   * Execute a call-back on all entries in a namespace, in sorted order.
+   * @param ns The namespace (like "d" for "d/...").
+   * @param cb Call-back routine, called with the Entry.
+   */
+  template<typename T>
+    inline void
+    forNamespace (const std::string& ns, T cb) const
+  {
+    forPrefix (ns + "/", cb);
+  }
+
+};
+
+/**
+ * A single name in a snapshot.
+ */
+class NameSnapshot::Entry
+{
+
+private:
+
+  friend class NameSnapshot;
+
+  /** The name.  */
+  std::string name;
+
+  /** The name's value.  */
+  std::string value;
+
+  /** The address holding the name.  */
+  std::string address;
+
+  /** Blocks until the name expires, as of the snapshot's height.  */
+  int expiresIn;
+
+  /** Block height of the name's last update.  */
+  unsigned height;
+
+public:
+
+  /**
+   * Default constructor, for entries that are assigned later.
+   */
+  inline Entry ()
+    : name(), value(), address(), expiresIn(0), height(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  Entry (const Entry&) = default;
+  Entry (Entry&&) = default;
+  Entry& operator= (const Entry&) = default;
+  Entry& operator= (Entry&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getName () const
+  {
+    return name;
+  }
+
+  inline const std::string&
+  getStringValue () const
+  {
+    return value;
+  }
+
+  /**
+   * Get the name's value as JSON object.
+   * @return This name's value as JSON object.
+   * @throws JsonRpc::JsonParseError if JSON parsing fails.
+   */
+  inline JsonRpc::JsonData
+  getJsonValue () const
+  {
+    return JsonRpc::decodeJson (value);
+  }
+
+  inline const std::string&
+  getAddress () const
+  {
+    return address;
+  }
+
+  /**
+   * Return number of blocks until the name expires, counted from the
+   * snapshot's height.
+   * @return The number of blocks until the name expires.  Might be negative.
+   */
+  inline int
+  getExpireCounter () const
+  {
+    return expiresIn;
+  }
+
+  /**
+   * Return whether the name was expired at the snapshot's height.
+   * @return True iff the name is expired.
+   */
+  inline bool
+  isExpired () const
+  {
+    return expiresIn <= 0;
+  }
+
+  /**
+   * Get the block height at which the name was last updated.
+   * @return The height of the last update.
+   */
+  inline unsigned
+  getUpdateHeight () const
+  {
+    return height;
+  }
+
+};
+
+/* ************************************************************************** */
+
+/* Include template implementations.  */
+#include "NameSnapshot.tpp"
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
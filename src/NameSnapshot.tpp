@@ -0,0 +1,36 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Template implementation for NameSnapshot.hpp.  */
+
+/**
+ * Execute a call-back on all entries whose name starts with the
+ * given prefix, in sorted order.
+ * @param prefix The prefix.
+ * @param cb Call-back routine, called with the Entry.
+ */
+template<typename T>
+  void
+  NameSnapshot::forPrefix (const std::string& prefix, T cb) const
+{
+  for (unsigned i = lowerBound (prefix); i < count && hasPrefix (i, prefix);
+       ++i)
+    cb (getEntry (i));
+}
@@ -0,0 +1,319 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for NameTable.hpp.  */
+
+#include "NameTable.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* NameRecord.  */
+
+/**
+ * Check whether the name is in a namespace.
+ * @param ns The namespace (like "d" for "d/...").
+ * @return True iff the name is in the namespace.
+ */
+bool
+NameRecord::isInNamespace (const std::string& ns) const
+{
+  return nameSize > ns.size () && name[ns.size ()] == '/'
+          && ns.compare (0, ns.size (), name, ns.size ()) == 0;
+}
+
+/* ************************************************************************** */
+/* NameTable.  */
+
+/**
+ * Comparison of rows by name.
+ */
+class NameTable::NameOrder
+{
+
+private:
+
+  /** The table.  */
+  const NameTable& table;
+
+public:
+
+  explicit inline NameOrder (const NameTable& t)
+    : table(t)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Compare two rows.
+   * @param a The first row.
+   * @param b The second row.
+   * @return True iff a's name is less than b's.
+   */
+  inline bool
+  operator() (unsigned a, unsigned b) const
+  {
+    const size_t sizeA = table.nameSizes[a];
+    const size_t sizeB = table.nameSizes[b];
+    const int cmp = std::memcmp (table.strings.data () + table.offsets[a],
+                                 table.strings.data () + table.offsets[b],
+                                 std::min (sizeA, sizeB));
+    return cmp < 0 || (cmp == 0 && sizeA < sizeB);
+  }
+
+};
+
+/**
+ * Comparison of rows by expiration.
+ */
+class NameTable::ExpirationOrder
+{
+
+private:
+
+  /** The table.  */
+  const NameTable& table;
+
+public:
+
+  explicit inline ExpirationOrder (const NameTable& t)
+    : table(t)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Compare two rows.
+   * @param a The first row.
+   * @param b The second row.
+   * @return True iff a expires before b.
+   */
+  inline bool
+  operator() (unsigned a, unsigned b) const
+  {
+    return table.expiresIn[a] < table.expiresIn[b];
+  }
+
+};
+
+/**
+ * Construct an empty table.
+ */
+NameTable::NameTable ()
+  : strings(), offsets(1, 0), nameSizes(), addressIds(), expiresIn(),
+    heights(), mine(), addresses(), addressIndex()
+{
+  // Nothing else to do.
+}
+
+/**
+ * Remove all rows.
+ */
+void
+NameTable::clear ()
+{
+  strings.clear ();
+  offsets.assign (1, 0);
+  nameSizes.clear ();
+  addressIds.clear ();
+  expiresIn.clear ();
+  heights.clear ();
+  mine.clear ();
+  addresses.clear ();
+  addressIndex.clear ();
+}
+
+/**
+ * Add a name.
+ * @param name The name.
+ * @param value The name's value.
+ * @param address The address holding the name.
+ * @param expires Blocks until the name expires.
+ * @param height Block height of the last update, zero if unknown.
+ * @param owned Whether the name is owned by the user.
+ */
+void
+NameTable::add (const std::string& name, const std::string& value,
+                const std::string& address, int expires, unsigned height,
+                bool owned)
+{
+  const std::map<std::string, unsigned>::iterator addr
+    = addressIndex.insert (std::make_pair (address, addresses.size ())).first;
+  if (addr->second == addresses.size ())
+    addresses.push_back (address);
+
+  strings.append (name);
+  strings.append (value);
+  offsets.push_back (strings.size ());
+  nameSizes.push_back (name.size ());
+
+  addressIds.push_back (addr->second);
+  expiresIn.push_back (expires);
+  heights.push_back (height);
+  mine.push_back (owned);
+}
+
+/**
+ * Add a name found by a scan.  It is not marked as owned.
+ * @param entry The entry of the scan.
+ */
+void
+NameTable::add (const NameInterface::ScanEntry& entry)
+{
+  add (entry.getName (), entry.getStringValue (), entry.getAddress (),
+       entry.getExpireCounter (), entry.getUpdateHeight (), false);
+}
+
+/**
+ * Get a row.
+ * @param i The row's index.
+ * @return The record of the row.
+ */
+NameRecord
+NameTable::getRecord (unsigned i) const
+{
+  NameRecord res;
+
+  res.name = strings.data () + offsets[i];
+  res.nameSize = nameSizes[i];
+  res.value = res.name + res.nameSize;
+  res.valueSize = offsets[i + 1] - offsets[i] - res.nameSize;
+
+  res.address = &addresses[addressIds[i]];
+  res.expiresIn = expiresIn[i];
+  res.height = heights[i];
+  res.mine = mine[i];
+
+  return res;
+}
+
+/**
+ * Keep only the given rows, in the given order.  All columns are rebuilt,
+ * so that they stay contiguous; the addresses are kept as they are.
+ * @param rows The indices of the rows to keep.
+ */
+void
+NameTable::select (const std::vector<unsigned>& rows)
+{
+  std::string newStrings;
+  std::vector<size_t> newOffsets(1, 0);
+  std::vector<unsigned> newNameSizes, newAddressIds, newHeights;
+  std::vector<int> newExpiresIn;
+  std::vector<bool> newMine;
+
+  newOffsets.reserve (rows.size () + 1);
+  newNameSizes.reserve (rows.size ());
+  newAddressIds.reserve (rows.size ());
+  newExpiresIn.reserve (rows.size ());
+  newHeights.reserve (rows.size ());
+  newMine.reserve (rows.size ());
+
+  size_t total = 0;
+  for (unsigned i = 0; i < rows.size (); ++i)
+    total += offsets[rows[i] + 1] - offsets[rows[i]];
+  newStrings.reserve (total);
+
+  for (unsigned i = 0; i < rows.size (); ++i)
+    {
+      const unsigned row = rows[i];
+      newStrings.append (strings, offsets[row],
+                         offsets[row + 1] - offsets[row]);
+      newOffsets.push_back (newStrings.size ());
+      newNameSizes.push_back (nameSizes[row]);
+      newAddressIds.push_back (addressIds[row]);
+      newExpiresIn.push_back (expiresIn[row]);
+      newHeights.push_back (heights[row]);
+      newMine.push_back (mine[row]);
+    }
+
+  strings.swap (newStrings);
+  offsets.swap (newOffsets);
+  nameSizes.swap (newNameSizes);
+  addressIds.swap (newAddressIds);
+  expiresIn.swap (newExpiresIn);
+  heights.swap (newHeights);
+  mine.swap (newMine);
+}
+
+/**
+ * Sort the rows by name.
+ */
+void
+NameTable::sortByName ()
+{
+  std::vector<unsigned> rows(size ());
+  for (unsigned i = 0; i < rows.size (); ++i)
+    rows[i] = i;
+
+  std::sort (rows.begin (), rows.end (), NameOrder (*this));
+  select (rows);
+}
+
+/**
+ * Sort the rows by expiration counter, soonest first.  Rows with
+ * the same counter keep their order.
+ */
+void
+NameTable::sortByExpiration ()
+{
+  std::vector<unsigned> rows(size ());
+  for (unsigned i = 0; i < rows.size (); ++i)
+    rows[i] = i;
+
+  std::stable_sort (rows.begin (), rows.end (), ExpirationOrder (*this));
+  select (rows);
+}
+
+/**
+ * Keep only the names in a namespace.
+ * @param ns The namespace (like "d" for "d/...").
+ */
+void
+NameTable::filterNamespace (const std::string& ns)
+{
+  std::vector<unsigned> rows;
+  for (unsigned i = 0; i < size (); ++i)
+    if (getRecord (i).isInNamespace (ns))
+      rows.push_back (i);
+
+  select (rows);
+}
+
+/**
+ * Keep only the names expiring within some blocks.  This includes
+ * names that have expired already.
+ * @param blocks Keep names with at most this expiration counter.
+ */
+void
+NameTable::filterExpiring (int blocks)
+{
+  std::vector<unsigned> rows;
+  for (unsigned i = 0; i < size (); ++i)
+    if (expiresIn[i] <= blocks)
+      rows.push_back (i);
+
+  select (rows);
+}
+
+} // namespace nmcrpc
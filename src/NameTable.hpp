@@ -0,0 +1,390 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_NAMETABLE_HPP
+#define NMCRPC_NAMETABLE_HPP
+
+#include "NameInterface.hpp"
+
+#include <cstddef>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+class NameTable;
+
+/* ************************************************************************** */
+/* Single name in a table.  */
+
+/**
+ * A name in a NameTable.  This is a small value type referring to the
+ * table's storage instead of holding copies of the strings, and stays
+ * valid only as long as the table is not changed.
+ */
+class NameRecord
+{
+
+private:
+
+  friend class NameTable;
+
+  /** The name's characters.  */
+  const char* name;
+  /** Length of the name.  */
+  size_t nameSize;
+
+  /** The value's characters.  */
+  const char* value;
+  /** Length of the value.  */
+  size_t valueSize;
+
+  /** The address holding the name.  */
+  const std::string* address;
+
+  /** Blocks until the name expires.  */
+  int expiresIn;
+
+  /** Block height of the name's last update, zero if unknown.  */
+  unsigned height;
+
+  /** Whether the name is known to be owned by the user.  */
+  bool mine;
+
+  /**
+   * Construct it, only done by NameTable.
+   */
+  inline NameRecord ()
+    : name(nullptr), nameSize(0), value(nullptr), valueSize(0),
+      address(nullptr), expiresIn(0), height(0), mine(false)
+  {
+    // Nothing else to do.
+  }
+
+public:
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  NameRecord (const NameRecord&) = default;
+  NameRecord (NameRecord&&) = default;
+  NameRecord& operator= (const NameRecord&) = default;
+  NameRecord& operator= (NameRecord&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the name as string.  This copies it, use getNameData to
+   * look at it in place.
+   * @return The name.
+   */
+  inline std::string
+  getName () const
+  {
+    return std::string (name, nameSize);
+  }
+
+  /**
+   * Get the name's characters in the table, without copying.
+   * They are not null-terminated.
+   * @return Pointer to the name's characters.
+   */
+  inline const char*
+  getNameData () const
+  {
+    return name;
+  }
+
+  inline size_t
+  getNameSize () const
+  {
+    return nameSize;
+  }
+
+  /**
+   * Get the value as string.  This copies it, use getValueData to
+   * look at it in place.
+   * @return The value.
+   */
+  inline std::string
+  getStringValue () const
+  {
+    return std::string (value, valueSize);
+  }
+
+  /**
+   * Get the value's characters in the table, without copying.
+   * They are not null-terminated.
+   * @return Pointer to the value's characters.
+   */
+  inline const char*
+  getValueData () const
+  {
+    return value;
+  }
+
+  inline size_t
+  getValueSize () const
+  {
+    return valueSize;
+  }
+
+  /**
+   * Get the name's value as JSON object.
+   * @return This name's value as JSON object.
+   * @throws JsonRpc::JsonParseError if JSON parsing fails.
+   */
+  inline JsonRpc::JsonData
+  getJsonValue () const
+  {
+    return JsonRpc::decodeJson (value, value + valueSize);
+  }
+
+  /**
+   * Get the address holding the name.  The string is shared by all
+   * records in the table with the same address.
+   * @return The address as string.
+   */
+  inline const std::string&
+  getAddress () const
+  {
+    return *address;
+  }
+
+  /**
+   * Return number of blocks until the name expires.
+   * @return The number of blocks until the name expires.  Might be negative.
+   */
+  inline int
+  getExpireCounter () const
+  {
+    return expiresIn;
+  }
+
+  /**
+   * Return whether the name is expired.
+   * @return True iff the name is expired.
+   */
+  inline bool
+  isExpired () const
+  {
+    return expiresIn <= 0;
+  }
+
+  /**
+   * Get the block height at which the name was last updated.
+   * @return The height of the last update, zero if it is unknown.
+   */
+  inline unsigned
+  getUpdateHeight () const
+  {
+    return height;
+  }
+
+  /**
+   * Return whether the name is known to be owned by the user.  This is
+   * set for names from the wallet, but not for those from scans.
+   * @return True iff the name is owned by the user.
+   */
+  inline bool
+  isMine () const
+  {
+    return mine;
+  }
+
+  /**
+   * Check whether the name is in a namespace.
+   * @param ns The namespace (like "d" for "d/...").
+   * @return True iff the name is in the namespace.
+   */
+  bool isInNamespace (const std::string& ns) const;
+
+};
+
+/* ************************************************************************** */
+/* Columnar container of names.  */
+
+/**
+ * Compact storage for many names, like the results of a scan over the
+ * whole chain or of the wallet's names.  Instead of one object per name,
+ * each field is stored in its own contiguous column:  The names and values
+ * are appended to a single character buffer, addresses are stored once
+ * each and referred to by index, and the expiration counters, heights and
+ * ownership flags are plain arrays.  Sorting and filtering thus only touch
+ * the columns they need, and a table of several hundred thousand names
+ * takes little more memory than their strings.
+ *
+ * Records returned by getRecord refer into the table and are invalidated
+ * by all changes to it.
+ */
+class NameTable
+{
+
+private:
+
+  /** Names and values of all rows, back to back.  */
+  std::string strings;
+
+  /**
+   * Start of each row's name in strings, followed by its value.  There is
+   * one more entry than rows, holding the end of the last row.
+   */
+  std::vector<size_t> offsets;
+
+  /** Length of each row's name.  */
+  std::vector<unsigned> nameSizes;
+
+  /** Index of each row's address in addresses.  */
+  std::vector<unsigned> addressIds;
+
+  /** Blocks until each row's name expires.  */
+  std::vector<int> expiresIn;
+
+  /** Block height of each row's last update.  */
+  std::vector<unsigned> heights;
+
+  /** Ownership flag of each row.  */
+  std::vector<bool> mine;
+
+  /** The distinct addresses.  */
+  std::vector<std::string> addresses;
+
+  /** Index of each address in addresses.  */
+  std::map<std::string, unsigned> addressIndex;
+
+  /**
+   * Comparison of rows by name.
+   */
+  class NameOrder;
+
+  /**
+   * Comparison of rows by expiration.
+   */
+  class ExpirationOrder;
+
+  /**
+   * Keep only the given rows, in the given order.
+   * @param rows The indices of the rows to keep.
+   */
+  void select (const std::vector<unsigned>& rows);
+
+public:
+
+  /**
+   * Construct an empty table.
+   */
+  NameTable ();
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  NameTable (const NameTable&) = default;
+  NameTable (NameTable&&) = default;
+  NameTable& operator= (const NameTable&) = default;
+  NameTable& operator= (NameTable&&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the number of rows.
+   * @return The number of names in the table.
+   */
+  inline unsigned
+  size () const
+  {
+    return expiresIn.size ();
+  }
+
+  inline bool
+  empty () const
+  {
+    return expiresIn.empty ();
+  }
+
+  /**
+   * Remove all rows.
+   */
+  void clear ();
+
+  /**
+   * Add a name.
+   * @param name The name.
+   * @param value The name's value.
+   * @param address The address holding the name.
+   * @param expires Blocks until the name expires.
+   * @param height Block height of the last update, zero if unknown.
+   * @param owned Whether the name is owned by the user.
+   */
+  void add (const std::string& name, const std::string& value,
+            const std::string& address, int expires, unsigned height,
+            bool owned);
+
+  /**
+   * Add a name found by a scan.  It is not marked as owned.
+   * @param entry The entry of the scan.
+   */
+  void add (const NameInterface::ScanEntry& entry);
+
+  /**
+   * Get a row.
+   * @param i The row's index.
+   * @return The record of the row.
+   */
+  NameRecord getRecord (unsigned i) const;
+
+  /**
+   * Sort the rows by name.
+   */
+  void sortByName ();
+
+  /**
+   * Sort the rows by expiration counter, soonest first.  Rows with
+   * the same counter keep their order.
+   */
+  void sortByExpiration ();
+
+  /**
+   * Keep only the names in a namespace.
+   * @param ns The namespace (like "d" for "d/...").
+   */
+  void filterNamespace (const std::string& ns);
+
+  /**
+   * Keep only the names expiring within some blocks.  This includes
+   * names that have expired already.
+   * @param blocks Keep names with at most this expiration counter.
+   */
+  void filterExpiring (int blocks);
+
+  /**
+   * Keep only the rows for which a predicate is true.
+   * @param pred The predicate, called with the NameRecord of each row.
+   */
+  template<typename T>
+    void filter (T pred);
+
+};
+
+/* ************************************************************************** */
+
+/* Include template implementations.  */
+#include "NameTable.tpp"
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,37 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Template implementation for NameTable.hpp.  */
+
+/**
+ * Keep only the rows for which a predicate is true.
+ * @param pred The predicate, called with the NameRecord of each row.
+ */
+template<typename T>
+  void
+  NameTable::filter (T pred)
+{
+  std::vector<unsigned> rows;
+  for (unsigned i = 0; i < size (); ++i)
+    if (pred (getRecord (i)))
+      rows.push_back (i);
+
+  select (rows);
+}
@@ -0,0 +1,439 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for RegistrationJournal.hpp.  */
+
+#include "RegistrationJournal.hpp"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+
+namespace nmcrpc
+{
+
+/**
+ * Flush the directory containing a file to disk, so that a rename
+ * into it is durable.
+ * @param file The file whose directory to flush.
+ * @return False if that failed.
+ */
+static bool
+syncDirectory (const std::string& file)
+{
+  const std::string::size_type slash = file.rfind ('/');
+  std::string dir;
+  if (slash == std::string::npos)
+    dir = ".";
+  else if (slash == 0)
+    dir = "/";
+  else
+    dir = file.substr (0, slash);
+
+  const int fd = open (dir.c_str (), O_RDONLY);
+  if (fd < 0)
+    return false;
+
+  const bool ok = (fsync (fd) == 0);
+  ::close (fd);
+
+  return ok;
+}
+
+/* ************************************************************************** */
+/* Recorded state of a name.  */
+
+/**
+ * Construct it with the current state of a registration.
+ * @param reg The registration process.
+ */
+RegistrationJournal::Entry::Entry (const NameRegistration& reg)
+  : state(reg.state), value(reg.value), rand(reg.rand), tx(reg.tx),
+    txActivation(reg.txActivation)
+{
+  // Nothing else to do.
+}
+
+/**
+ * Check whether the recorded state is still up-to-date.  For
+ * activated names, only the activation is recorded and compared.
+ * @param reg The registration process.
+ * @return True iff no new record is needed for it.
+ */
+bool
+RegistrationJournal::Entry::matches (const NameRegistration& reg) const
+{
+  if (state != reg.state)
+    return false;
+
+  if (state == NameRegistration::ACTIVATED)
+    return txActivation == reg.txActivation;
+
+  return value == reg.value && rand == reg.rand && tx == reg.tx;
+}
+
+/* ************************************************************************** */
+/* The journal itself.  */
+
+const unsigned RegistrationJournal::COMPACT_FACTOR = 4;
+const unsigned RegistrationJournal::COMPACT_SLACK = 64;
+
+/**
+ * Construct it for the given file.  The file is not accessed
+ * before load() or sync() are called.
+ * @param f The journal file.
+ */
+RegistrationJournal::RegistrationJournal (const std::string& f)
+  : file(f), entries(), records(0), valid(false), out(nullptr)
+{
+  // Nothing else to do.
+}
+
+/**
+ * Destroy it, closing the file.
+ */
+RegistrationJournal::~RegistrationJournal ()
+{
+  close ();
+}
+
+/**
+ * Close the file opened for appending, if any.
+ * @return False if closing failed.
+ */
+bool
+RegistrationJournal::close ()
+{
+  if (!out)
+    return true;
+
+  const bool ok = (std::fclose (out) == 0);
+  out = nullptr;
+
+  return ok;
+}
+
+/**
+ * Append the record for the current state of a registration.
+ * @param reg The registration process.
+ * @param buf Append the record to this buffer.
+ * @throws std::runtime_error if it is not REGISTERED or ACTIVATED.
+ */
+void
+RegistrationJournal::writeRecord (const NameRegistration& reg,
+                                  std::string& buf)
+{
+  JsonRpc::JsonData rec(Json::objectValue);
+  rec["name"] = reg.name;
+
+  switch (reg.state)
+    {
+    case NameRegistration::REGISTERED:
+      rec["op"] = "registered";
+      rec["value"] = reg.value;
+      rec["rand"] = reg.rand;
+      rec["tx"] = reg.tx;
+      break;
+
+    case NameRegistration::ACTIVATED:
+      rec["op"] = "activated";
+      rec["txActivation"] = reg.txActivation;
+      break;
+
+    default:
+      throw std::runtime_error ("Wrong state for saving of NameRegistration.");
+    }
+
+  buf += JsonRpc::encodeJson (rec);
+}
+
+/**
+ * Replay a journal record.
+ * @param rec The record.
+ * @param mgr The manager the registrations are for.
+ * @param regs List of registrations, in order of their first record.
+ * @param index Index of each live name in regs.
+ * @throws std::runtime_error if the record is invalid.
+ */
+void
+RegistrationJournal::replay (const JsonRpc::JsonData& rec,
+                             RegistrationManager& mgr,
+                             std::vector<NameRegistration>& regs,
+                             std::map<std::string, unsigned>& index)
+{
+  if (!rec.isObject () || !rec["name"].isString () || !rec["op"].isString ())
+    throw std::runtime_error ("Invalid record in journal " + file + ".");
+
+  const std::string name = rec["name"].asString ();
+  const std::string op = rec["op"].asString ();
+  const std::map<std::string, unsigned>::iterator i = index.find (name);
+
+  if (op == "removed")
+    {
+      if (i == index.end ())
+        throw std::runtime_error ("Journal " + file
+                                  + " removes unknown name " + name + ".");
+
+      /* Mark the slot as unused, it is skipped when loading.  */
+      regs[i->second].state = NameRegistration::NOT_STARTED;
+      index.erase (i);
+      entries.erase (name);
+      return;
+    }
+
+  unsigned ind;
+  if (i != index.end ())
+    ind = i->second;
+  else
+    {
+      ind = regs.size ();
+      regs.push_back (NameRegistration (mgr.rpc, mgr.nc));
+      regs.back ().name = name;
+      index.insert (std::make_pair (name, ind));
+    }
+  NameRegistration& reg = regs[ind];
+
+  if (op == "registered")
+    {
+      reg.state = NameRegistration::REGISTERED;
+      reg.value = rec["value"].asString ();
+      reg.rand = rec["rand"].asString ();
+      reg.tx = rec["tx"].asString ();
+    }
+  else if (op == "activated")
+    {
+      reg.state = NameRegistration::ACTIVATED;
+      reg.txActivation = rec["txActivation"].asString ();
+    }
+  else
+    throw std::runtime_error ("Invalid record in journal " + file + ".");
+
+  entries.erase (name);
+  entries.insert (std::make_pair (name, Entry (reg)));
+}
+
+/**
+ * Load the state from the file, replacing all names in the manager.
+ * A truncated last record (from an interrupted write) is ignored.
+ * @param reg Load into this manager.
+ * @return False if the file does not exist (reg is not changed then).
+ * @throws std::runtime_error/JsonParseError if the file is invalid.
+ */
+bool
+RegistrationJournal::load (RegistrationManager& reg)
+{
+  std::ifstream in(file.c_str ());
+  if (!in)
+    return false;
+
+  close ();
+  entries.clear ();
+  records = 0;
+  valid = false;
+
+  std::string header;
+  std::getline (in, header);
+  const JsonRpc::JsonData hdr = JsonRpc::decodeJson (header);
+
+  /* The version 1 format is a single JSON object, which is handled by
+     the stream operator.  It is rewritten at the next sync.  */
+  if (hdr["type"].asString () == "RegistrationManager")
+    {
+      std::istringstream old(header);
+      old >> reg;
+
+      for (unsigned i = 0; i < reg.names.size (); ++i)
+        entries.insert (std::make_pair (reg.names[i].name,
+                                        Entry (reg.names[i])));
+
+      return true;
+    }
+
+  if (hdr["type"].asString () != "RegistrationJournal"
+      || hdr["version"].asInt () != 2)
+    throw std::runtime_error ("Wrong JSON object found, expected"
+                              " version 2 RegistrationJournal.");
+
+  std::vector<NameRegistration> regs;
+  std::map<std::string, unsigned> index;
+
+  valid = true;
+  std::string line;
+  while (std::getline (in, line))
+    {
+      /* A record that is not terminated by a newline was not completely
+         written.  Drop it, and rewrite the file on the next sync so that
+         no further records are appended after it.  */
+      if (in.eof ())
+        {
+          valid = false;
+          break;
+        }
+
+      replay (JsonRpc::decodeJson (line), reg, regs, index);
+      ++records;
+    }
+
+  reg.clear ();
+  for (unsigned i = 0; i < regs.size (); ++i)
+    if (regs[i].state != NameRegistration::NOT_STARTED)
+      reg.names.push_back (regs[i]);
+
+  return true;
+}
+
+/**
+ * Record all changes of the manager since the last load or sync.
+ * This appends to the file, or rewrites it if it is not a valid
+ * journal yet or has grown too large.  The records are flushed to disk
+ * before it returns.
+ * @param reg The manager whose state to record.
+ * @throws std::runtime_error if writing fails.
+ */
+void
+RegistrationJournal::sync (const RegistrationManager& reg)
+{
+  if (!valid)
+    {
+      compact (reg);
+      return;
+    }
+
+  std::string buf;
+  unsigned added = 0;
+  std::set<std::string> live;
+  for (RegistrationManager::const_iterator i = reg.begin ();
+       i != reg.end (); ++i)
+    {
+      const NameRegistration& nm = *i;
+      live.insert (nm.name);
+
+      const entryMapT::const_iterator e = entries.find (nm.name);
+      if (e == entries.end () || !e->second.matches (nm))
+        {
+          writeRecord (nm, buf);
+          ++added;
+        }
+    }
+
+  for (entryMapT::const_iterator i = entries.begin ();
+       i != entries.end (); ++i)
+    if (live.count (i->first) == 0)
+      {
+        JsonRpc::JsonData rec(Json::objectValue);
+        rec["op"] = "removed";
+        rec["name"] = i->first;
+        buf += JsonRpc::encodeJson (rec);
+        ++added;
+      }
+
+  if (added == 0)
+    return;
+
+  if (records + added > COMPACT_FACTOR * live.size () + COMPACT_SLACK)
+    {
+      compact (reg);
+      return;
+    }
+
+  if (!out)
+    {
+      out = std::fopen (file.c_str (), "ab");
+      if (!out)
+        throw std::runtime_error ("Could not open journal " + file + ".");
+    }
+
+  /* The records may hold the rand values of broadcast name_new
+     transactions, so they must be on disk before sync returns.  */
+  if (std::fwrite (buf.data (), 1, buf.size (), out) != buf.size ()
+      || std::fflush (out) != 0 || fsync (fileno (out)) != 0)
+    {
+      /* We no longer know which records made it into the file.  */
+      close ();
+      valid = false;
+      throw std::runtime_error ("Could not write journal " + file + ".");
+    }
+  records += added;
+
+  entries.clear ();
+  for (RegistrationManager::const_iterator i = reg.begin ();
+       i != reg.end (); ++i)
+    entries.insert (std::make_pair ((*i).name, Entry (*i)));
+}
+
+/**
+ * Rewrite the file with only the current state of the manager.
+ * It is first written to a temporary file, which is flushed to disk
+ * and then renamed to the final name.  The directory is flushed
+ * afterwards, so that the rename is durable as well.
+ * @param reg The manager whose state to record.
+ * @throws std::runtime_error if writing fails.
+ */
+void
+RegistrationJournal::compact (const RegistrationManager& reg)
+{
+  JsonRpc::JsonData hdr(Json::objectValue);
+  hdr["type"] = "RegistrationJournal";
+  hdr["version"] = 2;
+
+  std::string buf = JsonRpc::encodeJson (hdr);
+  entryMapT newEntries;
+  for (RegistrationManager::const_iterator i = reg.begin ();
+       i != reg.end (); ++i)
+    {
+      writeRecord (*i, buf);
+      newEntries.insert (std::make_pair ((*i).name, Entry (*i)));
+    }
+
+  close ();
+
+  const std::string tmp = file + ".tmp";
+  std::FILE* f = std::fopen (tmp.c_str (), "wb");
+  if (!f)
+    throw std::runtime_error ("Could not write journal " + tmp + ".");
+
+  /* Without flushing the data before the rename, a crash could leave
+     the new name pointing to an empty or partial file.  */
+  bool ok = (std::fwrite (buf.data (), 1, buf.size (), f) == buf.size ());
+  ok = ok && std::fflush (f) == 0 && fsync (fileno (f)) == 0;
+  ok = (std::fclose (f) == 0) && ok;
+
+  if (!ok || std::rename (tmp.c_str (), file.c_str ()) != 0)
+    {
+      std::remove (tmp.c_str ());
+      throw std::runtime_error ("Could not write journal " + file + ".");
+    }
+
+  /* The new file is in place, so the state is updated even if flushing
+     the directory fails.  */
+  entries.swap (newEntries);
+  records = entries.size ();
+  valid = true;
+
+  if (!syncDirectory (file))
+    throw std::runtime_error ("Could not flush the directory of journal "
+                              + file + ".");
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,223 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_REGISTRATIONJOURNAL_HPP
+#define NMCRPC_REGISTRATIONJOURNAL_HPP
+
+#include "NameRegistration.hpp"
+
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+/**
+ * Persist the state of a RegistrationManager in an append-only journal
+ * file.  Instead of writing out all registrations after each change,
+ * sync() compares the manager with the state already recorded and appends
+ * one small record per changed name:  when it is registered, activated or
+ * removed by cleanUp().  Loading replays the records in order.
+ *
+ * When the journal has grown much larger than the state it describes,
+ * sync() compacts it by writing a fresh file with one record per name
+ * and renaming it over the old one.  Files in the version 1 format
+ * written by the stream operators of RegistrationManager can be loaded
+ * as well, and are converted on the next sync.
+ *
+ * Names are used as keys, so a manager should not contain more than
+ * one registration with the same name.
+ */
+class RegistrationJournal
+{
+
+private:
+
+  /** Compact when there are more records per live name than this.  */
+  static const unsigned COMPACT_FACTOR;
+  /** Always allow at least this many records before compacting.  */
+  static const unsigned COMPACT_SLACK;
+
+  /**
+   * State of a name as it was last recorded in the file.
+   */
+  class Entry
+  {
+
+  public:
+
+    /** The recorded state.  */
+    NameRegistration::State state;
+
+    /** Value for firstupdate, if registered.  */
+    std::string value;
+    /** Random value of name_new, if registered.  */
+    std::string rand;
+    /** Txid of name_new, if registered.  */
+    std::string tx;
+
+    /** Txid of name_firstupdate, if activated.  */
+    std::string txActivation;
+
+    /**
+     * Construct it with the current state of a registration.
+     * @param reg The registration process.
+     */
+    explicit Entry (const NameRegistration& reg);
+
+    // Copying and moving is ok.
+#ifdef CXX_11
+    Entry (const Entry&) = default;
+    Entry (Entry&&) = default;
+    Entry& operator= (const Entry&) = default;
+    Entry& operator= (Entry&&) = default;
+#endif /* CXX_11  */
+
+    /**
+     * Check whether the recorded state is still up-to-date.  For
+     * activated names, only the activation is recorded and compared.
+     * @param reg The registration process.
+     * @return True iff no new record is needed for it.
+     */
+    bool matches (const NameRegistration& reg) const;
+
+  };
+
+  /** Type used for the recorded state.  */
+  typedef std::map<std::string, Entry> entryMapT;
+
+  /** The journal file.  */
+  std::string file;
+
+  /** State of all names as recorded in the file.  */
+  entryMapT entries;
+
+  /** Number of records in the file, not counting the header.  */
+  unsigned records;
+
+  /**
+   * Whether the file is a journal matching entries.  If it is not, the
+   * next sync rewrites it completely.
+   */
+  bool valid;
+
+  /** File opened for appending, NULL if not yet opened.  */
+  std::FILE* out;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  RegistrationJournal ();
+  RegistrationJournal (const RegistrationJournal&);
+  RegistrationJournal& operator= (const RegistrationJournal&);
+#endif /* !CXX_11  */
+
+  /**
+   * Close the file opened for appending, if any.
+   * @return False if closing failed.
+   */
+  bool close ();
+
+  /**
+   * Append the record for the current state of a registration.
+   * @param reg The registration process.
+   * @param buf Append the record to this buffer.
+   * @throws std::runtime_error if it is not REGISTERED or ACTIVATED.
+   */
+  static void writeRecord (const NameRegistration& reg, std::string& buf);
+
+  /**
+   * Replay a journal record.
+   * @param rec The record.
+   * @param mgr The manager the registrations are for.
+   * @param regs List of registrations, in order of their first record.
+   * @param index Index of each live name in regs.
+   * @throws std::runtime_error if the record is invalid.
+   */
+  void replay (const JsonRpc::JsonData& rec, RegistrationManager& mgr,
+               std::vector<NameRegistration>& regs,
+               std::map<std::string, unsigned>& index);
+
+public:
+
+  /**
+   * Construct it for the given file.  The file is not accessed
+   * before load() or sync() are called.
+   * @param f The journal file.
+   */
+  explicit RegistrationJournal (const std::string& f);
+
+  /**
+   * Destroy it, closing the file.
+   */
+  ~RegistrationJournal ();
+
+  // No copying.
+#ifdef CXX_11
+  RegistrationJournal () = delete;
+  RegistrationJournal (const RegistrationJournal&) = delete;
+  RegistrationJournal& operator= (const RegistrationJournal&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Load the state from the file, replacing all names in the manager.
+   * A truncated last record (from an interrupted write) is ignored.
+   * @param reg Load into this manager.
+   * @return False if the file does not exist (reg is not changed then).
+   * @throws std::runtime_error/JsonParseError if the file is invalid.
+   */
+  bool load (RegistrationManager& reg);
+
+  /**
+   * Record all changes of the manager since the last load or sync.
+   * This appends to the file, or rewrites it if it is not a valid
+   * journal yet or has grown too large.  The records are flushed to disk
+   * before it returns.
+   * @param reg The manager whose state to record.
+   * @throws std::runtime_error if writing fails.
+   */
+  void sync (const RegistrationManager& reg);
+
+  /**
+   * Rewrite the file with only the current state of the manager.
+   * It is first written to a temporary file, which is flushed to disk
+   * and then renamed to the final name.  The directory is flushed
+   * afterwards, so that the rename is durable as well.
+   * @param reg The manager whose state to record.
+   * @throws std::runtime_error if writing fails.
+   */
+  void compact (const RegistrationManager& reg);
+
+  /**
+   * Get the number of records currently in the file.
+   * @return The number of records.
+   */
+  inline unsigned
+  getRecords () const
+  {
+    return records;
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
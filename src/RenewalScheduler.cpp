@@ -0,0 +1,279 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for RenewalScheduler.hpp.  */
+
+#include "RenewalScheduler.hpp"
+
+#include "Rpc.hpp"
+#include "Thread.hpp"
+
+namespace nmcrpc
+{
+
+/**
+ * Construct it without names.
+ * @param r The RPC connection to use.
+ * @param n The high-level interface.
+ */
+RenewalScheduler::RenewalScheduler (JsonRpc& r, NameInterface& n)
+  : rpc(r), nc(n), heap(), expiration(), horizon(2000), maxPerBlock(50),
+    lastHeight(0), renewedAtLast(0), retry(), tipHeight(0),
+    mutex(new Mutex ())
+{
+  // Nothing else to do.
+}
+
+/**
+ * Destroy it.
+ */
+RenewalScheduler::~RenewalScheduler ()
+{
+  delete mutex;
+}
+
+/**
+ * Get the current block height, from the last tip event if there
+ * was one and queried from the daemon otherwise.
+ * @return The block height.
+ */
+unsigned
+RenewalScheduler::getHeight ()
+{
+  {
+    Lock lock(*mutex);
+    if (tipHeight > 0)
+      return tipHeight;
+  }
+
+  return nc.getBlockCount ();
+}
+
+/**
+ * Remove entries from the top of the heap that are out of date.
+ */
+void
+RenewalScheduler::dropStale ()
+{
+  while (!heap.empty ())
+    {
+      const std::map<std::string, unsigned>::const_iterator i
+        = expiration.find (heap.top ().second);
+      if (i != expiration.end () && i->second == heap.top ().first)
+        break;
+
+      heap.pop ();
+    }
+}
+
+/**
+ * Load all names owned by the wallet, replacing the tracked ones.
+ * Names that are already expired are ignored, since they can't
+ * be renewed.
+ * @return The number of names tracked.
+ * @throws JsonRpc::Exception in case of RPC errors.
+ */
+unsigned
+RenewalScheduler::load ()
+{
+  const unsigned height = getHeight ();
+  const std::vector<NameInterface::Name> names = nc.queryMyNames ();
+
+  heap = heapT ();
+  retry.clear ();
+  expiration.clear ();
+  for (unsigned i = 0; i < names.size (); ++i)
+    if (!names[i].isExpired ())
+      add (names[i].getName (), height + names[i].getExpireCounter ());
+
+  return expiration.size ();
+}
+
+/**
+ * Track a name, or update its expiration height if it is already
+ * tracked.  This can be used to add names after registering them.
+ * @param name The name.
+ * @param height The block height at which it expires.
+ */
+void
+RenewalScheduler::add (const std::string& name, unsigned height)
+{
+  expiration[name] = height;
+  heap.push (entryT (height, name));
+}
+
+/**
+ * Stop tracking a name.
+ * @param name The name.
+ */
+void
+RenewalScheduler::remove (const std::string& name)
+{
+  expiration.erase (name);
+}
+
+/**
+ * Get the earliest expiration height of all tracked names.
+ * @return The block height, or zero if there are no names.
+ */
+unsigned
+RenewalScheduler::getNextExpiration ()
+{
+  dropStale ();
+  if (heap.empty ())
+    return 0;
+
+  return heap.top ().first;
+}
+
+/**
+ * Record the new chain tip.
+ * @param height The new block height.
+ * @param hash The new best block hash.
+ */
+void
+RenewalScheduler::tipChanged (unsigned height, const std::string&)
+{
+  Lock lock(*mutex);
+  tipHeight = height;
+}
+
+/**
+ * Renew names that expire within the horizon, up to the limit for the
+ * current block.  The wallet must be unlocked.  Names that were renewed
+ * are scheduled again for their new expiration, names that no longer
+ * belong to the wallet are dropped, and other failures (including
+ * calls that could not be sent) are retried after the next block.
+ * If an exception is thrown, all names that were due are retried.
+ * @return The results of the updates sent.
+ * @throws JsonRpc::Exception in case of transport errors.
+ */
+std::vector<BulkNameUpdate::Result>
+RenewalScheduler::renewDue ()
+{
+  const unsigned height = getHeight ();
+  if (height != lastHeight)
+    {
+      lastHeight = height;
+      renewedAtLast = 0;
+
+      for (unsigned i = 0; i < retry.size (); ++i)
+        heap.push (retry[i]);
+      retry.clear ();
+    }
+
+  std::vector<entryT> due;
+  while (renewedAtLast + due.size () < maxPerBlock)
+    {
+      dropStale ();
+      if (heap.empty () || heap.top ().first > height + horizon)
+        break;
+
+      due.push_back (heap.top ());
+      heap.pop ();
+    }
+
+  std::vector<BulkNameUpdate::Result> res;
+  if (due.empty ())
+    return res;
+
+  /* The due names stay in the retry list until their outcome is known,
+     so that none of them are lost if one of the calls below throws.
+     Those that don't need to be retried are dropped at the end.  */
+  const size_t firstDue = retry.size ();
+  retry.insert (retry.end (), due.begin (), due.end ());
+  std::vector<entryT> failed;
+
+  std::vector<JsonRpc::Call> shows;
+  for (unsigned i = 0; i < due.size (); ++i)
+    shows.push_back (Rpc::NameShow (due[i].second));
+  const std::vector<JsonRpc::CallResult> current = rpc.executeRpcBatch (shows);
+
+  std::vector<BulkNameUpdate::Item> items;
+  std::vector<entryT> updating;
+  for (unsigned i = 0; i < due.size (); ++i)
+    {
+      const std::string& name = due[i].second;
+      if (current[i].isFailed ())
+        {
+          failed.push_back (due[i]);
+          continue;
+        }
+      if (current[i].isError ())
+        {
+          if (current[i].getErrorCode () == -4)
+            expiration.erase (name);
+          else
+            failed.push_back (due[i]);
+          continue;
+        }
+
+      const Rpc::NameInfo info = Rpc::NameShow::decode (current[i].get ());
+      if (info.isExpired ())
+        {
+          expiration.erase (name);
+          continue;
+        }
+
+      /* If the name was updated in the meantime, just schedule it
+         for its new expiration.  */
+      const unsigned exp = height + info.getExpiresIn ();
+      if (exp > height + horizon)
+        {
+          add (name, exp);
+          continue;
+        }
+
+      items.push_back (BulkNameUpdate::Item (name, info.getValue ()));
+      updating.push_back (due[i]);
+    }
+
+  if (!items.empty ())
+    {
+      BulkNameUpdate updater(rpc, nc);
+      res = updater.execute (items);
+      renewedAtLast += items.size ();
+
+      for (unsigned i = 0; i < res.size (); ++i)
+        switch (res[i].getStatus ())
+          {
+          case BulkNameUpdate::Result::UPDATED:
+            add (res[i].getName (),
+                 height + NameInterface::EXPIRATION_DEPTH);
+            break;
+
+          case BulkNameUpdate::Result::NOT_FOUND:
+          case BulkNameUpdate::Result::NO_PRIVATE_KEY:
+            expiration.erase (res[i].getName ());
+            break;
+
+          default:
+            failed.push_back (updating[i]);
+            break;
+          }
+    }
+
+  retry.resize (firstDue);
+  retry.insert (retry.end (), failed.begin (), failed.end ());
+
+  return res;
+}
+
+} // namespace nmcrpc
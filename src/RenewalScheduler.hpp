@@ -0,0 +1,229 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_RENEWALSCHEDULER_HPP
+#define NMCRPC_RENEWALSCHEDULER_HPP
+
+#include "ChainTipWatcher.hpp"
+#include "JsonRpc.hpp"
+#include "NameInterface.hpp"
+#include "NameRegistration.hpp"
+
+#include <functional>
+#include <map>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace nmcrpc
+{
+
+class Mutex;
+
+/* ************************************************************************** */
+/* Schedule renewal of names before they expire.  */
+
+/**
+ * Keep track of when the user's names expire, and renew those that are
+ * due with BulkNameUpdate.  The names are loaded once with load(), and
+ * kept in a heap ordered by the block height at which they expire.  After
+ * that, only the chain tip is needed to find the names due for renewal:
+ * The scheduler can be registered as listener of a ChainTipWatcher, and
+ * otherwise queries the block count itself.
+ *
+ * renewDue() renews the names expiring within the configured horizon.
+ * Their current state is queried (in one batch) just before, so that
+ * names updated in the meantime by someone else are not renewed again.
+ * To avoid flooding a single block with transactions, at most a fixed
+ * number of names is renewed per block height; the others follow at
+ * the next blocks.  This works best with a horizon that leaves enough
+ * blocks for all names expiring in a burst.
+ *
+ * The tip listener may be called from the watcher's background thread,
+ * but all other methods must be called from a single thread.
+ */
+class RenewalScheduler : public ChainTipWatcher::Listener
+{
+
+private:
+
+  /** Entry in the heap.  */
+  typedef std::pair<unsigned, std::string> entryT;
+
+  /** Min-heap of expiration heights and names.  */
+  typedef std::priority_queue<entryT, std::vector<entryT>,
+                              std::greater<entryT> > heapT;
+
+  /** The RPC connection to use.  */
+  JsonRpc& rpc;
+  /** The high-level Namecoin interface.  */
+  NameInterface& nc;
+
+  /**
+   * Names by expiration height.  Entries are not removed when
+   * a name's expiration changes, instead they are skipped if they
+   * don't match the one in expiration.
+   */
+  heapT heap;
+
+  /** Current expiration height of each tracked name.  */
+  std::map<std::string, unsigned> expiration;
+
+  /** Renew names expiring within this many blocks.  */
+  unsigned horizon;
+  /** Renew at most this many names per block height.  */
+  unsigned maxPerBlock;
+
+  /** Block height at which renewDue last sent updates.  */
+  unsigned lastHeight;
+  /** Number of names renewed at lastHeight.  */
+  unsigned renewedAtLast;
+
+  /** Names that failed at lastHeight, tried again at the next block.  */
+  std::vector<entryT> retry;
+
+  /** Block height from the last tip event, zero if none.  */
+  unsigned tipHeight;
+  /** Lock for tipHeight.  */
+  Mutex* mutex;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  RenewalScheduler ();
+  RenewalScheduler (const RenewalScheduler&);
+  RenewalScheduler& operator= (const RenewalScheduler&);
+#endif /* !CXX_11  */
+
+  /**
+   * Get the current block height, from the last tip event if there
+   * was one and queried from the daemon otherwise.
+   * @return The block height.
+   */
+  unsigned getHeight ();
+
+  /**
+   * Remove entries from the top of the heap that are out of date.
+   */
+  void dropStale ();
+
+public:
+
+  /**
+   * Construct it without names.
+   * @param r The RPC connection to use.
+   * @param n The high-level interface.
+   */
+  RenewalScheduler (JsonRpc& r, NameInterface& n);
+
+  /**
+   * Destroy it.
+   */
+  ~RenewalScheduler ();
+
+  // No copying.
+#ifdef CXX_11
+  RenewalScheduler () = delete;
+  RenewalScheduler (const RenewalScheduler&) = delete;
+  RenewalScheduler& operator= (const RenewalScheduler&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Set the horizon within which names are renewed.
+   * @param blocks Renew names expiring within this many blocks.
+   */
+  inline void
+  setHorizon (unsigned blocks)
+  {
+    horizon = blocks;
+  }
+
+  /**
+   * Set the maximum number of names renewed per block.
+   * @param n Renew at most this many names per block height.
+   */
+  inline void
+  setMaxPerBlock (unsigned n)
+  {
+    maxPerBlock = n;
+  }
+
+  /**
+   * Load all names owned by the wallet, replacing the tracked ones.
+   * Names that are already expired are ignored, since they can't
+   * be renewed.
+   * @return The number of names tracked.
+   * @throws JsonRpc::Exception in case of RPC errors.
+   */
+  unsigned load ();
+
+  /**
+   * Track a name, or update its expiration height if it is already
+   * tracked.  This can be used to add names after registering them.
+   * @param name The name.
+   * @param height The block height at which it expires.
+   */
+  void add (const std::string& name, unsigned height);
+
+  /**
+   * Stop tracking a name.
+   * @param name The name.
+   */
+  void remove (const std::string& name);
+
+  /**
+   * Get the number of tracked names.
+   * @return The number of names.
+   */
+  inline unsigned
+  size () const
+  {
+    return expiration.size ();
+  }
+
+  /**
+   * Get the earliest expiration height of all tracked names.
+   * @return The block height, or zero if there are no names.
+   */
+  unsigned getNextExpiration ();
+
+  /**
+   * Record the new chain tip.
+   * @param height The new block height.
+   * @param hash The new best block hash.
+   */
+  void tipChanged (unsigned height, const std::string& hash);
+
+  /**
+   * Renew names that expire within the horizon, up to the limit for the
+   * current block.  The wallet must be unlocked.  Names that were renewed
+   * are scheduled again for their new expiration, names that no longer
+   * belong to the wallet are dropped, and other failures (including
+   * calls that could not be sent) are retried after the next block.
+   * If an exception is thrown, all names that were due are retried.
+   * @return The results of the updates sent.
+   * @throws JsonRpc::Exception in case of transport errors.
+   */
+  std::vector<BulkNameUpdate::Result> renewDue ();
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,324 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for ResponseSplitter.hpp.  */
+
+#include "ResponseSplitter.hpp"
+
+#include <stdexcept>
+
+namespace nmcrpc
+{
+
+/**
+ * Construct it.
+ * @param c The call-back for the result elements.  It may also
+ *          implement JsonTape::Callback.
+ */
+ResponseSplitter::ResponseSplitter (JsonRpc::ElementCallback& c)
+  : cb(c), tapeCb(dynamic_cast<JsonTape::Callback*> (&c)), tape(),
+    phase(BEFORE_OBJECT), nesting(0), inString(false), escaped(false),
+    key(), buffer(), fields(), streamed(false), elements(0),
+    failed(false), parseFailure(false), failure()
+{
+  // Nothing else to do.
+}
+
+/**
+ * Handle the next chunk of the body.
+ * @param data Start of the chunk.
+ * @param len Length of the chunk.
+ * @return False to abort the transfer.
+ */
+bool
+ResponseSplitter::consume (const char* data, size_t len)
+{
+  for (size_t i = 0; i < len; ++i)
+    {
+      /* Malformed input is only reported by finish(), so that an
+         unexpected HTTP error page can be reported properly.  */
+      if (phase == BROKEN)
+        return true;
+
+      const char c = data[i];
+      if (inString)
+        {
+          if (escaped)
+            escaped = false;
+          else if (c == '\\')
+            escaped = true;
+          else if (c == '"')
+            inString = false;
+
+          if (phase == IN_KEY)
+            {
+              if (inString)
+                key.push_back (c);
+              else
+                phase = AFTER_KEY;
+            }
+          else
+            buffer.push_back (c);
+
+          continue;
+        }
+
+      if (!handle (c))
+        return false;
+    }
+
+  return true;
+}
+
+/**
+ * Handle a single character outside of strings.
+ * @param c The character.
+ * @return False to abort the transfer.
+ */
+bool
+ResponseSplitter::handle (char c)
+{
+  const bool space = (c == ' ' || c == '\t' || c == '\n' || c == '\r');
+
+  switch (phase)
+    {
+    case BEFORE_OBJECT:
+      if (c == '{')
+        phase = BEFORE_KEY;
+      else if (!space)
+        phase = BROKEN;
+      return true;
+
+    case BEFORE_KEY:
+      if (c == '"')
+        {
+          key.clear ();
+          inString = true;
+          phase = IN_KEY;
+        }
+      else if (c == '}' && fields.empty () && !streamed)
+        phase = FINISHED;
+      else if (!space)
+        phase = BROKEN;
+      return true;
+
+    case AFTER_KEY:
+      if (c == ':')
+        phase = BEFORE_VALUE;
+      else if (!space)
+        phase = BROKEN;
+      return true;
+
+    case BEFORE_VALUE:
+      if (space)
+        return true;
+
+      nesting = 0;
+      buffer.clear ();
+      if (key == "result" && c == '[')
+        {
+          streamed = true;
+          phase = IN_ARRAY;
+          return true;
+        }
+      phase = IN_RAW_VALUE;
+      break;
+
+    case IN_RAW_VALUE:
+    case IN_ARRAY:
+      break;
+
+    case AFTER_VALUE:
+      if (c == ',')
+        phase = BEFORE_KEY;
+      else if (c == '}')
+        phase = FINISHED;
+      else if (!space)
+        phase = BROKEN;
+      return true;
+
+    case FINISHED:
+      if (!space)
+        phase = BROKEN;
+      return true;
+
+    default:
+      return true;
+    }
+
+  /* We're inside a value now, either raw or an array element.  */
+
+  if (nesting == 0)
+    {
+      if (phase == IN_RAW_VALUE && (c == ',' || c == '}'))
+        {
+          fields[key].swap (buffer);
+          buffer.clear ();
+          phase = (c == ',' ? BEFORE_KEY : FINISHED);
+          return true;
+        }
+
+      if (phase == IN_ARRAY && (c == ',' || c == ']'))
+        {
+          if (buffer.empty ())
+            {
+              /* Only an empty array may have no element before ']'.  */
+              if (c == ',' || elements > 0)
+                phase = BROKEN;
+            }
+          else if (!emitElement ())
+            return false;
+
+          buffer.clear ();
+          if (c == ']')
+            phase = AFTER_VALUE;
+          return true;
+        }
+
+      if (phase == IN_ARRAY && space && buffer.empty ())
+        return true;
+    }
+
+  switch (c)
+    {
+    case '"':
+      inString = true;
+      break;
+
+    case '{':
+    case '[':
+      ++nesting;
+      break;
+
+    case '}':
+    case ']':
+      if (nesting == 0)
+        {
+          phase = BROKEN;
+          return true;
+        }
+      --nesting;
+      break;
+
+    default:
+      break;
+    }
+
+  buffer.push_back (c);
+  return true;
+}
+
+/**
+ * Parse the buffered array element and pass it to the call-back.
+ * @return False if the call-back failed.
+ */
+bool
+ResponseSplitter::emitElement ()
+{
+  try
+    {
+      if (tapeCb)
+        {
+          tape.parse (buffer);
+          tapeCb->element (tape.getRoot ());
+        }
+      else
+        {
+          const JsonRpc::JsonData el = JsonRpc::decodeJson (buffer);
+          cb (el);
+        }
+      ++elements;
+    }
+  catch (const JsonRpc::JsonParseError& exc)
+    {
+      failed = true;
+      parseFailure = true;
+      failure = exc.what ();
+      return false;
+    }
+  catch (const std::exception& exc)
+    {
+      failed = true;
+      failure = exc.what ();
+      return false;
+    }
+  catch (...)
+    {
+      /* Nothing may unwind through cURL's write call-back.  */
+      failed = true;
+      failure = "unknown exception";
+      return false;
+    }
+
+  return true;
+}
+
+/**
+ * Throw the failure of the call-back, if there was one.
+ * @throws JsonParseError if an element could not be parsed.
+ * @throws Exception if the call-back threw.
+ */
+void
+ResponseSplitter::checkFailure () const
+{
+  if (!failed)
+    return;
+
+  if (parseFailure)
+    throw JsonRpc::JsonParseError (failure);
+  throw JsonRpc::Exception ("Streaming call-back failed: " + failure);
+}
+
+/**
+ * Finish the response and check the id and error fields.
+ * @param id The expected JSON-RPC id.
+ * @return The number of elements passed to the call-back.
+ * @throws JsonParseError if the response was malformed.
+ * @throws RpcError if the call returned an error.
+ * @throws Exception if the result is no array or the id doesn't match.
+ */
+unsigned
+ResponseSplitter::finish (int id) const
+{
+  if (phase != FINISHED)
+    throw JsonRpc::JsonParseError ("Error decoding the JSON value.");
+
+  const std::map<std::string, std::string>::const_iterator idField
+    = fields.find ("id");
+  if (idField == fields.end ()
+      || JsonRpc::decodeJson (idField->second).asInt () != id)
+    throw JsonRpc::Exception ("IDs don't match for JSON-RPC response.");
+
+  const std::map<std::string, std::string>::const_iterator errorField
+    = fields.find ("error");
+  if (errorField != fields.end ())
+    {
+      const JsonRpc::JsonData error = JsonRpc::decodeJson (errorField->second);
+      if (!error.isNull ())
+        throw JsonRpc::RpcError (error);
+    }
+
+  if (!streamed)
+    throw JsonRpc::Exception ("Result of the streamed call is no array.");
+
+  return elements;
+}
+
+} // namespace nmcrpc
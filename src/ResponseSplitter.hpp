@@ -0,0 +1,187 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the incremental parser
+   used for streaming JSON-RPC responses.  */
+
+#ifndef NMCRPC_RESPONSESPLITTER_HPP
+#define NMCRPC_RESPONSESPLITTER_HPP
+
+#include "ConnectionPool.hpp"
+#include "JsonRpc.hpp"
+#include "JsonTape.hpp"
+
+#include <map>
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Split a JSON-RPC response object as it arrives.  If the "result" field
+ * is an array, each of its elements is parsed on its own as soon as it is
+ * complete and passed to a call-back.  The other fields (and a non-array
+ * result) are kept as raw text so that they can be checked at the end.
+ * The splitter only tracks nesting and strings to find the boundaries,
+ * the actual parsing is left to JsonRpc::decodeJson.  If the call-back
+ * is also a JsonTape::Callback, the elements are parsed onto a tape
+ * instead and never converted to Json::Value.
+ */
+class ResponseSplitter : public ResponseSink
+{
+
+private:
+
+  /** State of the top-level object we're in.  */
+  enum Phase
+  {
+    /** Before the opening brace.  */
+    BEFORE_OBJECT,
+    /** Expecting a key (or the closing brace).  */
+    BEFORE_KEY,
+    /** Inside a key string.  */
+    IN_KEY,
+    /** Expecting the colon after a key.  */
+    AFTER_KEY,
+    /** Expecting the start of a value.  */
+    BEFORE_VALUE,
+    /** Inside a value that is buffered raw.  */
+    IN_RAW_VALUE,
+    /** Inside the streamed result array.  */
+    IN_ARRAY,
+    /** After a value, expecting a comma or the closing brace.  */
+    AFTER_VALUE,
+    /** After the closing brace.  */
+    FINISHED,
+    /** Malformed input was found.  */
+    BROKEN
+  };
+
+  /** Call-back for the array elements.  */
+  JsonRpc::ElementCallback& cb;
+
+  /** The call-back as JsonTape::Callback, if it implements that.  */
+  JsonTape::Callback* tapeCb;
+
+  /** Tape reused for parsing the elements for tapeCb.  */
+  JsonTape tape;
+
+  /** Current phase.  */
+  Phase phase;
+
+  /** Nesting depth inside the current value or array element.  */
+  unsigned nesting;
+
+  /** Whether we're inside a string.  */
+  bool inString;
+
+  /** Whether the last character was a backslash in a string.  */
+  bool escaped;
+
+  /** The current key.  */
+  std::string key;
+
+  /** Buffer for the current raw value or array element.  */
+  std::string buffer;
+
+  /** Raw values of the fields seen.  */
+  std::map<std::string, std::string> fields;
+
+  /** Whether the result was streamed as array.  */
+  bool streamed;
+
+  /** Number of elements passed to the call-back.  */
+  unsigned elements;
+
+  /** Set if the call-back failed.  */
+  bool failed;
+
+  /** Whether the failure was a parsing error of an element.  */
+  bool parseFailure;
+
+  /** Error message of the failure.  */
+  std::string failure;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  ResponseSplitter ();
+  ResponseSplitter (const ResponseSplitter&);
+  ResponseSplitter& operator= (const ResponseSplitter&);
+#endif /* !CXX_11  */
+
+  /**
+   * Handle a single character outside of strings.
+   * @param c The character.
+   * @return False to abort the transfer.
+   */
+  bool handle (char c);
+
+  /**
+   * Parse the buffered array element and pass it to the call-back.
+   * @return False if the call-back failed.
+   */
+  bool emitElement ();
+
+public:
+
+  /**
+   * Construct it.
+   * @param c The call-back for the result elements.  It may also
+   *          implement JsonTape::Callback.
+   */
+  explicit ResponseSplitter (JsonRpc::ElementCallback& c);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  ResponseSplitter () = delete;
+  ResponseSplitter (const ResponseSplitter&) = delete;
+  ResponseSplitter& operator= (const ResponseSplitter&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Handle the next chunk of the body.
+   * @param data Start of the chunk.
+   * @param len Length of the chunk.
+   * @return False to abort the transfer.
+   */
+  bool consume (const char* data, size_t len);
+
+  /**
+   * Throw the failure of the call-back, if there was one.
+   * @throws JsonParseError if an element could not be parsed.
+   * @throws Exception if the call-back threw.
+   */
+  void checkFailure () const;
+
+  /**
+   * Finish the response and check the id and error fields.
+   * @param id The expected JSON-RPC id.
+   * @return The number of elements passed to the call-back.
+   * @throws JsonParseError if the response was malformed.
+   * @throws RpcError if the call returned an error.
+   * @throws Exception if the result is no array or the id doesn't match.
+   */
+  unsigned finish (int id) const;
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
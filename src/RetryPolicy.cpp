@@ -0,0 +1,90 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for RetryPolicy.hpp.  */
+
+#include "RetryPolicy.hpp"
+
+#include "Metrics.hpp"
+
+namespace nmcrpc
+{
+
+/**
+ * Start the policy for a new call.
+ * @param settings The settings with default timeout and retry parameters.
+ * @param timeout The call's deadline in milliseconds, zero for the
+ *                default from the settings.
+ * @param retry Whether the call may be retried at all.
+ */
+RetryPolicy::RetryPolicy (const RpcSettings& settings, unsigned timeout,
+                          bool retry)
+  : deadline(0.0), retriesLeft(retry ? settings.getMaxRetries () : 0),
+    backoff(settings.getRetryBackoff ()), delay(0)
+{
+  if (timeout == 0)
+    timeout = settings.getCallTimeout ();
+  if (timeout > 0)
+    deadline = Metrics::now () + timeout / 1000.0;
+}
+
+/**
+ * Get the time left until the deadline, to be used as timeout
+ * for the next attempt.
+ * @return The time left in milliseconds (at least one), or zero if
+ *         there is no deadline.
+ */
+unsigned
+RetryPolicy::getRemaining () const
+{
+  if (deadline == 0.0)
+    return 0;
+
+  const double left = (deadline - Metrics::now ()) * 1000.0;
+  if (left < 1.0)
+    return 1;
+
+  return static_cast<unsigned> (left);
+}
+
+/**
+ * Decide whether a failed attempt should be retried.  If so, this
+ * uses up one of the retries.
+ * @param transient Whether the failure was transient.
+ * @return True iff the call should be tried again after getDelay().
+ */
+bool
+RetryPolicy::shouldRetry (bool transient)
+{
+  if (!transient || retriesLeft == 0)
+    return false;
+
+  /* Don't retry if the deadline would be over before the retry starts.  */
+  if (deadline != 0.0 && Metrics::now () + backoff / 1000.0 >= deadline)
+    return false;
+
+  --retriesLeft;
+  delay = backoff;
+  backoff *= 2;
+
+  return true;
+}
+
+} // namespace nmcrpc
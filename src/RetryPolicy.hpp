@@ -0,0 +1,101 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the deadline and retry
+   handling of a single call.  */
+
+#ifndef NMCRPC_RETRYPOLICY_HPP
+#define NMCRPC_RETRYPOLICY_HPP
+
+#include "RpcSettings.hpp"
+
+namespace nmcrpc
+{
+
+/**
+ * Keep track of the deadline and the remaining retries of a call.
+ * Retries are done with exponential backoff, but never past the
+ * deadline.
+ */
+class RetryPolicy
+{
+
+private:
+
+  /** Point in time when the call must be finished, zero for none.  */
+  double deadline;
+
+  /** Number of retries left.  */
+  unsigned retriesLeft;
+
+  /** Delay before the next retry in milliseconds.  */
+  unsigned backoff;
+
+  /** The delay chosen for the retry decided last.  */
+  unsigned delay;
+
+public:
+
+  /**
+   * Start the policy for a new call.
+   * @param settings The settings with default timeout and retry parameters.
+   * @param timeout The call's deadline in milliseconds, zero for the
+   *                default from the settings.
+   * @param retry Whether the call may be retried at all.
+   */
+  RetryPolicy (const RpcSettings& settings, unsigned timeout, bool retry);
+
+  // Copying is ok.
+#ifdef CXX_11
+  RetryPolicy (const RetryPolicy&) = default;
+  RetryPolicy& operator= (const RetryPolicy&) = default;
+#endif /* CXX_11?  */
+
+  /**
+   * Get the time left until the deadline, to be used as timeout
+   * for the next attempt.
+   * @return The time left in milliseconds (at least one), or zero if
+   *         there is no deadline.
+   */
+  unsigned getRemaining () const;
+
+  /**
+   * Decide whether a failed attempt should be retried.  If so, this
+   * uses up one of the retries.
+   * @param transient Whether the failure was transient.
+   * @return True iff the call should be tried again after getDelay().
+   */
+  bool shouldRetry (bool transient);
+
+  /**
+   * Get the time to wait before the retry decided last.
+   * @return The delay in milliseconds.
+   */
+  inline unsigned
+  getDelay () const
+  {
+    return delay;
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,185 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for Rpc.hpp.  */
+
+#include "Rpc.hpp"
+
+namespace nmcrpc
+{
+
+/**
+ * Ensure that a result has the expected form.
+ * @param ok Whether the result is fine.
+ * @param method The method called, for the error message.
+ * @throws JsonRpc::Exception if ok is false.
+ */
+void
+Rpc::expect (bool ok, const char* method)
+{
+  if (!ok)
+    throw JsonRpc::Exception (std::string ("Unexpected result of ")
+                              + method + ".");
+}
+
+/* ************************************************************************** */
+/* Result decoding.  */
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::GetBestBlockHash::Result
+Rpc::GetBestBlockHash::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isString (), "getbestblockhash");
+  return res.asString ();
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::GetBlockCount::Result
+Rpc::GetBlockCount::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isIntegral () && res.asInt64 () >= 0, "getblockcount");
+  return res.asUInt ();
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::GetTransaction::Result
+Rpc::GetTransaction::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isObject () && res["confirmations"].isIntegral (),
+          "gettransaction");
+
+  TransactionInfo info;
+  info.txid = res["txid"].asString ();
+  const int conf = res["confirmations"].asInt ();
+  info.confirmations = (conf < 0 ? 0 : conf);
+
+  return info;
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::NameFirstUpdate::Result
+Rpc::NameFirstUpdate::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isString (), "name_firstupdate");
+  return res.asString ();
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::NameNew::Result
+Rpc::NameNew::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isArray () && res.size () == 2
+            && res[0u].isString () && res[1u].isString (),
+          "name_new");
+
+  NameNewResult info;
+  info.tx = res[0u].asString ();
+  info.rand = res[1u].asString ();
+
+  return info;
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::NameShow::Result
+Rpc::NameShow::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isObject () && res["name"].isString (), "name_show");
+
+  NameInfo info;
+  info.name = res["name"].asString ();
+  info.value = res["value"].asString ();
+  info.address = res["address"].asString ();
+  info.txid = res["txid"].asString ();
+  info.expiresIn = res["expires_in"].asInt ();
+  info.expired = (res["expired"].isInt () && res["expired"].asInt () != 0);
+
+  return info;
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::NameUpdate::Result
+Rpc::NameUpdate::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isString (), "name_update");
+  return res.asString ();
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::SignMessage::Result
+Rpc::SignMessage::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isString (), "signmessage");
+  return res.asString ();
+}
+
+/**
+ * Decode the result.
+ * @param res The JSON result.
+ * @return The decoded result.
+ * @throws JsonRpc::Exception if the result is malformed.
+ */
+Rpc::VerifyMessage::Result
+Rpc::VerifyMessage::decode (const JsonRpc::JsonData& res)
+{
+  expect (res.isBool (), "verifymessage");
+  return res.asBool ();
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,581 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+#ifndef NMCRPC_RPC_HPP
+#define NMCRPC_RPC_HPP
+
+#include "JsonRpc.hpp"
+
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Typed descriptions of the RPC methods used by the library.  Each method
+ * is a JsonRpc::Call whose constructor takes exactly the method's
+ * parameters with their proper types, and which knows how to decode the
+ * result into a small object.  They can be executed with JsonRpc::call,
+ * or passed to JsonRpc::executeRpcBatch like any other Call, so that a
+ * misspelt method or a wrong parameter list is caught by the compiler.
+ * This class itself only serves as the scope for them.
+ */
+class Rpc
+{
+
+public:
+
+  /* Decoded results.  */
+  class NameInfo;
+  class NameNewResult;
+  class TransactionInfo;
+
+  /* The methods.  */
+  class GetBestBlockHash;
+  class GetBlockCount;
+  class GetTransaction;
+  class NameFirstUpdate;
+  class NameNew;
+  class NameShow;
+  class NameUpdate;
+  class SignMessage;
+  class VerifyMessage;
+
+private:
+
+  /**
+   * Ensure that a result has the expected form.
+   * @param ok Whether the result is fine.
+   * @param method The method called, for the error message.
+   * @throws JsonRpc::Exception if ok is false.
+   */
+  static void expect (bool ok, const char* method);
+
+  // No instances.
+#ifndef CXX_11
+  Rpc ();
+  Rpc (const Rpc&);
+  Rpc& operator= (const Rpc&);
+#endif /* !CXX_11  */
+
+public:
+
+  // No instances.
+#ifdef CXX_11
+  Rpc () = delete;
+  Rpc (const Rpc&) = delete;
+  Rpc& operator= (const Rpc&) = delete;
+#endif /* CXX_11?  */
+
+};
+
+/* ************************************************************************** */
+/* Results.  */
+
+/**
+ * The data about a registered name, as returned by name_show.
+ */
+class Rpc::NameInfo
+{
+
+private:
+
+  friend class NameShow;
+
+  /** The name.  */
+  std::string name;
+
+  /** The name's value.  */
+  std::string value;
+
+  /** The address holding the name.  */
+  std::string address;
+
+  /** The transaction of the last update.  */
+  std::string txid;
+
+  /** Number of blocks until the name expires.  */
+  int expiresIn;
+
+  /** Whether the name is expired.  */
+  bool expired;
+
+public:
+
+  /**
+   * Default constructor, leaving everything empty.
+   */
+  inline NameInfo ()
+    : name(), value(), address(), txid(), expiresIn(0), expired(false)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  NameInfo (const NameInfo&) = default;
+  NameInfo (NameInfo&&) = default;
+  NameInfo& operator= (const NameInfo&) = default;
+  NameInfo& operator= (NameInfo&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getName () const
+  {
+    return name;
+  }
+
+  inline const std::string&
+  getValue () const
+  {
+    return value;
+  }
+
+  inline const std::string&
+  getAddress () const
+  {
+    return address;
+  }
+
+  inline const std::string&
+  getTxid () const
+  {
+    return txid;
+  }
+
+  inline int
+  getExpiresIn () const
+  {
+    return expiresIn;
+  }
+
+  inline bool
+  isExpired () const
+  {
+    return expired;
+  }
+
+};
+
+/**
+ * Result of name_new:  The transaction and the rand value needed
+ * later for name_firstupdate.
+ */
+class Rpc::NameNewResult
+{
+
+private:
+
+  friend class NameNew;
+
+  /** The name_new transaction.  */
+  std::string tx;
+
+  /** The rand value.  */
+  std::string rand;
+
+public:
+
+  /**
+   * Default constructor, leaving everything empty.
+   */
+  inline NameNewResult ()
+    : tx(), rand()
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  NameNewResult (const NameNewResult&) = default;
+  NameNewResult (NameNewResult&&) = default;
+  NameNewResult& operator= (const NameNewResult&) = default;
+  NameNewResult& operator= (NameNewResult&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getTx () const
+  {
+    return tx;
+  }
+
+  inline const std::string&
+  getRand () const
+  {
+    return rand;
+  }
+
+};
+
+/**
+ * The data about a wallet transaction that we use.
+ */
+class Rpc::TransactionInfo
+{
+
+private:
+
+  friend class GetTransaction;
+
+  /** The transaction id.  */
+  std::string txid;
+
+  /** Number of confirmations.  */
+  unsigned confirmations;
+
+public:
+
+  /**
+   * Default constructor, leaving everything empty.
+   */
+  inline TransactionInfo ()
+    : txid(), confirmations(0)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok.
+#ifdef CXX_11
+  TransactionInfo (const TransactionInfo&) = default;
+  TransactionInfo (TransactionInfo&&) = default;
+  TransactionInfo& operator= (const TransactionInfo&) = default;
+  TransactionInfo& operator= (TransactionInfo&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getTxid () const
+  {
+    return txid;
+  }
+
+  inline unsigned
+  getConfirmations () const
+  {
+    return confirmations;
+  }
+
+};
+
+/* ************************************************************************** */
+/* Methods.  */
+
+/**
+ * getbestblockhash:  Get the hash of the chain tip.
+ */
+class Rpc::GetBestBlockHash : public JsonRpc::Call
+{
+
+public:
+
+  /** The block hash.  */
+  typedef std::string Result;
+
+  inline GetBestBlockHash ()
+    : JsonRpc::Call("getbestblockhash")
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * getblockcount:  Get the height of the chain tip.
+ */
+class Rpc::GetBlockCount : public JsonRpc::Call
+{
+
+public:
+
+  /** The block height.  */
+  typedef unsigned Result;
+
+  inline GetBlockCount ()
+    : JsonRpc::Call("getblockcount")
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * gettransaction:  Look up a wallet transaction.
+ */
+class Rpc::GetTransaction : public JsonRpc::Call
+{
+
+public:
+
+  typedef TransactionInfo Result;
+
+  /**
+   * Construct the call.
+   * @param txid The transaction to look up.
+   */
+  explicit inline GetTransaction (const std::string& txid)
+    : JsonRpc::Call("gettransaction")
+  {
+    addParam (txid);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * name_firstupdate:  Activate a name registered with name_new.
+ */
+class Rpc::NameFirstUpdate : public JsonRpc::Call
+{
+
+public:
+
+  /** The transaction id.  */
+  typedef std::string Result;
+
+  /**
+   * Construct the call.
+   * @param name The name.
+   * @param rand The rand value returned by name_new.
+   * @param tx The name_new transaction.
+   * @param value The initial value.
+   */
+  inline NameFirstUpdate (const std::string& name, const std::string& rand,
+                          const std::string& tx, const std::string& value)
+    : JsonRpc::Call("name_firstupdate")
+  {
+    addParam (name);
+    addParam (rand);
+    addParam (tx);
+    addParam (value);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * name_new:  Start the registration of a name.
+ */
+class Rpc::NameNew : public JsonRpc::Call
+{
+
+public:
+
+  typedef NameNewResult Result;
+
+  /**
+   * Construct the call.
+   * @param name The name to register.
+   */
+  explicit inline NameNew (const std::string& name)
+    : JsonRpc::Call("name_new")
+  {
+    addParam (name);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * name_show:  Look up a registered name.
+ */
+class Rpc::NameShow : public JsonRpc::Call
+{
+
+public:
+
+  typedef NameInfo Result;
+
+  /**
+   * Construct the call.
+   * @param name The name to look up.
+   */
+  explicit inline NameShow (const std::string& name)
+    : JsonRpc::Call("name_show")
+  {
+    addParam (name);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * name_update:  Update a name's value, optionally sending it
+ * to another address.
+ */
+class Rpc::NameUpdate : public JsonRpc::Call
+{
+
+public:
+
+  /** The transaction id.  */
+  typedef std::string Result;
+
+  /**
+   * Construct the call, keeping the name in the wallet.
+   * @param name The name to update.
+   * @param value The new value.
+   */
+  inline NameUpdate (const std::string& name, const std::string& value)
+    : JsonRpc::Call("name_update")
+  {
+    addParam (name);
+    addParam (value);
+  }
+
+  /**
+   * Construct the call, sending the name to the given address.
+   * @param name The name to update.
+   * @param value The new value.
+   * @param address The recipient address.
+   */
+  inline NameUpdate (const std::string& name, const std::string& value,
+                     const std::string& address)
+    : JsonRpc::Call("name_update")
+  {
+    addParam (name);
+    addParam (value);
+    addParam (address);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * signmessage:  Sign a message with the key of a wallet address.
+ */
+class Rpc::SignMessage : public JsonRpc::Call
+{
+
+public:
+
+  /** The base64-encoded signature.  */
+  typedef std::string Result;
+
+  /**
+   * Construct the call.
+   * @param address The address to sign with.
+   * @param msg The message to sign.
+   */
+  inline SignMessage (const std::string& address, const std::string& msg)
+    : JsonRpc::Call("signmessage")
+  {
+    addParam (address);
+    addParam (msg);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+/**
+ * verifymessage:  Check a message signature against an address.
+ */
+class Rpc::VerifyMessage : public JsonRpc::Call
+{
+
+public:
+
+  /** Whether the signature is valid.  */
+  typedef bool Result;
+
+  /**
+   * Construct the call.
+   * @param address The address that should have signed.
+   * @param sig The base64-encoded signature.
+   * @param msg The signed message.
+   */
+  inline VerifyMessage (const std::string& address, const std::string& sig,
+                        const std::string& msg)
+    : JsonRpc::Call("verifymessage")
+  {
+    addParam (address);
+    addParam (sig);
+    addParam (msg);
+  }
+
+  /**
+   * Decode the result.
+   * @param res The JSON result.
+   * @return The decoded result.
+   * @throws JsonRpc::Exception if the result is malformed.
+   */
+  static Result decode (const JsonRpc::JsonData& res);
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -37,6 +37,81 @@ const unsigned RpcSettings::DEFAULT_PORT_MAINNET = 8336;
 /** Default port for test-net.  */
 const unsigned RpcSettings::DEFAULT_PORT_TESTNET = 18336;
 
+/**
+ * Get the methods that are retried by default.  These are the methods
+ * that only read data.  Methods changing the wallet or sending
+ * transactions must never be retried, as the first try may have
+ * succeeded without us seeing the response.
+ * @return The default set of idempotent methods.
+ */
+std::set<std::string>
+RpcSettings::getDefaultIdempotent ()
+{
+  static const char* const methods[] =
+    {
+      "getbalance",
+      "getbestblockhash",
+      "getblockcount",
+      "getinfo",
+      "gettransaction",
+      "name_filter",
+      "name_history",
+      "name_list",
+      "name_scan",
+      "name_show",
+      "validateaddress",
+      "verifymessage",
+    };
+
+  std::set<std::string> res;
+  for (size_t i = 0; i < sizeof (methods) / sizeof (methods[0]); ++i)
+    res.insert (methods[i]);
+
+  return res;
+}
+
+/**
+ * Get the methods that are balanced by default.  These only read the
+ * chain state, which is the same on all nodes that are in sync.  Wallet
+ * methods (including validateaddress and gettransaction, whose results
+ * depend on the wallet) stay on the primary.
+ * @return The default set of balanced methods.
+ */
+std::set<std::string>
+RpcSettings::getDefaultBalanced ()
+{
+  static const char* const methods[] =
+    {
+      "getbestblockhash",
+      "getblockcount",
+      "name_filter",
+      "name_history",
+      "name_scan",
+      "name_show",
+      "verifymessage",
+    };
+
+  std::set<std::string> res;
+  for (size_t i = 0; i < sizeof (methods) / sizeof (methods[0]); ++i)
+    res.insert (methods[i]);
+
+  return res;
+}
+
+/**
+ * Get all daemons that calls may be sent to.
+ * @return The primary followed by all replicas.
+ */
+std::vector<RpcEndpoint>
+RpcSettings::getEndpoints () const
+{
+  std::vector<RpcEndpoint> res;
+  res.push_back (RpcEndpoint (host, port));
+  res.insert (res.end (), replicas.begin (), replicas.end ());
+
+  return res;
+}
+
 /**
  * Try to read the given input file and update settings when corresponding
  * ones are found there.
@@ -71,6 +146,8 @@ RpcSettings::readConfig (const std::string& filename)
             username = after;
           else if (before == "rpcpassword")
             password = after;
+          else if (before == "rpccookiefile")
+            cookieFile = after;
           else if (before == "rpcconnect")
             host = after;
           else if (before == "testnet" && newPort == 0)
@@ -91,6 +168,10 @@ RpcSettings::readConfig (const std::string& filename)
 
 /**
  * Try to read the default namecoin.conf config file and update settings.
+ * If it doesn't set any credentials, the daemon's cookie file in the
+ * default data directory is used if it exists.  Otherwise, a missing
+ * cookie file would make every connection fail, even if the caller sets
+ * the credentials afterwards.
  */
 void
 RpcSettings::readDefaultConfig ()
@@ -108,9 +189,16 @@ RpcSettings::readDefaultConfig ()
   if (!home)
     return;
 
-  std::ostringstream filename;
-  filename << home << "/.namecoin/namecoin.conf";
-  readConfig (filename.str ());
+  const std::string dataDir = std::string (home) + "/.namecoin/";
+  readConfig (dataDir + "namecoin.conf");
+
+  if (username.empty () && password.empty () && cookieFile.empty ())
+    {
+      const std::string cookie = dataDir + ".cookie";
+      std::ifstream cookieIn(cookie.c_str ());
+      if (cookieIn)
+        cookieFile = cookie;
+    }
 }
 
 } // namespace nmcrpc
@@ -21,11 +21,66 @@
 #ifndef NMCRPC_RPCSETTINGS_HPP
 #define NMCRPC_RPCSETTINGS_HPP
 
+#include <set>
 #include <string>
+#include <vector>
 
 namespace nmcrpc
 {
 
+/**
+ * Address of a single daemon.
+ */
+class RpcEndpoint
+{
+
+private:
+
+  /** Host name.  */
+  std::string host;
+  /** Port to connect to.  */
+  unsigned port;
+
+#ifndef CXX_11
+  RpcEndpoint ();
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it.
+   * @param h The host name.
+   * @param p The port.
+   */
+  inline RpcEndpoint (const std::string& h, unsigned p)
+    : host(h), port(p)
+  {
+    // Nothing else to do.
+  }
+
+  // Copying and moving is ok, but no default constructor.
+#ifdef CXX_11
+  RpcEndpoint () = delete;
+  RpcEndpoint (const RpcEndpoint&) = default;
+  RpcEndpoint (RpcEndpoint&&) = default;
+  RpcEndpoint& operator= (const RpcEndpoint&) = default;
+  RpcEndpoint& operator= (RpcEndpoint&&) = default;
+#endif /* CXX_11?  */
+
+  inline const std::string&
+  getHost () const
+  {
+    return host;
+  }
+
+  inline unsigned
+  getPort () const
+  {
+    return port;
+  }
+
+};
+
 /**
  * Connection settings for the HTTP channel to the RPC interface.  This
  * also contains routines for trying to load the correct settings from
@@ -34,6 +89,21 @@ namespace nmcrpc
 class RpcSettings
 {
 
+public:
+
+  /**
+   * The ways the daemon can be reached.
+   */
+  enum TransportType
+  {
+    /** Plain HTTP over TCP.  */
+    TRANSPORT_HTTP,
+    /** HTTP over TLS, for daemons reached through the network.  */
+    TRANSPORT_HTTPS,
+    /** HTTP over a Unix domain socket, for a daemon on the same machine.  */
+    TRANSPORT_UNIX
+  };
+
 private:
 
   /** Environment variable name for controlling the config file.  */
@@ -54,6 +124,82 @@ private:
   /** Password for authentication.  */
   std::string password;
 
+  /**
+   * File with the credentials written by the daemon.  If set, it is used
+   * instead of username and password.  Setting either of those explicitly
+   * clears it again.
+   */
+  std::string cookieFile;
+
+  /** How to reach the daemon.  */
+  TransportType transport;
+
+  /** Path of the Unix socket for TRANSPORT_UNIX.  */
+  std::string socketPath;
+
+  /** CA certificates for TRANSPORT_HTTPS, empty for cURL's default.  */
+  std::string caFile;
+
+  /** Whether the daemon's certificate is verified for TRANSPORT_HTTPS.  */
+  bool verifyPeer;
+
+  /** Whether to disable Nagle's algorithm on the connection.  */
+  bool tcpNoDelay;
+
+  /** Maximum number of idle connections kept open for reuse.  */
+  unsigned maxIdleConnections;
+
+  /** Maximum number of calls sent together in one batch request.  */
+  unsigned maxBatchSize;
+
+  /** Maximum number of connections used in parallel for async calls.  */
+  unsigned maxParallelRequests;
+
+  /** Timeout for establishing a connection in milliseconds.  */
+  unsigned connectTimeout;
+
+  /**
+   * Default deadline for a call (including retries) in milliseconds.
+   * Zero means no limit.
+   */
+  unsigned callTimeout;
+
+  /** How often a failed call of an idempotent method is retried.  */
+  unsigned maxRetries;
+
+  /** Delay before the first retry in milliseconds, doubled for each.  */
+  unsigned retryBackoff;
+
+  /** Methods that are safe to retry, since they don't change anything.  */
+  std::set<std::string> idempotent;
+
+  /**
+   * Additional daemons (besides host and port, which are the primary)
+   * serving the same chain.  Read-only calls are spread across all.
+   */
+  std::vector<RpcEndpoint> replicas;
+
+  /** Methods that may be answered by any node instead of the primary.  */
+  std::set<std::string> balanced;
+
+  /** How many blocks a node may be behind and still serve calls.  */
+  unsigned maxHeightLag;
+
+  /** How often to check the nodes' heights and health in milliseconds.  */
+  unsigned nodeCheckInterval;
+
+  /**
+   * Get the methods that are retried by default.
+   * @return The default set of idempotent methods.
+   */
+  static std::set<std::string> getDefaultIdempotent ();
+
+  /**
+   * Get the methods that are balanced by default.
+   * @return The default set of balanced methods.
+   */
+  static std::set<std::string> getDefaultBalanced ();
+
 public:
 
   /**
@@ -61,7 +207,15 @@ public:
    * and leaves the authentication data blank.
    */
   inline RpcSettings ()
-    : host("localhost"), port(DEFAULT_PORT_MAINNET), username(""), password("")
+    : host("localhost"), port(DEFAULT_PORT_MAINNET),
+      username(""), password(""), cookieFile(""), transport(TRANSPORT_HTTP),
+      socketPath(""), caFile(""), verifyPeer(true),
+      tcpNoDelay(true), maxIdleConnections(4),
+      maxBatchSize(100), maxParallelRequests(8),
+      connectTimeout(10000), callTimeout(120000),
+      maxRetries(3), retryBackoff(100), idempotent(getDefaultIdempotent ()),
+      replicas(), balanced(getDefaultBalanced ()),
+      maxHeightLag(1), nodeCheckInterval(5000)
   {
     // Nothing else to do.
   }
@@ -75,15 +229,25 @@ public:
    */
   inline RpcSettings (const std::string& h, unsigned p,
                       const std::string& u, const std::string& pwd)
-    : host(h), port(p), username(u), password(pwd)
+    : host(h), port(p), username(u), password(pwd),
+      cookieFile(""), transport(TRANSPORT_HTTP),
+      socketPath(""), caFile(""), verifyPeer(true),
+      tcpNoDelay(true), maxIdleConnections(4),
+      maxBatchSize(100), maxParallelRequests(8),
+      connectTimeout(10000), callTimeout(120000),
+      maxRetries(3), retryBackoff(100), idempotent(getDefaultIdempotent ()),
+      replicas(), balanced(getDefaultBalanced ()),
+      maxHeightLag(1), nodeCheckInterval(5000)
   {
     // Nothing else to do.
   }
 
-  // Allow copying.
+  // Allow copying and moving.
 #ifdef CXX_11
   RpcSettings (const RpcSettings&) = default;
+  RpcSettings (RpcSettings&&) = default;
   RpcSettings& operator= (const RpcSettings&) = default;
+  RpcSettings& operator= (RpcSettings&&) = default;
 #endif /* CXX_11?  */
 
   /**
@@ -95,6 +259,8 @@ public:
 
   /**
    * Try to read the default namecoin.conf config file and update settings.
+   * If it doesn't set any credentials, the daemon's cookie file in the
+   * default data directory is used if it exists.
    */
   void readDefaultConfig ();
 
@@ -131,6 +297,7 @@ public:
   setUsername (const std::string& u)
   {
     username = u;
+    cookieFile.clear ();
   }
 
   inline const std::string&
@@ -142,6 +309,253 @@ public:
   setPassword (const std::string& pwd)
   {
     password = pwd;
+    cookieFile.clear ();
+  }
+
+  inline const std::string&
+  getCookieFile () const
+  {
+    return cookieFile;
+  }
+  inline void
+  setCookieFile (const std::string& f)
+  {
+    cookieFile = f;
+  }
+
+  inline TransportType
+  getTransport () const
+  {
+    return transport;
+  }
+  inline void
+  setTransport (TransportType t)
+  {
+    transport = t;
+  }
+
+  /**
+   * Connect to the primary daemon through a Unix socket instead of
+   * host and port.  Replicas are still reached over TCP.
+   * @param path The socket's path.
+   */
+  inline void
+  setUnixSocket (const std::string& path)
+  {
+    transport = TRANSPORT_UNIX;
+    socketPath = path;
+  }
+
+  inline const std::string&
+  getSocketPath () const
+  {
+    return socketPath;
+  }
+
+  inline const std::string&
+  getCaFile () const
+  {
+    return caFile;
+  }
+  inline void
+  setCaFile (const std::string& f)
+  {
+    caFile = f;
+  }
+
+  inline bool
+  getVerifyPeer () const
+  {
+    return verifyPeer;
+  }
+  inline void
+  setVerifyPeer (bool v)
+  {
+    verifyPeer = v;
+  }
+
+  inline bool
+  getTcpNoDelay () const
+  {
+    return tcpNoDelay;
+  }
+  inline void
+  setTcpNoDelay (bool v)
+  {
+    tcpNoDelay = v;
+  }
+
+  inline unsigned
+  getMaxIdleConnections () const
+  {
+    return maxIdleConnections;
+  }
+  inline void
+  setMaxIdleConnections (unsigned n)
+  {
+    maxIdleConnections = n;
+  }
+
+  inline unsigned
+  getMaxBatchSize () const
+  {
+    return maxBatchSize;
+  }
+  inline void
+  setMaxBatchSize (unsigned n)
+  {
+    maxBatchSize = n;
+  }
+
+  inline unsigned
+  getMaxParallelRequests () const
+  {
+    return maxParallelRequests;
+  }
+  inline void
+  setMaxParallelRequests (unsigned n)
+  {
+    maxParallelRequests = n;
+  }
+
+  inline unsigned
+  getConnectTimeout () const
+  {
+    return connectTimeout;
+  }
+  inline void
+  setConnectTimeout (unsigned ms)
+  {
+    connectTimeout = ms;
+  }
+
+  inline unsigned
+  getCallTimeout () const
+  {
+    return callTimeout;
+  }
+  inline void
+  setCallTimeout (unsigned ms)
+  {
+    callTimeout = ms;
+  }
+
+  inline unsigned
+  getMaxRetries () const
+  {
+    return maxRetries;
+  }
+  inline void
+  setMaxRetries (unsigned n)
+  {
+    maxRetries = n;
+  }
+
+  inline unsigned
+  getRetryBackoff () const
+  {
+    return retryBackoff;
+  }
+  inline void
+  setRetryBackoff (unsigned ms)
+  {
+    retryBackoff = ms;
+  }
+
+  /**
+   * Check whether calls of a method may be retried after transient
+   * failures.  By default, this is the case for methods that only
+   * read data, but never for methods like name_new or name_update.
+   * @param method The method name.
+   * @return True iff the method is idempotent.
+   */
+  inline bool
+  isIdempotent (const std::string& method) const
+  {
+    return idempotent.count (method) > 0;
+  }
+
+  /**
+   * Set whether calls of a method may be retried.
+   * @param method The method name.
+   * @param v Whether the method is idempotent.
+   */
+  inline void
+  setIdempotent (const std::string& method, bool v)
+  {
+    if (v)
+      idempotent.insert (method);
+    else
+      idempotent.erase (method);
+  }
+
+  /**
+   * Add another daemon serving the same chain.  It uses the same
+   * credentials as the primary one given by host and port.
+   * @param h The host of the daemon.
+   * @param p The port of the daemon.
+   */
+  inline void
+  addReplica (const std::string& h, unsigned p)
+  {
+    replicas.push_back (RpcEndpoint (h, p));
+  }
+
+  /**
+   * Get all daemons that calls may be sent to.  The first one is
+   * always the primary, which handles all calls that are not balanced.
+   * @return The primary followed by all replicas.
+   */
+  std::vector<RpcEndpoint> getEndpoints () const;
+
+  /**
+   * Check whether calls of a method may be sent to any node.  By default,
+   * this is the case for methods that only read the chain state.  Everything
+   * else, in particular all calls depending on the wallet, is always
+   * sent to the primary.
+   * @param method The method name.
+   * @return True iff the method is balanced across nodes.
+   */
+  inline bool
+  isBalanced (const std::string& method) const
+  {
+    return balanced.count (method) > 0;
+  }
+
+  /**
+   * Set whether calls of a method may be sent to any node.
+   * @param method The method name.
+   * @param v Whether the method is balanced.
+   */
+  inline void
+  setBalanced (const std::string& method, bool v)
+  {
+    if (v)
+      balanced.insert (method);
+    else
+      balanced.erase (method);
+  }
+
+  inline unsigned
+  getMaxHeightLag () const
+  {
+    return maxHeightLag;
+  }
+  inline void
+  setMaxHeightLag (unsigned n)
+  {
+    maxHeightLag = n;
+  }
+
+  inline unsigned
+  getNodeCheckInterval () const
+  {
+    return nodeCheckInterval;
+  }
+  inline void
+  setNodeCheckInterval (unsigned ms)
+  {
+    nodeCheckInterval = ms;
   }
 
 };
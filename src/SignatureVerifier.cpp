@@ -0,0 +1,516 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for SignatureVerifier.hpp.  */
+
+#include "SignatureVerifier.hpp"
+
+#include <openssl/evp.h>
+#include <openssl/obj_mac.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <stdint.h>
+#include <vector>
+
+namespace nmcrpc
+{
+
+const unsigned SignatureVerifier::SIGNATURE_LENGTH = 65;
+
+/**
+ * Compute a digest with OpenSSL.
+ * @param md The digest to use.
+ * @param data The data to hash.
+ * @return The hash.
+ * @throws std::runtime_error if the digest is not available.
+ */
+static std::string
+digest (const EVP_MD* md, const std::string& data)
+{
+  unsigned char buf[EVP_MAX_MD_SIZE];
+  unsigned len;
+  if (!md || !EVP_Digest (data.data (), data.size (), buf, &len, md, nullptr))
+    throw std::runtime_error ("Hashing for signature check failed.");
+
+  return std::string (reinterpret_cast<const char*> (buf), len);
+}
+
+/**
+ * Append the size of a string in the compact format used by
+ * the message hash.
+ * @param out Append to this.
+ * @param size The size to encode.
+ */
+static void
+appendCompactSize (std::string& out, size_t size)
+{
+  unsigned bytes;
+  if (size < 0xfd)
+    bytes = 0;
+  else if (size <= 0xffff)
+    {
+      out.push_back (static_cast<char> (0xfd));
+      bytes = 2;
+    }
+  else if (size <= 0xffffffffUL)
+    {
+      out.push_back (static_cast<char> (0xfe));
+      bytes = 4;
+    }
+  else
+    {
+      out.push_back (static_cast<char> (0xff));
+      bytes = 8;
+    }
+
+  if (bytes == 0)
+    {
+      out.push_back (static_cast<char> (size));
+      return;
+    }
+
+  for (unsigned i = 0; i < bytes; ++i)
+    out.push_back (static_cast<char> ((static_cast<uint64_t> (size)
+                                       >> (8 * i)) & 0xff));
+}
+
+/**
+ * Rotate a 32-bit word to the left.
+ * @param x The word.
+ * @param n The number of bits, between 1 and 31.
+ * @return The rotated word.
+ */
+static inline uint32_t
+rotateLeft (uint32_t x, unsigned n)
+{
+  return (x << n) | (x >> (32 - n));
+}
+
+/**
+ * Nonlinear function of RIPEMD-160 for the given step.
+ * @param j The step, between 0 and 79.
+ * @param x First input word.
+ * @param y Second input word.
+ * @param z Third input word.
+ * @return The function's value.
+ */
+static inline uint32_t
+ripemdFunction (unsigned j, uint32_t x, uint32_t y, uint32_t z)
+{
+  switch (j / 16)
+    {
+    case 0:
+      return x ^ y ^ z;
+    case 1:
+      return (x & y) | (~x & z);
+    case 2:
+      return (x | ~y) ^ z;
+    case 3:
+      return (x & z) | (y & ~z);
+    default:
+      return x ^ (y | ~z);
+    }
+}
+
+/**
+ * Construct it.
+ * @param m The prefix for messages, e.g. "Bitcoin Signed Message:\n".
+ * @param v The version byte of addresses, e.g. 52 for Namecoin.
+ * @throws std::runtime_error if the curve can not be set up.
+ */
+SignatureVerifier::SignatureVerifier (const std::string& m, unsigned char v)
+  : magic(m), version(v), group(nullptr), ctx(nullptr)
+{
+  group = EC_GROUP_new_by_curve_name (NID_secp256k1);
+  ctx = BN_CTX_new ();
+  if (!group || !ctx)
+    {
+      EC_GROUP_free (group);
+      BN_CTX_free (ctx);
+      throw std::runtime_error ("Could not set up secp256k1.");
+    }
+}
+
+/**
+ * Free the curve data.
+ */
+SignatureVerifier::~SignatureVerifier ()
+{
+  BN_CTX_free (ctx);
+  EC_GROUP_free (group);
+}
+
+/**
+ * Check a message signature.
+ * @param addr The address that should have signed the message.
+ * @param msg The message.
+ * @param sig The base64-encoded signature.
+ * @return True iff the signature is valid for the message and address.
+ */
+bool
+SignatureVerifier::verify (const std::string& addr, const std::string& msg,
+                           const std::string& sig) const
+{
+  std::string payload;
+  if (!decodeBase58Check (addr, payload) || payload.size () != 21
+      || static_cast<unsigned char> (payload[0]) != version)
+    return false;
+
+  std::string rawSig;
+  if (!decodeBase64 (sig, rawSig) || rawSig.size () != SIGNATURE_LENGTH)
+    return false;
+
+  std::string pubkey;
+  if (!recoverKey (rawSig, hashMessage (msg), pubkey))
+    return false;
+
+  return hash160 (pubkey) == payload.substr (1);
+}
+
+/**
+ * Compute the hash that is signed for a message.
+ * @param msg The message.
+ * @return The double SHA-256 of magic and message.
+ */
+std::string
+SignatureVerifier::hashMessage (const std::string& msg) const
+{
+  std::string data;
+  data.reserve (magic.size () + msg.size () + 10);
+  appendCompactSize (data, magic.size ());
+  data.append (magic);
+  appendCompactSize (data, msg.size ());
+  data.append (msg);
+
+  return hash256 (data);
+}
+
+/**
+ * Recover the public key from a compact signature.
+ * @param sig The signature, of length SIGNATURE_LENGTH.
+ * @param hash The signed message hash.
+ * @param pubkey Set to the serialised public key.
+ * @return False if the signature is malformed.
+ */
+bool
+SignatureVerifier::recoverKey (const std::string& sig, const std::string& hash,
+                               std::string& pubkey) const
+{
+  const unsigned char* data
+    = reinterpret_cast<const unsigned char*> (sig.data ());
+  const int header = data[0] - 27;
+  if (header < 0 || header > 7)
+    return false;
+  const int recid = header & 3;
+  const bool compressed = (header & 4);
+
+  BN_CTX_start (ctx);
+  BIGNUM* r = BN_CTX_get (ctx);
+  BIGNUM* s = BN_CTX_get (ctx);
+  BIGNUM* e = BN_CTX_get (ctx);
+  BIGNUM* x = BN_CTX_get (ctx);
+  BIGNUM* order = BN_CTX_get (ctx);
+  BIGNUM* prime = BN_CTX_get (ctx);
+  BIGNUM* rInv = BN_CTX_get (ctx);
+  BIGNUM* u1 = BN_CTX_get (ctx);
+  BIGNUM* u2 = BN_CTX_get (ctx);
+  EC_POINT* point = EC_POINT_new (group);
+  EC_POINT* key = EC_POINT_new (group);
+
+  /* Following SEC 1, section 4.1.6:  R is the point with x coordinate
+     r (+ order) and the parity given by the recovery id, and then
+     Q = r^-1 (s R - e G).  */
+
+  bool ok = (u2 && point && key);
+  ok = ok && BN_bin2bn (data + 1, 32, r) && BN_bin2bn (data + 33, 32, s);
+  ok = ok && EC_GROUP_get_order (group, order, ctx)
+          && EC_GROUP_get_curve (group, prime, nullptr, nullptr, ctx);
+  ok = ok && !BN_is_zero (r) && !BN_is_zero (s)
+          && BN_cmp (r, order) < 0 && BN_cmp (s, order) < 0;
+
+  ok = ok && BN_copy (x, r);
+  if (ok && (recid & 2))
+    ok = BN_add (x, x, order) && BN_cmp (x, prime) < 0;
+  ok = ok && EC_POINT_set_compressed_coordinates (group, point, x,
+                                                  recid & 1, ctx);
+
+  ok = ok && BN_bin2bn (reinterpret_cast<const unsigned char*> (hash.data ()),
+                        hash.size (), e);
+  ok = ok && BN_mod_inverse (rInv, r, order, ctx);
+  ok = ok && BN_mod_mul (u1, e, rInv, order, ctx);
+  if (ok && !BN_is_zero (u1))
+    ok = BN_sub (u1, order, u1);
+  ok = ok && BN_mod_mul (u2, s, rInv, order, ctx);
+  ok = ok && EC_POINT_mul (group, key, u1, point, u2, ctx)
+          && !EC_POINT_is_at_infinity (group, key);
+
+  if (ok)
+    {
+      const point_conversion_form_t form
+        = (compressed ? POINT_CONVERSION_COMPRESSED
+                      : POINT_CONVERSION_UNCOMPRESSED);
+      unsigned char buf[65];
+      const size_t len = EC_POINT_point2oct (group, key, form,
+                                             buf, sizeof (buf), ctx);
+      ok = (len > 0);
+      pubkey.assign (reinterpret_cast<const char*> (buf), len);
+    }
+
+  EC_POINT_free (key);
+  EC_POINT_free (point);
+  BN_CTX_end (ctx);
+
+  return ok;
+}
+
+/**
+ * Decode base64 data.
+ * @param str The encoded string.
+ * @param out Set to the decoded data.
+ * @return False if the string is not valid base64.
+ */
+bool
+SignatureVerifier::decodeBase64 (const std::string& str, std::string& out)
+{
+  static const char* const ALPHABET
+    = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+  if (str.size () % 4 != 0)
+    return false;
+
+  out.clear ();
+  out.reserve (str.size () / 4 * 3);
+
+  unsigned bits = 0;
+  unsigned nBits = 0;
+  unsigned padding = 0;
+  for (std::string::const_iterator i = str.begin (); i != str.end (); ++i)
+    {
+      if (*i == '=')
+        {
+          ++padding;
+          continue;
+        }
+      const char* pos = std::strchr (ALPHABET, *i);
+      if (padding > 0 || *i == '\0' || !pos)
+        return false;
+
+      bits = (bits << 6) | (pos - ALPHABET);
+      nBits += 6;
+      if (nBits >= 8)
+        {
+          nBits -= 8;
+          out.push_back (static_cast<char> ((bits >> nBits) & 0xff));
+        }
+    }
+
+  return padding <= 2;
+}
+
+/**
+ * Decode a base58 string with checksum.
+ * @param str The encoded string.
+ * @param out Set to the decoded payload without the checksum.
+ * @return False if the string or checksum is invalid.
+ */
+bool
+SignatureVerifier::decodeBase58Check (const std::string& str,
+                                      std::string& out)
+{
+  static const char* const ALPHABET
+    = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+  /* Big-endian base-256 digits of the number, built up by multiplying
+     with 58 and adding each digit.  */
+  std::vector<unsigned char> num;
+  unsigned zeros = 0;
+  for (std::string::const_iterator i = str.begin (); i != str.end (); ++i)
+    {
+      const char* pos = std::strchr (ALPHABET, *i);
+      if (*i == '\0' || !pos)
+        return false;
+
+      unsigned carry = pos - ALPHABET;
+      if (carry == 0 && num.empty ())
+        {
+          ++zeros;
+          continue;
+        }
+
+      for (std::vector<unsigned char>::reverse_iterator j = num.rbegin ();
+           j != num.rend (); ++j)
+        {
+          carry += 58 * *j;
+          *j = carry & 0xff;
+          carry >>= 8;
+        }
+      while (carry > 0)
+        {
+          num.insert (num.begin (), carry & 0xff);
+          carry >>= 8;
+        }
+    }
+
+  std::string data(zeros, '\0');
+  data.append (num.begin (), num.end ());
+  if (data.size () < 4)
+    return false;
+
+  out = data.substr (0, data.size () - 4);
+  return hash256 (out).substr (0, 4) == data.substr (data.size () - 4);
+}
+
+/**
+ * Compute double SHA-256.
+ * @param data The data to hash.
+ * @return The hash.
+ */
+std::string
+SignatureVerifier::hash256 (const std::string& data)
+{
+  return digest (EVP_sha256 (), digest (EVP_sha256 (), data));
+}
+
+/**
+ * Compute RIPEMD-160 of SHA-256, as used for addresses.
+ * @param data The data to hash.
+ * @return The hash.
+ */
+std::string
+SignatureVerifier::hash160 (const std::string& data)
+{
+  return ripemd160 (digest (EVP_sha256 (), data));
+}
+
+/**
+ * Compute RIPEMD-160.  This is implemented here instead of using OpenSSL,
+ * since OpenSSL 3 only provides it with the legacy provider loaded.
+ * @param data The data to hash.
+ * @return The hash.
+ */
+std::string
+SignatureVerifier::ripemd160 (const std::string& data)
+{
+  /* Message words used in each step of the left and right lines.  */
+  static const unsigned char WORD_LEFT[80] =
+    {
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+      7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+      3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+      1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+      4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13,
+    };
+  static const unsigned char WORD_RIGHT[80] =
+    {
+      5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+      6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+      15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+      8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+      12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11,
+    };
+
+  /* Rotation amounts of each step.  */
+  static const unsigned char SHIFT_LEFT[80] =
+    {
+      11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+      7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+      11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+      11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+      9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6,
+    };
+  static const unsigned char SHIFT_RIGHT[80] =
+    {
+      8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+      9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+      9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+      15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+      8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11,
+    };
+
+  /* Constants added in each round.  */
+  static const uint32_t ADD_LEFT[5] =
+    {0x00000000, 0x5A827999, 0x6ED9EBA1, 0x8F1BBCDC, 0xA953FD4E};
+  static const uint32_t ADD_RIGHT[5] =
+    {0x50A28BE6, 0x5C4DD124, 0x6D703EF3, 0x7A6D76E9, 0x00000000};
+
+  /* Pad like MD4:  a one bit, zeros and the length in bits, so that the
+     total is a multiple of 64 bytes.  */
+  std::string msg(data);
+  msg.push_back (static_cast<char> (0x80));
+  while (msg.size () % 64 != 56)
+    msg.push_back ('\0');
+  const uint64_t bits = static_cast<uint64_t> (data.size ()) * 8;
+  for (unsigned i = 0; i < 8; ++i)
+    msg.push_back (static_cast<char> ((bits >> (8 * i)) & 0xff));
+
+  uint32_t h[5] = {0x67452301, 0xEFCDAB89, 0x98BADCFE, 0x10325476,
+                   0xC3D2E1F0};
+  for (size_t off = 0; off < msg.size (); off += 64)
+    {
+      const unsigned char* block
+        = reinterpret_cast<const unsigned char*> (msg.data () + off);
+      uint32_t x[16];
+      for (unsigned i = 0; i < 16; ++i)
+        x[i] = static_cast<uint32_t> (block[4 * i])
+                | (static_cast<uint32_t> (block[4 * i + 1]) << 8)
+                | (static_cast<uint32_t> (block[4 * i + 2]) << 16)
+                | (static_cast<uint32_t> (block[4 * i + 3]) << 24);
+
+      uint32_t al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4];
+      uint32_t ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+      for (unsigned j = 0; j < 80; ++j)
+        {
+          uint32_t t = rotateLeft (al + ripemdFunction (j, bl, cl, dl)
+                                    + x[WORD_LEFT[j]] + ADD_LEFT[j / 16],
+                                   SHIFT_LEFT[j]) + el;
+          al = el;
+          el = dl;
+          dl = rotateLeft (cl, 10);
+          cl = bl;
+          bl = t;
+
+          t = rotateLeft (ar + ripemdFunction (79 - j, br, cr, dr)
+                           + x[WORD_RIGHT[j]] + ADD_RIGHT[j / 16],
+                          SHIFT_RIGHT[j]) + er;
+          ar = er;
+          er = dr;
+          dr = rotateLeft (cr, 10);
+          cr = br;
+          br = t;
+        }
+
+      const uint32_t t = h[1] + cl + dr;
+      h[1] = h[2] + dl + er;
+      h[2] = h[3] + el + ar;
+      h[3] = h[4] + al + br;
+      h[4] = h[0] + bl + cr;
+      h[0] = t;
+    }
+
+  std::string res;
+  for (unsigned i = 0; i < 5; ++i)
+    for (unsigned j = 0; j < 4; ++j)
+      res.push_back (static_cast<char> ((h[i] >> (8 * j)) & 0xff));
+
+  return res;
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,160 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It implements checking of message
+   signatures without asking the daemon.  */
+
+#ifndef NMCRPC_SIGNATUREVERIFIER_HPP
+#define NMCRPC_SIGNATUREVERIFIER_HPP
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+
+#include <string>
+
+namespace nmcrpc
+{
+
+/**
+ * Verify signatures as produced by signmessage locally.  The public key
+ * is recovered from the compact signature and the message hash on
+ * secp256k1, and its hash compared to the one in the address.  The
+ * address must also have the chain's version byte, so that addresses of
+ * other chains with the same key hash (which the daemon rejects) don't
+ * verify.  A verifier is not thread-safe, each thread should use its own.
+ */
+class SignatureVerifier
+{
+
+private:
+
+  /** Length of a decoded compact signature.  */
+  static const unsigned SIGNATURE_LENGTH;
+
+  /** The prefix hashed together with each message.  */
+  std::string magic;
+
+  /** The version byte of pay-to-pubkey-hash addresses.  */
+  unsigned char version;
+
+  /** The secp256k1 curve.  */
+  EC_GROUP* group;
+
+  /** Scratch space for the big number arithmetic.  */
+  BN_CTX* ctx;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  SignatureVerifier ();
+  SignatureVerifier (const SignatureVerifier&);
+  SignatureVerifier& operator= (const SignatureVerifier&);
+#endif /* !CXX_11  */
+
+  /**
+   * Compute the hash that is signed for a message.
+   * @param msg The message.
+   * @return The double SHA-256 of magic and message.
+   */
+  std::string hashMessage (const std::string& msg) const;
+
+  /**
+   * Recover the public key from a compact signature.
+   * @param sig The signature, of length SIGNATURE_LENGTH.
+   * @param hash The signed message hash.
+   * @param pubkey Set to the serialised public key.
+   * @return False if the signature is malformed.
+   */
+  bool recoverKey (const std::string& sig, const std::string& hash,
+                   std::string& pubkey) const;
+
+  /**
+   * Decode base64 data.
+   * @param str The encoded string.
+   * @param out Set to the decoded data.
+   * @return False if the string is not valid base64.
+   */
+  static bool decodeBase64 (const std::string& str, std::string& out);
+
+  /**
+   * Decode a base58 string with checksum.
+   * @param str The encoded string.
+   * @param out Set to the decoded payload without the checksum.
+   * @return False if the string or checksum is invalid.
+   */
+  static bool decodeBase58Check (const std::string& str, std::string& out);
+
+  /**
+   * Compute double SHA-256.
+   * @param data The data to hash.
+   * @return The hash.
+   */
+  static std::string hash256 (const std::string& data);
+
+  /**
+   * Compute RIPEMD-160 of SHA-256, as used for addresses.
+   * @param data The data to hash.
+   * @return The hash.
+   */
+  static std::string hash160 (const std::string& data);
+
+  /**
+   * Compute RIPEMD-160.
+   * @param data The data to hash.
+   * @return The hash.
+   */
+  static std::string ripemd160 (const std::string& data);
+
+public:
+
+  /**
+   * Construct it.
+   * @param m The prefix for messages, e.g. "Bitcoin Signed Message:\n".
+   * @param v The version byte of addresses, e.g. 52 for Namecoin.
+   * @throws std::runtime_error if the curve can not be set up.
+   */
+  SignatureVerifier (const std::string& m, unsigned char v);
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  SignatureVerifier () = delete;
+  SignatureVerifier (const SignatureVerifier&) = delete;
+  SignatureVerifier& operator= (const SignatureVerifier&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Free the curve data.
+   */
+  ~SignatureVerifier ();
+
+  /**
+   * Check a message signature.
+   * @param addr The address that should have signed the message.
+   * @param msg The message.
+   * @param sig The base64-encoded signature.
+   * @return True iff the signature is valid for the message and address.
+   */
+  bool verify (const std::string& addr, const std::string& msg,
+               const std::string& sig) const;
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
@@ -0,0 +1,269 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  Thin wrappers around pthreads, since
+   we can not rely on C++11's thread support.  */
+
+#ifndef NMCRPC_THREAD_HPP
+#define NMCRPC_THREAD_HPP
+
+#include <pthread.h>
+#include <sys/time.h>
+
+namespace nmcrpc
+{
+
+/**
+ * Simple mutex.  It can optionally be recursive, so that the same thread
+ * can lock it multiple times.
+ */
+class Mutex
+{
+
+private:
+
+  friend class Condition;
+  friend class Lock;
+  friend class Unlock;
+
+  /** The underlying pthread mutex.  */
+  pthread_mutex_t mutex;
+
+  // Disable copying.
+#ifndef CXX_11
+  Mutex (const Mutex&);
+  Mutex& operator= (const Mutex&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Construct it.
+   * @param recursive Whether the mutex should be recursive.
+   */
+  explicit inline Mutex (bool recursive = false)
+  {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init (&attr);
+    if (recursive)
+      pthread_mutexattr_settype (&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init (&mutex, &attr);
+    pthread_mutexattr_destroy (&attr);
+  }
+
+  // No copying.
+#ifdef CXX_11
+  Mutex (const Mutex&) = delete;
+  Mutex& operator= (const Mutex&) = delete;
+#endif /* CXX_11?  */
+
+  inline ~Mutex ()
+  {
+    pthread_mutex_destroy (&mutex);
+  }
+
+};
+
+/**
+ * RAII lock on a mutex.
+ */
+class Lock
+{
+
+private:
+
+  friend class Condition;
+  friend class Unlock;
+
+  /** The mutex locked.  */
+  Mutex& mut;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Lock ();
+  Lock (const Lock&);
+  Lock& operator= (const Lock&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Lock the given mutex.
+   * @param m The mutex to lock.
+   */
+  explicit inline Lock (Mutex& m)
+    : mut(m)
+  {
+    pthread_mutex_lock (&mut.mutex);
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Lock () = delete;
+  Lock (const Lock&) = delete;
+  Lock& operator= (const Lock&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Unlock the mutex again.
+   */
+  inline ~Lock ()
+  {
+    pthread_mutex_unlock (&mut.mutex);
+  }
+
+};
+
+/**
+ * Temporarily release a held Lock for the lifetime of this object.
+ */
+class Unlock
+{
+
+private:
+
+  /** The lock released.  */
+  Lock& lock;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Unlock ();
+  Unlock (const Unlock&);
+  Unlock& operator= (const Unlock&);
+#endif /* !CXX_11  */
+
+public:
+
+  /**
+   * Release the given lock.
+   * @param l The lock, which must be held by this thread.
+   */
+  explicit inline Unlock (Lock& l)
+    : lock(l)
+  {
+    pthread_mutex_unlock (&lock.mut.mutex);
+  }
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Unlock () = delete;
+  Unlock (const Unlock&) = delete;
+  Unlock& operator= (const Unlock&) = delete;
+#endif /* CXX_11?  */
+
+  /**
+   * Acquire the lock again.
+   */
+  inline ~Unlock ()
+  {
+    pthread_mutex_lock (&lock.mut.mutex);
+  }
+
+};
+
+/**
+ * Condition variable, used together with a Lock.
+ */
+class Condition
+{
+
+private:
+
+  /** The underlying pthread condition.  */
+  pthread_cond_t cond;
+
+  // Disable copying.
+#ifndef CXX_11
+  Condition (const Condition&);
+  Condition& operator= (const Condition&);
+#endif /* !CXX_11  */
+
+public:
+
+  inline Condition ()
+  {
+    pthread_cond_init (&cond, nullptr);
+  }
+
+  // No copying.
+#ifdef CXX_11
+  Condition (const Condition&) = delete;
+  Condition& operator= (const Condition&) = delete;
+#endif /* CXX_11?  */
+
+  inline ~Condition ()
+  {
+    pthread_cond_destroy (&cond);
+  }
+
+  /**
+   * Wait for the condition to be signalled.  The lock is released
+   * while waiting and held again when this returns.
+   * @param lock The lock held by the caller.
+   */
+  inline void
+  wait (Lock& lock)
+  {
+    pthread_cond_wait (&cond, &lock.mut.mutex);
+  }
+
+  /**
+   * Wait for the condition to be signalled, but at most the given time.
+   * @param lock The lock held by the caller.
+   * @param ms Maximum time to wait in milliseconds.
+   * @return False if the time ran out.
+   */
+  inline bool
+  waitFor (Lock& lock, unsigned ms)
+  {
+    struct timeval now;
+    gettimeofday (&now, nullptr);
+
+    const long nsec = now.tv_usec * 1000L + (ms % 1000) * 1000000L;
+    struct timespec until;
+    until.tv_sec = now.tv_sec + ms / 1000 + nsec / 1000000000L;
+    until.tv_nsec = nsec % 1000000000L;
+
+    return pthread_cond_timedwait (&cond, &lock.mut.mutex, &until) == 0;
+  }
+
+  /**
+   * Wake up one waiting thread.
+   */
+  inline void
+  signal ()
+  {
+    pthread_cond_signal (&cond);
+  }
+
+  /**
+   * Wake up all waiting threads.
+   */
+  inline void
+  broadcast ()
+  {
+    pthread_cond_broadcast (&cond);
+  }
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
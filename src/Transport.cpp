@@ -0,0 +1,248 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Source code for Transport.hpp.  */
+
+#include "Transport.hpp"
+
+#include "JsonRpc.hpp"
+
+#include <cassert>
+#include <fstream>
+#include <sstream>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* Transport base class.  */
+
+/**
+ * Set the credentials for Basic authentication on the handle.  If a cookie
+ * file is configured, it is read anew.
+ * @param handle The handle to set up.
+ * @throws JsonRpc::Exception if the cookie file can't be read.
+ */
+void
+Transport::setCredentials (CURL* handle) const
+{
+  std::string username = settings.getUsername ();
+  std::string password = settings.getPassword ();
+
+  const std::string& cookieFile = settings.getCookieFile ();
+  if (!cookieFile.empty ())
+    {
+      /* The cookie file contains a single line "user:password".  */
+      std::ifstream in(cookieFile.c_str ());
+      std::string line;
+      std::getline (in, line);
+
+      const std::string::size_type colonPos = line.find (':');
+      if (!in || colonPos == std::string::npos)
+        throw JsonRpc::Exception ("Could not read the RPC cookie file.");
+
+      username = line.substr (0, colonPos);
+      password = line.substr (colonPos + 1);
+    }
+
+  /* cURL copies the strings, so the temporaries are fine.  Setting Basic
+     as the only scheme makes cURL send it right away, instead of
+     probing with an unauthenticated request first.  */
+  curl_easy_setopt (handle, CURLOPT_HTTPAUTH, CURLAUTH_BASIC);
+  curl_easy_setopt (handle, CURLOPT_USERNAME, username.c_str ());
+  curl_easy_setopt (handle, CURLOPT_PASSWORD, password.c_str ());
+}
+
+/**
+ * Construct the transport selected in the settings for a daemon.
+ * @param s The settings to use.  Must outlive the transport.
+ * @param e The daemon to connect to.
+ * @return The newly allocated transport.
+ */
+Transport*
+Transport::create (const RpcSettings& s, const RpcEndpoint& e)
+{
+  switch (s.getTransport ())
+    {
+    case RpcSettings::TRANSPORT_HTTP:
+      break;
+
+    case RpcSettings::TRANSPORT_HTTPS:
+      return new HttpsTransport (s, e);
+
+    case RpcSettings::TRANSPORT_UNIX:
+      if (e.getHost () == s.getHost () && e.getPort () == s.getPort ())
+        return new UnixSocketTransport (s);
+      break;
+
+    default:
+      assert (false);
+    }
+
+  return new HttpTransport (s, e);
+}
+
+/* ************************************************************************** */
+/* Plain HTTP.  */
+
+/**
+ * Construct it.
+ * @param s The settings to use.  Must outlive the transport.
+ * @param e The daemon to connect to.
+ */
+HttpTransport::HttpTransport (const RpcSettings& s, const RpcEndpoint& e)
+  : Transport(s), url()
+{
+  std::ostringstream urlOut;
+  urlOut << "http://" << e.getHost () << ":" << e.getPort () << "/";
+  url = urlOut.str ();
+}
+
+/**
+ * Set up a new cURL handle for connecting to the daemon.
+ * @param handle The handle to set up.
+ * @throws JsonRpc::Exception if that fails.
+ */
+void
+HttpTransport::configure (CURL* handle) const
+{
+  curl_easy_setopt (handle, CURLOPT_URL, url.c_str ());
+  setCredentials (handle);
+}
+
+/* ************************************************************************** */
+/* HTTPS.  */
+
+/**
+ * Construct it.
+ * @param s The settings to use.  Must outlive the transport.
+ * @param e The daemon to connect to.
+ * @throws JsonRpc::Exception if cURL initialisation fails.
+ */
+HttpsTransport::HttpsTransport (const RpcSettings& s, const RpcEndpoint& e)
+  : Transport(s), url(), share(nullptr)
+{
+  std::ostringstream urlOut;
+  urlOut << "https://" << e.getHost () << ":" << e.getPort () << "/";
+  url = urlOut.str ();
+
+  share = curl_share_init ();
+  if (!share)
+    throw JsonRpc::Exception ("Initialisation of cURL failed.");
+
+  for (unsigned i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+    pthread_mutex_init (&locks[i], nullptr);
+
+  curl_share_setopt (share, CURLSHOPT_LOCKFUNC, &lockShare);
+  curl_share_setopt (share, CURLSHOPT_UNLOCKFUNC, &unlockShare);
+  curl_share_setopt (share, CURLSHOPT_USERDATA, this);
+  curl_share_setopt (share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+}
+
+/**
+ * Destroy it.  All handles using it must have been cleaned up.
+ */
+HttpsTransport::~HttpsTransport ()
+{
+  curl_share_cleanup (share);
+  for (unsigned i = 0; i < CURL_LOCK_DATA_LAST; ++i)
+    pthread_mutex_destroy (&locks[i]);
+}
+
+/**
+ * Lock function for the share handle.  We don't distinguish between
+ * shared and exclusive access.
+ * @param handle The easy handle using the share.
+ * @param data The kind of data to lock.
+ * @param access Whether shared or exclusive access is needed.
+ * @param userptr The transport as void pointer.
+ */
+void
+HttpsTransport::lockShare (CURL*, curl_lock_data data, curl_lock_access,
+                           void* userptr)
+{
+  HttpsTransport* me = static_cast<HttpsTransport*> (userptr);
+  pthread_mutex_lock (&me->locks[data]);
+}
+
+/**
+ * Unlock function for the share handle.
+ * @param handle The easy handle using the share.
+ * @param data The kind of data to unlock.
+ * @param userptr The transport as void pointer.
+ */
+void
+HttpsTransport::unlockShare (CURL*, curl_lock_data data, void* userptr)
+{
+  HttpsTransport* me = static_cast<HttpsTransport*> (userptr);
+  pthread_mutex_unlock (&me->locks[data]);
+}
+
+/**
+ * Set up a new cURL handle for connecting to the daemon.
+ * @param handle The handle to set up.
+ * @throws JsonRpc::Exception if that fails.
+ */
+void
+HttpsTransport::configure (CURL* handle) const
+{
+  const RpcSettings& s = getSettings ();
+
+  curl_easy_setopt (handle, CURLOPT_URL, url.c_str ());
+  curl_easy_setopt (handle, CURLOPT_SHARE, share);
+
+  if (!s.getCaFile ().empty ())
+    curl_easy_setopt (handle, CURLOPT_CAINFO, s.getCaFile ().c_str ());
+  if (!s.getVerifyPeer ())
+    {
+      curl_easy_setopt (handle, CURLOPT_SSL_VERIFYPEER, 0L);
+      curl_easy_setopt (handle, CURLOPT_SSL_VERIFYHOST, 0L);
+    }
+
+  setCredentials (handle);
+}
+
+/* ************************************************************************** */
+/* Unix domain socket.  */
+
+/**
+ * Set up a new cURL handle for connecting to the daemon.  The host
+ * in the URL is only used for the Host header.
+ * @param handle The handle to set up.
+ * @throws JsonRpc::Exception if that fails.
+ */
+void
+UnixSocketTransport::configure (CURL* handle) const
+{
+#if LIBCURL_VERSION_NUM >= 0x072800
+  const std::string& path = getSettings ().getSocketPath ();
+  const CURLcode res
+    = curl_easy_setopt (handle, CURLOPT_UNIX_SOCKET_PATH, path.c_str ());
+  if (res != CURLE_OK)
+    throw JsonRpc::Exception ("cURL does not support Unix sockets.");
+#else /* LIBCURL_VERSION_NUM?  */
+  throw JsonRpc::Exception ("cURL does not support Unix sockets.");
+#endif /* LIBCURL_VERSION_NUM?  */
+
+  curl_easy_setopt (handle, CURLOPT_URL, "http://localhost/");
+  setCredentials (handle);
+}
+
+} // namespace nmcrpc
@@ -0,0 +1,255 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Internal header, not installed.  It defines the ways of reaching
+   the daemon that HttpConnection handles are set up for.  */
+
+#ifndef NMCRPC_TRANSPORT_HPP
+#define NMCRPC_TRANSPORT_HPP
+
+#include "RpcSettings.hpp"
+
+#include <curl/curl.h>
+
+#include <pthread.h>
+
+#include <string>
+
+namespace nmcrpc
+{
+
+/* ************************************************************************** */
+/* Transport base class.  */
+
+/**
+ * The way HTTP requests reach one daemon.  It sets up the URL,
+ * authentication and any channel-specific options on each newly created
+ * cURL handle.  Everything else about a request is the same for
+ * all transports and handled by HttpConnection.  One instance is shared
+ * by all connections of a pool, possibly from different threads.
+ */
+class Transport
+{
+
+private:
+
+  /** Settings with the credentials.  */
+  const RpcSettings& settings;
+
+  // Disable copying and default constructor.
+#ifndef CXX_11
+  Transport ();
+  Transport (const Transport&);
+  Transport& operator= (const Transport&);
+#endif /* !CXX_11  */
+
+protected:
+
+  /**
+   * Construct it.
+   * @param s The settings to use.  Must outlive the transport.
+   */
+  explicit inline Transport (const RpcSettings& s)
+    : settings(s)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Get the settings used.
+   * @return The settings.
+   */
+  inline const RpcSettings&
+  getSettings () const
+  {
+    return settings;
+  }
+
+  /**
+   * Set the credentials for Basic authentication on the handle.  They
+   * are sent already with the first request instead of waiting to be
+   * challenged by the daemon.  If a cookie file is configured, it is
+   * read anew (since the daemon writes a fresh one whenever it starts).
+   * @param handle The handle to set up.
+   * @throws JsonRpc::Exception if the cookie file can't be read.
+   */
+  void setCredentials (CURL* handle) const;
+
+public:
+
+  // No copying or default constructor.
+#ifdef CXX_11
+  Transport () = delete;
+  Transport (const Transport&) = delete;
+  Transport& operator= (const Transport&) = delete;
+#endif /* CXX_11?  */
+
+  virtual inline ~Transport ()
+  {
+    // Nothing to do.
+  }
+
+  /**
+   * Set up a new cURL handle for connecting to the daemon.
+   * @param handle The handle to set up.
+   * @throws JsonRpc::Exception if that fails.
+   */
+  virtual void configure (CURL* handle) const = 0;
+
+  /**
+   * Construct the transport selected in the settings for a daemon.
+   * A Unix socket only replaces the primary daemon, replicas are
+   * still reached over plain HTTP.
+   * @param s The settings to use.  Must outlive the transport.
+   * @param e The daemon to connect to.
+   * @return The newly allocated transport.
+   */
+  static Transport* create (const RpcSettings& s, const RpcEndpoint& e);
+
+};
+
+/* ************************************************************************** */
+/* Concrete transports.  */
+
+/**
+ * Plain HTTP over TCP.
+ */
+class HttpTransport : public Transport
+{
+
+private:
+
+  /** URL to post to.  */
+  std::string url;
+
+public:
+
+  /**
+   * Construct it.
+   * @param s The settings to use.  Must outlive the transport.
+   * @param e The daemon to connect to.
+   */
+  HttpTransport (const RpcSettings& s, const RpcEndpoint& e);
+
+  /**
+   * Set up a new cURL handle for connecting to the daemon.
+   * @param handle The handle to set up.
+   * @throws JsonRpc::Exception if that fails.
+   */
+  virtual void configure (CURL* handle) const;
+
+};
+
+/**
+ * HTTP over TLS, for daemons reached through the network.  The TLS
+ * sessions are shared between all connections, so that new connections
+ * can resume a session instead of doing a full handshake.
+ */
+class HttpsTransport : public Transport
+{
+
+private:
+
+  /** URL to post to.  */
+  std::string url;
+
+  /** Share handle holding the TLS sessions.  */
+  CURLSH* share;
+
+  /**
+   * Locks for the shared data, one for each kind of data.  These are
+   * pthread mutexes directly, since cURL locks and unlocks them in
+   * separate callbacks.
+   */
+  pthread_mutex_t locks[CURL_LOCK_DATA_LAST];
+
+  /**
+   * Lock function for the share handle.
+   * @param handle The easy handle using the share.
+   * @param data The kind of data to lock.
+   * @param access Whether shared or exclusive access is needed.
+   * @param userptr The transport as void pointer.
+   */
+  static void lockShare (CURL* handle, curl_lock_data data,
+                         curl_lock_access access, void* userptr);
+
+  /**
+   * Unlock function for the share handle.
+   * @param handle The easy handle using the share.
+   * @param data The kind of data to unlock.
+   * @param userptr The transport as void pointer.
+   */
+  static void unlockShare (CURL* handle, curl_lock_data data, void* userptr);
+
+public:
+
+  /**
+   * Construct it.
+   * @param s The settings to use.  Must outlive the transport.
+   * @param e The daemon to connect to.
+   * @throws JsonRpc::Exception if cURL initialisation fails.
+   */
+  HttpsTransport (const RpcSettings& s, const RpcEndpoint& e);
+
+  /**
+   * Destroy it.  All handles using it must have been cleaned up.
+   */
+  ~HttpsTransport ();
+
+  /**
+   * Set up a new cURL handle for connecting to the daemon.
+   * @param handle The handle to set up.
+   * @throws JsonRpc::Exception if that fails.
+   */
+  virtual void configure (CURL* handle) const;
+
+};
+
+/**
+ * HTTP over a Unix domain socket, for a daemon on the same machine.
+ * This avoids the overhead of TCP on the loopback interface.
+ */
+class UnixSocketTransport : public Transport
+{
+
+public:
+
+  /**
+   * Construct it.
+   * @param s The settings to use.  Must outlive the transport.
+   */
+  explicit inline UnixSocketTransport (const RpcSettings& s)
+    : Transport(s)
+  {
+    // Nothing else to do.
+  }
+
+  /**
+   * Set up a new cURL handle for connecting to the daemon.
+   * @param handle The handle to set up.
+   * @throws JsonRpc::Exception if that fails.
+   */
+  virtual void configure (CURL* handle) const;
+
+};
+
+} // namespace nmcrpc
+
+#endif /* Header guard.  */
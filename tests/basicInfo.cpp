@@ -94,5 +94,14 @@ main ()
   name = nc.queryName ("a", "-");
   assert (name.exists () && name.isExpired ());
 
+  NameInterface::AsyncName asyncFound, asyncNotFound;
+  nc.queryNameAsync ("id/domob", asyncFound);
+  nc.queryNameAsync ("name-is-not-yet-registered", asyncNotFound);
+  rpc.waitAsync ();
+  assert (asyncFound.isDone () && asyncNotFound.isDone ());
+  assert (asyncFound.get ().exists () && !asyncNotFound.get ().exists ());
+  assert (asyncFound.get ().getAddress ().getAddress ()
+          == nc.queryName ("id/domob").getAddress ().getAddress ());
+
   return EXIT_SUCCESS;
 }
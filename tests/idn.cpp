@@ -25,6 +25,8 @@
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace nmcrpc;
 
@@ -64,5 +66,18 @@ main ()
   roundtrip (idn, "foobar");
   roundtrip (idn, "id/xn--danielines-v5a0tyc");
 
+  std::vector<std::string> names, decoded, encoded;
+  names.push_back ("d/xn--mnchen-3ya");
+  names.push_back ("d/foobar");
+  names.push_back ("d/XN--MNCHEN-3YA");
+  names.push_back ("id/xn--danielines-v5a0tyc");
+  idn.decodeAll (names, decoded);
+  assert (decoded.size () == names.size ());
+  assert (decoded[1] == "d/foobar");
+  for (unsigned i = 0; i < names.size (); ++i)
+    assert (decoded[i] == idn.decode (names[i]));
+  idn.encodeAll (decoded, encoded);
+  assert (encoded[0] == names[0] && encoded[1] == names[1]);
+
   return EXIT_SUCCESS;
 }
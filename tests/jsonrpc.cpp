@@ -65,5 +65,24 @@ main ()
       assert (err.getErrorCode () == -4);
     }
 
+  std::vector<JsonRpc::Call> batch;
+  batch.push_back (JsonRpc::Call ("name_show").addParam ("id/domob"));
+  batch.push_back (JsonRpc::Call ("name_history")
+                    .addParam ("name-does-not-exist"));
+  batch.push_back (JsonRpc::Call ("getinfo"));
+  const std::vector<JsonRpc::CallResult> results = rpc.executeRpcBatch (batch);
+  assert (results.size () == batch.size ());
+  assert (!results[0].isError ());
+  assert (results[0].get ()["name"].asString () == "id/domob");
+  assert (results[1].isError () && results[1].getErrorCode () == -4);
+  assert (results[2].get ()["version"].isInt ());
+
+  /* The connection is kept alive at least between the first two calls.
+     The daemon may close it after error responses, though.  */
+  const JsonRpc::ConnectionStats& stats = rpc.getConnectionStats ();
+  assert (stats.getCalls () == 5);
+  assert (stats.getOpened () + stats.getReused () == stats.getCalls ());
+  assert (stats.getReused () >= 1);
+
   return EXIT_SUCCESS;
 }
@@ -26,6 +26,8 @@
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace nmcrpc;
 
@@ -52,6 +54,23 @@ main ()
   addr = nc.queryAddress ("invalid-address");
   assert (!addr.verifySignature (testMsg, testSig));
 
+  typedef CoinInterface::SignedMessage Signed;
+  std::vector<Signed> msgs;
+  msgs.push_back (Signed (testAddr, testMsg, testSig));
+  msgs.push_back (Signed (testAddr, "Wrong message.", testSig));
+  msgs.push_back (Signed (testAddr, testMsg, "Wrong signature."));
+  msgs.push_back (Signed ("NKj3oHnX9PMjJhD124Pi41wa2WoV43aFDW",
+                          testMsg, testSig));
+  msgs.push_back (Signed ("invalid-address", testMsg, testSig));
+  for (int local = 0; local < 2; ++local)
+    {
+      const std::vector<bool> res = nc.verifySignatures (msgs, local);
+      assert (res.size () == msgs.size ());
+      assert (res[0]);
+      for (unsigned i = 1; i < res.size (); ++i)
+        assert (!res[i]);
+    }
+
   std::string signAddr, passphrase;
   std::cout << "Enter address for testing message signing (or 'auto'): ";
   getline (std::cin, signAddr);
@@ -93,6 +112,12 @@ main ()
         {
           const std::string sig = addr.signMessage (testMsg);
           assert (addr.verifySignature (testMsg, sig));
+
+          const std::vector<std::string> texts(3, testMsg);
+          const std::vector<std::string> sigs = nc.signMessages (addr, texts);
+          assert (sigs.size () == texts.size ());
+          for (unsigned i = 0; i < sigs.size (); ++i)
+            assert (addr.verifySignature (texts[i], sigs[i]));
         }
       else
         std::cout << "Signing address is invalid, ignoring this test."
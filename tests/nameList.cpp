@@ -38,10 +38,10 @@ main ()
   NameInterface nc(rpc);
 
   unsigned cnt = 0;
-  const auto cb = [&cnt] (const std::string& str)
+  const auto cb = [&cnt] (const NameInterface::ScanEntry& entry)
     {
-      /* FIXME: Adapt to change in call-back interface.  */
-      std::cout << str << std::endl;
+      std::cout << entry.getName () << " (expires in "
+                << entry.getExpireCounter () << ")" << std::endl;
       ++cnt;
     };
   nc.forAllNames (cb);
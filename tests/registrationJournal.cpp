@@ -0,0 +1,269 @@
+/*  Namecoin RPC library.
+ *  Copyright (C) 2014  Daniel Kraft <d@domob.eu>
+ *
+ *  This program is free software: you can redistribute it and/or modify
+ *  it under the terms of the GNU Affero General Public License as published by
+ *  the Free Software Foundation, either version 3 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU Affero General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Affero General Public License
+ *  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *  See the distributed file COPYING for additional permissions in addition
+ *  to those of the GNU Affero General Public License.
+ */
+
+/* Test program for the registration journal.  It only works on a local
+   file and does not need a running daemon.  */
+
+#include "JsonRpc.hpp"
+#include "NameInterface.hpp"
+#include "NameRegistration.hpp"
+#include "RegistrationJournal.hpp"
+
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+using namespace nmcrpc;
+
+/** The journal file used for testing.  */
+static const std::string FILE_NAME = "registrationJournal.state";
+
+/**
+ * Read the whole journal file.
+ * @return The file's content.
+ */
+static std::string
+readFile ()
+{
+  std::ifstream in(FILE_NAME.c_str ());
+  std::ostringstream res;
+  res << in.rdbuf ();
+
+  return res.str ();
+}
+
+/**
+ * Count the lines of the journal file.
+ * @return The number of newline characters in it.
+ */
+static unsigned
+countLines ()
+{
+  const std::string data = readFile ();
+
+  unsigned res = 0;
+  for (std::string::size_type i = 0; i < data.size (); ++i)
+    if (data[i] == '\n')
+      ++res;
+
+  return res;
+}
+
+/**
+ * Find a name in the manager.
+ * @param mgr The manager to search.
+ * @param name The name to look for.
+ * @return The registration, or NULL if it is not there.
+ */
+static NameRegistration*
+findName (RegistrationManager& mgr, const std::string& name)
+{
+  for (RegistrationManager::iterator i = mgr.begin (); i != mgr.end (); ++i)
+    if ((*i).getName () == name)
+      return &*i;
+
+  return nullptr;
+}
+
+/**
+ * Count the names in the manager.
+ * @param mgr The manager.
+ * @return The number of registrations in it.
+ */
+static unsigned
+countNames (const RegistrationManager& mgr)
+{
+  unsigned res = 0;
+  for (RegistrationManager::const_iterator i = mgr.begin ();
+       i != mgr.end (); ++i)
+    ++res;
+
+  return res;
+}
+
+/**
+ * Get the value saved for a registration.  It is not exposed directly,
+ * so take it from the stream output.
+ * @param reg The registration.
+ * @return Its value.
+ */
+static std::string
+getValue (const NameRegistration& reg)
+{
+  std::ostringstream out;
+  out << reg;
+
+  return JsonRpc::decodeJson (out.str ())["value"].asString ();
+}
+
+/**
+ * Write a state file in the version 1 format of RegistrationManager.
+ */
+static void
+writeVersion1 ()
+{
+  JsonRpc::JsonData reg(Json::objectValue);
+  reg["type"] = "NameRegistration";
+  reg["version"] = 1;
+  reg["name"] = "d/registered";
+  reg["state"] = "registered";
+  reg["value"] = "old";
+  reg["rand"] = "abcd";
+  reg["tx"] = "txnew";
+
+  JsonRpc::JsonData act(Json::objectValue);
+  act["type"] = "NameRegistration";
+  act["version"] = 1;
+  act["name"] = "d/activated";
+  act["state"] = "activated";
+  act["txActivation"] = "txfirstupdate";
+
+  JsonRpc::JsonData arr(Json::arrayValue);
+  arr.append (JsonRpc::encodeJson (reg));
+  arr.append (JsonRpc::encodeJson (act));
+
+  JsonRpc::JsonData mgr(Json::objectValue);
+  mgr["type"] = "RegistrationManager";
+  mgr["version"] = 1;
+  mgr["elements"] = arr;
+
+  std::ofstream out(FILE_NAME.c_str ());
+  out << JsonRpc::encodeJson (mgr);
+}
+
+int
+main ()
+{
+  RpcSettings settings;
+  JsonRpc rpc(settings);
+  NameInterface nc(rpc);
+
+  std::remove (FILE_NAME.c_str ());
+
+  /* A missing file is not an error.  */
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (!journal.load (mgr));
+  }
+
+  /* Import the version 1 format, which is converted on sync.  */
+  writeVersion1 ();
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+    assert (countNames (mgr) == 2);
+
+    const NameRegistration* reg = findName (mgr, "d/registered");
+    assert (reg && reg->getState () == NameRegistration::REGISTERED);
+    assert (reg->getRand () == "abcd" && getValue (*reg) == "old");
+    reg = findName (mgr, "d/activated");
+    assert (reg && reg->getState () == NameRegistration::ACTIVATED);
+
+    journal.sync (mgr);
+    assert (countLines () == 3);
+    const JsonRpc::JsonData hdr = JsonRpc::decodeJson (readFile ());
+    assert (hdr["type"].asString () == "RegistrationJournal");
+  }
+
+  /* Append a change and replay it.  Syncing without changes must
+     not append anything.  */
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+    assert (countNames (mgr) == 2);
+
+    findName (mgr, "d/registered")->setValue (std::string ("new"));
+    journal.sync (mgr);
+    assert (countLines () == 4);
+    journal.sync (mgr);
+    assert (countLines () == 4);
+  }
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+    assert (countNames (mgr) == 2);
+    assert (getValue (*findName (mgr, "d/registered")) == "new");
+  }
+
+  /* A partially written last record is dropped, and the file is
+     rewritten by the next sync.  */
+  {
+    std::ofstream out(FILE_NAME.c_str (), std::ios::app);
+    out << "{\"name\":\"d/partial\",\"op\":\"registered\"";
+  }
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+    assert (countNames (mgr) == 2);
+    assert (!findName (mgr, "d/partial"));
+    assert (getValue (*findName (mgr, "d/registered")) == "new");
+
+    journal.sync (mgr);
+    const std::string data = readFile ();
+    assert (countLines () == 3 && data[data.size () - 1] == '\n');
+  }
+
+  /* Many changes make the journal compact itself.  */
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+
+    NameRegistration* reg = findName (mgr, "d/registered");
+    unsigned maxLines = 0;
+    for (unsigned i = 0; i < 200; ++i)
+      {
+        std::ostringstream val;
+        val << "value " << i;
+        reg->setValue (val.str ());
+        journal.sync (mgr);
+
+        const unsigned lines = countLines ();
+        if (lines > maxLines)
+          maxLines = lines;
+      }
+    std::cout << "Journal lines at most: " << maxLines
+              << ", at the end: " << countLines () << std::endl;
+    assert (maxLines < 200 && countLines () < maxLines);
+
+    std::ifstream tmp((FILE_NAME + ".tmp").c_str ());
+    assert (!tmp);
+  }
+  {
+    RegistrationManager mgr(rpc, nc);
+    RegistrationJournal journal(FILE_NAME);
+    assert (journal.load (mgr));
+    assert (countNames (mgr) == 2);
+    assert (getValue (*findName (mgr, "d/registered")) == "value 199");
+  }
+
+  std::remove (FILE_NAME.c_str ());
+
+  return EXIT_SUCCESS;
+}
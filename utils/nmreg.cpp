@@ -24,11 +24,14 @@
 #include "JsonRpc.hpp"
 #include "NameInterface.hpp"
 #include "NameRegistration.hpp"
+#include "RegistrationJournal.hpp"
 
 #include <cassert>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <string>
+#include <vector>
 
 using namespace nmcrpc;
 
@@ -125,6 +128,92 @@ doRegister (RegistrationManager& reg, NameInterface& nc,
             << cur.getRand () << std::endl;
 }
 
+/**
+ * Print the progress of bulk operations, and save the state to the
+ * journal after each batch of transactions.
+ */
+class PrintProgress : public RegistrationManager::Progress
+{
+
+private:
+
+  /** The journal to save to.  */
+  RegistrationJournal& journal;
+
+  /** Number of names that failed.  */
+  unsigned failures;
+
+public:
+
+  explicit inline PrintProgress (RegistrationJournal& j)
+    : journal(j), failures(0)
+  {
+    // Nothing else to do.
+  }
+
+  inline unsigned
+  getFailures () const
+  {
+    return failures;
+  }
+
+  void
+  registered (const NameRegistration& reg)
+  {
+    std::cout << "Started registration of " << reg.getName () << ": "
+              << reg.getRand () << std::endl;
+  }
+
+  void
+  failed (const std::string& name, const std::string& error)
+  {
+    std::cout << "Failed to register " << name << ": " << error << std::endl;
+    ++failures;
+  }
+
+  void
+  batchDone (const RegistrationManager& mgr)
+  {
+    journal.sync (mgr);
+  }
+
+};
+
+/**
+ * Perform registration of all names in a file.
+ * @param reg The registration manager object to use.
+ * @param journal The journal to save the state to after each batch.
+ * @param file File with the list of names.
+ * @param val The value to set.
+ */
+static void
+doMulti (RegistrationManager& reg, RegistrationJournal& journal,
+         const std::string& file, const std::string& val)
+{
+  std::ifstream listIn (file.c_str ());
+  if (!listIn)
+    throw std::runtime_error ("Could not read list of names.");
+
+  std::vector<std::string> lines;
+  while (listIn)
+    {
+      std::string line;
+      std::getline (listIn, line);
+
+      if (!line.empty ())
+        lines.push_back (line);
+    }
+
+  IdnTool idn(true);
+  std::vector<std::string> idnNames;
+  idn.encodeAll (lines, idnNames);
+
+  PrintProgress progress(journal);
+  const unsigned started = reg.registerNames (idnNames, val, &progress);
+  std::cout << "Started " << started << " of " << idnNames.size ()
+            << " registrations." << std::endl;
+}
+
 /**
  * Check the status (found, not found, expired) of a list of names in the given
  * file and print it out for each one.
@@ -204,6 +293,10 @@ main (int argc, char** argv)
       JsonRpc rpc(settings);
       NameInterface nc(rpc);
 
+      /* Only existence and expiration of the names are used, so there
+         is no need to look up their addresses.  */
+      nc.setLazyNames (true);
+
       if (command == "check")
         {
           if (argc != 3)
@@ -218,14 +311,10 @@ main (int argc, char** argv)
       const std::string stateFile = argv[2];
 
       RegistrationManager reg(rpc, nc);
+      RegistrationJournal journal(stateFile);
 
-      std::ifstream fileIn (stateFile.c_str ());
-      if (fileIn)
-        {
-          std::cout << "Reading old state." << std::endl;
-          fileIn >> reg;
-          fileIn.close ();
-        }
+      if (journal.load (reg))
+        std::cout << "Read old state." << std::endl;
       else
         std::cout << "No old state to read, intialising empty." << std::endl;
 
@@ -249,7 +338,11 @@ main (int argc, char** argv)
 
           if (command == "update")
             {
-              reg.update ();
+              PrintProgress progress(journal);
+              reg.update (&progress);
+              if (progress.getFailures () > 0)
+                throw std::runtime_error ("Some names could not be"
+                                          " activated.");
               std::cout << "Updated all processes." << std::endl;
             }
           else if (command == "register")
@@ -269,30 +362,14 @@ main (int argc, char** argv)
                 throw std::runtime_error ("Expected: nmreg multi"
                                           " FILE LIST-FILE VALUE");
 
-              const std::string listFile = argv[3];
-              const std::string val = argv[4];
-
-              std::ifstream listIn (listFile.c_str ());
-              if (!listIn)
-                throw std::runtime_error ("Could not read list of names.");
-
-              while (listIn)
-                {
-                  std::string line;
-                  std::getline (listIn, line);
-
-                  if (!line.empty ())
-                    doRegister (reg, nc, line, val);
-                }
+              doMulti (reg, journal, argv[3], argv[4]);
             }
           else
             throw std::runtime_error ("Unknown command '" + command + "'.");
         }
 
-      std::ofstream fileOut (stateFile.c_str ());
-      fileOut << reg;
-      fileOut.close ();
-      std::cout << "Wrote new state." << std::endl;
+      journal.sync (reg);
+      std::cout << "Saved new state." << std::endl;
     }
   catch (const JsonRpc::RpcError& exc)
     {
@@ -23,6 +23,7 @@
 #include "JsonRpc.hpp"
 #include "NameInterface.hpp"
 #include "NameRegistration.hpp"
+#include "RenewalScheduler.hpp"
 
 #include <algorithm>
 #include <cassert>
@@ -55,6 +56,9 @@ displayHelp ()
             << " their current value." << std::endl;
   std::cerr << "  * send-multi FILE ADDR [VAL]: Send all names in FILE to ADDR."
             << std::endl;
+  std::cerr << "  * renew BLOCKS [MAX]: Renew (at most MAX) names expiring"
+            << std::endl
+            << "                        within BLOCKS blocks." << std::endl;
 }
 
 /**
@@ -81,7 +85,42 @@ readNames (const std::string& fileName, std::vector<std::string>& names)
 }
 
 /**
- * Perform a name update operation on an array of names.
+ * Print the results of updating names.
+ * @param results The results.
+ * @return True iff all names were updated.
+ */
+static bool
+printResults (const std::vector<BulkNameUpdate::Result>& results)
+{
+  bool ok = true;
+#ifdef CXX_11
+  for (const auto& res : results)
+#else /* CXX_11  */
+  for (std::vector<BulkNameUpdate::Result>::const_iterator i = results.begin ();
+       i != results.end (); ++i)
+#endif /* CXX_11  */
+    {
+#ifndef CXX_11
+      const BulkNameUpdate::Result& res = *i;
+#endif /* !CXX_11  */
+
+      std::cout << "Updating " << res.getName () << ": ";
+      if (res.isSuccess ())
+        std::cout << res.getTxid () << std::endl;
+      else
+        {
+          std::cout << "failed: " << res.getError () << std::endl;
+          ok = false;
+        }
+    }
+
+  return ok;
+}
+
+/**
+ * Perform a name update operation on an array of names.  All updates
+ * are sent in batches, and names that fail are reported but don't stop
+ * the others.
  * @param rpc Json RPC connection.
  * @param nc Namecoin high-level interface.
  * @param names Array of names to update.
@@ -89,13 +128,16 @@ readNames (const std::string& fileName, std::vector<std::string>& names)
  * @param val The value, is ignored if !hasVal.
  * @param hasAddr Whether to send to a specified address.
  * @param addr Target address, ignored if !hasAddr.
+ * @return True iff all names were updated.
  */
-static void
+static bool
 performUpdate (JsonRpc& rpc, NameInterface& nc,
                const std::vector<std::string>& names,
                bool hasVal, const std::string& val,
                bool hasAddr, const std::string& addr)
 {
+  std::vector<BulkNameUpdate::Item> items;
+  items.reserve (names.size ());
 #ifdef CXX_11
   for (const auto& nm : names)
 #else /* CXX_11  */
@@ -107,21 +149,35 @@ performUpdate (JsonRpc& rpc, NameInterface& nc,
       const std::string& nm = *i;
 #endif /* !CXX_11  */
 
-      std::cout << "Updating " << nm << ": ";
-      NameInterface::Name name = nc.queryName (nm);
-
-      NameUpdate updater (rpc, nc, name);
       if (hasVal)
-        updater.setValue (val);
-
-      std::string txid;
-      if (!hasAddr)
-        txid = updater.execute ();
+        items.push_back (BulkNameUpdate::Item (nm, val));
       else
-        txid = updater.execute (nc.queryAddress (addr));
-
-      std::cout << txid << std::endl;
+        items.push_back (BulkNameUpdate::Item (nm));
+      if (hasAddr)
+        items.back ().setAddress (addr);
     }
+
+  BulkNameUpdate updater(rpc, nc);
+  return printResults (updater.execute (items));
+}
+
+/**
+ * Renew names that expire soon.
+ * @param rpc Json RPC connection.
+ * @param nc Namecoin high-level interface.
+ * @param blocks Renew names expiring within this many blocks.
+ * @param max Renew at most this many names.
+ * @return True iff all names were updated.
+ */
+static bool
+performRenew (JsonRpc& rpc, NameInterface& nc, unsigned blocks, unsigned max)
+{
+  RenewalScheduler scheduler(rpc, nc);
+  scheduler.setHorizon (blocks);
+  scheduler.setMaxPerBlock (max);
+  scheduler.load ();
+
+  return printResults (scheduler.renewDue ());
 }
 
 /**
@@ -236,6 +292,7 @@ main (int argc, char** argv)
           unlock.unlock (passphrase);
 
           std::vector<std::string> names;
+          bool ok = true;
 
           if (command == "update")
             {
@@ -249,7 +306,7 @@ main (int argc, char** argv)
                 val = argv[3];
 
               names.push_back (name);
-              performUpdate (rpc, nc, names, argc == 4, val, false, "");
+              ok = performUpdate (rpc, nc, names, argc == 4, val, false, "");
             }
           else if (command == "update-multi")
             {
@@ -263,7 +320,7 @@ main (int argc, char** argv)
                 val = argv[3];
 
               readNames (file, names);
-              performUpdate (rpc, nc, names, argc == 4, val, false, "");
+              ok = performUpdate (rpc, nc, names, argc == 4, val, false, "");
             }
           else if (command == "send")
             {
@@ -278,7 +335,7 @@ main (int argc, char** argv)
                 val = argv[4];
 
               names.push_back (name);
-              performUpdate (rpc, nc, names, argc == 5, val, true, addr);
+              ok = performUpdate (rpc, nc, names, argc == 5, val, true, addr);
             }
           else if (command == "send-multi")
             {
@@ -293,10 +350,26 @@ main (int argc, char** argv)
                 val = argv[4];
 
               readNames (file, names);
-              performUpdate (rpc, nc, names, argc == 5, val, true, addr);
+              ok = performUpdate (rpc, nc, names, argc == 5, val, true, addr);
+            }
+          else if (command == "renew")
+            {
+              if (argc < 3 || argc > 4)
+                throw std::runtime_error ("Expected: nmupdate renew"
+                                          " BLOCKS [MAX]");
+
+              const unsigned blocks = std::atoi (argv[2]);
+              unsigned max = 50;
+              if (argc == 4)
+                max = std::atoi (argv[3]);
+
+              ok = performRenew (rpc, nc, blocks, max);
             }
           else
             throw std::runtime_error ("Unknown command '" + command + "'.");
+
+          if (!ok)
+            return EXIT_FAILURE;
         }
     }
   catch (const JsonRpc::RpcError& exc)